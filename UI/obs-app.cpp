@@ -336,6 +336,8 @@ bool OBSApp::InitGlobalConfigDefaults()
 	config_set_default_string(globalConfig, "General", "Language",
 			DEFAULT_LANG);
 	config_set_default_uint(globalConfig, "General", "MaxLogs", 10);
+	config_set_default_bool(globalConfig, "General", "LoadModulesOnDemand",
+			true);
 	config_set_default_string(globalConfig, "General", "ProcessPriority",
 			"Normal");
 
@@ -346,6 +348,10 @@ bool OBSApp::InitGlobalConfigDefaults()
 	config_set_default_string(globalConfig, "Video", "Renderer", "OpenGL");
 #endif
 
+	config_set_default_uint(globalConfig, "Video", "PreviewFPSLimit", 0);
+	config_set_default_bool(globalConfig, "Video", "ThreadedDisplays",
+			false);
+
 	config_set_default_bool(globalConfig, "BasicWindow", "PreviewEnabled",
 			true);
 	config_set_default_bool(globalConfig, "BasicWindow",
@@ -842,7 +848,13 @@ static bool StartupOBS(const char *locale, profiler_name_store_t *store)
 	if (GetConfigPath(path, sizeof(path), "obs-studio/plugin_config") <= 0)
 		return false;
 
-	return obs_startup(locale, path, store);
+	if (!obs_startup(locale, path, store))
+		return false;
+
+	if (GetConfigPath(path, sizeof(path), "obs-studio/shader_cache") > 0)
+		obs_set_shader_cache_path(path);
+
+	return true;
 }
 
 bool OBSApp::OBSInit()
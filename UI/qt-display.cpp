@@ -18,6 +18,8 @@ OBSQTDisplay::OBSQTDisplay(QWidget *parent, Qt::WindowFlags flags)
 
 	auto windowVisible = [this] (bool visible)
 	{
+		obs_display_set_occluded(display, !visible);
+
 		if (!visible)
 			return;
 
@@ -1096,12 +1096,25 @@ void OBSBasic::OBSInit()
 			throw "Failed to initialize video:  Unspecified error";
 	}
 
+	obs_set_threaded_displays(config_get_bool(App()->GlobalConfig(),
+				"Video", "ThreadedDisplays"));
+
 	InitOBSCallbacks();
 	InitHotkeys();
 
 	api = InitializeAPIInterface(this);
 
 	AddExtraModulePaths();
+
+	if (config_get_bool(App()->GlobalConfig(), "General",
+				"LoadModulesOnDemand")) {
+		char manifestPath[512];
+		int len = GetConfigPath(manifestPath, sizeof(manifestPath),
+				"obs-studio/plugin_manifest.json");
+		if (len > 0)
+			obs_set_module_manifest_path(manifestPath);
+	}
+
 	blog(LOG_INFO, "---------------------------------");
 	obs_load_all_modules();
 	blog(LOG_INFO, "---------------------------------");
@@ -1178,6 +1191,9 @@ void OBSBasic::OBSInit()
 	{
 		obs_display_add_draw_callback(window->GetDisplay(),
 				OBSBasic::RenderMain, this);
+		obs_display_set_fps_limit(window->GetDisplay(),
+				(uint32_t)config_get_uint(App()->GlobalConfig(),
+					"Video", "PreviewFPSLimit"));
 
 		struct obs_video_info ovi;
 		if (obs_get_video_info(&ovi))
@@ -2370,7 +2386,7 @@ void OBSBasic::RenderMain(void *data, uint32_t cx, uint32_t cy)
 		if (source)
 			obs_source_video_render(source);
 	} else {
-		obs_render_main_view();
+		obs_render_main_texture();
 	}
 	gs_load_vertexbuffer(nullptr);
 
@@ -2735,8 +2751,9 @@ void OBSBasic::closeEvent(QCloseEvent *event)
 
 void OBSBasic::changeEvent(QEvent *event)
 {
-	/* TODO */
-	UNUSED_PARAMETER(event);
+	if (event->type() == QEvent::WindowStateChange)
+		obs_display_set_occluded(ui->preview->GetDisplay(),
+				isMinimized());
 }
 
 void OBSBasic::on_actionShow_Recordings_triggered()
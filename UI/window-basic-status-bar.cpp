@@ -66,6 +66,7 @@ void OBSBasicStatusBar::Deactivate()
 		delayInfo->setText("");
 		droppedFrames->setText("");
 		kbps->setText("");
+		kbps->setToolTip("");
 
 		delaySecTotal = 0;
 		delaySecStarting = 0;
@@ -133,6 +134,16 @@ void OBSBasicStatusBar::UpdateBandwidth()
 	kbps->setText(text);
 	kbps->setMinimumWidth(kbps->width());
 
+	struct obs_transport_stats stats;
+	if (obs_output_get_transport_stats(streamOutput, &stats) &&
+	    stats.timestamp) {
+		QString tip = QTStr("Basic.StatusBar.TransportStats")
+			.arg(QString::number(stats.window_loss_pct, 'f', 2),
+			     QString::number(stats.window_xmit_delay_ms,
+					     'f', 0));
+		kbps->setToolTip(tip);
+	}
+
 	lastBytesSent        = bytesSent;
 	lastBytesSentTime    = bytesSentTime;
 	bitrateUpdateSeconds = 0;
@@ -184,7 +184,16 @@ void OBSRemux::reject()
 
 void OBSRemux::updateProgress(float percent)
 {
+	long eta = media_remux_job_get_eta(worker->job.get());
+
 	ui->progressBar->setValue(percent * 10);
+
+	if (eta > 0)
+		ui->progressBar->setFormat(QTStr("Remux.ETA")
+				.arg(eta / 60)
+				.arg(eta % 60, 2, 10, QChar('0')));
+	else
+		ui->progressBar->setFormat("%p%");
 }
 
 void OBSRemux::remuxFinished(bool success)
@@ -195,6 +204,7 @@ void OBSRemux::remuxFinished(bool success)
 
 	worker->job.reset();
 	ui->progressBar->setVisible(false);
+	ui->progressBar->setFormat("%p%");
 	ui->remux->setEnabled(true);
 }
 
@@ -1954,6 +1954,47 @@ void gs_vertexbuffer_flush(gs_vertbuffer_t *vertbuffer)
 	}
 }
 
+void gs_vertexbuffer_flush_range(gs_vertbuffer_t *vertbuffer, size_t start,
+		size_t count)
+{
+	if (!vertbuffer->dynamic) {
+		blog(LOG_ERROR, "gs_vertexbuffer_flush_range: vertex buffer is "
+		                "not dynamic");
+		return;
+	}
+	if (start + count > vertbuffer->numVerts) {
+		blog(LOG_ERROR, "gs_vertexbuffer_flush_range: vertex range is "
+		                "out of bounds");
+		return;
+	}
+
+	vertbuffer->FlushBufferRange(vertbuffer->vertexBuffer,
+			vertbuffer->vbd.data->points, sizeof(vec3),
+			start, count);
+
+	if (vertbuffer->normalBuffer)
+		vertbuffer->FlushBufferRange(vertbuffer->normalBuffer,
+				vertbuffer->vbd.data->normals, sizeof(vec3),
+				start, count);
+
+	if (vertbuffer->tangentBuffer)
+		vertbuffer->FlushBufferRange(vertbuffer->tangentBuffer,
+				vertbuffer->vbd.data->tangents, sizeof(vec3),
+				start, count);
+
+	if (vertbuffer->colorBuffer)
+		vertbuffer->FlushBufferRange(vertbuffer->colorBuffer,
+				vertbuffer->vbd.data->colors, sizeof(uint32_t),
+				start, count);
+
+	for (size_t i = 0; i < vertbuffer->uvBuffers.size(); i++) {
+		gs_tvertarray &tv = vertbuffer->vbd.data->tvarray[i];
+		vertbuffer->FlushBufferRange(vertbuffer->uvBuffers[i],
+				tv.array, tv.width*sizeof(float),
+				start, count);
+	}
+}
+
 struct gs_vb_data *gs_vertexbuffer_get_data(const gs_vertbuffer_t *vertbuffer)
 {
 	return vertbuffer->vbd.data;
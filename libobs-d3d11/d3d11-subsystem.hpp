@@ -245,6 +245,8 @@ struct gs_vertex_buffer : gs_obj {
 
 	void FlushBuffer(ID3D11Buffer *buffer, void *array,
 			size_t elementSize);
+	void FlushBufferRange(ID3D11Buffer *buffer, void *array,
+			size_t elementSize, size_t start, size_t count);
 
 	void MakeBufferList(gs_vertex_shader *shader,
 			vector<ID3D11Buffer*> &buffers,
@@ -46,6 +46,23 @@ void gs_vertex_buffer::FlushBuffer(ID3D11Buffer *buffer, void *array,
 	device->context->Unmap(buffer, 0);
 }
 
+void gs_vertex_buffer::FlushBufferRange(ID3D11Buffer *buffer, void *array,
+		size_t elementSize, size_t start, size_t count)
+{
+	D3D11_MAPPED_SUBRESOURCE msr;
+	D3D11_MAP type = start ?
+		D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD;
+	size_t offset = elementSize * start;
+	HRESULT hr;
+
+	if (FAILED(hr = device->context->Map(buffer, 0, type, 0, &msr)))
+		throw HRError("Failed to map buffer", hr);
+
+	memcpy((uint8_t*)msr.pData + offset, (uint8_t*)array + offset,
+			elementSize * count);
+	device->context->Unmap(buffer, 0);
+}
+
 void gs_vertex_buffer::MakeBufferList(gs_vertex_shader *shader,
 		vector<ID3D11Buffer*> &buffers, vector<uint32_t> &strides)
 {
@@ -170,3 +170,33 @@ bool update_buffer(GLenum target, GLuint buffer, void *data, size_t size)
 	gl_bind_buffer(target, 0);
 	return success;
 }
+
+/* writes to an offset of zero orphan the buffer, anything after is written
+ * unsynchronized, which is safe because data that may still be in use by the
+ * GPU is never written to again until the buffer has been orphaned */
+bool update_buffer_range(GLenum target, GLuint buffer, void *data,
+		size_t offset, size_t size)
+{
+	GLbitfield access = GL_MAP_WRITE_BIT;
+	void *ptr;
+	bool success = true;
+
+	if (offset == 0)
+		access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+	else
+		access |= GL_MAP_INVALIDATE_RANGE_BIT |
+		          GL_MAP_UNSYNCHRONIZED_BIT;
+
+	if (!gl_bind_buffer(target, buffer))
+		return false;
+
+	ptr = glMapBufferRange(target, offset, size, access);
+	success = gl_success("glMapBufferRange");
+	if (success && ptr) {
+		memcpy(ptr, (uint8_t*)data + offset, size);
+		glUnmapBuffer(target);
+	}
+
+	gl_bind_buffer(target, 0);
+	return success;
+}
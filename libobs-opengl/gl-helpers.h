@@ -35,6 +35,20 @@ static inline bool gl_success(const char *funcname)
 	return true;
 }
 
+/*
+ * glGetError has to wait on the driver, so the calls that are made for every
+ * draw are only checked in debug builds or with GL_CHECK_ERRORS defined.
+ */
+static inline bool gl_success_debug(const char *funcname)
+{
+#ifdef GL_CHECK_ERRORS
+	return gl_success(funcname);
+#else
+	UNUSED_PARAMETER(funcname);
+	return true;
+#endif
+}
+
 static inline bool gl_gen_textures(GLsizei num_texture, GLuint *textures)
 {
 	glGenTextures(num_texture, textures);
@@ -159,3 +173,5 @@ extern bool gl_create_buffer(GLenum target, GLuint *buffer, GLsizeiptr size,
 
 extern bool update_buffer(GLenum target, GLuint buffer, void *data,
 		size_t size);
+extern bool update_buffer_range(GLenum target, GLuint buffer, void *data,
+		size_t offset, size_t size);
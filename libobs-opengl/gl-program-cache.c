@@ -0,0 +1,293 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdio.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include "gl-subsystem.h"
+
+/*
+ * Linked program binaries are stored one per file in the cache directory,
+ * named after a key made from the hashes of the two shaders' GLSL and the
+ * driver identification strings.  A driver update changes the key, so stale
+ * binaries are simply never looked up again; a binary the driver still
+ * refuses is deleted and the program is linked from source.
+ */
+
+#define PROGRAM_CACHE_MAGIC   0x42504C47 /* "GLPB" */
+#define PROGRAM_CACHE_VERSION 1
+
+struct program_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t size;
+};
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x100000001B3ULL
+
+static uint64_t hash_data(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+uint64_t gl_program_cache_hash(const char *str)
+{
+	return str ? hash_data(FNV_OFFSET, str, strlen(str)) : 0;
+}
+
+static inline uint64_t get_program_key(const struct gs_program *program)
+{
+	uint64_t hash = program->device->program_cache_driver;
+	hash = hash_data(hash, &program->vertex_shader->hash, sizeof(uint64_t));
+	hash = hash_data(hash, &program->pixel_shader->hash, sizeof(uint64_t));
+	return hash;
+}
+
+static void get_program_file(struct dstr *path,
+		const struct gs_program *program, uint64_t key)
+{
+	dstr_printf(path, "%s/%016llX.bin", program->device->program_cache_path,
+			(unsigned long long)key);
+}
+
+static inline bool program_cache_enabled(const struct gs_program *program)
+{
+	return program->device->program_cache_path != NULL &&
+		program->vertex_shader->hash && program->pixel_shader->hash;
+}
+
+static void *read_program_binary(const char *file, uint64_t key,
+		struct program_cache_header *header)
+{
+	FILE *f = os_fopen(file, "rb");
+	void *binary = NULL;
+
+	if (!f)
+		return NULL;
+
+	if (fread(header, sizeof(*header), 1, f) != 1)
+		goto fail;
+	if (header->magic   != PROGRAM_CACHE_MAGIC ||
+	    header->version != PROGRAM_CACHE_VERSION ||
+	    header->key     != key ||
+	    header->size    == 0)
+		goto fail;
+
+	binary = bmalloc(header->size);
+	if (fread(binary, 1, header->size, f) != header->size) {
+		bfree(binary);
+		binary = NULL;
+	}
+
+fail:
+	fclose(f);
+	return binary;
+}
+
+bool gl_program_cache_load(struct gs_program *program)
+{
+	struct gs_device *device = program->device;
+	struct program_cache_header header;
+	struct dstr file = {0};
+	uint64_t start = os_gettime_ns();
+	uint64_t key;
+	GLint linked = GL_FALSE;
+	void *binary;
+
+	if (!program_cache_enabled(program))
+		return false;
+
+	key = get_program_key(program);
+	get_program_file(&file, program, key);
+
+	binary = read_program_binary(file.array, key, &header);
+	if (!binary) {
+		device->program_cache_stats.misses++;
+		dstr_free(&file);
+		return false;
+	}
+
+	glProgramBinary(program->obj, (GLenum)header.format, binary,
+			(GLsizei)header.size);
+
+	/* drivers are allowed to reject any binary, so this is not treated
+	 * as an error */
+	if (glGetError() == GL_NO_ERROR)
+		glGetProgramiv(program->obj, GL_LINK_STATUS, &linked);
+
+	if (linked == GL_FALSE) {
+		blog(LOG_DEBUG, "Program binary '%s' was rejected by the "
+		                "driver, relinking", file.array);
+		os_unlink(file.array);
+		device->program_cache_stats.rejected++;
+		device->program_cache_stats.misses++;
+	} else {
+		device->program_cache_stats.hits++;
+		device->program_cache_stats.load_ns += os_gettime_ns() - start;
+	}
+
+	bfree(binary);
+	dstr_free(&file);
+	return linked != GL_FALSE;
+}
+
+void gl_program_cache_prepare(struct gs_program *program)
+{
+	if (!program_cache_enabled(program))
+		return;
+
+	glProgramParameteri(program->obj, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+			GL_TRUE);
+	gl_success("glProgramParameteri");
+}
+
+static bool write_program_binary(const char *file,
+		const struct program_cache_header *header, const void *binary)
+{
+	struct dstr tmp = {0};
+	bool success = false;
+	FILE *f;
+
+	dstr_printf(&tmp, "%s.tmp", file);
+
+	f = os_fopen(tmp.array, "wb");
+	if (!f)
+		goto exit;
+
+	success = fwrite(header, sizeof(*header), 1, f) == 1 &&
+	          fwrite(binary, 1, header->size, f) == header->size;
+	fclose(f);
+
+	/* write to a temporary file first so a crash never leaves a
+	 * truncated binary under the real name */
+	if (success)
+		success = os_rename(tmp.array, file) == 0;
+	if (!success)
+		os_unlink(tmp.array);
+
+exit:
+	dstr_free(&tmp);
+	return success;
+}
+
+void gl_program_cache_store(struct gs_program *program)
+{
+	struct gs_device *device = program->device;
+	struct program_cache_header header = {0};
+	struct dstr file = {0};
+	GLint size = 0;
+	GLsizei written = 0;
+	GLenum format = 0;
+	void *binary;
+
+	if (!program_cache_enabled(program))
+		return;
+
+	glGetProgramiv(program->obj, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (!gl_success("glGetProgramiv") || size <= 0)
+		return;
+
+	binary = bmalloc(size);
+	glGetProgramBinary(program->obj, size, &written, &format, binary);
+	if (!gl_success("glGetProgramBinary") || written <= 0)
+		goto exit;
+
+	header.magic   = PROGRAM_CACHE_MAGIC;
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key     = get_program_key(program);
+	header.format  = (uint32_t)format;
+	header.size    = (uint32_t)written;
+
+	get_program_file(&file, program, header.key);
+	if (write_program_binary(file.array, &header, binary))
+		device->program_cache_stats.stores++;
+	else
+		blog(LOG_WARNING, "Failed to write program binary '%s'",
+				file.array);
+
+exit:
+	dstr_free(&file);
+	bfree(binary);
+}
+
+static uint64_t get_driver_hash(void)
+{
+	const char *strings[] = {
+		(const char*)glGetString(GL_VENDOR),
+		(const char*)glGetString(GL_RENDERER),
+		(const char*)glGetString(GL_VERSION)
+	};
+	uint64_t hash = FNV_OFFSET;
+
+	for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		if (strings[i])
+			hash = hash_data(hash, strings[i],
+					strlen(strings[i]) + 1);
+	}
+
+	return hash;
+}
+
+bool device_set_program_cache_path(gs_device_t *device, const char *path)
+{
+	GLint num_formats = 0;
+
+	bfree(device->program_cache_path);
+	device->program_cache_path = NULL;
+
+	if (!path || !*path)
+		return true;
+
+	if (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary) {
+		blog(LOG_INFO, "Program binaries are not supported, shader "
+		               "program cache disabled");
+		return false;
+	}
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (!gl_success("glGetIntegerv") || num_formats <= 0) {
+		blog(LOG_INFO, "Driver does not provide any program binary "
+		               "formats, shader program cache disabled");
+		return false;
+	}
+
+	if (os_mkdirs(path) == MKDIR_ERROR) {
+		blog(LOG_WARNING, "Failed to create shader program cache "
+		                  "directory '%s'", path);
+		return false;
+	}
+
+	device->program_cache_path   = bstrdup(path);
+	device->program_cache_driver = get_driver_hash();
+	return true;
+}
+
+void device_get_program_cache_stats(const gs_device_t *device,
+		struct gs_program_cache_stats *stats)
+{
+	*stats = device->program_cache_stats;
+}
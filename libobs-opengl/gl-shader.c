@@ -17,6 +17,7 @@
 
 #include <assert.h>
 
+#include <util/platform.h>
 #include <graphics/vec2.h>
 #include <graphics/vec3.h>
 #include <graphics/vec4.h>
@@ -199,6 +200,8 @@ static bool gl_shader_init(struct gs_shader *shader,
 	if (!gl_success("glCreateShader") || !shader->obj)
 		return false;
 
+	shader->hash = gl_program_cache_hash(glsp->gl_string.array);
+
 	glShaderSource(shader->obj, 1, (const GLchar**)&glsp->gl_string.array,
 			0);
 	if (!gl_success("glShaderSource"))
@@ -443,59 +446,88 @@ static inline bool validate_param(struct program_param *pp,
 	return true;
 }
 
+/* uniforms keep their values per program, so only upload values that
+ * changed since this program last used them */
+static bool param_changed(struct gs_program *program, struct program_param *pp)
+{
+	struct gs_shader_param *param = pp->param;
+
+	if (pp->uploaded && pp->last_value.num == param->cur_value.num &&
+	    memcmp(pp->last_value.array, param->cur_value.array,
+		    param->cur_value.num) == 0) {
+		gl_state_count(program->device, false);
+		return false;
+	}
+
+	da_copy(pp->last_value, param->cur_value);
+	pp->uploaded = true;
+	gl_state_count(program->device, true);
+	return true;
+}
+
 static void program_set_param_data(struct gs_program *program,
 		struct program_param *pp)
 {
 	void *array = pp->param->cur_value.array;
 
+	if (pp->param->type == GS_SHADER_PARAM_TEXTURE) {
+		if (pp->param->next_sampler) {
+			program->device->cur_samplers[pp->param->sampler_id] =
+				pp->param->next_sampler;
+			pp->param->next_sampler = NULL;
+		}
+
+		if (!pp->uploaded) {
+			glUniform1i(pp->obj, pp->param->texture_id);
+			gl_success_debug("glUniform1i");
+			pp->uploaded = true;
+		}
+
+		device_load_texture(program->device, pp->param->texture,
+				pp->param->texture_id);
+		return;
+	}
+
+	if (!param_changed(program, pp))
+		return;
+
 	if (pp->param->type == GS_SHADER_PARAM_BOOL ||
 	    pp->param->type == GS_SHADER_PARAM_INT) {
 		if (validate_param(pp, sizeof(int))) {
 			glUniform1iv(pp->obj, 1, (int*)array);
-			gl_success("glUniform1iv");
+			gl_success_debug("glUniform1iv");
 		}
 
 	} else if (pp->param->type == GS_SHADER_PARAM_FLOAT) {
 		if (validate_param(pp, sizeof(float))) {
 			glUniform1fv(pp->obj, 1, (float*)array);
-			gl_success("glUniform1fv");
+			gl_success_debug("glUniform1fv");
 		}
 
 	} else if (pp->param->type == GS_SHADER_PARAM_VEC2) {
 		if (validate_param(pp, sizeof(struct vec2))) {
 			glUniform2fv(pp->obj, 1, (float*)array);
-			gl_success("glUniform2fv");
+			gl_success_debug("glUniform2fv");
 		}
 
 	} else if (pp->param->type == GS_SHADER_PARAM_VEC3) {
 		if (validate_param(pp, sizeof(float) * 3)) {
 			glUniform3fv(pp->obj, 1, (float*)array);
-			gl_success("glUniform3fv");
+			gl_success_debug("glUniform3fv");
 		}
 
 	} else if (pp->param->type == GS_SHADER_PARAM_VEC4) {
 		if (validate_param(pp, sizeof(struct vec4))) {
 			glUniform4fv(pp->obj, 1, (float*)array);
-			gl_success("glUniform4fv");
+			gl_success_debug("glUniform4fv");
 		}
 
 	} else if (pp->param->type == GS_SHADER_PARAM_MATRIX4X4) {
 		if (validate_param(pp, sizeof(struct matrix4))) {
 			glUniformMatrix4fv(pp->obj, 1, false,
 					(float*)array);
-			gl_success("glUniformMatrix4fv");
-		}
-
-	} else if (pp->param->type == GS_SHADER_PARAM_TEXTURE) {
-		if (pp->param->next_sampler) {
-			program->device->cur_samplers[pp->param->sampler_id] =
-				pp->param->next_sampler;
-			pp->param->next_sampler = NULL;
+			gl_success_debug("glUniformMatrix4fv");
 		}
-
-		glUniform1i(pp->obj, pp->param->texture_id);
-		device_load_texture(program->device, pp->param->texture,
-				pp->param->texture_id);
 	}
 }
 
@@ -559,7 +591,7 @@ static inline bool assign_program_attribs(struct gs_program *program)
 static bool assign_program_param(struct gs_program *program,
 		struct gs_shader_param *param)
 {
-	struct program_param info;
+	struct program_param info = {0};
 
 	info.obj = glGetUniformLocation(program->obj, param->name);
 	if (!gl_success("glGetUniformLocation"))
@@ -596,22 +628,16 @@ static inline bool assign_program_params(struct gs_program *program)
 	return true;
 }
 
-struct gs_program *gs_program_create(struct gs_device *device)
+static bool link_program(struct gs_program *program)
 {
-	struct gs_program *program = bzalloc(sizeof(*program));
+	uint64_t start = os_gettime_ns();
 	int linked = false;
 
-	program->device        = device;
-	program->vertex_shader = device->cur_vertex_shader;
-	program->pixel_shader  = device->cur_pixel_shader;
-
-	program->obj = glCreateProgram();
-	if (!gl_success("glCreateProgram"))
-		goto error_detach_neither;
+	gl_program_cache_prepare(program);
 
 	glAttachShader(program->obj, program->vertex_shader->obj);
 	if (!gl_success("glAttachShader (vertex)"))
-		goto error_detach_neither;
+		return false;
 
 	glAttachShader(program->obj, program->pixel_shader->obj);
 	if (!gl_success("glAttachShader (pixel)"))
@@ -630,16 +656,41 @@ struct gs_program *gs_program_create(struct gs_device *device)
 		goto error;
 	}
 
-	if (!assign_program_attribs(program))
-		goto error;
-	if (!assign_program_params(program))
-		goto error;
+	program->device->program_cache_stats.link_ns +=
+		os_gettime_ns() - start;
+	gl_program_cache_store(program);
 
+error:
+	glDetachShader(program->obj, program->pixel_shader->obj);
+	gl_success("glDetachShader (pixel)");
+
+error_detach_vertex:
 	glDetachShader(program->obj, program->vertex_shader->obj);
 	gl_success("glDetachShader (vertex)");
 
-	glDetachShader(program->obj, program->pixel_shader->obj);
-	gl_success("glDetachShader (pixel)");
+	return linked != GL_FALSE;
+}
+
+struct gs_program *gs_program_create(struct gs_device *device)
+{
+	struct gs_program *program = bzalloc(sizeof(*program));
+
+	program->device        = device;
+	program->vertex_shader = device->cur_vertex_shader;
+	program->pixel_shader  = device->cur_pixel_shader;
+	program->id            = ++device->next_program_id;
+
+	program->obj = glCreateProgram();
+	if (!gl_success("glCreateProgram"))
+		goto error;
+
+	if (!gl_program_cache_load(program) && !link_program(program))
+		goto error;
+
+	if (!assign_program_attribs(program))
+		goto error;
+	if (!assign_program_params(program))
+		goto error;
 
 	program->next = device->first_program;
 	program->prev_next = &device->first_program;
@@ -650,14 +701,6 @@ struct gs_program *gs_program_create(struct gs_device *device)
 	return program;
 
 error:
-	glDetachShader(program->obj, program->pixel_shader->obj);
-	gl_success("glDetachShader (pixel)");
-
-error_detach_vertex:
-	glDetachShader(program->obj, program->vertex_shader->obj);
-	gl_success("glDetachShader (vertex)");
-
-error_detach_neither:
 	gs_program_destroy(program);
 	return NULL;
 }
@@ -669,10 +712,12 @@ void gs_program_destroy(struct gs_program *program)
 
 	if (program->device->cur_program == program) {
 		program->device->cur_program = 0;
-		glUseProgram(0);
-		gl_success("glUseProgram (zero)");
+		gl_state_use_program(program->device, 0);
 	}
 
+	for (size_t i = 0; i < program->params.num; i++)
+		da_free(program->params.array[i].last_value);
+
 	da_free(program->attribs);
 	da_free(program->params);
 
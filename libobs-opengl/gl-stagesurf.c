@@ -17,21 +17,69 @@
 
 #include "gl-subsystem.h"
 
-static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
+static inline GLsizeiptr get_pack_buffer_size(struct gs_stage_surface *surf)
 {
 	GLsizeiptr size;
+
+	size  = surf->width * surf->bytes_per_pixel;
+	size  = (size+3) & 0xFFFFFFFC; /* align width to 4-byte boundry */
+	size *= surf->height;
+	return size;
+}
+
+#define PERSISTENT_MAP_FLAGS \
+	(GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+/* with immutable buffer storage the pack buffer can stay mapped for its
+ * whole lifetime, so mapping a surface after a readback only has to wait
+ * for the readback's fence rather than map and unmap the buffer each frame */
+static bool create_persistent_pack_buffer(struct gs_stage_surface *surf)
+{
+	GLsizeiptr size = get_pack_buffer_size(surf);
+
+	if (!GLAD_GL_VERSION_4_4 && !GLAD_GL_ARB_buffer_storage)
+		return false;
+
+	if (!gl_gen_buffers(1, &surf->pack_buffer))
+		return false;
+	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, surf->pack_buffer))
+		goto fail;
+
+	glBufferStorage(GL_PIXEL_PACK_BUFFER, size, NULL,
+			PERSISTENT_MAP_FLAGS | GL_CLIENT_STORAGE_BIT);
+	if (!gl_success("glBufferStorage"))
+		goto fail;
+
+	surf->persistent_data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+			PERSISTENT_MAP_FLAGS);
+	if (!gl_success("glMapBufferRange") || !surf->persistent_data)
+		goto fail;
+
+	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+
+fail:
+	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	gl_delete_buffers(1, &surf->pack_buffer);
+	surf->pack_buffer = 0;
+	surf->persistent_data = NULL;
+	return false;
+}
+
+static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
+{
+	GLsizeiptr size = get_pack_buffer_size(surf);
 	bool success = true;
 
+	if (create_persistent_pack_buffer(surf))
+		return true;
+
 	if (!gl_gen_buffers(1, &surf->pack_buffer))
 		return false;
 
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, surf->pack_buffer))
 		return false;
 
-	size  = surf->width * surf->bytes_per_pixel;
-	size  = (size+3) & 0xFFFFFFFC; /* align width to 4-byte boundry */
-	size *= surf->height;
-
 	glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_DYNAMIC_READ);
 	if (!gl_success("glBufferData"))
 		success = false;
@@ -42,6 +90,26 @@ static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
 	return success;
 }
 
+static inline void delete_fence(struct gs_stage_surface *surf)
+{
+	if (surf->fence) {
+		glDeleteSync(surf->fence);
+		surf->fence = NULL;
+	}
+}
+
+/* marks the point the readback has to reach before the mapped data can be
+ * read */
+static void set_readback_fence(struct gs_stage_surface *surf)
+{
+	if (!surf->persistent_data)
+		return;
+
+	delete_fence(surf);
+	surf->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_success("glFenceSync");
+}
+
 gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 		uint32_t height, enum gs_color_format color_format)
 {
@@ -68,6 +136,9 @@ gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
 {
 	if (stagesurf) {
+		delete_fence(stagesurf);
+
+		/* deleting the buffer also unmaps it */
 		if (stagesurf->pack_buffer)
 			gl_delete_buffers(1, &stagesurf->pack_buffer);
 
@@ -141,6 +212,7 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glReadPixels"))
 		goto failed_unbind_all;
 
+	set_readback_fence(dst);
 	success = true;
 
 failed_unbind_all:
@@ -172,6 +244,8 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glGetTexImage"))
 		goto failed;
 
+	set_readback_fence(dst);
+
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 	return;
@@ -202,9 +276,45 @@ enum gs_color_format gs_stagesurface_get_color_format(
 	return stagesurf->format;
 }
 
+#define READBACK_TIMEOUT_NS 1000000000ULL
+
+/* the fence is only removed once it has signaled; until then every map fails
+ * rather than handing out a buffer the readback may still be writing to */
+static bool wait_for_readback(struct gs_stage_surface *surf)
+{
+	GLenum result;
+
+	if (!surf->fence)
+		return true;
+
+	result = glClientWaitSync(surf->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+			READBACK_TIMEOUT_NS);
+	if (result != GL_ALREADY_SIGNALED &&
+	    result != GL_CONDITION_SATISFIED) {
+		if (result == GL_TIMEOUT_EXPIRED)
+			blog(LOG_WARNING, "stagesurf_map (GL): readback "
+					"has not finished");
+		else
+			gl_success("glClientWaitSync");
+		return false;
+	}
+
+	delete_fence(surf);
+	return true;
+}
+
 bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize)
 {
+	if (stagesurf->persistent_data) {
+		if (!wait_for_readback(stagesurf))
+			goto fail;
+
+		*data = stagesurf->persistent_data;
+		*linesize = stagesurf->bytes_per_pixel * stagesurf->width;
+		return true;
+	}
+
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, stagesurf->pack_buffer))
 		goto fail;
 
@@ -224,6 +334,9 @@ fail:
 
 void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 {
+	if (stagesurf->persistent_data)
+		return;
+
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, stagesurf->pack_buffer))
 		return;
 
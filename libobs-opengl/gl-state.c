@@ -0,0 +1,243 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gl-subsystem.h"
+
+/*
+ * Shadow copy of the context state that is changed for every draw.  Each
+ * setter compares against the last value it passed to the driver and skips
+ * the call if nothing changed.  Anything that changes this state without
+ * going through these functions must call gl_state_invalidate.
+ */
+
+#define STATE_UNKNOWN ((GLenum)-1)
+
+static inline bool state_elided(struct gs_device *device)
+{
+	device->state.stats.elided++;
+	return true;
+}
+
+static inline void state_issued(struct gs_device *device)
+{
+	device->state.stats.calls++;
+}
+
+void gl_state_invalidate(struct gs_device *device)
+{
+	struct gl_state *state = &device->state;
+
+	state->program        = STATE_UNKNOWN;
+	state->vertex_array   = STATE_UNKNOWN;
+	state->active_texture = STATE_UNKNOWN;
+	state->front_face     = STATE_UNKNOWN;
+	state->depth_func     = STATE_UNKNOWN;
+
+	for (size_t i = 0; i < GL_STATE_CAP_COUNT; i++)
+		state->caps[i] = STATE_UNKNOWN;
+	for (size_t i = 0; i < 4; i++)
+		state->blend_func[i] = STATE_UNKNOWN;
+
+	state->viewport_valid = false;
+	state->scissor_valid  = false;
+}
+
+bool gl_state_use_program(struct gs_device *device, GLuint program)
+{
+	if (device->state.program == program)
+		return state_elided(device);
+
+	device->state.program = program;
+	state_issued(device);
+
+	glUseProgram(program);
+	return gl_success_debug("glUseProgram");
+}
+
+bool gl_state_bind_vertex_array(struct gs_device *device, GLuint vao)
+{
+	if (device->state.vertex_array == vao)
+		return state_elided(device);
+
+	device->state.vertex_array = vao;
+	state_issued(device);
+
+	glBindVertexArray(vao);
+	return gl_success_debug("glBindVertexArray");
+}
+
+void gl_state_delete_vertex_array(struct gs_device *device, GLuint vao)
+{
+	/* deleting the bound vertex array reverts the binding to zero, and
+	 * the name may be handed out again */
+	if (device->state.vertex_array == vao)
+		device->state.vertex_array = 0;
+}
+
+bool gl_state_active_texture(struct gs_device *device, GLenum unit)
+{
+	if (device->state.active_texture == unit)
+		return state_elided(device);
+
+	device->state.active_texture = unit;
+	state_issued(device);
+
+	glActiveTexture(unit);
+	return gl_success_debug("glActiveTexture");
+}
+
+static inline size_t get_cap_index(GLenum cap)
+{
+	switch (cap) {
+	case GL_BLEND:        return GL_STATE_CAP_BLEND;
+	case GL_DEPTH_TEST:   return GL_STATE_CAP_DEPTH_TEST;
+	case GL_STENCIL_TEST: return GL_STATE_CAP_STENCIL_TEST;
+	case GL_SCISSOR_TEST: return GL_STATE_CAP_SCISSOR_TEST;
+	}
+
+	return GL_STATE_CAP_COUNT;
+}
+
+bool gl_state_enable(struct gs_device *device, GLenum cap, bool enable)
+{
+	size_t idx = get_cap_index(cap);
+	GLenum value = enable ? GL_TRUE : GL_FALSE;
+
+	if (idx < GL_STATE_CAP_COUNT) {
+		if (device->state.caps[idx] == value)
+			return state_elided(device);
+
+		device->state.caps[idx] = value;
+	}
+
+	state_issued(device);
+
+	if (enable) {
+		glEnable(cap);
+		return gl_success_debug("glEnable");
+	} else {
+		glDisable(cap);
+		return gl_success_debug("glDisable");
+	}
+}
+
+bool gl_state_blend_func(struct gs_device *device, GLenum src_c, GLenum dst_c,
+		GLenum src_a, GLenum dst_a)
+{
+	GLenum *func = device->state.blend_func;
+
+	if (func[0] == src_c && func[1] == dst_c &&
+	    func[2] == src_a && func[3] == dst_a)
+		return state_elided(device);
+
+	func[0] = src_c;
+	func[1] = dst_c;
+	func[2] = src_a;
+	func[3] = dst_a;
+	state_issued(device);
+
+	glBlendFuncSeparate(src_c, dst_c, src_a, dst_a);
+	return gl_success_debug("glBlendFuncSeparate");
+}
+
+bool gl_state_depth_func(struct gs_device *device, GLenum func)
+{
+	if (device->state.depth_func == func)
+		return state_elided(device);
+
+	device->state.depth_func = func;
+	state_issued(device);
+
+	glDepthFunc(func);
+	return gl_success_debug("glDepthFunc");
+}
+
+bool gl_state_front_face(struct gs_device *device, GLenum mode)
+{
+	if (device->state.front_face == mode)
+		return state_elided(device);
+
+	device->state.front_face = mode;
+	state_issued(device);
+
+	glFrontFace(mode);
+	return gl_success_debug("glFrontFace");
+}
+
+static inline bool rect_equal(const GLint *rect, GLint x, GLint y,
+		GLsizei width, GLsizei height)
+{
+	return rect[0] == x && rect[1] == y &&
+	       rect[2] == width && rect[3] == height;
+}
+
+static inline void set_rect(GLint *rect, GLint x, GLint y,
+		GLsizei width, GLsizei height)
+{
+	rect[0] = x;
+	rect[1] = y;
+	rect[2] = width;
+	rect[3] = height;
+}
+
+bool gl_state_viewport(struct gs_device *device, GLint x, GLint y,
+		GLsizei width, GLsizei height)
+{
+	struct gl_state *state = &device->state;
+
+	if (state->viewport_valid &&
+	    rect_equal(state->viewport, x, y, width, height))
+		return state_elided(device);
+
+	set_rect(state->viewport, x, y, width, height);
+	state->viewport_valid = true;
+	state_issued(device);
+
+	glViewport(x, y, width, height);
+	return gl_success_debug("glViewport");
+}
+
+bool gl_state_scissor(struct gs_device *device, GLint x, GLint y,
+		GLsizei width, GLsizei height)
+{
+	struct gl_state *state = &device->state;
+
+	if (state->scissor_valid &&
+	    rect_equal(state->scissor, x, y, width, height))
+		return state_elided(device);
+
+	set_rect(state->scissor, x, y, width, height);
+	state->scissor_valid = true;
+	state_issued(device);
+
+	glScissor(x, y, width, height);
+	return gl_success_debug("glScissor");
+}
+
+void gl_state_count(struct gs_device *device, bool issued)
+{
+	if (issued)
+		state_issued(device);
+	else
+		state_elided(device);
+}
+
+void device_get_state_stats(const gs_device_t *device,
+		struct gs_state_stats *stats)
+{
+	*stats = device->state.stats;
+}
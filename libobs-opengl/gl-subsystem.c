@@ -150,7 +150,7 @@ static void clear_textures(struct gs_device *device)
 	GLenum i;
 	for (i = 0; i < GS_MAX_TEXTURES; i++) {
 		if (device->cur_textures[i]) {
-			gl_active_texture(GL_TEXTURE0 + i);
+			gl_state_active_texture(device, GL_TEXTURE0 + i);
 			gl_bind_texture(device->cur_textures[i]->gl_target, 0);
 			device->cur_textures[i] = NULL;
 		}
@@ -217,6 +217,7 @@ int device_create(gs_device_t **p_device, uint32_t adapter)
 	}
 	
 	gl_enable(GL_CULL_FACE);
+	gl_state_invalidate(device);
 	
 	device_leave_context(device);
 	device->cur_swap = NULL;
@@ -253,6 +254,7 @@ void device_destroy(gs_device_t *device)
 
 		da_free(device->proj_stack);
 		da_free(device->fbos);
+		bfree(device->program_cache_path);
 		gl_platform_destroy(device->plat);
 		bfree(device);
 	}
@@ -460,7 +462,7 @@ void device_load_texture(gs_device_t *device, gs_texture_t *tex, int unit)
 	if (cur_tex == tex)
 		return;
 
-	if (!gl_active_texture(GL_TEXTURE0 + unit))
+	if (!gl_state_active_texture(device, GL_TEXTURE0 + unit))
 		goto fail;
 
 	/* the target for the previous text may not be the same as the
@@ -507,7 +509,8 @@ static bool load_sampler_on_textures(gs_device_t *device, gs_samplerstate_t *ss,
 		if (param->type == GS_SHADER_PARAM_TEXTURE &&
 		    param->sampler_id == (uint32_t)sampler_unit &&
 		    param->texture) {
-			if (!gl_active_texture(GL_TEXTURE0 + param->texture_id))
+			if (!gl_state_active_texture(device,
+						GL_TEXTURE0 + param->texture_id))
 				return false;
 			if (!load_texture_sampler(param->texture, ss))
 				return false;
@@ -888,6 +891,8 @@ void device_copy_texture(gs_device_t *device, gs_texture_t *dst,
 
 void device_begin_scene(gs_device_t *device)
 {
+	/* plugins may have changed state with their own GL calls */
+	gl_state_invalidate(device);
 	clear_textures(device);
 }
 
@@ -930,13 +935,11 @@ static void update_viewproj_matrix(struct gs_device *device)
 		cur_proj.z.y = -cur_proj.z.y;
 		cur_proj.t.y = -cur_proj.t.y;
 
-		glFrontFace(GL_CW);
+		gl_state_front_face(device, GL_CW);
 	} else {
-		glFrontFace(GL_CCW);
+		gl_state_front_face(device, GL_CCW);
 	}
 
-	gl_success("glFrontFace");
-
 	matrix4_mul(&device->cur_viewproj, &device->cur_view, &cur_proj);
 	matrix4_transpose(&device->cur_viewproj, &device->cur_viewproj);
 
@@ -989,16 +992,10 @@ void device_draw(gs_device_t *device, enum gs_draw_mode draw_mode,
 
 	load_vb_buffers(program, device->cur_vertex_buffer, ib);
 
-	if (program != device->cur_program && device->cur_program) {
-		glUseProgram(0);
-		gl_success("glUseProgram (zero)");
-	}
-
 	if (program != device->cur_program) {
 		device->cur_program = program;
 
-		glUseProgram(program->obj);
-		if (!gl_success("glUseProgram"))
+		if (!gl_state_use_program(device, program->obj))
 			goto fail;
 	}
 
@@ -1011,14 +1008,14 @@ void device_draw(gs_device_t *device, enum gs_draw_mode draw_mode,
 			num_verts = (uint32_t)device->cur_index_buffer->num;
 		glDrawElements(topology, num_verts, ib->gl_type,
 				(const GLvoid*)(start_vert * ib->width));
-		if (!gl_success("glDrawElements"))
+		if (!gl_success_debug("glDrawElements"))
 			goto fail;
 
 	} else {
 		if (num_verts == 0)
 			num_verts = (uint32_t)device->cur_vertex_buffer->num;
 		glDrawArrays(topology, start_vert, num_verts);
-		if (!gl_success("glDrawArrays"))
+		if (!gl_success_debug("glDrawArrays"))
 			goto fail;
 	}
 
@@ -1073,6 +1070,47 @@ void device_flush(gs_device_t *device)
 	UNUSED_PARAMETER(device);
 }
 
+gs_sync_t *device_sync_create(gs_device_t *device)
+{
+	struct gs_sync *sync = bzalloc(sizeof(struct gs_sync));
+	sync->device = device;
+
+	sync->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (!gl_success("glFenceSync") || !sync->sync) {
+		blog(LOG_ERROR, "device_sync_create (GL) failed");
+		bfree(sync);
+		return NULL;
+	}
+
+	return sync;
+}
+
+void gs_sync_destroy(gs_sync_t *sync)
+{
+	if (!sync)
+		return;
+
+	glDeleteSync(sync->sync);
+	bfree(sync);
+}
+
+#define SYNC_TIMEOUT_NS 1000000000ULL
+
+bool gs_sync_wait(gs_sync_t *sync)
+{
+	GLenum result = glClientWaitSync(sync->sync,
+			GL_SYNC_FLUSH_COMMANDS_BIT, SYNC_TIMEOUT_NS);
+
+	if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+		return true;
+
+	if (result == GL_TIMEOUT_EXPIRED)
+		blog(LOG_WARNING, "gs_sync_wait (GL): timed out");
+	else
+		gl_success("glClientWaitSync");
+	return false;
+}
+
 void device_set_cull_mode(gs_device_t *device, enum gs_cull_mode mode)
 {
 	if (device->cur_cull_mode == mode)
@@ -1098,32 +1136,17 @@ enum gs_cull_mode device_get_cull_mode(const gs_device_t *device)
 
 void device_enable_blending(gs_device_t *device, bool enable)
 {
-	if (enable)
-		gl_enable(GL_BLEND);
-	else
-		gl_disable(GL_BLEND);
-
-	UNUSED_PARAMETER(device);
+	gl_state_enable(device, GL_BLEND, enable);
 }
 
 void device_enable_depth_test(gs_device_t *device, bool enable)
 {
-	if (enable)
-		gl_enable(GL_DEPTH_TEST);
-	else
-		gl_disable(GL_DEPTH_TEST);
-
-	UNUSED_PARAMETER(device);
+	gl_state_enable(device, GL_DEPTH_TEST, enable);
 }
 
 void device_enable_stencil_test(gs_device_t *device, bool enable)
 {
-	if (enable)
-		gl_enable(GL_STENCIL_TEST);
-	else
-		gl_disable(GL_STENCIL_TEST);
-
-	UNUSED_PARAMETER(device);
+	gl_state_enable(device, GL_STENCIL_TEST, enable);
 }
 
 void device_enable_stencil_write(gs_device_t *device, bool enable)
@@ -1150,11 +1173,8 @@ void device_blend_function(gs_device_t *device, enum gs_blend_type src,
 	GLenum gl_src = convert_gs_blend_type(src);
 	GLenum gl_dst = convert_gs_blend_type(dest);
 
-	glBlendFunc(gl_src, gl_dst);
-	if (!gl_success("glBlendFunc"))
+	if (!gl_state_blend_func(device, gl_src, gl_dst, gl_src, gl_dst))
 		blog(LOG_ERROR, "device_blend_function (GL) failed");
-
-	UNUSED_PARAMETER(device);
 }
 
 void device_blend_function_separate(gs_device_t *device,
@@ -1166,22 +1186,17 @@ void device_blend_function_separate(gs_device_t *device,
 	GLenum gl_src_a = convert_gs_blend_type(src_a);
 	GLenum gl_dst_a = convert_gs_blend_type(dest_a);
 
-	glBlendFuncSeparate(gl_src_c, gl_dst_c, gl_src_a, gl_dst_a);
-	if (!gl_success("glBlendFuncSeparate"))
+	if (!gl_state_blend_func(device, gl_src_c, gl_dst_c, gl_src_a,
+				gl_dst_a))
 		blog(LOG_ERROR, "device_blend_function_separate (GL) failed");
-
-	UNUSED_PARAMETER(device);
 }
 
 void device_depth_function(gs_device_t *device, enum gs_depth_test test)
 {
 	GLenum gl_test = convert_gs_depth_test(test);
 
-	glDepthFunc(gl_test);
-	if (!gl_success("glDepthFunc"))
+	if (!gl_state_depth_func(device, gl_test))
 		blog(LOG_ERROR, "device_depth_function (GL) failed");
-
-	UNUSED_PARAMETER(device);
 }
 
 void device_stencil_function(gs_device_t *device, enum gs_stencil_side side,
@@ -1237,8 +1252,8 @@ void device_set_viewport(gs_device_t *device, int x, int y, int width,
 		gl_getclientsize(device->cur_swap, &dw, &base_height);
 	}
 
-	glViewport(x, base_height - y - height, width, height);
-	if (!gl_success("glViewport"))
+	if (!gl_state_viewport(device, x, base_height - y - height, width,
+				height))
 		blog(LOG_ERROR, "device_set_viewport (GL) failed");
 
 	device->cur_viewport.x  = x;
@@ -1254,14 +1269,13 @@ void device_get_viewport(const gs_device_t *device, struct gs_rect *rect)
 
 void device_set_scissor_rect(gs_device_t *device, const struct gs_rect *rect)
 {
-	UNUSED_PARAMETER(device);
-
 	if (rect != NULL) {
-		glScissor(rect->x, rect->y, rect->cx, rect->cy);
-		if (gl_success("glScissor") && gl_enable(GL_SCISSOR_TEST))
+		if (gl_state_scissor(device, rect->x, rect->y, rect->cx,
+					rect->cy) &&
+		    gl_state_enable(device, GL_SCISSOR_TEST, true))
 			return;
 
-	} else if (gl_disable(GL_SCISSOR_TEST)) {
+	} else if (gl_state_enable(device, GL_SCISSOR_TEST, false)) {
 		return;
 	}
 
@@ -331,6 +331,7 @@ struct gs_shader {
 	gs_device_t          *device;
 	enum gs_shader_type  type;
 	GLuint               obj;
+	uint64_t             hash;
 
 	struct gs_shader_param  *viewproj;
 	struct gs_shader_param  *world;
@@ -343,6 +344,10 @@ struct gs_shader {
 struct program_param {
 	GLint                  obj;
 	struct gs_shader_param *param;
+
+	/* value last uploaded to this program's uniform */
+	DARRAY(uint8_t)        last_value;
+	bool                   uploaded;
 };
 
 struct gs_program {
@@ -353,6 +358,7 @@ struct gs_program {
 
 	DARRAY(struct program_param) params;
 	DARRAY(GLint)                attribs;
+	uint64_t                     id;
 
 	struct gs_program            **prev_next;
 	struct gs_program            *next;
@@ -362,6 +368,11 @@ extern struct gs_program *gs_program_create(struct gs_device *device);
 extern void gs_program_destroy(struct gs_program *program);
 extern void program_update_params(struct gs_program *shader);
 
+extern uint64_t gl_program_cache_hash(const char *str);
+extern bool gl_program_cache_load(struct gs_program *program);
+extern void gl_program_cache_prepare(struct gs_program *program);
+extern void gl_program_cache_store(struct gs_program *program);
+
 struct gs_vertex_buffer {
 	GLuint               vao;
 	GLuint               vertex_buffer;
@@ -375,6 +386,9 @@ struct gs_vertex_buffer {
 	size_t               num;
 	bool                 dynamic;
 	struct gs_vb_data    *data;
+
+	/* program the vertex array's attributes were last set up for */
+	uint64_t             cur_program_id;
 };
 
 extern bool load_vb_buffers(struct gs_program *program,
@@ -438,6 +452,15 @@ struct gs_stage_surface {
 	GLint                gl_internal_format;
 	GLenum               gl_type;
 	GLuint               pack_buffer;
+
+	/* set when the pack buffer is persistently mapped */
+	uint8_t              *persistent_data;
+	GLsync               fence;
+};
+
+struct gs_sync {
+	gs_device_t          *device;
+	GLsync               sync;
 };
 
 struct gs_zstencil_buffer {
@@ -474,6 +497,47 @@ static inline void fbo_info_destroy(struct fbo_info *fbo)
 	}
 }
 
+enum gl_state_cap {
+	GL_STATE_CAP_BLEND,
+	GL_STATE_CAP_DEPTH_TEST,
+	GL_STATE_CAP_STENCIL_TEST,
+	GL_STATE_CAP_SCISSOR_TEST,
+	GL_STATE_CAP_COUNT
+};
+
+struct gl_state {
+	GLenum               program;
+	GLenum               vertex_array;
+	GLenum               active_texture;
+	GLenum               front_face;
+	GLenum               depth_func;
+	GLenum               caps[GL_STATE_CAP_COUNT];
+	GLenum               blend_func[4];
+	GLint                viewport[4];
+	GLint                scissor[4];
+	bool                 viewport_valid;
+	bool                 scissor_valid;
+
+	struct gs_state_stats stats;
+};
+
+extern void gl_state_invalidate(struct gs_device *device);
+extern bool gl_state_use_program(struct gs_device *device, GLuint program);
+extern bool gl_state_bind_vertex_array(struct gs_device *device, GLuint vao);
+extern void gl_state_delete_vertex_array(struct gs_device *device, GLuint vao);
+extern bool gl_state_active_texture(struct gs_device *device, GLenum unit);
+extern bool gl_state_enable(struct gs_device *device, GLenum cap,
+		bool enable);
+extern bool gl_state_blend_func(struct gs_device *device,
+		GLenum src_c, GLenum dst_c, GLenum src_a, GLenum dst_a);
+extern bool gl_state_depth_func(struct gs_device *device, GLenum func);
+extern bool gl_state_front_face(struct gs_device *device, GLenum mode);
+extern bool gl_state_viewport(struct gs_device *device, GLint x, GLint y,
+		GLsizei width, GLsizei height);
+extern bool gl_state_scissor(struct gs_device *device, GLint x, GLint y,
+		GLsizei width, GLsizei height);
+extern void gl_state_count(struct gs_device *device, bool issued);
+
 struct gs_device {
 	struct gl_platform   *plat;
 	enum copy_type       copy_type;
@@ -503,6 +567,13 @@ struct gs_device {
 
 	DARRAY(struct fbo_info*) fbos;
 	struct fbo_info          *cur_fbo;
+
+	struct gl_state               state;
+	uint64_t                      next_program_id;
+
+	char                          *program_cache_path;
+	uint64_t                      program_cache_driver;
+	struct gs_program_cache_stats program_cache_stats;
 };
 
 extern struct fbo_info *get_fbo(struct gs_device *device,
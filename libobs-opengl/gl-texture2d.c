@@ -210,10 +210,12 @@ void gs_texture_unmap(gs_texture_t *tex)
 	if (!gl_bind_texture(GL_TEXTURE_2D, tex2d->base.texture))
 		goto failed;
 
-	glTexImage2D(GL_TEXTURE_2D, 0, tex->gl_internal_format,
-			tex2d->width, tex2d->height, 0,
+	/* storage already exists, so only copy into it rather than
+	 * reallocating the texture */
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+			tex2d->width, tex2d->height,
 			tex->gl_format, tex->gl_type, 0);
-	if (!gl_success("glTexImage2D"))
+	if (!gl_success("glTexSubImage2D"))
 		goto failed;
 
 	gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
@@ -226,6 +228,47 @@ failed:
 	blog(LOG_ERROR, "gs_texture_unmap (GL) failed");
 }
 
+bool gs_texture_set_image_region(gs_texture_t *tex,
+		const struct gs_rect *rect, const uint8_t *data,
+		uint32_t linesize)
+{
+	struct gs_texture_2d *tex2d = (struct gs_texture_2d*)tex;
+	uint32_t bpp;
+	bool success;
+
+	if (!is_texture_2d(tex, "gs_texture_set_image_region"))
+		goto fail;
+	if (gs_is_compressed_format(tex->format))
+		goto fail;
+
+	bpp = gs_get_format_bpp(tex->format) / 8;
+	if (!bpp || linesize % bpp != 0)
+		goto fail;
+
+	if (rect->x < 0 || rect->y < 0 || rect->cx <= 0 || rect->cy <= 0 ||
+	    (uint32_t)(rect->x + rect->cx) > tex2d->width ||
+	    (uint32_t)(rect->y + rect->cy) > tex2d->height)
+		goto fail;
+
+	if (!gl_bind_texture(tex->gl_target, tex->texture))
+		goto fail;
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(linesize / bpp));
+	glTexSubImage2D(tex->gl_target, 0, rect->x, rect->y,
+			rect->cx, rect->cy, tex->gl_format, tex->gl_type,
+			data);
+	success = gl_success("glTexSubImage2D");
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	gl_bind_texture(tex->gl_target, 0);
+	if (success)
+		return true;
+
+fail:
+	blog(LOG_ERROR, "gs_texture_set_image_region (GL) failed");
+	return false;
+}
+
 bool gs_texture_is_rect(const gs_texture_t *tex)
 {
 	const struct gs_texture_2d *tex2d = (const struct gs_texture_2d*)tex;
@@ -109,8 +109,10 @@ void gs_vertexbuffer_destroy(gs_vertbuffer_t *vb)
 			gl_delete_buffers((GLsizei)vb->uv_buffers.num,
 					vb->uv_buffers.array);
 
-		if (vb->vao)
+		if (vb->vao) {
+			gl_state_delete_vertex_array(vb->device, vb->vao);
 			gl_delete_vertex_arrays(1, &vb->vao);
+		}
 
 		da_free(vb->uv_sizes);
 		da_free(vb->uv_buffers);
@@ -170,6 +172,68 @@ failed:
 	blog(LOG_ERROR, "gs_vertexbuffer_flush (GL) failed");
 }
 
+void gs_vertexbuffer_flush_range(gs_vertbuffer_t *vb, size_t start,
+		size_t count)
+{
+	size_t i;
+
+	if (!vb->dynamic) {
+		blog(LOG_ERROR, "vertex buffer is not dynamic");
+		goto failed;
+	}
+	if (!count)
+		return;
+	if (start + count > vb->data->num) {
+		blog(LOG_ERROR, "vertex range is out of bounds");
+		goto failed;
+	}
+
+	if (!update_buffer_range(GL_ARRAY_BUFFER, vb->vertex_buffer,
+				vb->data->points,
+				start * sizeof(struct vec3),
+				count * sizeof(struct vec3)))
+		goto failed;
+
+	if (vb->normal_buffer) {
+		if (!update_buffer_range(GL_ARRAY_BUFFER, vb->normal_buffer,
+					vb->data->normals,
+					start * sizeof(struct vec3),
+					count * sizeof(struct vec3)))
+			goto failed;
+	}
+
+	if (vb->tangent_buffer) {
+		if (!update_buffer_range(GL_ARRAY_BUFFER, vb->tangent_buffer,
+					vb->data->tangents,
+					start * sizeof(struct vec3),
+					count * sizeof(struct vec3)))
+			goto failed;
+	}
+
+	if (vb->color_buffer) {
+		if (!update_buffer_range(GL_ARRAY_BUFFER, vb->color_buffer,
+					vb->data->colors,
+					start * sizeof(uint32_t),
+					count * sizeof(uint32_t)))
+			goto failed;
+	}
+
+	for (i = 0; i < vb->data->num_tex; i++) {
+		GLuint buffer = vb->uv_buffers.array[i];
+		struct gs_tvertarray *tv = vb->data->tvarray+i;
+		size_t size = tv->width * sizeof(float);
+
+		if (!update_buffer_range(GL_ARRAY_BUFFER, buffer, tv->array,
+					start * size, count * size))
+			goto failed;
+	}
+
+	return;
+
+failed:
+	blog(LOG_ERROR, "gs_vertexbuffer_flush_range (GL) failed");
+}
+
 struct gs_vb_data *gs_vertexbuffer_get_data(const gs_vertbuffer_t *vb)
 {
 	return vb->data;
@@ -240,13 +304,23 @@ bool load_vb_buffers(struct gs_program *program, struct gs_vertex_buffer *vb,
 	struct gs_shader *shader = program->vertex_shader;
 	size_t i;
 
-	if (!gl_bind_vertex_array(vb->vao))
+	if (!gl_state_bind_vertex_array(vb->device, vb->vao))
 		return false;
 
-	for (i = 0; i < shader->attribs.num; i++) {
-		struct shader_attrib *attrib = shader->attribs.array+i;
-		if (!load_vb_buffer(attrib, vb, program->attribs.array[i]))
-			return false;
+	/* the attribute bindings are stored in the vertex array object, so
+	 * they only need to be set up again when a different program with
+	 * possibly different attribute locations draws with it */
+	if (vb->cur_program_id != program->id) {
+		for (i = 0; i < shader->attribs.num; i++) {
+			struct shader_attrib *attrib = shader->attribs.array+i;
+			if (!load_vb_buffer(attrib, vb,
+						program->attribs.array[i])) {
+				vb->cur_program_id = 0;
+				return false;
+			}
+		}
+
+		vb->cur_program_id = program->id;
 	}
 
 	if (ib && !gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ib->buffer))
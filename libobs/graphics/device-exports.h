@@ -143,6 +143,14 @@ EXPORT void device_frustum(gs_device_t *device, float left, float right,
 EXPORT void device_projection_push(gs_device_t *device);
 EXPORT void device_projection_pop(gs_device_t *device);
 
+EXPORT bool device_set_program_cache_path(gs_device_t *device,
+		const char *path);
+EXPORT void device_get_program_cache_stats(const gs_device_t *device,
+		struct gs_program_cache_stats *stats);
+EXPORT void device_get_state_stats(const gs_device_t *device,
+		struct gs_state_stats *stats);
+EXPORT gs_sync_t *device_sync_create(gs_device_t *device);
+
 #ifdef __cplusplus
 }
 #endif
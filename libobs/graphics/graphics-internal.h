@@ -20,6 +20,7 @@
 #include "../util/threading.h"
 #include "../util/darray.h"
 #include "graphics.h"
+#include "vec2.h"
 #include "matrix3.h"
 #include "matrix4.h"
 
@@ -159,6 +160,9 @@ struct gs_exports {
 	bool     (*gs_texture_map)(gs_texture_t *tex, uint8_t **ptr,
 			uint32_t *linesize);
 	void     (*gs_texture_unmap)(gs_texture_t *tex);
+	bool     (*gs_texture_set_image_region)(gs_texture_t *tex,
+			const struct gs_rect *rect, const uint8_t *data,
+			uint32_t linesize);
 	bool     (*gs_texture_is_rect)(const gs_texture_t *tex);
 	void    *(*gs_texture_get_obj)(const gs_texture_t *tex);
 
@@ -189,6 +193,8 @@ struct gs_exports {
 
 	void (*gs_vertexbuffer_destroy)(gs_vertbuffer_t *vertbuffer);
 	void (*gs_vertexbuffer_flush)(gs_vertbuffer_t *vertbuffer);
+	void (*gs_vertexbuffer_flush_range)(gs_vertbuffer_t *vertbuffer,
+			size_t start, size_t count);
 	struct gs_vb_data *(*gs_vertexbuffer_get_data)(
 			const gs_vertbuffer_t *vertbuffer);
 
@@ -228,6 +234,17 @@ struct gs_exports {
 	void (*gs_shader_set_next_sampler)(gs_sparam_t *param,
 			gs_samplerstate_t *sampler);
 
+	bool (*device_set_program_cache_path)(gs_device_t *device,
+			const char *path);
+	void (*device_get_program_cache_stats)(const gs_device_t *device,
+			struct gs_program_cache_stats *stats);
+	void (*device_get_state_stats)(const gs_device_t *device,
+			struct gs_state_stats *stats);
+
+	gs_sync_t *(*device_sync_create)(gs_device_t *device);
+	void (*gs_sync_destroy)(gs_sync_t *sync);
+	bool (*gs_sync_wait)(gs_sync_t *sync);
+
 #ifdef __APPLE__
 	/* OSX/Cocoa specific functions */
 	gs_texture_t *(*device_texture_create_from_iosurface)(gs_device_t *dev,
@@ -268,6 +285,11 @@ struct blend_state {
 	enum gs_blend_type dest_a;
 };
 
+struct gs_sprite_vertices {
+	struct vec3            points[4];
+	struct vec2            uvs[4];
+};
+
 struct graphics_subsystem {
 	void                   *module;
 	gs_device_t            *device;
@@ -282,6 +304,12 @@ struct graphics_subsystem {
 	struct gs_effect       *cur_effect;
 
 	gs_vertbuffer_t        *sprite_buffer;
+	size_t                 sprite_buffer_size;
+	size_t                 sprite_offset;
+	struct gs_sprite_vertices last_sprite;
+	size_t                 last_sprite_offset;
+	bool                   last_sprite_valid;
+	struct gs_draw_stats   draw_stats;
 
 	bool                   using_immediate;
 	struct gs_vb_data      *vbd;
@@ -20,6 +20,7 @@
 #include "../util/base.h"
 #include "../util/bmem.h"
 #include "../util/platform.h"
+#include "../util/profiler.h"
 #include "graphics-internal.h"
 #include "vec2.h"
 #include "vec3.h"
@@ -121,20 +122,35 @@ static bool graphics_init_immediate_vb(struct graphics_subsystem *graphics)
 	return true;
 }
 
+/* sprites are appended to a ring of vertices rather than overwriting the
+ * same four vertices every time, so each sprite only uploads its own
+ * vertices (or none, if it repeats the previous sprite).  the ring is
+ * orphaned when it wraps rather than reused behind a fence, so the driver
+ * never has to wait on vertices still in use.  sprites are not batched
+ * into one draw, see draw_sprite_vertices */
+#define SPRITE_RING_SPRITES 256
+
 static bool graphics_init_sprite_vb(struct graphics_subsystem *graphics)
 {
 	struct gs_vb_data *vbd;
+	size_t num = 4;
+
+	if (graphics->exports.gs_vertexbuffer_flush_range)
+		num *= SPRITE_RING_SPRITES;
 
 	vbd = gs_vbdata_create();
-	vbd->num     = 4;
-	vbd->points  = bmalloc(sizeof(struct vec3) * 4);
+	vbd->num     = num;
+	vbd->points  = bmalloc(sizeof(struct vec3) * num);
 	vbd->num_tex = 1;
 	vbd->tvarray = bmalloc(sizeof(struct gs_tvertarray));
 	vbd->tvarray[0].width = 2;
-	vbd->tvarray[0].array = bmalloc(sizeof(struct vec2) * 4);
+	vbd->tvarray[0].array = bmalloc(sizeof(struct vec2) * num);
 
-	memset(vbd->points,           0, sizeof(struct vec3) * 4);
-	memset(vbd->tvarray[0].array, 0, sizeof(struct vec2) * 4);
+	memset(vbd->points,           0, sizeof(struct vec3) * num);
+	memset(vbd->tvarray[0].array, 0, sizeof(struct vec2) * num);
+
+	graphics->sprite_buffer_size = num;
+	graphics->sprite_offset = 0;
 
 	graphics->sprite_buffer = graphics->exports.
 		device_vertexbuffer_create(graphics->device, vbd, GS_DYNAMIC);
@@ -578,7 +594,8 @@ void gs_render_stop(enum gs_draw_mode mode)
 	}
 
 	if (graphics->using_immediate) {
-		gs_vertexbuffer_flush(graphics->immediate_vertbuffer);
+		gs_vertexbuffer_flush_range(graphics->immediate_vertbuffer,
+				0, num);
 
 		gs_load_vertexbuffer(graphics->immediate_vertbuffer);
 		gs_load_indexbuffer(NULL);
@@ -936,33 +953,35 @@ static inline void assign_sprite_uv(float *start, float *end, bool flip)
 	}
 }
 
-static void build_sprite(struct gs_vb_data *data, float fcx, float fcy,
+static void build_sprite(struct gs_sprite_vertices *sprite,
+		float fcx, float fcy,
 		float start_u, float end_u, float start_v, float end_v)
 {
-	struct vec2 *tvarray = data->tvarray[0].array;
+	struct vec3 *points  = sprite->points;
+	struct vec2 *tvarray = sprite->uvs;
 
-	vec3_zero(data->points);
-	vec3_set(data->points+1,  fcx, 0.0f, 0.0f);
-	vec3_set(data->points+2, 0.0f,  fcy, 0.0f);
-	vec3_set(data->points+3,  fcx,  fcy, 0.0f);
+	vec3_zero(points);
+	vec3_set(points+1,  fcx, 0.0f, 0.0f);
+	vec3_set(points+2, 0.0f,  fcy, 0.0f);
+	vec3_set(points+3,  fcx,  fcy, 0.0f);
 	vec2_set(tvarray,   start_u, start_v);
 	vec2_set(tvarray+1, end_u,   start_v);
 	vec2_set(tvarray+2, start_u, end_v);
 	vec2_set(tvarray+3, end_u,   end_v);
 }
 
-static inline void build_sprite_norm(struct gs_vb_data *data, float fcx,
-		float fcy, uint32_t flip)
+static inline void build_sprite_norm(struct gs_sprite_vertices *sprite,
+		float fcx, float fcy, uint32_t flip)
 {
 	float start_u, end_u;
 	float start_v, end_v;
 
 	assign_sprite_uv(&start_u, &end_u, (flip & GS_FLIP_U) != 0);
 	assign_sprite_uv(&start_v, &end_v, (flip & GS_FLIP_V) != 0);
-	build_sprite(data, fcx, fcy, start_u, end_u, start_v, end_v);
+	build_sprite(sprite, fcx, fcy, start_u, end_u, start_v, end_v);
 }
 
-static inline void build_subsprite_norm(struct gs_vb_data *data,
+static inline void build_subsprite_norm(struct gs_sprite_vertices *sprite,
 		float fsub_x, float fsub_y, float fsub_cx, float fsub_cy,
 		float fcx, float fcy, uint32_t flip)
 {
@@ -985,11 +1004,12 @@ static inline void build_subsprite_norm(struct gs_vb_data *data,
 		end_v   = fsub_y / fcy;
 	}
 
-	build_sprite(data, fsub_cx, fsub_cy, start_u, end_u, start_v, end_v);
+	build_sprite(sprite, fsub_cx, fsub_cy,
+			start_u, end_u, start_v, end_v);
 }
 
-static inline void build_sprite_rect(struct gs_vb_data *data, gs_texture_t *tex,
-		float fcx, float fcy, uint32_t flip)
+static inline void build_sprite_rect(struct gs_sprite_vertices *sprite,
+		gs_texture_t *tex, float fcx, float fcy, uint32_t flip)
 {
 	float start_u, end_u;
 	float start_v, end_v;
@@ -998,15 +1018,59 @@ static inline void build_sprite_rect(struct gs_vb_data *data, gs_texture_t *tex,
 
 	assign_sprite_rect(&start_u, &end_u, width,  (flip & GS_FLIP_U) != 0);
 	assign_sprite_rect(&start_v, &end_v, height, (flip & GS_FLIP_V) != 0);
-	build_sprite(data, fcx, fcy, start_u, end_u, start_v, end_v);
+	build_sprite(sprite, fcx, fcy, start_u, end_u, start_v, end_v);
+}
+
+static inline size_t next_sprite_offset(graphics_t *graphics)
+{
+	if (graphics->sprite_offset + 4 > graphics->sprite_buffer_size)
+		graphics->sprite_offset = 0;
+
+	return graphics->sprite_offset;
+}
+
+/* consecutive sprites are not batched into one upload and draw: each is
+ * drawn straight away with the current matrix and effect parameters, which
+ * change between them, so merging them would mean transforming them on the
+ * CPU and deferring the parameters.  but most sprites in a frame repeat the
+ * one before (every pass of an effect, filters and scene items of the same
+ * size), and those are drawn from the vertices already uploaded */
+static void draw_sprite_vertices(graphics_t *graphics,
+		const struct gs_sprite_vertices *sprite)
+{
+	size_t offset = graphics->last_sprite_offset;
+
+	if (!graphics->last_sprite_valid ||
+	    memcmp(&graphics->last_sprite, sprite, sizeof(*sprite)) != 0) {
+		struct gs_vb_data *data;
+
+		offset = next_sprite_offset(graphics);
+		data = gs_vertexbuffer_get_data(graphics->sprite_buffer);
+
+		memcpy(data->points + offset, sprite->points,
+				sizeof(sprite->points));
+		memcpy((struct vec2*)data->tvarray[0].array + offset,
+				sprite->uvs, sizeof(sprite->uvs));
+		gs_vertexbuffer_flush_range(graphics->sprite_buffer, offset, 4);
+
+		graphics->last_sprite        = *sprite;
+		graphics->last_sprite_offset = offset;
+		graphics->last_sprite_valid  = true;
+		graphics->sprite_offset      = offset + 4;
+	}
+
+	gs_load_vertexbuffer(graphics->sprite_buffer);
+	gs_load_indexbuffer(NULL);
+
+	gs_draw(GS_TRISTRIP, (uint32_t)offset, 4);
 }
 
 void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width,
 		uint32_t height)
 {
 	graphics_t *graphics = thread_graphics;
+	struct gs_sprite_vertices sprite;
 	float fcx, fcy;
-	struct gs_vb_data *data;
 
 	if (tex) {
 		if (gs_get_texture_type(tex) != GS_TEXTURE_2D) {
@@ -1024,17 +1088,12 @@ void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width,
 	fcx = width  ? (float)width  : (float)gs_texture_get_width(tex);
 	fcy = height ? (float)height : (float)gs_texture_get_height(tex);
 
-	data = gs_vertexbuffer_get_data(graphics->sprite_buffer);
 	if (tex && gs_texture_is_rect(tex))
-		build_sprite_rect(data, tex, fcx, fcy, flip);
+		build_sprite_rect(&sprite, tex, fcx, fcy, flip);
 	else
-		build_sprite_norm(data, fcx, fcy, flip);
-
-	gs_vertexbuffer_flush(graphics->sprite_buffer);
-	gs_load_vertexbuffer(graphics->sprite_buffer);
-	gs_load_indexbuffer(NULL);
+		build_sprite_norm(&sprite, fcx, fcy, flip);
 
-	gs_draw(GS_TRISTRIP, 0, 0);
+	draw_sprite_vertices(graphics, &sprite);
 }
 
 void gs_draw_sprite_subregion(gs_texture_t *tex, uint32_t flip,
@@ -1042,8 +1101,8 @@ void gs_draw_sprite_subregion(gs_texture_t *tex, uint32_t flip,
 		uint32_t sub_cx, uint32_t sub_cy)
 {
 	graphics_t *graphics = thread_graphics;
+	struct gs_sprite_vertices sprite;
 	float fcx, fcy;
-	struct gs_vb_data *data;
 
 	if (tex) {
 		if (gs_get_texture_type(tex) != GS_TEXTURE_2D) {
@@ -1055,17 +1114,11 @@ void gs_draw_sprite_subregion(gs_texture_t *tex, uint32_t flip,
 	fcx = (float)gs_texture_get_width(tex);
 	fcy = (float)gs_texture_get_height(tex);
 
-	data = gs_vertexbuffer_get_data(graphics->sprite_buffer);
-	build_subsprite_norm(data,
-			(float)sub_x, (float)sub_y,
+	build_subsprite_norm(&sprite, (float)sub_x, (float)sub_y,
 			(float)sub_cx, (float)sub_cy,
 			fcx, fcy, flip);
 
-	gs_vertexbuffer_flush(graphics->sprite_buffer);
-	gs_load_vertexbuffer(graphics->sprite_buffer);
-	gs_load_indexbuffer(NULL);
-
-	gs_draw(GS_TRISTRIP, 0, 0);
+	draw_sprite_vertices(graphics, &sprite);
 }
 
 void gs_draw_cube_backdrop(gs_texture_t *cubetex, const struct quat *rot,
@@ -1135,6 +1188,21 @@ void gs_viewport_pop(void)
 	da_pop_back(thread_graphics->viewport_stack);
 }
 
+bool gs_texture_set_image_region(gs_texture_t *tex,
+		const struct gs_rect *rect, const uint8_t *data,
+		uint32_t linesize)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p3("gs_texture_set_image_region", tex, rect, data))
+		return false;
+	if (!graphics->exports.gs_texture_set_image_region)
+		return false;
+
+	return graphics->exports.gs_texture_set_image_region(tex, rect, data,
+			linesize);
+}
+
 void gs_texture_set_image(gs_texture_t *tex, const uint8_t *data,
 		uint32_t linesize, bool flip)
 {
@@ -1677,6 +1745,11 @@ void gs_begin_scene(void)
 	graphics->exports.device_begin_scene(graphics->device);
 }
 
+/* draw calls and buffer updates go through the profiler as well, so the
+ * number of each per frame shows up as calls per parent call */
+static const char *gs_draw_name = "gs_draw";
+static const char *gs_buffer_update_name = "gs_buffer_update";
+
 void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 		uint32_t num_verts)
 {
@@ -1685,8 +1758,92 @@ void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 	if (!gs_valid("gs_draw"))
 		return;
 
+	profile_start(gs_draw_name);
 	graphics->exports.device_draw(graphics->device, draw_mode,
 			start_vert, num_verts);
+	profile_end(gs_draw_name);
+
+	graphics->draw_stats.draw_calls++;
+}
+
+void gs_get_draw_stats(struct gs_draw_stats *stats)
+{
+	if (!gs_valid_p("gs_get_draw_stats", stats))
+		return;
+
+	*stats = thread_graphics->draw_stats;
+}
+
+bool gs_set_program_cache_path(const char *path)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid("gs_set_program_cache_path"))
+		return false;
+	if (!graphics->exports.device_set_program_cache_path)
+		return false;
+
+	return graphics->exports.device_set_program_cache_path(
+			graphics->device, path);
+}
+
+bool gs_get_program_cache_stats(struct gs_program_cache_stats *stats)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_get_program_cache_stats", stats))
+		return false;
+	if (!graphics->exports.device_get_program_cache_stats)
+		return false;
+
+	graphics->exports.device_get_program_cache_stats(graphics->device,
+			stats);
+	return true;
+}
+
+bool gs_get_state_stats(struct gs_state_stats *stats)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_get_state_stats", stats))
+		return false;
+	if (!graphics->exports.device_get_state_stats)
+		return false;
+
+	graphics->exports.device_get_state_stats(graphics->device, stats);
+	return true;
+}
+
+gs_sync_t *gs_sync_create(void)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid("gs_sync_create"))
+		return NULL;
+	if (!graphics->exports.device_sync_create)
+		return NULL;
+
+	return graphics->exports.device_sync_create(graphics->device);
+}
+
+void gs_sync_destroy(gs_sync_t *sync)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid("gs_sync_destroy"))
+		return;
+	if (!sync)
+		return;
+
+	graphics->exports.gs_sync_destroy(sync);
+}
+
+bool gs_sync_wait(gs_sync_t *sync)
+{
+	if (!gs_valid_p("gs_sync_wait", sync))
+		return false;
+
+	return thread_graphics->exports.gs_sync_wait(sync);
 }
 
 void gs_end_scene(void)
@@ -2427,7 +2584,30 @@ void gs_vertexbuffer_flush(gs_vertbuffer_t *vertbuffer)
 	if (!gs_valid_p("gs_vertexbuffer_flush", vertbuffer))
 		return;
 
+	profile_start(gs_buffer_update_name);
 	thread_graphics->exports.gs_vertexbuffer_flush(vertbuffer);
+	profile_end(gs_buffer_update_name);
+
+	thread_graphics->draw_stats.buffer_updates++;
+}
+
+void gs_vertexbuffer_flush_range(gs_vertbuffer_t *vertbuffer,
+		size_t start, size_t count)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_vertexbuffer_flush_range", vertbuffer))
+		return;
+
+	profile_start(gs_buffer_update_name);
+	if (graphics->exports.gs_vertexbuffer_flush_range)
+		graphics->exports.gs_vertexbuffer_flush_range(vertbuffer,
+				start, count);
+	else
+		graphics->exports.gs_vertexbuffer_flush(vertbuffer);
+	profile_end(gs_buffer_update_name);
+
+	graphics->draw_stats.buffer_updates++;
 }
 
 struct gs_vb_data *gs_vertexbuffer_get_data(const gs_vertbuffer_t *vertbuffer)
@@ -2455,7 +2635,11 @@ void   gs_indexbuffer_flush(gs_indexbuffer_t *indexbuffer)
 	if (!gs_valid_p("gs_indexbuffer_flush", indexbuffer))
 		return;
 
+	profile_start(gs_buffer_update_name);
 	thread_graphics->exports.gs_indexbuffer_flush(indexbuffer);
+	profile_end(gs_buffer_update_name);
+
+	thread_graphics->draw_stats.buffer_updates++;
 }
 
 void  *gs_indexbuffer_get_data(const gs_indexbuffer_t *indexbuffer)
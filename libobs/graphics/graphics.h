@@ -269,6 +269,7 @@ typedef struct gs_effect           gs_effect_t;
 typedef struct gs_effect_technique gs_technique_t;
 typedef struct gs_effect_param     gs_eparam_t;
 typedef struct gs_device           gs_device_t;
+typedef struct gs_sync             gs_sync_t;
 typedef struct graphics_subsystem  graphics_t;
 
 /* ---------------------------------------------------
@@ -625,6 +626,51 @@ EXPORT void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 		uint32_t num_verts);
 EXPORT void gs_end_scene(void);
 
+struct gs_draw_stats {
+	uint64_t draw_calls;
+	uint64_t buffer_updates;
+};
+
+/** Gets the total number of draw calls and vertex/index buffer updates */
+EXPORT void gs_get_draw_stats(struct gs_draw_stats *stats);
+
+struct gs_program_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t stores;
+	uint64_t rejected;
+	uint64_t link_ns;
+	uint64_t load_ns;
+};
+
+/**
+ * Sets the directory linked shader programs are cached in between runs, or
+ * disables the cache if NULL.  Returns false if the renderer does not
+ * support caching programs.
+ */
+EXPORT bool gs_set_program_cache_path(const char *path);
+EXPORT bool gs_get_program_cache_stats(struct gs_program_cache_stats *stats);
+
+struct gs_state_stats {
+	uint64_t calls;  /**< state changes passed on to the driver */
+	uint64_t elided; /**< redundant state changes that were skipped */
+};
+
+/** Gets the number of render state changes made and skipped by the device */
+EXPORT bool gs_get_state_stats(struct gs_state_stats *stats);
+
+/**
+ * Inserts a fence after the commands issued so far.  Waiting on it returns
+ * once the GPU has finished all of them, for example to know when a buffer
+ * the GPU was reading from can be written to again.  Returns NULL if the
+ * renderer does not support fences.
+ */
+EXPORT gs_sync_t *gs_sync_create(void);
+EXPORT void gs_sync_destroy(gs_sync_t *sync);
+
+/** Waits for a fence to signal, returns false on timeout or error */
+EXPORT bool gs_sync_wait(gs_sync_t *sync);
+
 #define GS_CLEAR_COLOR   (1<<0)
 #define GS_CLEAR_DEPTH   (1<<1)
 #define GS_CLEAR_STENCIL (1<<2)
@@ -679,6 +725,16 @@ EXPORT enum gs_color_format gs_texture_get_color_format(
 EXPORT bool     gs_texture_map(gs_texture_t *tex, uint8_t **ptr,
 		uint32_t *linesize);
 EXPORT void     gs_texture_unmap(gs_texture_t *tex);
+
+/**
+ * Updates only part of a dynamic texture.  data points to the first pixel of
+ * the region and linesize is the pitch of the source image.  Returns false if
+ * the renderer can't do partial updates, in which case the whole texture
+ * should be updated with gs_texture_set_image instead.
+ */
+EXPORT bool     gs_texture_set_image_region(gs_texture_t *tex,
+		const struct gs_rect *rect, const uint8_t *data,
+		uint32_t linesize);
 /** special-case function (GL only) - specifies whether the texture is a
  * GL_TEXTURE_RECTANGLE type, which doesn't use normalized texture
  * coordinates, doesn't support mipmapping, and requires address clamping */
@@ -716,6 +772,15 @@ EXPORT void     gs_samplerstate_destroy(gs_samplerstate_t *samplerstate);
 
 EXPORT void     gs_vertexbuffer_destroy(gs_vertbuffer_t *vertbuffer);
 EXPORT void     gs_vertexbuffer_flush(gs_vertbuffer_t *vertbuffer);
+
+/**
+ * Uploads only vertices start through start + count - 1 of a dynamic vertex
+ * buffer.  Meant for buffers that are appended to and drawn from piece by
+ * piece: vertices already drawn are not overwritten until the buffer is
+ * restarted with a start of 0, which discards the previous contents.
+ */
+EXPORT void     gs_vertexbuffer_flush_range(gs_vertbuffer_t *vertbuffer,
+		size_t start, size_t count);
 EXPORT struct gs_vb_data *gs_vertexbuffer_get_data(
 		const gs_vertbuffer_t *vertbuffer);
 
@@ -51,6 +51,25 @@ struct audio_mix {
 	float buffer[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
 };
 
+struct audio_disconnect {
+	size_t                  mix_idx;
+	audio_output_callback_t callback;
+	void                    *param;
+};
+
+/*
+ * The mixes (usually one audio encoder per track) are handed to a small pool
+ * of worker threads each tick, with the audio thread taking part as well, so
+ * several expensive encoders no longer run one after another.  The inputs of
+ * one mix are still called one after another on the same thread, so no two
+ * callbacks ever read the same mix buffer at once.  The tick only finishes
+ * once every input has been called, so each input still gets its data in
+ * order and the mix buffers are not touched while inputs are reading them.
+ * Anything fed by several mixes (outputs with more than one audio track) has
+ * to serialize its own callbacks.
+ */
+#define MAX_AUDIO_WORKERS (MAX_AUDIO_MIXES - 1)
+
 struct audio_output {
 	struct audio_output_info   info;
 	size_t                     block_size;
@@ -66,6 +85,24 @@ struct audio_output {
 	void                       *input_param;
 	pthread_mutex_t            input_mutex;
 	struct audio_mix           mixes[MAX_AUDIO_MIXES];
+
+	pthread_t                  workers[MAX_AUDIO_WORKERS];
+	size_t                     num_workers;
+	os_sem_t                   *work_sem;
+	os_event_t                 *done_event;
+	volatile bool              stop_workers;
+
+	/* the current tick, protected by input_mutex */
+	size_t                     jobs[MAX_AUDIO_MIXES];
+	size_t                     num_jobs;
+	volatile long              next_job;
+	volatile long              remaining;
+	volatile bool              dispatching;
+	uint64_t                   tick_ts;
+
+	/* inputs disconnected from within their own callback */
+	pthread_mutex_t            disconnect_mutex;
+	DARRAY(struct audio_disconnect) disconnects;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -141,25 +178,100 @@ static bool resample_audio_output(struct audio_input *input,
 	return success;
 }
 
-static inline void do_audio_output(struct audio_output *audio,
-		size_t mix_idx, uint64_t timestamp, uint32_t frames)
+static void run_job(struct audio_output *audio, size_t mix_idx)
 {
 	struct audio_mix *mix = &audio->mixes[mix_idx];
 	struct audio_data data;
 
-	pthread_mutex_lock(&audio->input_mutex);
-
 	for (size_t i = mix->inputs.num; i > 0; i--) {
 		struct audio_input *input = mix->inputs.array+(i-1);
 
 		for (size_t i = 0; i < audio->planes; i++)
 			data.data[i] = (uint8_t*)mix->buffer[i];
-		data.frames = frames;
-		data.timestamp = timestamp;
+		data.frames = AUDIO_OUTPUT_FRAMES;
+		data.timestamp = audio->tick_ts;
 
 		if (resample_audio_output(input, &data))
 			input->callback(input->param, mix_idx, &data);
 	}
+}
+
+static inline void finish_work(struct audio_output *audio)
+{
+	if (os_atomic_dec_long(&audio->remaining) == 0)
+		os_event_signal(audio->done_event);
+}
+
+static void run_jobs(struct audio_output *audio)
+{
+	for (;;) {
+		long idx = os_atomic_inc_long(&audio->next_job) - 1;
+		if (idx >= (long)audio->num_jobs)
+			break;
+
+		run_job(audio, audio->jobs[idx]);
+		finish_work(audio);
+	}
+}
+
+static void *worker_thread(void *param)
+{
+	struct audio_output *audio = param;
+
+	os_set_thread_name("audio-io: worker thread");
+
+	while (os_sem_wait(audio->work_sem) == 0) {
+		if (os_atomic_load_bool(&audio->stop_workers))
+			break;
+
+		run_jobs(audio);
+		finish_work(audio);
+
+		profile_reenable_thread();
+	}
+
+	return NULL;
+}
+
+static void process_disconnects(struct audio_output *audio);
+
+static void do_audio_output(struct audio_output *audio, uint64_t timestamp)
+{
+	size_t num_workers;
+
+	pthread_mutex_lock(&audio->input_mutex);
+
+	audio->num_jobs = 0;
+
+	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
+		if (audio->mixes[mix_idx].inputs.num)
+			audio->jobs[audio->num_jobs++] = mix_idx;
+	}
+
+	if (!audio->num_jobs) {
+		pthread_mutex_unlock(&audio->input_mutex);
+		return;
+	}
+
+	num_workers = audio->num_jobs - 1;
+	if (num_workers > audio->num_workers)
+		num_workers = audio->num_workers;
+
+	/* every job and every woken worker counts down, whoever gets to zero
+	 * ends the tick */
+	audio->tick_ts = timestamp;
+	audio->next_job = 0;
+	audio->remaining = (long)(audio->num_jobs + num_workers);
+	os_atomic_set_bool(&audio->dispatching, true);
+
+	for (size_t i = 0; i < num_workers; i++)
+		os_sem_post(audio->work_sem);
+
+	run_jobs(audio);
+	os_event_wait(audio->done_event);
+
+	os_atomic_set_bool(&audio->dispatching, false);
+	process_disconnects(audio);
 
 	pthread_mutex_unlock(&audio->input_mutex);
 }
@@ -234,8 +346,7 @@ static void input_and_output(struct audio_output *audio,
 	clamp_audio_output(audio, bytes);
 
 	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	do_audio_output(audio, new_ts);
 }
 
 static void *audio_thread(void *param)
@@ -372,23 +483,99 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 	return success;
 }
 
-void audio_output_disconnect(audio_t *audio, size_t mix_idx,
+static void remove_input(struct audio_output *audio, size_t mix_idx,
 		audio_output_callback_t callback, void *param)
 {
-	if (!audio || mix_idx >= MAX_AUDIO_MIXES) return;
-
-	pthread_mutex_lock(&audio->input_mutex);
-
 	size_t idx = audio_get_input_idx(audio, mix_idx, callback, param);
 	if (idx != DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 		audio_input_free(mix->inputs.array+idx);
 		da_erase(mix->inputs, idx);
 	}
+}
+
+/* called with input_mutex held */
+static void process_disconnects(struct audio_output *audio)
+{
+	pthread_mutex_lock(&audio->disconnect_mutex);
+
+	for (size_t i = 0; i < audio->disconnects.num; i++) {
+		struct audio_disconnect *d = audio->disconnects.array+i;
+		remove_input(audio, d->mix_idx, d->callback, d->param);
+	}
+	da_resize(audio->disconnects, 0);
+
+	pthread_mutex_unlock(&audio->disconnect_mutex);
+}
+
+/* the audio thread holds input_mutex while the inputs are being called, so
+ * inputs that disconnect from their own callback are removed afterwards */
+static bool in_input_callback(struct audio_output *audio)
+{
+	pthread_t self = pthread_self();
+
+	if (!os_atomic_load_bool(&audio->dispatching))
+		return false;
+	if (pthread_equal(self, audio->thread))
+		return true;
+
+	for (size_t i = 0; i < audio->num_workers; i++) {
+		if (pthread_equal(self, audio->workers[i]))
+			return true;
+	}
+
+	return false;
+}
+
+void audio_output_disconnect(audio_t *audio, size_t mix_idx,
+		audio_output_callback_t callback, void *param)
+{
+	if (!audio || mix_idx >= MAX_AUDIO_MIXES) return;
+
+	if (in_input_callback(audio)) {
+		struct audio_disconnect d = {mix_idx, callback, param};
+
+		pthread_mutex_lock(&audio->disconnect_mutex);
+		da_push_back(audio->disconnects, &d);
+		pthread_mutex_unlock(&audio->disconnect_mutex);
+		return;
+	}
 
+	pthread_mutex_lock(&audio->input_mutex);
+	remove_input(audio, mix_idx, callback, param);
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
+static bool start_workers(struct audio_output *audio)
+{
+	int cores = os_get_logical_cores();
+	size_t num_workers = cores > 1 ? (size_t)(cores - 1) : 0;
+
+	if (num_workers > MAX_AUDIO_WORKERS)
+		num_workers = MAX_AUDIO_WORKERS;
+
+	for (size_t i = 0; i < num_workers; i++) {
+		if (pthread_create(&audio->workers[i], NULL, worker_thread,
+					audio) != 0)
+			return false;
+		audio->num_workers++;
+	}
+
+	return true;
+}
+
+static void stop_workers(struct audio_output *audio)
+{
+	os_atomic_set_bool(&audio->stop_workers, true);
+
+	for (size_t i = 0; i < audio->num_workers; i++)
+		os_sem_post(audio->work_sem);
+	for (size_t i = 0; i < audio->num_workers; i++)
+		pthread_join(audio->workers[i], NULL);
+
+	audio->num_workers = 0;
+}
+
 static inline bool valid_audio_params(const struct audio_output_info *info)
 {
 	return info->format && info->name && info->samples_per_sec > 0 &&
@@ -408,6 +595,9 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	if (!out)
 		goto fail;
 
+	pthread_mutex_init_value(&out->input_mutex);
+	pthread_mutex_init_value(&out->disconnect_mutex);
+
 	memcpy(&out->info, info, sizeof(struct audio_output_info));
 	out->channels   = get_audio_channels(info->speakers);
 	out->planes     = planar ? out->channels : 1;
@@ -422,8 +612,16 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->disconnect_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
+	if (os_event_init(&out->done_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (os_sem_init(&out->work_sem, 0) != 0)
+		goto fail;
+	if (!start_workers(out))
+		goto fail;
 	if (pthread_create(&out->thread, NULL, audio_thread, out) != 0)
 		goto fail;
 
@@ -448,6 +646,8 @@ void audio_output_close(audio_t *audio)
 		pthread_join(audio->thread, &thread_ret);
 	}
 
+	stop_workers(audio);
+
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
@@ -457,7 +657,12 @@ void audio_output_close(audio_t *audio)
 		da_free(mix->inputs);
 	}
 
+	da_free(audio->disconnects);
 	os_event_destroy(audio->stop_event);
+	os_event_destroy(audio->done_event);
+	os_sem_destroy(audio->work_sem);
+	pthread_mutex_destroy(&audio->input_mutex);
+	pthread_mutex_destroy(&audio->disconnect_mutex);
 	bfree(audio);
 }
 
@@ -19,16 +19,50 @@
 
 #include "../util/base.h"
 #include "../util/bmem.h"
+#include "../util/dstr.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #include <libavformat/avformat.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
+/*
+ * The input and output go through our own AVIOContexts with large buffers
+ * rather than the small default ones libavformat opens files with, so a
+ * multi gigabyte recording is read and written in a few thousand large
+ * requests instead of hundreds of thousands of small ones.
+ */
+#define REMUX_IO_BUFFER_SIZE (4 * 1024 * 1024)
+
+/*
+ * Rough size of the moov atom per packet (sample size, composition offset,
+ * chunk offset and sync sample entries) used to reserve space for it at the
+ * start of mp4/mov files.  The muxer then writes moov into that space when
+ * it finishes, so the file can start playing before it is fully downloaded
+ * without a faststart pass that moves the whole file.
+ */
+#define REMUX_MOOV_BYTES_PER_PACKET 24
+#define REMUX_MOOV_BASE_SIZE        (64 * 1024)
+
+#define REMUX_PROGRESS_INTERVAL_NS 100000000ULL
+
 struct media_remux_job {
 	int64_t in_size;
 	AVFormatContext *ifmt_ctx, *ofmt_ctx;
+
+	struct dstr in_filename;
+	struct dstr out_filename;
+
+	FILE *in_file, *out_file;
+	AVIOContext *in_pb, *out_pb;
+	int64_t moov_size;
+
+	int64_t bytes_done;
+	uint64_t start_ts;
+	volatile long eta_sec;
+	volatile bool cancel;
 };
 
 static inline void init_size(media_remux_job_t job, const char *in_filename)
@@ -43,9 +77,102 @@ static inline void init_size(media_remux_job_t job, const char *in_filename)
 	job->in_size = st.st_size;
 }
 
+/* ------------------------------------------------------------------------- */
+/* file I/O */
+
+static int file_read(void *opaque, uint8_t *buf, int buf_size)
+{
+	FILE *file = opaque;
+	size_t size = fread(buf, 1, (size_t)buf_size, file);
+
+	if (!size)
+		return ferror(file) ? AVERROR(EIO) : AVERROR_EOF;
+	return (int)size;
+}
+
+static int file_write(void *opaque, uint8_t *buf, int buf_size)
+{
+	FILE *file = opaque;
+	size_t size = fwrite(buf, 1, (size_t)buf_size, file);
+
+	return size == (size_t)buf_size ? buf_size : AVERROR(EIO);
+}
+
+static int64_t file_seek(void *opaque, int64_t offset, int whence)
+{
+	FILE *file = opaque;
+
+	if (whence & AVSEEK_SIZE) {
+		int64_t cur = os_ftelli64(file);
+		int64_t size;
+
+		os_fseeki64(file, 0, SEEK_END);
+		size = os_ftelli64(file);
+		os_fseeki64(file, cur, SEEK_SET);
+		return size;
+	}
+
+	if (os_fseeki64(file, offset, whence & ~AVSEEK_FORCE) != 0)
+		return AVERROR(EIO);
+	return os_ftelli64(file);
+}
+
+static AVIOContext *open_io(FILE **file, const char *filename, bool write)
+{
+	AVIOContext *pb;
+	uint8_t *buf;
+
+	*file = os_fopen(filename, write ? "wb" : "rb");
+	if (!*file)
+		return NULL;
+
+	/* all buffering happens in the AVIOContext */
+	setvbuf(*file, NULL, _IONBF, 0);
+
+	buf = av_malloc(REMUX_IO_BUFFER_SIZE);
+	if (!buf)
+		return NULL;
+
+	pb = avio_alloc_context(buf, REMUX_IO_BUFFER_SIZE, write ? 1 : 0,
+			*file, write ? NULL : file_read,
+			write ? file_write : NULL, file_seek);
+	if (!pb)
+		av_free(buf);
+	return pb;
+}
+
+static void close_io(AVIOContext **pb, FILE **file)
+{
+	if (*pb) {
+		if ((*pb)->write_flag)
+			avio_flush(*pb);
+		av_freep(&(*pb)->buffer);
+		av_freep(pb);
+	}
+
+	if (*file) {
+		fclose(*file);
+		*file = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline bool init_input(media_remux_job_t job, const char *in_filename)
 {
-	int ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
+	int ret;
+
+	job->in_pb = open_io(&job->in_file, in_filename, false);
+	job->ifmt_ctx = avformat_alloc_context();
+	if (!job->in_pb || !job->ifmt_ctx) {
+		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
+				in_filename);
+		return false;
+	}
+
+	job->ifmt_ctx->pb = job->in_pb;
+
+	ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
 				in_filename);
@@ -103,15 +230,81 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 #endif
 
 	if (!(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-		ret = avio_open(&job->ofmt_ctx->pb, out_filename,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
+		job->out_pb = open_io(&job->out_file, out_filename, true);
+		if (!job->out_pb) {
 			blog(LOG_ERROR, "media_remux: Failed to open output"
 					" file '%s'", out_filename);
 			return false;
 		}
+
+		job->ofmt_ctx->pb = job->out_pb;
+	}
+
+	return true;
+}
+
+static int64_t estimate_packets(AVStream *stream, int64_t duration)
+{
+	AVCodecContext *codec = stream->codec;
+	double seconds = (double)duration / AV_TIME_BASE;
+
+	if (stream->nb_frames > 0)
+		return stream->nb_frames;
+
+	if (codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+	    stream->avg_frame_rate.num && stream->avg_frame_rate.den)
+		return (int64_t)(seconds * av_q2d(stream->avg_frame_rate)) + 1;
+
+	if (codec->codec_type == AVMEDIA_TYPE_AUDIO && codec->sample_rate) {
+		int frame_size = codec->frame_size ? codec->frame_size : 1024;
+		return (int64_t)(seconds * codec->sample_rate / frame_size) + 1;
+	}
+
+	return -1;
+}
+
+/* returns 0 if there is no way to know how large moov is going to be */
+static int64_t estimate_moov_size(media_remux_job_t job)
+{
+	const char *name = job->ofmt_ctx->oformat->name;
+	int64_t duration = job->ifmt_ctx->duration;
+	int64_t packets = 0;
+
+	if (strcmp(name, "mov") != 0 && strcmp(name, "mp4") != 0)
+		return 0;
+	if (duration == AV_NOPTS_VALUE || duration <= 0)
+		return 0;
+
+	for (unsigned i = 0; i < job->ifmt_ctx->nb_streams; i++) {
+		int64_t num = estimate_packets(job->ifmt_ctx->streams[i],
+				duration);
+		if (num < 0)
+			return 0;
+		packets += num;
 	}
 
+	/* plenty of room for variable frame rates and estimation errors */
+	return REMUX_MOOV_BASE_SIZE +
+		packets * REMUX_MOOV_BYTES_PER_PACKET * 5 / 4;
+}
+
+static void close_job(media_remux_job_t job)
+{
+	avformat_close_input(&job->ifmt_ctx);
+	avformat_free_context(job->ofmt_ctx);
+	job->ofmt_ctx = NULL;
+
+	close_io(&job->in_pb, &job->in_file);
+	close_io(&job->out_pb, &job->out_file);
+}
+
+static bool open_job(media_remux_job_t job)
+{
+	if (!init_input(job, job->in_filename.array))
+		return false;
+	if (!init_output(job, job->out_filename.array))
+		return false;
+
 	return true;
 }
 
@@ -130,15 +323,16 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 		return false;
 
 	init_size(*job, in_filename);
+	dstr_copy(&(*job)->in_filename, in_filename);
+	dstr_copy(&(*job)->out_filename, out_filename);
+	(*job)->eta_sec = -1;
 
 	av_register_all();
 
-	if (!init_input(*job, in_filename))
-		goto fail;
-
-	if (!init_output(*job, out_filename))
+	if (!open_job(*job))
 		goto fail;
 
+	(*job)->moov_size = estimate_moov_size(*job);
 	return true;
 
 fail:
@@ -161,12 +355,44 @@ static inline void process_packet(AVPacket *pkt,
 
 }
 
+static void update_eta(media_remux_job_t job, uint64_t ts)
+{
+	double elapsed = (double)(ts - job->start_ts) / 1000000000.0;
+	double left;
+
+	if (job->bytes_done <= 0 || elapsed < 1.0)
+		return;
+
+	left = (double)(job->in_size - job->bytes_done) * elapsed /
+		(double)job->bytes_done;
+	os_atomic_set_long(&job->eta_sec, left > 0.0 ? (long)(left + 0.5) : 0);
+}
+
+static void report_progress(media_remux_job_t job,
+		media_remux_progress_callback callback, void *data,
+		uint64_t *last_ts)
+{
+	uint64_t ts = os_gettime_ns();
+	float progress;
+
+	if (ts - *last_ts < REMUX_PROGRESS_INTERVAL_NS)
+		return;
+
+	progress = job->bytes_done / (float)job->in_size * 100.f;
+	update_eta(job, ts);
+	*last_ts = ts;
+
+	if (!callback(data, progress))
+		os_atomic_set_bool(&job->cancel, true);
+}
+
 static inline int process_packets(media_remux_job_t job,
 		media_remux_progress_callback callback, void *data)
 {
+	uint64_t last_progress_ts = 0;
 	AVPacket pkt;
 
-	int ret, throttle = 0;
+	int ret;
 	for (;;) {
 		ret = av_read_frame(job->ifmt_ctx, &pkt);
 		if (ret < 0) {
@@ -177,11 +403,15 @@ static inline int process_packets(media_remux_job_t job,
 			break;
 		}
 
-		if (callback != NULL && throttle++ > 10) {
-			float progress = pkt.pos / (float)job->in_size * 100.f;
-			if (!callback(data, progress))
-				break;
-			throttle = 0;
+		if (pkt.pos > job->bytes_done)
+			job->bytes_done = pkt.pos;
+
+		if (callback != NULL)
+			report_progress(job, callback, data, &last_progress_ts);
+
+		if (os_atomic_load_bool(&job->cancel)) {
+			av_free_packet(&pkt);
+			break;
 		}
 
 		process_packet(&pkt, job->ifmt_ctx->streams[pkt.stream_index],
@@ -200,52 +430,261 @@ static inline int process_packets(media_remux_job_t job,
 	return ret;
 }
 
-bool media_remux_job_process(media_remux_job_t job,
-		media_remux_progress_callback callback, void *data)
+static bool remux(media_remux_job_t job,
+		media_remux_progress_callback callback, void *data,
+		bool *trailer_failed)
 {
+	AVDictionary *opts = NULL;
+	bool success;
 	int ret;
-	bool success = false;
 
-	if (!job)
-		return success;
+	*trailer_failed = false;
 
-	ret = avformat_write_header(job->ofmt_ctx, NULL);
+	if (job->moov_size)
+		av_dict_set_int(&opts, "moov_size", job->moov_size, 0);
+
+	ret = avformat_write_header(job->ofmt_ctx, &opts);
+	av_dict_free(&opts);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: Error opening output file: %s",
 				av_err2str(ret));
-		return success;
+		return false;
 	}
 
-	if (callback != NULL)
-		callback(data, 0.f);
-
 	ret = process_packets(job, callback, data);
-	success = ret >= 0 || ret == AVERROR_EOF;
+	success = (ret >= 0 || ret == AVERROR_EOF) &&
+		!os_atomic_load_bool(&job->cancel);
 
 	ret = av_write_trailer(job->ofmt_ctx);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: av_write_trailer: %s",
 				av_err2str(ret));
+		*trailer_failed = success;
 		success = false;
 	}
 
+	return success;
+}
+
+bool media_remux_job_process(media_remux_job_t job,
+		media_remux_progress_callback callback, void *data)
+{
+	bool trailer_failed;
+	bool success = false;
+
+	if (!job || !job->ofmt_ctx)
+		return success;
+
+	job->start_ts = os_gettime_ns();
+
+	if (callback != NULL)
+		callback(data, 0.f);
+
+	success = remux(job, callback, data, &trailer_failed);
+
+	/* the moov estimate was too small, so write it at the end instead */
+	if (trailer_failed && job->moov_size) {
+		blog(LOG_WARNING, "media_remux: Not enough space reserved for "
+				"moov, remuxing again without it");
+
+		close_job(job);
+		job->moov_size = 0;
+		job->bytes_done = 0;
+
+		success = open_job(job) &&
+			remux(job, callback, data, &trailer_failed);
+	}
+
+	os_atomic_set_long(&job->eta_sec, 0);
+
 	if (callback != NULL)
 		callback(data, 100.f);
 
 	return success;
 }
 
+void media_remux_job_cancel(media_remux_job_t job)
+{
+	if (job)
+		os_atomic_set_bool(&job->cancel, true);
+}
+
+long media_remux_job_get_eta(media_remux_job_t job)
+{
+	return job ? os_atomic_load_long(&job->eta_sec) : -1;
+}
+
 void media_remux_job_destroy(media_remux_job_t job)
 {
 	if (!job)
 		return;
 
-	avformat_close_input(&job->ifmt_ctx);
+	close_job(job);
 
-	if (job->ofmt_ctx && !(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-		avio_close(job->ofmt_ctx->pb);
+	dstr_free(&job->in_filename);
+	dstr_free(&job->out_filename);
+	bfree(job);
+}
 
-	avformat_free_context(job->ofmt_ctx);
+/* ------------------------------------------------------------------------- */
+/* batch */
+
+struct remux_batch {
+	media_remux_job_t             *jobs;
+	size_t                        num_jobs;
+	volatile long                 next_job;
+
+	pthread_mutex_t               mutex;
+	int64_t                       total_size;
+	int64_t                       *bytes_done;
+	uint64_t                      start_ts;
+	uint64_t                      last_progress_ts;
+	media_remux_progress_callback *callback;
+	void                          *data;
+	volatile bool                 cancel;
+	volatile bool                 failed;
+};
 
-	bfree(job);
+struct remux_batch_worker {
+	struct remux_batch *batch;
+	size_t             idx;
+};
+
+static void cancel_batch(struct remux_batch *batch)
+{
+	os_atomic_set_bool(&batch->cancel, true);
+
+	for (size_t i = 0; i < batch->num_jobs; i++)
+		media_remux_job_cancel(batch->jobs[i]);
+}
+
+static bool batch_progress(void *param, float percent)
+{
+	struct remux_batch_worker *worker = param;
+	struct remux_batch *batch = worker->batch;
+	media_remux_job_t job = batch->jobs[worker->idx];
+	int64_t done = 0;
+	uint64_t ts = os_gettime_ns();
+	double elapsed;
+	bool keep_going = true;
+
+	pthread_mutex_lock(&batch->mutex);
+
+	batch->bytes_done[worker->idx] = percent >= 100.f ?
+		job->in_size : job->bytes_done;
+	for (size_t i = 0; i < batch->num_jobs; i++)
+		done += batch->bytes_done[i];
+
+	/* the ETA of every job is the ETA of the whole batch */
+	elapsed = (double)(ts - batch->start_ts) / 1000000000.0;
+	if (done > 0 && elapsed >= 1.0) {
+		double left = (double)(batch->total_size - done) * elapsed /
+			(double)done;
+		long eta = left > 0.0 ? (long)(left + 0.5) : 0;
+
+		for (size_t i = 0; i < batch->num_jobs; i++)
+			os_atomic_set_long(&batch->jobs[i]->eta_sec, eta);
+	}
+
+	if (batch->callback &&
+	    ts - batch->last_progress_ts >= REMUX_PROGRESS_INTERVAL_NS) {
+		float total = batch->total_size ?
+			(float)done / (float)batch->total_size * 100.f : 0.f;
+
+		batch->last_progress_ts = ts;
+		keep_going = batch->callback(batch->data, total);
+	}
+
+	pthread_mutex_unlock(&batch->mutex);
+
+	if (!keep_going)
+		cancel_batch(batch);
+	return !os_atomic_load_bool(&batch->cancel);
+}
+
+static void *batch_thread(void *param)
+{
+	struct remux_batch *batch = param;
+
+	os_set_thread_name("media-remux: batch thread");
+
+	for (;;) {
+		long idx = os_atomic_inc_long(&batch->next_job) - 1;
+		struct remux_batch_worker worker = {batch, (size_t)idx};
+
+		if (idx >= (long)batch->num_jobs)
+			break;
+		if (os_atomic_load_bool(&batch->cancel))
+			continue;
+
+		if (!media_remux_job_process(batch->jobs[idx], batch_progress,
+					&worker))
+			os_atomic_set_bool(&batch->failed, true);
+	}
+
+	return NULL;
+}
+
+bool media_remux_batch_process(media_remux_job_t *jobs, size_t num_jobs,
+		size_t max_threads, media_remux_progress_callback callback,
+		void *data)
+{
+	struct remux_batch batch = {0};
+	pthread_t *threads;
+	size_t num_threads = 0;
+
+	if (!jobs || !num_jobs)
+		return false;
+
+	if (!max_threads) {
+		int cores = os_get_logical_cores();
+		max_threads = cores > 0 ? (size_t)cores : 1;
+	}
+	if (max_threads > num_jobs)
+		max_threads = num_jobs;
+
+	pthread_mutex_init_value(&batch.mutex);
+	if (pthread_mutex_init(&batch.mutex, NULL) != 0)
+		return false;
+
+	batch.jobs       = jobs;
+	batch.num_jobs   = num_jobs;
+	batch.bytes_done = bzalloc(sizeof(int64_t) * num_jobs);
+	batch.callback   = callback;
+	batch.data       = data;
+	batch.start_ts   = os_gettime_ns();
+
+	for (size_t i = 0; i < num_jobs; i++) {
+		if (!jobs[i])
+			batch.failed = true;
+		else
+			batch.total_size += jobs[i]->in_size;
+	}
+
+	if (callback != NULL)
+		callback(data, 0.f);
+
+	threads = bzalloc(sizeof(pthread_t) * max_threads);
+	for (size_t i = 0; i < max_threads; i++) {
+		if (pthread_create(&threads[i], NULL, batch_thread,
+					&batch) != 0)
+			break;
+		num_threads++;
+	}
+
+	/* no threads at all, do the work here */
+	if (!num_threads)
+		batch_thread(&batch);
+
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	if (callback != NULL)
+		callback(data, 100.f);
+
+	bfree(threads);
+	bfree(batch.bytes_done);
+	pthread_mutex_destroy(&batch.mutex);
+
+	return !batch.failed && !batch.cancel;
 }
@@ -34,6 +34,25 @@ EXPORT bool media_remux_job_process(media_remux_job_t job,
 		media_remux_progress_callback callback, void *data);
 EXPORT void media_remux_job_destroy(media_remux_job_t job);
 
+/** Stops a job being processed on another thread as soon as possible */
+EXPORT void media_remux_job_cancel(media_remux_job_t job);
+
+/**
+ * Returns the estimated number of seconds until the job (or the batch it is
+ * part of) finishes, or -1 if there is no estimate yet
+ */
+EXPORT long media_remux_job_get_eta(media_remux_job_t job);
+
+/**
+ * Processes several jobs at once on up to max_threads threads (0 for one per
+ * logical core).  The callback gets the progress of the whole batch and may
+ * be called from any of the threads, one call at a time.  Returns false if
+ * any job failed or the batch was cancelled.
+ */
+EXPORT bool media_remux_batch_process(media_remux_job_t *jobs,
+		size_t num_jobs, size_t max_threads,
+		media_remux_progress_callback callback, void *data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,7 @@
 #include "../util/profiler.h"
 #include "../util/threading.h"
 #include "../util/darray.h"
+#include "../util/circlebuf.h"
 
 #include "format-conversion.h"
 #include "video-io.h"
@@ -35,9 +36,29 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 struct cached_frame_info {
 	struct video_data frame;
 	int count;
+
+	/* number of input queues still holding the frame */
+	long refs;
+	bool pending;
+};
+
+struct queued_frame {
+	size_t   cache_idx;
+	uint64_t timestamp;
 };
 
+/*
+ * Each input is called from its own thread, so one slow input (such as an
+ * encoder at a slow preset) can't hold up the others.  Inputs get references
+ * to the cached frames rather than copies, and a cached frame is only reused
+ * once every input is done with it.  The number of frames an input may hold
+ * is bounded; when its queue is full, its oldest waiting frame is dropped to
+ * make room.  Inputs are also never allowed to hold every cache slot between
+ * them: the oldest waiting frames are dropped until one is free again, so
+ * slow inputs skip frames rather than every output.
+ */
 struct video_input {
+	struct video_output       *video;
 	struct video_scale_info   conversion;
 	video_scaler_t            *scaler;
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
@@ -45,14 +66,20 @@ struct video_input {
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
-};
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
+	pthread_t                 thread;
+	os_sem_t                  *frame_sem;
+	bool                      thread_active;
+	volatile bool             stop;
+	bool                      detached;
+
+	/* protected by the video output's data_mutex.  frames waiting for the
+	 * callback, the one being passed to it is no longer in the queue */
+	struct circlebuf          queue;
+	size_t                    max_queued;
+	uint32_t                  total_frames;
+	uint32_t                  skipped_frames;
+};
 
 struct video_output {
 	struct video_output_info   info;
@@ -69,16 +96,83 @@ struct video_output {
 	bool                       initialized;
 
 	pthread_mutex_t            input_mutex;
-	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_input*) inputs;
 
 	size_t                     available_frames;
-	size_t                     first_added;
 	size_t                     last_added;
 	struct cached_frame_info   cache[MAX_CACHE_SIZE];
+
+	/* cache slots waiting to be sent to the inputs, oldest first.  slots
+	 * are released in whatever order the inputs finish with them, so they
+	 * are not necessarily sent in cache order */
+	size_t                     pending[MAX_CACHE_SIZE];
+	size_t                     first_pending;
+	size_t                     num_pending;
 };
 
 /* ------------------------------------------------------------------------- */
 
+static inline bool frame_free(const struct cached_frame_info *cfi)
+{
+	return !cfi->pending && cfi->refs == 0;
+}
+
+/* called with data_mutex held */
+static void release_frame(struct video_output *video, size_t cache_idx)
+{
+	struct cached_frame_info *cfi = &video->cache[cache_idx];
+
+	if (--cfi->refs == 0 && !cfi->pending)
+		video->available_frames++;
+}
+
+static void release_queued_frames(struct video_input *input)
+{
+	struct video_output *video = input->video;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	while (input->queue.size) {
+		struct queued_frame qf;
+		circlebuf_pop_front(&input->queue, &qf, sizeof(qf));
+		release_frame(video, qf.cache_idx);
+	}
+
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+static void video_input_free(struct video_input *input)
+{
+	release_queued_frames(input);
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_free(&input->frame[i]);
+	video_scaler_destroy(input->scaler);
+	circlebuf_free(&input->queue);
+	os_sem_destroy(input->frame_sem);
+	bfree(input);
+}
+
+static void video_input_destroy(struct video_input *input)
+{
+	if (input->thread_active) {
+		input->stop = true;
+
+		if (pthread_equal(pthread_self(), input->thread)) {
+			input->detached = true;
+			pthread_detach(input->thread);
+			return;
+		}
+
+		os_sem_post(input->frame_sem);
+		pthread_join(input->thread, NULL);
+	}
+
+	video_input_free(input);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline bool scale_video_output(struct video_input *input,
 		struct video_data *data)
 {
@@ -110,49 +204,161 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
-static inline bool video_output_cur_frame(struct video_output *video)
+/* called with data_mutex held */
+static void drop_queued_frame(struct video_input *input)
 {
-	struct cached_frame_info *frame_info;
-	bool complete;
+	struct queued_frame qf;
 
-	/* -------------------------------- */
+	circlebuf_pop_front(&input->queue, &qf, sizeof(qf));
+	release_frame(input->video, qf.cache_idx);
+	input->skipped_frames++;
+}
 
-	pthread_mutex_lock(&video->data_mutex);
+/* called with data_mutex held */
+static void queue_frame(struct video_input *input, size_t cache_idx,
+		uint64_t timestamp)
+{
+	struct video_output *video = input->video;
+	struct queued_frame qf = {cache_idx, timestamp};
 
-	frame_info = &video->cache[video->first_added];
+	input->total_frames++;
 
-	pthread_mutex_unlock(&video->data_mutex);
+	if (input->queue.size / sizeof(qf) >= input->max_queued)
+		drop_queued_frame(input);
 
-	/* -------------------------------- */
+	circlebuf_push_back(&input->queue, &qf, sizeof(qf));
+	video->cache[cache_idx].refs++;
+	os_sem_post(input->frame_sem);
+}
 
-	pthread_mutex_lock(&video->input_mutex);
+/* drops the oldest frame still waiting in any input's queue, called with
+ * input_mutex and data_mutex held.  frames being passed to a callback can't
+ * be dropped */
+static bool drop_oldest_queued_frame(struct video_output *video)
+{
+	struct video_input *oldest = NULL;
+	uint64_t oldest_ts = 0;
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array+i;
-		struct video_data frame = frame_info->frame;
+		struct video_input *input = video->inputs.array[i];
+		struct queued_frame qf;
+
+		if (!input->queue.size)
+			continue;
 
+		circlebuf_peek_front(&input->queue, &qf, sizeof(qf));
+		if (!oldest || qf.timestamp < oldest_ts) {
+			oldest = input;
+			oldest_ts = qf.timestamp;
+		}
+	}
+
+	if (!oldest)
+		return false;
+
+	drop_queued_frame(oldest);
+	return true;
+}
+
+static void *input_thread(void *param)
+{
+	struct video_input *input = param;
+	struct video_output *video = input->video;
+
+	os_set_thread_name("video-io: input thread");
+
+	const char *input_thread_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				"input_thread(%s)", video->info.name);
+
+	while (os_sem_wait(input->frame_sem) == 0) {
+		struct queued_frame qf;
+		struct video_data frame;
+
+		if (input->stop)
+			break;
+
+		/* frames dropped from the queue leave their posts behind */
+		pthread_mutex_lock(&video->data_mutex);
+		if (!input->queue.size) {
+			pthread_mutex_unlock(&video->data_mutex);
+			continue;
+		}
+
+		circlebuf_pop_front(&input->queue, &qf, sizeof(qf));
+		frame = video->cache[qf.cache_idx].frame;
+		pthread_mutex_unlock(&video->data_mutex);
+
+		frame.timestamp = qf.timestamp;
+
+		profile_start(input_thread_name);
 		if (scale_video_output(input, &frame))
 			input->callback(input->param, &frame);
+		profile_end(input_thread_name);
+
+		/* the frame stays referenced until the callback returns */
+		pthread_mutex_lock(&video->data_mutex);
+		release_frame(video, qf.cache_idx);
+		pthread_mutex_unlock(&video->data_mutex);
+
+		profile_reenable_thread();
+
+		if (input->stop)
+			break;
 	}
 
-	pthread_mutex_unlock(&video->input_mutex);
+	/* the input was disconnected from within its own callback */
+	if (input->detached)
+		video_input_free(input);
+
+	return NULL;
+}
+
+static inline bool video_output_cur_frame(struct video_output *video)
+{
+	struct cached_frame_info *frame_info;
+	size_t cache_idx;
+	bool complete;
 
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->data_mutex);
 
+	cache_idx = video->pending[video->first_pending];
+	frame_info = &video->cache[cache_idx];
+
+	pthread_mutex_unlock(&video->data_mutex);
+
+	/* -------------------------------- */
+
+	pthread_mutex_lock(&video->input_mutex);
+	pthread_mutex_lock(&video->data_mutex);
+
+	for (size_t i = 0; i < video->inputs.num; i++)
+		queue_frame(video->inputs.array[i], cache_idx,
+				frame_info->frame.timestamp);
+
 	frame_info->frame.timestamp += video->frame_time;
 	complete = --frame_info->count == 0;
 
 	if (complete) {
-		if (++video->first_added == video->info.cache_size)
-			video->first_added = 0;
+		if (++video->first_pending == video->info.cache_size)
+			video->first_pending = 0;
+		video->num_pending--;
+
+		frame_info->pending = false;
+		if (frame_info->refs == 0)
+			video->available_frames++;
+	}
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+	/* keep a slot free for the next frame to be rendered into */
+	while (!video->available_frames) {
+		if (!drop_oldest_queued_frame(video))
+			break;
 	}
 
 	pthread_mutex_unlock(&video->data_mutex);
+	pthread_mutex_unlock(&video->input_mutex);
 
 	/* -------------------------------- */
 
@@ -260,7 +466,7 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_destroy(video->inputs.array[i]);
 	da_free(video->inputs);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
@@ -277,7 +483,7 @@ static size_t video_get_input_idx(const video_t *video,
 		void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array+i;
+		struct video_input *input = video->inputs.array[i];
 		if (input->callback == callback && input->param == param)
 			return i;
 	}
@@ -288,6 +494,8 @@ static size_t video_get_input_idx(const video_t *video,
 static inline bool video_input_init(struct video_input *input,
 		struct video_output *video)
 {
+	input->video = video;
+
 	if (input->conversion.width  != video->info.width ||
 	    input->conversion.height != video->info.height ||
 	    input->conversion.format != video->info.format) {
@@ -318,6 +526,16 @@ static inline bool video_input_init(struct video_input *input,
 					input->conversion.height);
 	}
 
+	input->max_queued = video->info.cache_size / 2;
+	if (!input->max_queued)
+		input->max_queued = 1;
+
+	if (os_sem_init(&input->frame_sem, 0) != 0)
+		return false;
+	if (pthread_create(&input->thread, NULL, input_thread, input) != 0)
+		return false;
+
+	input->thread_active = true;
 	return true;
 }
 
@@ -334,28 +552,29 @@ bool video_output_connect(video_t *video,
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param    = param;
+		input->callback = callback;
+		input->param    = param;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format    = video->info.format;
-			input.conversion.width     = video->info.width;
-			input.conversion.height    = video->info.height;
+			input->conversion.format    = video->info.format;
+			input->conversion.width     = video->info.width;
+			input->conversion.height    = video->info.height;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
 
-		success = video_input_init(&input, video);
+		success = video_input_init(input, video);
 		if (success)
 			da_push_back(video->inputs, &input);
+		else
+			video_input_destroy(input);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -370,15 +589,49 @@ void video_output_disconnect(video_t *video,
 	if (!video || !callback)
 		return;
 
+	struct video_input *input = NULL;
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array+idx);
+		input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	/* wait for the callback outside of the lock so other inputs keep
+	 * receiving frames */
+	if (input)
+		video_input_destroy(input);
+}
+
+bool video_output_get_input_frames(video_t *video,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param, uint32_t *total, uint32_t *skipped)
+{
+	bool found = false;
+
+	if (!video || !callback)
+		return false;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input *input = video->inputs.array[idx];
+
+		pthread_mutex_lock(&video->data_mutex);
+		*total   = input->total_frames;
+		*skipped = input->skipped_frames;
+		pthread_mutex_unlock(&video->data_mutex);
+		found = true;
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return found;
 }
 
 bool video_output_active(const video_t *video)
@@ -404,18 +657,29 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 
 	if (video->available_frames == 0) {
 		video->skipped_frames += count;
-		video->cache[video->last_added].count += count;
+
+		/* the newest frame may already have been sent and only be
+		 * waiting for inputs to release it */
+		if (video->num_pending)
+			video->cache[video->last_added].count += count;
 		locked = false;
 
 	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
+		size_t idx = video->first_pending + video->num_pending;
+		if (idx >= video->info.cache_size)
+			idx -= video->info.cache_size;
+
+		video->last_added = 0;
+		while (!frame_free(&video->cache[video->last_added]))
+			video->last_added++;
+
+		video->pending[idx] = video->last_added;
+		video->num_pending++;
 
 		cfi = &video->cache[video->last_added];
 		cfi->frame.timestamp = timestamp;
 		cfi->count = count;
+		cfi->pending = true;
 
 		memcpy(frame, &cfi->frame, sizeof(*frame));
 
@@ -444,6 +708,16 @@ uint64_t video_output_get_frame_time(const video_t *video)
 	return video ? video->frame_time : 0;
 }
 
+int64_t video_output_get_frame_index(const video_t *video, uint64_t start_ts,
+		uint64_t timestamp)
+{
+	if (!video || !video->frame_time || timestamp <= start_ts)
+		return 0;
+
+	return (int64_t)((timestamp - start_ts + video->frame_time / 2) /
+			video->frame_time);
+}
+
 void video_output_stop(video_t *video)
 {
 	void *thread_ret;
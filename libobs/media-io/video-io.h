@@ -161,6 +161,14 @@ EXPORT void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
 
+/**
+ * Gets the number of frames sent to a connected input, and how many of those
+ * were skipped because the input was still busy with earlier frames.
+ */
+EXPORT bool video_output_get_input_frames(video_t *video,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param, uint32_t *total, uint32_t *skipped);
+
 EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *video_output_get_info(
@@ -169,6 +177,15 @@ EXPORT bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 		int count, uint64_t timestamp);
 EXPORT void video_output_unlock_frame(video_t *video);
 EXPORT uint64_t video_output_get_frame_time(const video_t *video);
+
+/**
+ * Gets the position of a frame on the video output's clock, in frames since
+ * the frame at start_ts.  Inputs that skip frames use this rather than
+ * counting the frames they receive, so a skipped frame leaves a gap instead
+ * of shifting every frame after it.
+ */
+EXPORT int64_t video_output_get_frame_index(const video_t *video,
+		uint64_t start_ts, uint64_t timestamp);
 EXPORT void video_output_stop(video_t *video);
 EXPORT bool video_output_stopped(video_t *video);
 
@@ -347,6 +347,67 @@ static inline void calc_min_ts(struct obs_core_data *data,
 		find_min_ts(data, min_ts);
 }
 
+struct audio_render_job {
+	struct obs_core_audio *audio;
+	uint32_t mixers;
+	size_t channels;
+	size_t sample_rate;
+	size_t size;
+};
+
+static void render_leaf_audio(void *param, size_t idx)
+{
+	struct audio_render_job *job = param;
+	obs_source_t *source = job->audio->leaf_nodes.array[idx];
+
+	obs_source_audio_render(source, job->mixers, job->channels,
+			job->sample_rate, job->size);
+}
+
+/* leaf sources only touch their own buffers, so they can be rendered in any
+ * order or concurrently.  composite sources read the output of the sources
+ * below them, and they are always after those in the render order, so
+ * rendering all leaves first and then the composites in their original
+ * relative order produces exactly the same output as the serial path.
+ *
+ * for a leaf this is copying its buffered audio to each mix and applying the
+ * volume.  audio filters are not run here, they already run on the thread
+ * that outputs the audio (see obs_source_output_audio), so sources are
+ * filtered concurrently with each other regardless of this. */
+static void render_audio_sources(struct obs_core_audio *audio,
+		uint32_t mixers, size_t channels, size_t sample_rate,
+		size_t size)
+{
+	struct audio_render_job job = {audio, mixers, channels, sample_rate,
+		size};
+
+	da_resize(audio->leaf_nodes, 0);
+	da_resize(audio->composite_nodes, 0);
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+
+		if (source->info.audio_render)
+			da_push_back(audio->composite_nodes, &source);
+		else
+			da_push_back(audio->leaf_nodes, &source);
+	}
+
+	if (audio->leaf_nodes.num >= MIN_PARALLEL_AUDIO_SOURCES) {
+		task_pool_run(audio->render_pool, audio->leaf_nodes.num,
+				render_leaf_audio, &job);
+	} else {
+		for (size_t i = 0; i < audio->leaf_nodes.num; i++)
+			render_leaf_audio(&job, i);
+	}
+
+	for (size_t i = 0; i < audio->composite_nodes.num; i++) {
+		obs_source_t *source = audio->composite_nodes.array[i];
+		obs_source_audio_render(source, mixers, channels, sample_rate,
+				size);
+	}
+}
+
 static inline void release_audio_sources(struct obs_core_audio *audio)
 {
 	for (size_t i = 0; i < audio->render_order.num; i++)
@@ -405,11 +466,7 @@ bool audio_callback(void *param,
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate,
-				audio_size);
-	}
+	render_audio_sources(audio, mixers, channels, sample_rate, audio_size);
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
@@ -19,21 +19,55 @@
 #include "obs.h"
 #include "obs-internal.h"
 
+static volatile long display_count = 0;
+
+/* the device displays are presented on */
+static inline graphics_t *present_graphics(void)
+{
+	struct obs_core_video *video = &obs->video;
+	return video->display_thread_active ?
+		video->display_graphics : video->graphics;
+}
+
+/* must be called with the graphics context of the device held */
+static inline bool create_swap(struct obs_display *display,
+		graphics_t *graphics)
+{
+	display->swap_data.cx = display->cx;
+	display->swap_data.cy = display->cy;
+	display->swap = gs_swapchain_create(&display->swap_data);
+	display->swap_graphics = display->swap ? graphics : NULL;
+	display->size_changed = false;
+	return display->swap != NULL;
+}
+
 bool obs_display_init(struct obs_display *display,
 		const struct gs_init_data *graphics_data)
 {
 	pthread_mutex_init_value(&display->draw_callbacks_mutex);
 
+	display->profile_name = profile_store_name(
+			obs_get_profiler_name_store(), "render_display(%ld)",
+			os_atomic_inc_long(&display_count));
+
 	if (graphics_data) {
-		display->swap = gs_swapchain_create(graphics_data);
-		if (!display->swap) {
+		graphics_t *graphics = present_graphics();
+		bool success;
+
+		display->swap_data     = *graphics_data;
+		display->has_swap_data = true;
+		display->cx            = graphics_data->cx;
+		display->cy            = graphics_data->cy;
+
+		gs_enter_context(graphics);
+		success = create_swap(display, graphics);
+		gs_leave_context();
+
+		if (!success) {
 			blog(LOG_ERROR, "obs_display_init: Failed to "
 			                "create swap chain");
 			return false;
 		}
-
-		display->cx = graphics_data->cx;
-		display->cy = graphics_data->cy;
 	}
 
 	if (pthread_mutex_init(&display->draw_callbacks_mutex, NULL) != 0) {
@@ -50,8 +84,6 @@ obs_display_t *obs_display_create(const struct gs_init_data *graphics_data)
 {
 	struct obs_display *display = bzalloc(sizeof(struct obs_display));
 
-	gs_enter_context(obs->video.graphics);
-
 	if (!obs_display_init(display, graphics_data)) {
 		obs_display_destroy(display);
 		display = NULL;
@@ -65,22 +97,105 @@ obs_display_t *obs_display_create(const struct gs_init_data *graphics_data)
 		pthread_mutex_unlock(&obs->data.displays_mutex);
 	}
 
-	gs_leave_context();
-
 	return display;
 }
 
+static void obs_display_free_threaded(struct obs_display *display);
+
 void obs_display_free(obs_display_t *display)
 {
+	if (display->lagged_frames)
+		blog(LOG_INFO, "%s: Output lagged %ld frame(s) while this "
+				"display was the slowest to render",
+				display->profile_name, display->lagged_frames);
+
 	pthread_mutex_destroy(&display->draw_callbacks_mutex);
 	da_free(display->draw_callbacks);
 
+	obs_display_free_threaded(display);
+
 	if (display->swap) {
+		gs_enter_context(display->swap_graphics);
 		gs_swapchain_destroy(display->swap);
+		gs_leave_context();
+
 		display->swap = NULL;
+		display->swap_graphics = NULL;
 	}
 }
 
+/* with the display device's context held: frees the texture frames are
+ * uploaded to */
+void obs_display_free_present(struct obs_display *display)
+{
+	gs_texture_destroy(display->present_tex);
+	display->present_tex = NULL;
+	display->frame_ready = false;
+}
+
+/* with the main graphics context held: frees the draw target and its
+ * readback */
+void obs_display_free_readback(struct obs_display *display)
+{
+	gs_texrender_destroy(display->texrender);
+	gs_stagesurface_destroy(display->stage);
+	display->texrender     = NULL;
+	display->stage         = NULL;
+	display->stage_pending = false;
+
+	bfree(display->frame);
+	display->frame       = NULL;
+	display->frame_size  = 0;
+	display->frame_ready = false;
+}
+
+/* frees what presenting from the display thread used, from outside of any
+ * graphics context */
+static void obs_display_free_threaded(struct obs_display *display)
+{
+	struct obs_core_video *video = &obs->video;
+
+	if (display->present_tex) {
+		gs_enter_context(video->display_graphics);
+		obs_display_free_present(display);
+		gs_leave_context();
+	}
+
+	if (display->texrender || display->stage) {
+		gs_enter_context(video->graphics);
+		obs_display_free_readback(display);
+		gs_leave_context();
+	}
+}
+
+/* a window can only have one swap chain at a time, so moving a display to
+ * another device destroys the swap chain with the old device's context held
+ * and then creates it with the new one's.  in between, neither thread
+ * presents the display */
+void obs_display_destroy_swap(struct obs_display *display)
+{
+	if (display->swap) {
+		gs_swapchain_destroy(display->swap);
+		display->swap = NULL;
+		display->swap_graphics = NULL;
+	}
+}
+
+void obs_display_create_swap(struct obs_display *display,
+		graphics_t *graphics)
+{
+	if (!display->has_swap_data || display->swap)
+		return;
+
+	pthread_mutex_lock(&display->draw_callbacks_mutex);
+
+	if (!create_swap(display, graphics))
+		blog(LOG_ERROR, "obs_display_create_swap: Failed to "
+		                "create swap chain");
+
+	pthread_mutex_unlock(&display->draw_callbacks_mutex);
+}
+
 void obs_display_destroy(obs_display_t *display)
 {
 	if (display) {
@@ -91,9 +206,7 @@ void obs_display_destroy(obs_display_t *display)
 			display->next->prev_next = display->prev_next;
 		pthread_mutex_unlock(&obs->data.displays_mutex);
 
-		obs_enter_graphics();
 		obs_display_free(display);
-		obs_leave_graphics();
 
 		bfree(display);
 	}
@@ -138,18 +251,19 @@ void obs_display_remove_draw_callback(obs_display_t *display,
 	pthread_mutex_unlock(&display->draw_callbacks_mutex);
 }
 
-static inline void render_display_begin(struct obs_display *display)
+static inline void load_display_swapchain(struct obs_display *display)
 {
-	struct vec4 clear_color;
-
-	gs_load_swapchain(display ? display->swap : NULL);
+	gs_load_swapchain(display->swap);
 
 	if (display->size_changed) {
 		gs_resize(display->cx, display->cy);
 		display->size_changed = false;
 	}
+}
 
-	gs_begin_scene();
+static inline void clear_display(struct obs_display *display)
+{
+	struct vec4 clear_color;
 
 	vec4_from_rgba(&clear_color, display->background_color);
 	clear_color.w = 1.0f;
@@ -166,18 +280,39 @@ static inline void render_display_begin(struct obs_display *display)
 	gs_set_viewport(0, 0, display->cx, display->cy);
 }
 
+static inline void render_display_begin(struct obs_display *display)
+{
+	load_display_swapchain(display);
+	gs_begin_scene();
+	clear_display(display);
+}
+
 static inline void render_display_end()
 {
 	gs_end_scene();
 	gs_present();
 }
 
-void render_display(struct obs_display *display)
+/* frames are allowed to be presented slightly early so that a limit which
+ * is a divisor of the render rate isn't missed due to timing jitter */
+static inline bool display_present_due(struct obs_display *display,
+		uint64_t cur_time)
 {
-	if (!display || !display->enabled) return;
+	uint64_t interval = display->present_interval;
 
-	render_display_begin(display);
+	if (!interval)
+		return true;
+	if (cur_time + interval / 4 < display->next_present_time)
+		return false;
 
+	display->next_present_time += interval;
+	if (display->next_present_time < cur_time)
+		display->next_present_time = cur_time;
+	return true;
+}
+
+static inline void draw_display(struct obs_display *display)
+{
 	pthread_mutex_lock(&display->draw_callbacks_mutex);
 
 	for (size_t i = 0; i < display->draw_callbacks.num; i++) {
@@ -188,6 +323,171 @@ void render_display(struct obs_display *display)
 	}
 
 	pthread_mutex_unlock(&display->draw_callbacks_mutex);
+}
+
+static inline bool display_visible(struct obs_display *display)
+{
+	return display && display->enabled && !display->occluded &&
+		display->cx && display->cy;
+}
+
+void render_display(struct obs_display *display)
+{
+	uint64_t start_time;
+
+	if (!display_visible(display))
+		return;
+	if (display->has_swap_data &&
+	    display->swap_graphics != obs->video.graphics)
+		return;
+
+	start_time = os_gettime_ns();
+	if (!display_present_due(display, start_time))
+		return;
+
+	profile_start(display->profile_name);
+
+	render_display_begin(display);
+	draw_display(display);
+	render_display_end();
+
+	profile_end(display->profile_name);
+
+	display->last_render_time = os_gettime_ns() - start_time;
+}
+
+/* copies the frame read back from the main device so that it can be
+ * uploaded on the display device.  fails if the readback hasn't finished */
+static bool read_display_stage(struct obs_display *display)
+{
+	uint8_t *data;
+	uint32_t linesize;
+	size_t size;
+
+	if (!gs_stagesurface_map(display->stage, &data, &linesize))
+		return false;
+
+	size = (size_t)linesize * display->stage_cy;
+	if (size > display->frame_size) {
+		display->frame = brealloc(display->frame, size);
+		display->frame_size = size;
+	}
+
+	memcpy(display->frame, data, size);
+	gs_stagesurface_unmap(display->stage);
+
+	display->frame_cx       = display->stage_cx;
+	display->frame_cy       = display->stage_cy;
+	display->frame_linesize = linesize;
+	display->frame_ready    = true;
+	display->stage_pending  = false;
+	return true;
+}
+
+static inline bool reset_display_stage(struct obs_display *display)
+{
+	if (display->stage && display->stage_cx == display->cx &&
+	    display->stage_cy == display->cy)
+		return true;
+
+	gs_stagesurface_destroy(display->stage);
+	display->stage = gs_stagesurface_create(display->cx, display->cy,
+			GS_RGBA);
+	display->stage_cx = display->cx;
+	display->stage_cy = display->cy;
+	return display->stage != NULL;
+}
+
+/* threaded displays, main graphics context: picks up the frame drawn last
+ * time, then runs the draw callbacks into a texture and starts reading it
+ * back.  presenting happens later on the display device, see
+ * present_display_texture */
+void render_display_texture(struct obs_display *display)
+{
+	uint64_t start_time;
+	gs_texture_t *tex;
+
+	if (!display_visible(display) || !display->swap)
+		return;
+
+	/* the readback is never overwritten before it has been picked up */
+	if (display->stage_pending && !read_display_stage(display))
+		return;
+
+	start_time = os_gettime_ns();
+	if (!display_present_due(display, start_time))
+		return;
+
+	if (!display->texrender)
+		display->texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	profile_start(display->profile_name);
+
+	gs_texrender_reset(display->texrender);
+	if (gs_texrender_begin(display->texrender, display->cx,
+				display->cy)) {
+		clear_display(display);
+		draw_display(display);
+		gs_texrender_end(display->texrender);
+
+		tex = gs_texrender_get_texture(display->texrender);
+		if (tex && reset_display_stage(display)) {
+			gs_stage_texture(display->stage, tex);
+			display->stage_pending = true;
+		}
+	}
+
+	profile_end(display->profile_name);
+
+	display->last_render_time = os_gettime_ns() - start_time;
+}
+
+static inline bool reset_present_texture(struct obs_display *display)
+{
+	gs_texture_t *tex = display->present_tex;
+
+	if (tex && gs_texture_get_width(tex) == display->frame_cx &&
+	    gs_texture_get_height(tex) == display->frame_cy)
+		return true;
+
+	gs_texture_destroy(tex);
+	display->present_tex = gs_texture_create(display->frame_cx,
+			display->frame_cy, GS_RGBA, 1, NULL, GS_DYNAMIC);
+	return display->present_tex != NULL;
+}
+
+/* threaded displays, display device context: uploads the frame read back
+ * from the main device and presents it */
+void present_display_texture(struct obs_display *display)
+{
+	gs_effect_t *effect = obs->video.display_effect;
+
+	if (!display->frame_ready || !display->swap)
+		return;
+
+	display->frame_ready = false;
+	if (!reset_present_texture(display))
+		return;
+
+	gs_texture_set_image(display->present_tex, display->frame,
+			display->frame_linesize, false);
+
+	load_display_swapchain(display);
+	gs_begin_scene();
+
+	gs_enable_depth_test(false);
+	gs_set_cull_mode(GS_NEITHER);
+	gs_ortho(0.0f, (float)display->cx, 0.0f, (float)display->cy,
+			-100.0f, 100.0f);
+	gs_set_viewport(0, 0, display->cx, display->cy);
+
+	gs_enable_blending(false);
+
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
+			display->present_tex);
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite(display->present_tex, 0, display->cx,
+				display->cy);
 
 	render_display_end();
 }
@@ -208,3 +508,30 @@ void obs_display_set_background_color(obs_display_t *display, uint32_t color)
 	if (display)
 		display->background_color = color;
 }
+
+void obs_display_set_fps_limit(obs_display_t *display, uint32_t fps)
+{
+	if (!display) return;
+
+	display->present_interval = fps ? 1000000000ULL / fps : 0;
+	display->next_present_time = 0;
+}
+
+uint32_t obs_display_get_fps_limit(obs_display_t *display)
+{
+	if (!display || !display->present_interval)
+		return 0;
+
+	return (uint32_t)(1000000000ULL / display->present_interval);
+}
+
+void obs_display_set_occluded(obs_display_t *display, bool occluded)
+{
+	if (display)
+		display->occluded = occluded;
+}
+
+uint32_t obs_display_get_lagged_frames(obs_display_t *display)
+{
+	return display ? (uint32_t)display->lagged_frames : 0;
+}
@@ -23,7 +23,7 @@
 #define set_encoder_active(encoder, val) \
 	os_atomic_set_bool(&encoder->active, val)
 
-struct obs_encoder_info *find_encoder(const char *id)
+static struct obs_encoder_info *find_encoder_info(const char *id)
 {
 	for (size_t i = 0; i < obs->encoder_types.num; i++) {
 		struct obs_encoder_info *info = obs->encoder_types.array+i;
@@ -35,9 +35,33 @@ struct obs_encoder_info *find_encoder(const char *id)
 	return NULL;
 }
 
+struct obs_encoder_info *find_encoder(const char *id)
+{
+	struct obs_encoder_info *info = find_encoder_info(id);
+	if (!info && obs_load_deferred_module(MODULE_KIND_ENCODER, id))
+		info = find_encoder_info(id);
+	return info;
+}
+
+/* listing encoders uses these queries, so deferred modules are not loaded
+ * for them while their types are in the module manifest */
+static inline const struct module_type_id *find_deferred_encoder(
+		const char *id)
+{
+	return find_encoder_info(id) ? NULL :
+		obs_find_deferred_type(MODULE_KIND_ENCODER, id);
+}
+
 const char *obs_encoder_get_display_name(const char *id)
 {
-	struct obs_encoder_info *ei = find_encoder(id);
+	const struct module_type_id *type = find_deferred_encoder(id);
+	const char *name = obs_get_deferred_type_name(type);
+	struct obs_encoder_info *ei;
+
+	if (name)
+		return name;
+
+	ei = find_encoder(id);
 	return ei ? ei->get_name(ei->type_data) : NULL;
 }
 
@@ -48,7 +72,10 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 
 	pthread_mutex_init_value(&encoder->init_mutex);
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
+	pthread_mutex_init_value(&encoder->slice_callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
+	pthread_mutex_init_value(&encoder->encode_mutex);
+	pthread_mutex_init_value(&encoder->pending_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -61,8 +88,14 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->callbacks_mutex, &attr) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->slice_callbacks_mutex, NULL) != 0)
+		return false;
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->encode_mutex, NULL) != 0)
+		return false;
+	if (pthread_mutex_init(&encoder->pending_mutex, NULL) != 0)
+		return false;
 
 	if (encoder->info.get_defaults)
 		encoder->info.get_defaults(encoder->context.settings);
@@ -236,9 +269,14 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
 		da_free(encoder->callbacks);
+		da_free(encoder->slice_callbacks);
 		pthread_mutex_destroy(&encoder->init_mutex);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
+		pthread_mutex_destroy(&encoder->slice_callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		pthread_mutex_destroy(&encoder->encode_mutex);
+		pthread_mutex_destroy(&encoder->pending_mutex);
+		obs_data_release(encoder->pending_settings);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
 			bfree((void*)encoder->info.id);
@@ -329,11 +367,67 @@ void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings)
 	if (!obs_encoder_valid(encoder, "obs_encoder_update"))
 		return;
 
+	/* never reconfigure the encoder in the middle of an encode call */
+	pthread_mutex_lock(&encoder->encode_mutex);
+
 	obs_data_apply(encoder->context.settings, settings);
 
 	if (encoder->info.update && encoder->context.data)
 		encoder->info.update(encoder->context.data,
 				encoder->context.settings);
+
+	pthread_mutex_unlock(&encoder->encode_mutex);
+}
+
+void obs_encoder_queue_update(obs_encoder_t *encoder, obs_data_t *settings)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_queue_update"))
+		return;
+
+	if (!encoder->active) {
+		obs_encoder_update(encoder, settings);
+		return;
+	}
+
+	pthread_mutex_lock(&encoder->pending_mutex);
+
+	if (!encoder->pending_settings)
+		encoder->pending_settings = obs_data_create();
+	obs_data_apply(encoder->pending_settings, settings);
+
+	pthread_mutex_unlock(&encoder->pending_mutex);
+}
+
+/* applies settings queued with obs_encoder_queue_update, between frames on
+ * the thread that encodes */
+static inline void apply_pending_settings(struct obs_encoder *encoder)
+{
+	obs_data_t *settings;
+
+	pthread_mutex_lock(&encoder->pending_mutex);
+	settings = encoder->pending_settings;
+	encoder->pending_settings = NULL;
+	pthread_mutex_unlock(&encoder->pending_mutex);
+
+	if (settings) {
+		obs_encoder_update(encoder, settings);
+		obs_data_release(settings);
+	}
+}
+
+size_t obs_encoder_get_active_output_count(const obs_encoder_t *encoder)
+{
+	size_t count;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_active_output_count"))
+		return 0;
+
+	/* each started output receives packets through its own callback */
+	pthread_mutex_lock((pthread_mutex_t*)&encoder->callbacks_mutex);
+	count = encoder->callbacks.num;
+	pthread_mutex_unlock((pthread_mutex_t*)&encoder->callbacks_mutex);
+
+	return count;
 }
 
 bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
@@ -534,6 +628,91 @@ void obs_encoder_stop(obs_encoder_t *encoder,
 		pthread_mutex_unlock(&encoder->init_mutex);
 }
 
+static inline size_t get_slice_callback_idx(
+		const struct obs_encoder *encoder,
+		void (*new_slice)(void *param, struct encoder_slice *slice),
+		void *param)
+{
+	for (size_t i = 0; i < encoder->slice_callbacks.num; i++) {
+		struct encoder_slice_callback *cb =
+			encoder->slice_callbacks.array+i;
+
+		if (cb->new_slice == new_slice && cb->param == param)
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+void obs_encoder_add_slice_callback(obs_encoder_t *encoder,
+		void (*new_slice)(void *param, struct encoder_slice *slice),
+		void *param)
+{
+	struct encoder_slice_callback cb = {new_slice, param};
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_add_slice_callback"))
+		return;
+
+	pthread_mutex_lock(&encoder->slice_callbacks_mutex);
+	if (get_slice_callback_idx(encoder, new_slice, param) ==
+			DARRAY_INVALID)
+		da_push_back(encoder->slice_callbacks, &cb);
+	pthread_mutex_unlock(&encoder->slice_callbacks_mutex);
+}
+
+void obs_encoder_remove_slice_callback(obs_encoder_t *encoder,
+		void (*new_slice)(void *param, struct encoder_slice *slice),
+		void *param)
+{
+	size_t idx;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_remove_slice_callback"))
+		return;
+
+	pthread_mutex_lock(&encoder->slice_callbacks_mutex);
+	idx = get_slice_callback_idx(encoder, new_slice, param);
+	if (idx != DARRAY_INVALID)
+		da_erase(encoder->slice_callbacks, idx);
+	pthread_mutex_unlock(&encoder->slice_callbacks_mutex);
+}
+
+void obs_encoder_send_slice(obs_encoder_t *encoder,
+		struct encoder_slice *slice)
+{
+	int64_t offset_usec;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_send_slice"))
+		return;
+	if (!obs_ptr_valid(slice, "obs_encoder_send_slice"))
+		return;
+
+	slice->timebase_num = encoder->timebase_num;
+	slice->timebase_den = encoder->timebase_den;
+	slice->encoder = encoder;
+
+	/* slices come from the encoder's own threads while do_encode may be
+	 * setting the offset, which it does with this mutex held */
+	pthread_mutex_lock(&encoder->slice_callbacks_mutex);
+
+	/* slices of the very first frame arrive before do_encode has seen
+	 * that frame, which then becomes the offset */
+	offset_usec = encoder->first_received ?
+		encoder->offset_usec : slice_dts_usec(slice);
+
+	/* same time base as the packets, see do_encode */
+	slice->dts_usec = encoder->start_ts / 1000 +
+		slice_dts_usec(slice) - offset_usec;
+	slice->sys_dts_usec = slice->dts_usec;
+
+	for (size_t i = 0; i < encoder->slice_callbacks.num; i++) {
+		struct encoder_slice_callback *cb;
+		cb = encoder->slice_callbacks.array+i;
+		cb->new_slice(cb->param, slice);
+	}
+
+	pthread_mutex_unlock(&encoder->slice_callbacks_mutex);
+}
+
 const char *obs_encoder_get_codec(const obs_encoder_t *encoder)
 {
 	return obs_encoder_valid(encoder, "obs_encoder_get_codec") ?
@@ -542,7 +721,13 @@ const char *obs_encoder_get_codec(const obs_encoder_t *encoder)
 
 const char *obs_get_encoder_codec(const char *id)
 {
-	struct obs_encoder_info *info = find_encoder(id);
+	const struct module_type_id *type = find_deferred_encoder(id);
+	struct obs_encoder_info *info;
+
+	if (type && type->codec)
+		return type->codec;
+
+	info = find_encoder(id);
 	return info ? info->codec : NULL;
 }
 
@@ -554,7 +739,13 @@ enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder)
 
 enum obs_encoder_type obs_get_encoder_type(const char *id)
 {
-	struct obs_encoder_info *info = find_encoder(id);
+	const struct module_type_id *type = find_deferred_encoder(id);
+	struct obs_encoder_info *info;
+
+	if (type)
+		return (enum obs_encoder_type)type->flags;
+
+	info = find_encoder(id);
 	return info ? info->type : OBS_ENCODER_AUDIO;
 }
 
@@ -616,6 +807,43 @@ uint32_t obs_encoder_get_height(const obs_encoder_t *encoder)
 		video_output_get_height(encoder->media);
 }
 
+static bool get_frame_counts(const obs_encoder_t *encoder, const char *f,
+		uint32_t *total, uint32_t *skipped)
+{
+	if (!obs_encoder_valid(encoder, f))
+		return false;
+	if (encoder->info.type != OBS_ENCODER_VIDEO) {
+		blog(LOG_WARNING, "%s: encoder '%s' is not a video encoder",
+				f, obs_encoder_get_name(encoder));
+		return false;
+	}
+	if (!encoder->media)
+		return false;
+
+	return video_output_get_input_frames(encoder->media, receive_video,
+			(void*)encoder, total, skipped);
+}
+
+uint32_t obs_encoder_get_total_frames(const obs_encoder_t *encoder)
+{
+	uint32_t total = 0;
+	uint32_t skipped = 0;
+
+	get_frame_counts(encoder, "obs_encoder_get_total_frames", &total,
+			&skipped);
+	return total;
+}
+
+uint32_t obs_encoder_get_skipped_frames(const obs_encoder_t *encoder)
+{
+	uint32_t total = 0;
+	uint32_t skipped = 0;
+
+	get_frame_counts(encoder, "obs_encoder_get_skipped_frames", &total,
+			&skipped);
+	return skipped;
+}
+
 uint32_t obs_encoder_get_sample_rate(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_get_sample_rate"))
@@ -721,6 +949,7 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 		struct encoder_callback *cb, struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
+	struct encoder_packet shared;
 	DARRAY(uint8_t)       data;
 	uint8_t               *sei;
 	size_t                size;
@@ -744,10 +973,13 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	first_packet.data = data.array;
 	first_packet.size = data.num;
 
-	cb->new_packet(cb->param, &first_packet);
+	obs_encoder_packet_create_instance(&shared, &first_packet);
+	da_free(data);
+
+	cb->new_packet(cb->param, &shared);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&shared);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -781,6 +1013,7 @@ static inline void do_encode(struct obs_encoder *encoder,
 					"encode(%s)", encoder->context.name);
 
 	struct encoder_packet pkt = {0};
+	struct encoder_packet shared;
 	bool received = false;
 	bool success;
 
@@ -788,9 +1021,13 @@ static inline void do_encode(struct obs_encoder *encoder,
 	pkt.timebase_den = encoder->timebase_den;
 	pkt.encoder = encoder;
 
+	apply_pending_settings(encoder);
+
 	profile_start(encoder->profile_encoder_encode_name);
+	pthread_mutex_lock(&encoder->encode_mutex);
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 			&received);
+	pthread_mutex_unlock(&encoder->encode_mutex);
 	profile_end(encoder->profile_encoder_encode_name);
 	if (!success) {
 		full_stop(encoder);
@@ -801,8 +1038,10 @@ static inline void do_encode(struct obs_encoder *encoder,
 
 	if (received) {
 		if (!encoder->first_received) {
+			pthread_mutex_lock(&encoder->slice_callbacks_mutex);
 			encoder->offset_usec = packet_dts_usec(&pkt);
 			encoder->first_received = true;
+			pthread_mutex_unlock(&encoder->slice_callbacks_mutex);
 		}
 
 		/* we use system time here to ensure sync with other encoders,
@@ -811,15 +1050,21 @@ static inline void do_encode(struct obs_encoder *encoder,
 			packet_dts_usec(&pkt) - encoder->offset_usec;
 		pkt.sys_dts_usec = pkt.dts_usec;
 
+		/* one shared copy for every callback, which take a reference
+		 * instead of copying the data again */
+		obs_encoder_packet_create_instance(&shared, &pkt);
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array+(i-1);
-			send_packet(encoder, cb, &pkt);
+			send_packet(encoder, cb, &shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&shared);
 	}
 
 error:
@@ -834,6 +1079,7 @@ static void receive_video(void *param, struct video_data *frame)
 	struct obs_encoder    *encoder  = param;
 	struct obs_encoder    *pair     = encoder->paired_encoder;
 	struct encoder_frame  enc_frame;
+	int64_t               pts;
 
 	if (!encoder->first_received && pair) {
 		if (!pair->first_received ||
@@ -852,12 +1098,20 @@ static void receive_video(void *param, struct video_data *frame)
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
+	/* frames can be skipped for this encoder alone when it falls behind,
+	 * so take the pts from the video clock rather than counting frames,
+	 * otherwise every skip would shift video against audio */
+	pts = video_output_get_frame_index(encoder->media, encoder->start_ts,
+			frame->timestamp) * encoder->timebase_num;
+	if (pts < encoder->cur_pts)
+		pts = encoder->cur_pts;
+
 	enc_frame.frames = 1;
-	enc_frame.pts    = encoder->cur_pts;
+	enc_frame.pts    = pts;
 
 	do_encode(encoder, &enc_frame);
 
-	encoder->cur_pts += encoder->timebase_num;
+	encoder->cur_pts = pts + encoder->timebase_num;
 
 wait_for_audio:
 	profile_end(receive_video_name);
@@ -990,6 +1244,56 @@ static void send_audio_data(struct obs_encoder *encoder)
 	encoder->cur_pts += encoder->framesize;
 }
 
+/* the mix handed over by audio-io is exactly one encoder frame.  if nothing
+ * is left over from earlier ticks it is encoded straight from the mix buffer.
+ * otherwise (a paired encoder trims its start to the video, which leaves a
+ * partial frame) the leftover and the front of the mix make up the frame and
+ * the rest of the mix becomes the new leftover, so only the frame itself and
+ * the leftover are copied instead of pushing and popping the whole mix */
+static void send_audio_direct(struct obs_encoder *encoder,
+		struct audio_data *data)
+{
+	size_t buffered = encoder->audio_input_buffer[0].size;
+	size_t head = encoder->framesize_bytes - buffered;
+	struct encoder_frame  enc_frame;
+
+	memset(&enc_frame, 0, sizeof(struct encoder_frame));
+
+	for (size_t i = 0; i < encoder->planes; i++) {
+		if (buffered) {
+			uint8_t *out = encoder->audio_output_buffer[i];
+
+			circlebuf_pop_front(&encoder->audio_input_buffer[i],
+					out, buffered);
+			memcpy(out + buffered, data->data[i], head);
+			circlebuf_push_back(&encoder->audio_input_buffer[i],
+					data->data[i] + head, buffered);
+
+			enc_frame.data[i] = out;
+		} else {
+			enc_frame.data[i] = data->data[i];
+		}
+
+		enc_frame.linesize[i] = (uint32_t)encoder->framesize_bytes;
+	}
+
+	enc_frame.frames = (uint32_t)encoder->framesize;
+	enc_frame.pts    = encoder->cur_pts;
+
+	do_encode(encoder, &enc_frame);
+
+	encoder->cur_pts += encoder->framesize;
+}
+
+/* less than a frame is ever left in the input buffer once audio started */
+static inline bool can_send_audio_direct(struct obs_encoder *encoder,
+		struct audio_data *data)
+{
+	return encoder->start_ts &&
+	       data->frames == encoder->framesize &&
+	       encoder->audio_input_buffer[0].size < encoder->framesize_bytes;
+}
+
 static const char *receive_audio_name = "receive_audio";
 static void receive_audio(void *param, size_t mix_idx, struct audio_data *data)
 {
@@ -1003,6 +1307,11 @@ static void receive_audio(void *param, size_t mix_idx, struct audio_data *data)
 		clear_audio(encoder);
 	}
 
+	if (can_send_audio_direct(encoder, data)) {
+		send_audio_direct(encoder, data);
+		goto end;
+	}
+
 	if (!buffer_audio(encoder, data))
 		goto end;
 
@@ -1048,6 +1357,50 @@ void obs_free_encoder_packet(struct encoder_packet *packet)
 	memset(packet, 0, sizeof(struct encoder_packet));
 }
 
+/* the reference count is stored just in front of the packet data */
+static inline long *packet_refs(const struct encoder_packet *packet)
+{
+	return ((long*)packet->data) - 1;
+}
+
+void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src)
+{
+	long *p_refs;
+
+	*dst = *src;
+	p_refs = bmalloc(src->size + sizeof(long));
+	dst->data = (void*)(p_refs + 1);
+	*p_refs = 1;
+	memcpy(dst->data, src->data, src->size);
+}
+
+void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src)
+{
+	if (!src)
+		return;
+
+	if (src->data)
+		os_atomic_inc_long(packet_refs(src));
+
+	*dst = *src;
+}
+
+void obs_encoder_packet_release(struct encoder_packet *packet)
+{
+	if (!packet)
+		return;
+
+	if (packet->data) {
+		long *p_refs = packet_refs(packet);
+		if (os_atomic_dec_long(p_refs) == 0)
+			bfree(p_refs);
+	}
+
+	memset(packet, 0, sizeof(struct encoder_packet));
+}
+
 void obs_encoder_set_preferred_video_format(obs_encoder_t *encoder,
 		enum video_format format)
 {
@@ -84,6 +84,40 @@ struct encoder_packet {
 	obs_encoder_t         *encoder;
 };
 
+/**
+ * Encoded video slice
+ *
+ * Encoders that encode a frame in several slices at once can hand each slice
+ * to the outputs as soon as it is finished, before the rest of its frame.
+ * The complete frame is still returned from encode() as usual.
+ */
+struct encoder_slice {
+	uint8_t               *data;        /**< Slice NAL units (Annex B) */
+	size_t                size;         /**< Slice size */
+
+	int64_t               pts;          /**< Presentation timestamp */
+	int64_t               dts;          /**< Decode timestamp */
+
+	int32_t               timebase_num; /**< Timebase numerator */
+	int32_t               timebase_den; /**< Timebase denominator */
+
+	bool                  keyframe;     /**< Belongs to a keyframe */
+	bool                  first_slice;  /**< First slice of the frame */
+	bool                  last_slice;   /**< Last slice of the frame */
+
+	/* ---------------------------------------------------------------- */
+	/* Internal variables (will be set automatically) */
+
+	/* DTS in microseconds */
+	int64_t               dts_usec;
+
+	/* System DTS in microseconds */
+	int64_t               sys_dts_usec;
+
+	/** Encoder from which the slice originated from */
+	obs_encoder_t         *encoder;
+};
+
 /** Encoder input frame */
 struct encoder_frame {
 	/** Data for the frame/audio */
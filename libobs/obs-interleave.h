@@ -0,0 +1,227 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/darray.h"
+#include "media-io/audio-io.h"
+#include "obs.h"
+
+/*
+ * Merges the encoded packets of an output's video track and audio tracks in
+ * dts order.  Each track keeps its own queue, which packets almost always
+ * arrive at in order, and a small min-heap over the head of each queue picks
+ * the next packet, so adding or removing a packet costs O(log tracks) rather
+ * than a scan over every pending packet.
+ *
+ * Packets with equal dts come out in the order they were pushed, which is the
+ * same order the single sorted packet array used to give.
+ */
+
+#define INTERLEAVE_TRACKS (1 + MAX_AUDIO_MIXES)
+
+struct interleaved_packet {
+	struct encoder_packet packet;
+	uint64_t              seq;
+};
+
+struct interleave_track {
+	DARRAY(struct interleaved_packet) packets;
+	size_t                            first;
+};
+
+struct packet_interleaver {
+	struct interleave_track tracks[INTERLEAVE_TRACKS];
+	size_t                  heap[INTERLEAVE_TRACKS];
+	size_t                  heap_pos[INTERLEAVE_TRACKS];
+	size_t                  heap_size;
+	size_t                  num_packets;
+	uint64_t                next_seq;
+};
+
+static inline size_t interleave_track_idx(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : 1 + packet->track_idx;
+}
+
+static inline bool interleave_track_empty(const struct interleave_track *track)
+{
+	return track->first == track->packets.num;
+}
+
+static inline struct interleaved_packet *interleave_track_head(
+		struct interleave_track *track)
+{
+	return track->packets.array + track->first;
+}
+
+static inline bool interleaved_packet_before(
+		const struct interleaved_packet *a,
+		const struct interleaved_packet *b)
+{
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	return a->seq < b->seq;
+}
+
+static inline bool interleaver_heap_before(struct packet_interleaver *il,
+		size_t a, size_t b)
+{
+	return interleaved_packet_before(
+			interleave_track_head(&il->tracks[il->heap[a]]),
+			interleave_track_head(&il->tracks[il->heap[b]]));
+}
+
+static inline void interleaver_heap_swap(struct packet_interleaver *il,
+		size_t a, size_t b)
+{
+	size_t track = il->heap[a];
+
+	il->heap[a] = il->heap[b];
+	il->heap[b] = track;
+	il->heap_pos[il->heap[a]] = a;
+	il->heap_pos[il->heap[b]] = b;
+}
+
+static inline void interleaver_sift_up(struct packet_interleaver *il,
+		size_t pos)
+{
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+		if (!interleaver_heap_before(il, pos, parent))
+			break;
+
+		interleaver_heap_swap(il, pos, parent);
+		pos = parent;
+	}
+}
+
+static inline void interleaver_sift_down(struct packet_interleaver *il,
+		size_t pos)
+{
+	for (;;) {
+		size_t left  = pos * 2 + 1;
+		size_t right = left + 1;
+		size_t min   = pos;
+
+		if (left < il->heap_size &&
+		    interleaver_heap_before(il, left, min))
+			min = left;
+		if (right < il->heap_size &&
+		    interleaver_heap_before(il, right, min))
+			min = right;
+		if (min == pos)
+			break;
+
+		interleaver_heap_swap(il, pos, min);
+		pos = min;
+	}
+}
+
+/* takes ownership of the packet data */
+static inline void interleaver_push(struct packet_interleaver *il,
+		const struct encoder_packet *packet)
+{
+	size_t track_idx = interleave_track_idx(packet);
+	struct interleave_track *track = &il->tracks[track_idx];
+	struct interleaved_packet ip = {*packet, il->next_seq++};
+	bool was_empty = interleave_track_empty(track);
+	size_t idx = track->packets.num;
+
+	/* packets of a track normally arrive in dts order, so this almost
+	 * always appends */
+	while (idx > track->first) {
+		struct interleaved_packet *prev = &track->packets.array[idx - 1];
+		if (ip.packet.dts_usec >= prev->packet.dts_usec)
+			break;
+		idx--;
+	}
+
+	da_insert(track->packets, idx, &ip);
+	il->num_packets++;
+
+	if (was_empty) {
+		size_t pos = il->heap_size++;
+		il->heap[pos] = track_idx;
+		il->heap_pos[track_idx] = pos;
+		interleaver_sift_up(il, pos);
+
+	} else if (idx == track->first) {
+		interleaver_sift_up(il, il->heap_pos[track_idx]);
+	}
+}
+
+/* returns the packet with the lowest dts without removing it */
+static inline struct encoder_packet *interleaver_peek(
+		struct packet_interleaver *il)
+{
+	if (!il->heap_size)
+		return NULL;
+
+	return &interleave_track_head(&il->tracks[il->heap[0]])->packet;
+}
+
+/* removes the packet with the lowest dts, ownership passes to the caller */
+static inline bool interleaver_pop(struct packet_interleaver *il,
+		struct encoder_packet *packet)
+{
+	struct interleave_track *track;
+
+	if (!il->heap_size)
+		return false;
+
+	track = &il->tracks[il->heap[0]];
+	*packet = interleave_track_head(track)->packet;
+	track->first++;
+	il->num_packets--;
+
+	if (interleave_track_empty(track)) {
+		da_resize(track->packets, 0);
+		track->first = 0;
+
+		if (--il->heap_size) {
+			interleaver_heap_swap(il, 0, il->heap_size);
+			interleaver_sift_down(il, 0);
+		}
+		return true;
+	}
+
+	/* drop sent packets from the front once they make up most of the
+	 * queue, so the cost of the move is spread over many packets */
+	if (track->first >= 32 && track->first * 2 >= track->packets.num) {
+		da_erase_range(track->packets, 0, track->first);
+		track->first = 0;
+	}
+
+	interleaver_sift_down(il, 0);
+	return true;
+}
+
+static inline void interleaver_free(struct packet_interleaver *il)
+{
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		struct interleave_track *track = &il->tracks[i];
+
+		for (size_t j = track->first; j < track->packets.num; j++) {
+			struct interleaved_packet *ip = &track->packets.array[j];
+			obs_encoder_packet_release(&ip->packet);
+		}
+		da_free(track->packets);
+	}
+
+	memset(il, 0, sizeof(*il));
+}
@@ -24,6 +24,7 @@
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/task-pool.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -35,6 +36,7 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-interleave.h"
 
 #define NUM_TEXTURES 2
 #define MICROSECOND_DEN 1000000
@@ -44,6 +46,11 @@ static inline int64_t packet_dts_usec(struct encoder_packet *packet)
 	return packet->dts * MICROSECOND_DEN / packet->timebase_den;
 }
 
+static inline int64_t slice_dts_usec(struct encoder_slice *slice)
+{
+	return slice->dts * MICROSECOND_DEN / slice->timebase_den;
+}
+
 struct draw_callback {
 	void (*draw)(void *param, uint32_t cx, uint32_t cy);
 	void *param;
@@ -72,6 +79,30 @@ static inline bool obs_object_valid(const void *obj, const char *f,
 /* ------------------------------------------------------------------------- */
 /* modules */
 
+enum module_type_kind {
+	MODULE_KIND_INPUT,
+	MODULE_KIND_FILTER,
+	MODULE_KIND_TRANSITION,
+	MODULE_KIND_OUTPUT,
+	MODULE_KIND_ENCODER,
+	MODULE_KIND_SERVICE,
+	MODULE_KIND_UI,
+
+	/* only for lookups, matches inputs, filters and transitions */
+	MODULE_KIND_SOURCE
+};
+
+/* a type registered by a module, recorded in the module manifest along with
+ * what is needed to list the type without loading the module */
+struct module_type_id {
+	enum module_type_kind kind;
+	char                  *id;
+	char                  *name;
+	uint32_t              flags;
+	bool                  configurable;
+	char                  *codec;
+};
+
 struct obs_module {
 	char *mod_name;
 	const char *file;
@@ -90,11 +121,38 @@ struct obs_module {
 	const char *(*description)(void);
 	const char *(*author)(void);
 
+	DARRAY(struct module_type_id) types;
+	uint64_t open_ns;
+	uint64_t init_ns;
+
 	struct obs_module *next;
 };
 
 extern void free_module(struct obs_module *mod);
 
+/* a module binary as recorded in the module manifest.  deferred modules
+ * have been found but not opened, and are loaded the first time one of
+ * their types is looked up. */
+struct module_manifest_entry {
+	char    *bin_path;
+	char    *data_path;
+	int64_t size;
+	int64_t mtime;
+	bool    deferred;
+
+	DARRAY(struct module_type_id) types;
+};
+
+extern bool obs_load_deferred_module(enum module_type_kind kind,
+		const char *id);
+extern const struct module_type_id *obs_find_deferred_type(
+		enum module_type_kind kind, const char *id);
+extern const char *obs_get_deferred_type_name(
+		const struct module_type_id *type);
+extern bool obs_enum_deferred_types(enum module_type_kind kind, size_t idx,
+		const char **id);
+extern void obs_free_module_manifest(void);
+
 struct obs_module_path {
 	char *bin;
 	char *data;
@@ -197,7 +255,35 @@ struct obs_display {
 	bool                            enabled;
 	uint32_t                        cx, cy;
 	uint32_t                        background_color;
+	bool                            occluded;
+	uint64_t                        present_interval;
+	uint64_t                        next_present_time;
+	uint64_t                        last_render_time;
+	volatile long                   lagged_frames;
+	const char                      *profile_name;
 	gs_swapchain_t                  *swap;
+
+	/* the swap chain belongs to the device that presents the display: the
+	 * main graphics device, or the display device while displays are
+	 * threaded.  swap_data is kept to recreate it on the other one */
+	graphics_t                      *swap_graphics;
+	struct gs_init_data             swap_data;
+	bool                            has_swap_data;
+
+	/* threaded displays: drawn into texrender and read back through stage
+	 * on the main device, then uploaded to present_tex and presented on the
+	 * display device.  only used by the display thread */
+	gs_texrender_t                  *texrender;
+	gs_stagesurf_t                  *stage;
+	uint32_t                        stage_cx, stage_cy;
+	bool                            stage_pending;
+	uint8_t                         *frame;
+	size_t                          frame_size;
+	uint32_t                        frame_cx, frame_cy;
+	uint32_t                        frame_linesize;
+	bool                            frame_ready;
+	gs_texture_t                    *present_tex;
+
 	pthread_mutex_t                 draw_callbacks_mutex;
 	DARRAY(struct draw_callback)    draw_callbacks;
 
@@ -208,6 +294,11 @@ struct obs_display {
 extern bool obs_display_init(struct obs_display *display,
 		const struct gs_init_data *graphics_data);
 extern void obs_display_free(struct obs_display *display);
+extern void obs_display_destroy_swap(struct obs_display *display);
+extern void obs_display_create_swap(struct obs_display *display,
+		graphics_t *graphics);
+extern void obs_display_free_present(struct obs_display *display);
+extern void obs_display_free_readback(struct obs_display *display);
 
 
 /* ------------------------------------------------------------------------- */
@@ -250,6 +341,33 @@ struct obs_core_video {
 	uint32_t                        lagged_frames;
 	bool                            thread_initialized;
 
+	/* when enabled, displays are presented from their own thread on their
+	 * own graphics device, so that a slow or vsynced swap chain can't
+	 * delay output frames */
+	bool                            threaded_displays;
+	volatile bool                   display_thread_active;
+	pthread_t                       display_thread;
+	os_event_t                      *display_thread_stop;
+	graphics_t                      *display_graphics;
+	gs_effect_t                     *display_effect;
+	char                            *graphics_module;
+	uint32_t                        adapter;
+
+	/* held while sources are ticked, so that threaded display draw
+	 * callbacks never render sources in the middle of a tick.  never taken
+	 * with the graphics context held */
+	pthread_mutex_t                 tick_mutex;
+	int                             last_main_texture;
+
+	/* async source frames are copied into mapped textures on this thread
+	 * rather than on the graphics thread */
+	volatile bool                   upload_thread_active;
+	bool                            upload_thread_stop;
+	pthread_t                       upload_thread;
+	pthread_mutex_t                 upload_mutex;
+	os_sem_t                        *upload_sem;
+	DARRAY(struct async_upload*)    upload_queue;
+
 	bool                            gpu_conversion;
 	const char                      *conversion_tech;
 	uint32_t                        conversion_height;
@@ -276,6 +394,9 @@ struct obs_core_video {
 	gs_effect_t                     *deinterlace_yadif_2x_effect;
 };
 
+#define MAX_AUDIO_RENDER_THREADS 8
+#define MIN_PARALLEL_AUDIO_SOURCES 4
+
 struct obs_core_audio {
 	/* TODO: sound output subsystem */
 	audio_t                         *audio;
@@ -283,6 +404,13 @@ struct obs_core_audio {
 	DARRAY(struct obs_source*)      render_order;
 	DARRAY(struct obs_source*)      root_nodes;
 
+	/* sources without a custom audio_render callback only depend on
+	 * their own buffers, so they are rendered in parallel on render_pool
+	 * before the composite sources that mix them */
+	DARRAY(struct obs_source*)      leaf_nodes;
+	DARRAY(struct obs_source*)      composite_nodes;
+	task_pool_t                     *render_pool;
+
 	uint64_t                        buffered_ts;
 	struct circlebuf                buffered_timestamps;
 	int                             buffering_wait_ticks;
@@ -292,6 +420,14 @@ struct obs_core_audio {
 };
 
 /* user sources, output channels, and displays */
+/* maps context names to contexts for the *_by_name lookups.  protected by
+ * the mutex of the list the contexts are in */
+struct obs_context_index {
+	struct obs_context_data         **buckets;
+	size_t                          num_buckets;
+	size_t                          count;
+};
+
 struct obs_core_data {
 	struct obs_source               *first_source;
 	struct obs_source               *first_audio_source;
@@ -307,6 +443,11 @@ struct obs_core_data {
 	pthread_mutex_t                 services_mutex;
 	pthread_mutex_t                 audio_sources_mutex;
 
+	struct obs_context_index        source_index;
+	struct obs_context_index        output_index;
+	struct obs_context_index        encoder_index;
+	struct obs_context_index        service_index;
+
 	struct obs_view                 main_view;
 
 	long long                       unnamed_index;
@@ -368,9 +509,21 @@ struct obs_core {
 
 	char                            *locale;
 	char                            *module_config_path;
+	char                            *shader_cache_path;
 	bool                            name_store_owned;
+
+	/* serializes module loading once modules can be loaded on demand */
+	pthread_mutex_t                 modules_mutex;
+	struct obs_module               *cur_module;
+	char                            *module_manifest_path;
+	char                            *module_manifest_locale;
+	DARRAY(struct module_manifest_entry) module_manifest;
+
 	profiler_name_store_t           *name_store;
 
+	/* applied by obs_reset_audio, 0 picks the count from the cores */
+	size_t                          audio_render_threads;
+
 	/* segmented into multiple sub-structures to keep things a bit more
 	 * clean and organized */
 	struct obs_core_video           video;
@@ -382,6 +535,10 @@ struct obs_core {
 extern struct obs_core *obs;
 
 extern void *obs_video_thread(void *param);
+extern bool obs_start_display_thread(void);
+extern void obs_stop_display_thread(void);
+extern bool obs_start_upload_thread(void);
+extern void obs_stop_upload_thread(void);
 
 extern gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file);
 
@@ -412,6 +569,10 @@ struct obs_context_data {
 	struct obs_context_data         *next;
 	struct obs_context_data         **prev_next;
 
+	struct obs_context_index        *index;
+	struct obs_context_data         *hash_next;
+	uint32_t                        name_hash;
+
 	bool                            private;
 };
 
@@ -483,6 +644,33 @@ struct async_frame {
 	bool used;
 };
 
+/*
+ * frames are copied by the upload thread into one of a ring of dynamic
+ * textures the same size as the async texture, each with its own pixel
+ * unpack buffer, and copied into the async texture on the GPU from there.
+ * a buffer is only mapped again once the fence set after its last copy has
+ * signaled, so the GPU is never still reading memory that is being written
+ */
+#define ASYNC_UPLOAD_BUFFERS 3
+
+struct async_upload_buffer {
+	gs_texture_t *texture;
+	gs_sync_t *sync;
+};
+
+/* a frame being copied into a mapped upload buffer by the upload thread */
+struct async_upload {
+	struct obs_source_frame *frame;
+	gs_texture_t *texture;
+	uint8_t *ptr;
+	uint32_t linesize;
+	uint32_t rows;
+	bool raw;
+	bool pending;
+	os_event_t *done;
+	uint64_t copy_time;
+};
+
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -603,6 +791,20 @@ struct obs_source {
 	uint32_t                        async_cache_height;
 	uint32_t                        async_convert_width;
 	uint32_t                        async_convert_height;
+	uint64_t                        async_target_latency;
+	enum obs_async_drop_policy      async_drop_policy;
+	size_t                          async_full_count;
+	uint64_t                        async_frames_received;
+	uint64_t                        async_frames_dropped;
+	uint64_t                        async_frames_late;
+	struct async_upload             async_upload;
+	struct async_upload_buffer      async_upload_buffers[
+	                                        ASYNC_UPLOAD_BUFFERS];
+	size_t                          async_upload_next;
+	uint64_t                        async_frames_uploaded;
+	uint64_t                        async_upload_bytes;
+	uint64_t                        async_upload_copy_time;
+	uint64_t                        async_upload_wait_time;
 
 	/* async video deinterlacing */
 	uint64_t                        deinterlace_offset;
@@ -744,6 +946,9 @@ extern bool set_async_texture_size(struct obs_source *source,
 		const struct obs_source_frame *frame);
 extern void remove_async_frame(obs_source_t *source,
 		struct obs_source_frame *frame);
+extern void copy_async_upload(struct async_upload *upload);
+extern bool finish_async_upload(struct obs_source *source, bool wait);
+extern void free_async_upload_buffers(struct obs_source *source);
 
 extern void set_deinterlace_texture_size(obs_source_t *source);
 extern void deinterlace_process_last_frame(obs_source_t *source,
@@ -793,7 +998,16 @@ struct obs_output {
 	pthread_t                       end_data_capture_thread;
 	os_event_t                      *stopping_event;
 	pthread_mutex_t                 interleaved_mutex;
+
+	/* audio-io calls the encoders of different tracks in parallel, so
+	 * their packets are handed to the output one at a time (recursive, a
+	 * delayed packet is passed on from within process_delay) */
+	pthread_mutex_t                 packet_mutex;
+
+	/* packets are kept in one sorted array until the start of audio and
+	 * video has been lined up, and merged per track after that */
 	DARRAY(struct encoder_packet)   interleaved_packets;
+	struct packet_interleaver       interleaver;
 	int                             stop_code;
 
 	int                             reconnect_retry_sec;
@@ -881,6 +1095,11 @@ struct encoder_callback {
 	void *param;
 };
 
+struct encoder_slice_callback {
+	void (*new_slice)(void *param, struct encoder_slice *slice);
+	void *param;
+};
+
 struct obs_encoder {
 	struct obs_context_data         context;
 	struct obs_encoder_info         info;
@@ -936,7 +1155,19 @@ struct obs_encoder {
 	pthread_mutex_t                 callbacks_mutex;
 	DARRAY(struct encoder_callback) callbacks;
 
+	pthread_mutex_t                 slice_callbacks_mutex;
+	DARRAY(struct encoder_slice_callback) slice_callbacks;
+
 	const char                      *profile_encoder_encode_name;
+
+	/* held around encode calls, so updates never reconfigure the encoder
+	 * in the middle of one */
+	pthread_mutex_t                 encode_mutex;
+
+	/* settings queued by obs_encoder_queue_update for the encoding thread
+	 * to apply before its next frame */
+	pthread_mutex_t                 pending_mutex;
+	obs_data_t                      *pending_settings;
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
@@ -951,6 +1182,13 @@ extern void obs_encoder_stop(obs_encoder_t *encoder,
 		void (*new_packet)(void *param, struct encoder_packet *packet),
 		void *param);
 
+extern void obs_encoder_add_slice_callback(obs_encoder_t *encoder,
+		void (*new_slice)(void *param, struct encoder_slice *slice),
+		void *param);
+extern void obs_encoder_remove_slice_callback(obs_encoder_t *encoder,
+		void (*new_slice)(void *param, struct encoder_slice *slice),
+		void *param);
+
 extern void obs_encoder_add_output(struct obs_encoder *encoder,
 		struct obs_output *output);
 extern void obs_encoder_remove_output(struct obs_encoder *encoder,
@@ -15,8 +15,11 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <sys/stat.h>
+
 #include "util/platform.h"
 #include "util/dstr.h"
+#include "util/threading.h"
 
 #include "obs-defs.h"
 #include "obs-internal.h"
@@ -75,22 +78,15 @@ static inline char *get_module_name(const char *file)
 extern void reset_win32_symbol_paths(void);
 #endif
 
-int obs_open_module(obs_module_t **module, const char *path,
-		const char *data_path)
+static int open_module_handle(obs_module_t **module, void *handle,
+		const char *path, const char *data_path)
 {
 	struct obs_module mod = {0};
 	int errorcode;
 
-	if (!module || !path || !obs)
-		return MODULE_ERROR;
-
 	blog(LOG_DEBUG, "---------------------------------");
 
-	mod.module = os_dlopen(path);
-	if (!mod.module) {
-		blog(LOG_WARNING, "Module '%s' not found", path);
-		return MODULE_FILE_NOT_FOUND;
-	}
+	mod.module = handle;
 
 	errorcode = load_module_exports(&mod, path);
 	if (errorcode != MODULE_SUCCESS)
@@ -117,8 +113,28 @@ int obs_open_module(obs_module_t **module, const char *path,
 	return MODULE_SUCCESS;
 }
 
+int obs_open_module(obs_module_t **module, const char *path,
+		const char *data_path)
+{
+	void *handle;
+
+	if (!module || !path || !obs)
+		return MODULE_ERROR;
+
+	handle = os_dlopen(path);
+	if (!handle) {
+		blog(LOG_WARNING, "Module '%s' not found", path);
+		return MODULE_FILE_NOT_FOUND;
+	}
+
+	return open_module_handle(module, handle, path, data_path);
+}
+
 bool obs_init_module(obs_module_t *module)
 {
+	struct obs_module *prev_module;
+	uint64_t start;
+
 	if (!module || !obs)
 		return false;
 	if (module->loaded)
@@ -129,7 +145,19 @@ bool obs_init_module(obs_module_t *module)
 				"obs_init_module(%s)", module->file);
 	profile_start(profile_name);
 
+	/* types registered while the module loads are recorded for the
+	 * module manifest */
+	pthread_mutex_lock(&obs->modules_mutex);
+	prev_module = obs->cur_module;
+	obs->cur_module = module;
+	start = os_gettime_ns();
+
 	module->loaded = module->load();
+
+	module->init_ns = os_gettime_ns() - start;
+	obs->cur_module = prev_module;
+	pthread_mutex_unlock(&obs->modules_mutex);
+
 	if (!module->loaded)
 		blog(LOG_WARNING, "Failed to initialize module '%s'",
 				module->file);
@@ -138,12 +166,36 @@ bool obs_init_module(obs_module_t *module)
 	return module->loaded;
 }
 
+static inline const char *get_file_name(const char *path)
+{
+	const char *file = strrchr(path, '/');
+	return file ? (file + 1) : path;
+}
+
 void obs_log_loaded_modules(void)
 {
 	blog(LOG_INFO, "  Loaded Modules:");
 
 	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next)
 		blog(LOG_INFO, "    %s", mod->file);
+
+	bool logged_header = false;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+		if (!entry->deferred)
+			continue;
+
+		if (!logged_header) {
+			blog(LOG_INFO, "  Deferred Modules (loaded on use):");
+			logged_header = true;
+		}
+
+		blog(LOG_INFO, "    %s", get_file_name(entry->bin_path));
+	}
+	pthread_mutex_unlock(&obs->modules_mutex);
 }
 
 const char *obs_get_module_file_name(obs_module_t *module)
@@ -221,31 +273,705 @@ void obs_add_module_path(const char *bin, const char *data)
 	da_push_back(obs->module_paths, &omp);
 }
 
-static void load_all_callback(void *param, const struct obs_module_info *info)
+/* ------------------------------------------------------------------------- */
+/* module manifest */
+
+#define MODULE_MANIFEST_VERSION 2
+
+static const char *module_kind_names[] = {
+	"input",
+	"filter",
+	"transition",
+	"output",
+	"encoder",
+	"service",
+	"ui"
+};
+
+#define NUM_MODULE_KINDS \
+	(sizeof(module_kind_names) / sizeof(module_kind_names[0]))
+
+static inline void free_module_types(struct module_type_id *types,
+		size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		bfree(types[i].id);
+		bfree(types[i].name);
+		bfree(types[i].codec);
+	}
+}
+
+static inline void free_manifest_entries(void)
+{
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+
+		free_module_types(entry->types.array, entry->types.num);
+		da_free(entry->types);
+		bfree(entry->bin_path);
+		bfree(entry->data_path);
+	}
+
+	da_free(obs->module_manifest);
+}
+
+void obs_free_module_manifest(void)
+{
+	pthread_mutex_lock(&obs->modules_mutex);
+	free_manifest_entries();
+	bfree(obs->module_manifest_path);
+	bfree(obs->module_manifest_locale);
+	obs->module_manifest_path = NULL;
+	obs->module_manifest_locale = NULL;
+	pthread_mutex_unlock(&obs->modules_mutex);
+}
+
+void obs_set_module_manifest_path(const char *path)
+{
+	if (!obs)
+		return;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	bfree(obs->module_manifest_path);
+	obs->module_manifest_path = path && *path ? bstrdup(path) : NULL;
+	pthread_mutex_unlock(&obs->modules_mutex);
+}
+
+/* returns the recorded type if a module is being loaded, for the caller to
+ * fill in the rest */
+static struct module_type_id *add_module_type(enum module_type_kind kind,
+		const char *id)
+{
+	struct obs_module *module = obs->cur_module;
+	struct module_type_id *type;
+
+	if (!module)
+		return NULL;
+
+	type = da_push_back_new(module->types);
+	type->kind = kind;
+	type->id   = bstrdup(id ? id : "");
+	return type;
+}
+
+static inline char *dup_string(const char *str)
+{
+	return str && *str ? bstrdup(str) : NULL;
+}
+
+static bool get_file_info(const char *path, int64_t *size, int64_t *mtime)
+{
+	struct stat st;
+
+	if (os_stat(path, &st) != 0)
+		return false;
+
+	*size  = (int64_t)st.st_size;
+	*mtime = (int64_t)st.st_mtime;
+	return true;
+}
+
+static void load_manifest_types(struct module_manifest_entry *entry,
+		obs_data_array_t *types)
+{
+	size_t count = obs_data_array_count(types);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(types, i);
+		const char *kind = obs_data_get_string(item, "kind");
+
+		for (size_t j = 0; j < NUM_MODULE_KINDS; j++) {
+			if (strcmp(kind, module_kind_names[j]) != 0)
+				continue;
+
+			struct module_type_id *type =
+				da_push_back_new(entry->types);
+			type->kind  = (enum module_type_kind)j;
+			type->id    = bstrdup(obs_data_get_string(item, "id"));
+			type->name  = dup_string(
+					obs_data_get_string(item, "name"));
+			type->codec = dup_string(
+					obs_data_get_string(item, "codec"));
+			type->flags = (uint32_t)obs_data_get_int(item,
+					"flags");
+			type->configurable = obs_data_get_bool(item,
+					"configurable");
+			break;
+		}
+
+		obs_data_release(item);
+	}
+}
+
+static void load_module_manifest(void)
+{
+	obs_data_t *manifest;
+	obs_data_array_t *modules;
+	size_t count;
+
+	free_manifest_entries();
+
+	if (!obs->module_manifest_path)
+		return;
+
+	manifest = obs_data_create_from_json_file_safe(
+			obs->module_manifest_path, "bak");
+	if (!manifest)
+		return;
+
+	/* a different libobs may register types differently, and the
+	 * display names are only valid for the locale they were saved in */
+	if (obs_data_get_int(manifest, "version") != MODULE_MANIFEST_VERSION ||
+	    obs_data_get_int(manifest, "api_version") != LIBOBS_API_VER ||
+	    strcmp(obs_data_get_string(manifest, "locale"),
+		    obs->locale ? obs->locale : "") != 0) {
+		obs_data_release(manifest);
+		return;
+	}
+
+	bfree(obs->module_manifest_locale);
+	obs->module_manifest_locale = bstrdup(obs->locale);
+
+	modules = obs_data_get_array(manifest, "modules");
+	count = obs_data_array_count(modules);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(modules, i);
+		obs_data_array_t *types = obs_data_get_array(item, "types");
+		struct module_manifest_entry *entry =
+			da_push_back_new(obs->module_manifest);
+
+		entry->bin_path = bstrdup(obs_data_get_string(item, "path"));
+		entry->size     = obs_data_get_int(item, "size");
+		entry->mtime    = obs_data_get_int(item, "mtime");
+		load_manifest_types(entry, types);
+
+		obs_data_array_release(types);
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(modules);
+	obs_data_release(manifest);
+}
+
+static void add_manifest_module(obs_data_array_t *modules,
+		const char *bin_path, const struct module_type_id *types,
+		size_t num_types)
+{
+	obs_data_array_t *type_array;
+	obs_data_t *item;
+	int64_t size, mtime;
+
+	if (!get_file_info(bin_path, &size, &mtime))
+		return;
+
+	item = obs_data_create();
+	type_array = obs_data_array_create();
+
+	for (size_t i = 0; i < num_types; i++) {
+		obs_data_t *type = obs_data_create();
+		obs_data_set_string(type, "kind",
+				module_kind_names[types[i].kind]);
+		obs_data_set_string(type, "id", types[i].id);
+		if (types[i].name)
+			obs_data_set_string(type, "name", types[i].name);
+		if (types[i].codec)
+			obs_data_set_string(type, "codec", types[i].codec);
+		obs_data_set_int(type, "flags", types[i].flags);
+		obs_data_set_bool(type, "configurable",
+				types[i].configurable);
+		obs_data_array_push_back(type_array, type);
+		obs_data_release(type);
+	}
+
+	obs_data_set_string(item, "path", bin_path);
+	obs_data_set_int(item, "size", size);
+	obs_data_set_int(item, "mtime", mtime);
+	obs_data_set_array(item, "types", type_array);
+	obs_data_array_push_back(modules, item);
+
+	obs_data_array_release(type_array);
+	obs_data_release(item);
+}
+
+static void save_module_manifest(void)
 {
+	obs_data_t *manifest;
+	obs_data_array_t *modules;
+
+	if (!obs->module_manifest_path)
+		return;
+
+	manifest = obs_data_create();
+	modules = obs_data_array_create();
+
+	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next) {
+		if (mod->loaded)
+			add_manifest_module(modules, mod->bin_path,
+					mod->types.array, mod->types.num);
+	}
+
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+		if (entry->deferred)
+			add_manifest_module(modules, entry->bin_path,
+					entry->types.array, entry->types.num);
+	}
+
+	obs_data_set_int(manifest, "version", MODULE_MANIFEST_VERSION);
+	obs_data_set_int(manifest, "api_version", LIBOBS_API_VER);
+	obs_data_set_string(manifest, "locale", obs->locale);
+	obs_data_set_array(manifest, "modules", modules);
+
+	if (!obs_data_save_json_safe(manifest, obs->module_manifest_path,
+				"tmp", "bak"))
+		blog(LOG_WARNING, "Failed to save module manifest '%s'",
+				obs->module_manifest_path);
+
+	obs_data_array_release(modules);
+	obs_data_release(manifest);
+}
+
+static struct module_manifest_entry *find_manifest_entry(const char *path)
+{
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+		if (strcmp(entry->bin_path, path) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/* modules that register nothing are loaded for their side effects, and UI
+ * callbacks are enumerated by the frontend without looking them up by id, so
+ * neither kind can wait until first use */
+static bool module_deferrable(const struct module_manifest_entry *entry)
+{
+	if (!entry->types.num)
+		return false;
+
+	for (size_t i = 0; i < entry->types.num; i++) {
+		if (entry->types.array[i].kind == MODULE_KIND_UI)
+			return false;
+	}
+
+	return true;
+}
+
+static inline bool kind_matches(enum module_type_kind kind,
+		enum module_type_kind match)
+{
+	if (match == MODULE_KIND_SOURCE)
+		return kind == MODULE_KIND_INPUT ||
+		       kind == MODULE_KIND_FILTER ||
+		       kind == MODULE_KIND_TRANSITION;
+
+	return kind == match;
+}
+
+static const struct module_type_id *find_module_type(
+		const struct module_manifest_entry *entry,
+		enum module_type_kind kind, const char *id)
+{
+	for (size_t i = 0; i < entry->types.num; i++) {
+		const struct module_type_id *type = entry->types.array + i;
+		if (kind_matches(type->kind, kind) &&
+		    strcmp(type->id, id) == 0)
+			return type;
+	}
+
+	return NULL;
+}
+
+/* lookups of types that are already registered don't take the modules
+ * mutex, so make sure registering the types of deferred modules later on
+ * never has to move the type arrays */
+static void reserve_deferred_types(void)
+{
+	size_t counts[NUM_MODULE_KINDS] = {0};
+
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+		if (!entry->deferred)
+			continue;
+
+		for (size_t j = 0; j < entry->types.num; j++)
+			counts[entry->types.array[j].kind]++;
+	}
+
+	size_t sources = counts[MODULE_KIND_INPUT] +
+		counts[MODULE_KIND_FILTER] + counts[MODULE_KIND_TRANSITION];
+
+	da_reserve(obs->source_types, obs->source_types.num + sources);
+	da_reserve(obs->input_types,
+			obs->input_types.num + counts[MODULE_KIND_INPUT]);
+	da_reserve(obs->filter_types,
+			obs->filter_types.num + counts[MODULE_KIND_FILTER]);
+	da_reserve(obs->transition_types, obs->transition_types.num +
+			counts[MODULE_KIND_TRANSITION]);
+	da_reserve(obs->output_types,
+			obs->output_types.num + counts[MODULE_KIND_OUTPUT]);
+	da_reserve(obs->encoder_types,
+			obs->encoder_types.num + counts[MODULE_KIND_ENCODER]);
+	da_reserve(obs->service_types,
+			obs->service_types.num + counts[MODULE_KIND_SERVICE]);
+}
+
+static void load_deferred_entry(struct module_manifest_entry *entry)
+{
+	uint64_t start = os_gettime_ns();
 	obs_module_t *module;
+	int code;
 
-	int code = obs_open_module(&module, info->bin_path, info->data_path);
+	entry->deferred = false;
+
+	code = obs_open_module(&module, entry->bin_path, entry->data_path);
 	if (code != MODULE_SUCCESS) {
-		blog(LOG_DEBUG, "Failed to load module file '%s': %d",
-				info->bin_path, code);
+		blog(LOG_WARNING, "Failed to load deferred module '%s': %d",
+				entry->bin_path, code);
 		return;
 	}
 
 	obs_init_module(module);
 
-	UNUSED_PARAMETER(param);
+#ifdef _WIN32
+	reset_win32_symbol_paths();
+#endif
+
+	blog(LOG_INFO, "Loaded deferred module '%s' in %.1f ms",
+			module->file,
+			(double)(os_gettime_ns() - start) / 1000000.0);
+}
+
+/* types are only looked up by id when they are about to be used (created,
+ * or their properties or defaults are needed), so that is when a deferred
+ * module is loaded.  listing types and their names, flags and codecs is
+ * answered from the manifest instead, see obs_find_deferred_type. */
+bool obs_load_deferred_module(enum module_type_kind kind, const char *id)
+{
+	bool known = false;
+
+	if (!obs || !id || !obs->module_manifest.num)
+		return false;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+		if (!find_module_type(entry, kind, id))
+			continue;
+
+		if (entry->deferred)
+			load_deferred_entry(entry);
+		known = true;
+		break;
+	}
+
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return known;
+}
+
+/* the manifest entries are not freed before shutdown, so the returned type
+ * stays valid even if its module is loaded in the meantime */
+const struct module_type_id *obs_find_deferred_type(
+		enum module_type_kind kind, const char *id)
+{
+	const struct module_type_id *type = NULL;
+
+	if (!obs || !id || !obs->module_manifest.num)
+		return NULL;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+
+		if (entry->deferred) {
+			type = find_module_type(entry, kind, id);
+			if (type)
+				break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return type;
+}
+
+/* NULL if the locale has changed since the manifest was saved */
+const char *obs_get_deferred_type_name(const struct module_type_id *type)
+{
+	const char *locale = obs->module_manifest_locale;
+
+	if (!type || !type->name || !locale || !obs->locale ||
+	    strcmp(locale, obs->locale) != 0)
+		return NULL;
+
+	return type->name;
+}
+
+/* the types of deferred modules follow the registered ones when types are
+ * enumerated.  a module loaded during an enumeration moves its types to the
+ * end of the registered ones, which is where the deferred ones start, so
+ * the order is kept as long as modules are loaded in manifest order */
+bool obs_enum_deferred_types(enum module_type_kind kind, size_t idx,
+		const char **id)
+{
+	bool found = false;
+
+	if (!obs || !obs->module_manifest.num)
+		return false;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	for (size_t i = 0; !found && i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+		if (!entry->deferred)
+			continue;
+
+		for (size_t j = 0; j < entry->types.num; j++) {
+			struct module_type_id *type = entry->types.array + j;
+			if (!kind_matches(type->kind, kind))
+				continue;
+
+			if (idx-- == 0) {
+				*id = type->id;
+				found = true;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
+}
+
+/* ------------------------------------------------------------------------- */
+/* loading all modules */
+
+#define MAX_MODULE_OPEN_THREADS 8
+
+struct module_load_job {
+	char              *bin_path;
+	char              *data_path;
+	void              *handle;
+	uint64_t          open_start;
+	uint64_t          open_ns;
+	uint64_t          init_start;
+	struct obs_module *module;
+};
+
+struct module_loader {
+	DARRAY(struct module_load_job) jobs;
+	volatile long                  next_job;
+	size_t                         num_threads;
+	size_t                         num_deferred;
+	uint64_t                       start;
+	uint64_t                       open_end;
+	uint64_t                       end;
+};
+
+static void find_all_callback(void *param, const struct obs_module_info *info)
+{
+	struct module_loader *loader = param;
+	struct module_manifest_entry *entry;
+	struct module_load_job *job;
+	int64_t size, mtime;
+
+	entry = find_manifest_entry(info->bin_path);
+	if (entry && !entry->data_path) {
+		entry->data_path = bstrdup(info->data_path);
+
+		if (get_file_info(info->bin_path, &size, &mtime) &&
+		    entry->size == size && entry->mtime == mtime &&
+		    module_deferrable(entry)) {
+			entry->deferred = true;
+			loader->num_deferred++;
+			return;
+		}
+	}
+
+	job = da_push_back_new(loader->jobs);
+	job->bin_path  = bstrdup(info->bin_path);
+	job->data_path = bstrdup(info->data_path);
+}
+
+/* the dynamic loader is thread safe, so the binaries themselves are mapped
+ * in parallel.  obs_module_load isn't required to be, so modules are still
+ * initialized one at a time afterwards. */
+static void *open_modules_thread(void *param)
+{
+	struct module_loader *loader = param;
+
+	for (;;) {
+		long next = os_atomic_inc_long(&loader->next_job);
+		size_t idx = (size_t)(next - 1);
+		if (idx >= loader->jobs.num)
+			break;
+
+		struct module_load_job *job = loader->jobs.array + idx;
+
+		job->open_start = os_gettime_ns();
+		job->handle     = os_dlopen(job->bin_path);
+		job->open_ns    = os_gettime_ns() - job->open_start;
+	}
+
+	return NULL;
+}
+
+static void open_modules(struct module_loader *loader)
+{
+	pthread_t threads[MAX_MODULE_OPEN_THREADS - 1];
+	size_t num_threads = (size_t)os_get_logical_cores();
+	size_t started = 0;
+
+	if (num_threads > MAX_MODULE_OPEN_THREADS)
+		num_threads = MAX_MODULE_OPEN_THREADS;
+	if (num_threads > loader->jobs.num)
+		num_threads = loader->jobs.num;
+
+	for (size_t i = 1; i < num_threads; i++) {
+		if (pthread_create(&threads[started], NULL,
+					open_modules_thread, loader) == 0)
+			started++;
+	}
+
+	/* the calling thread opens modules as well */
+	open_modules_thread(loader);
+
+	for (size_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	loader->num_threads = started + 1;
+}
+
+static void init_modules(struct module_loader *loader)
+{
+	for (size_t i = 0; i < loader->jobs.num; i++) {
+		struct module_load_job *job = loader->jobs.array + i;
+		obs_module_t *module;
+		int code;
+
+		if (!job->handle) {
+			blog(LOG_WARNING, "Module '%s' not found",
+					job->bin_path);
+			continue;
+		}
+
+		code = open_module_handle(&module, job->handle, job->bin_path,
+				job->data_path);
+		if (code != MODULE_SUCCESS) {
+			blog(LOG_DEBUG, "Failed to load module file '%s': %d",
+					job->bin_path, code);
+			continue;
+		}
+
+		module->open_ns = job->open_ns;
+		job->init_start = os_gettime_ns();
+		job->module     = module;
+
+		obs_init_module(module);
+	}
+}
+
+static inline double ms_between(uint64_t start, uint64_t end)
+{
+	return (double)(end - start) / 1000000.0;
+}
+
+static void log_module_timeline(struct module_loader *loader)
+{
+	blog(LOG_INFO, "Module load timeline (ms since loading started):");
+
+	for (size_t i = 0; i < loader->jobs.num; i++) {
+		struct module_load_job *job = loader->jobs.array + i;
+		struct obs_module *module = job->module;
+
+		if (!module)
+			continue;
+
+		blog(LOG_INFO, "  open %8.1f +%7.1f  init %8.1f +%7.1f  %s%s",
+				ms_between(loader->start, job->open_start),
+				ms_between(0, job->open_ns),
+				ms_between(loader->start, job->init_start),
+				ms_between(0, module->init_ns),
+				module->file,
+				module->loaded ? "" : " (failed)");
+	}
+
+	for (size_t i = 0; i < obs->module_manifest.num; i++) {
+		struct module_manifest_entry *entry =
+			obs->module_manifest.array + i;
+		if (entry->deferred)
+			blog(LOG_INFO, "  deferred until first use: %s",
+					get_file_name(entry->bin_path));
+	}
+
+	blog(LOG_INFO, "Modules loaded in %.1f ms (%.1f ms opening on %d "
+			"thread(s), %.1f ms initializing), %d deferred",
+			ms_between(loader->start, loader->end),
+			ms_between(loader->start, loader->open_end),
+			(int)loader->num_threads,
+			ms_between(loader->open_end, loader->end),
+			(int)loader->num_deferred);
+}
+
+static void free_module_loader(struct module_loader *loader)
+{
+	for (size_t i = 0; i < loader->jobs.num; i++) {
+		bfree(loader->jobs.array[i].bin_path);
+		bfree(loader->jobs.array[i].data_path);
+	}
+
+	da_free(loader->jobs);
 }
 
 static const char *obs_load_all_modules_name = "obs_load_all_modules";
+static const char *open_modules_name = "open_modules";
+static const char *init_modules_name = "init_modules";
 #ifdef _WIN32
 static const char *reset_win32_symbol_paths_name = "reset_win32_symbol_paths";
 #endif
 
 void obs_load_all_modules(void)
 {
+	struct module_loader loader = {0};
+
+	if (!obs)
+		return;
+
 	profile_start(obs_load_all_modules_name);
-	obs_find_modules(load_all_callback, NULL);
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	loader.start = os_gettime_ns();
+
+	load_module_manifest();
+	obs_find_modules(find_all_callback, &loader);
+
+	profile_start(open_modules_name);
+	open_modules(&loader);
+	profile_end(open_modules_name);
+	loader.open_end = os_gettime_ns();
+
+	profile_start(init_modules_name);
+	init_modules(&loader);
+	profile_end(init_modules_name);
+	loader.end = os_gettime_ns();
+
+	reserve_deferred_types();
+	save_module_manifest();
+	log_module_timeline(&loader);
+	free_module_loader(&loader);
+
+	pthread_mutex_unlock(&obs->modules_mutex);
+
 #ifdef _WIN32
 	profile_start(reset_win32_symbol_paths_name);
 	reset_win32_symbol_paths();
@@ -432,6 +1158,9 @@ void free_module(struct obs_module *mod)
 		/* os_dlclose(mod->module); */
 	}
 
+	free_module_types(mod->types.array, mod->types.num);
+	da_free(mod->types);
+
 	bfree(mod->mod_name);
 	bfree(mod->bin_path);
 	bfree(mod->data_path);
@@ -543,6 +1272,7 @@ cleanup:
 void obs_register_source_s(const struct obs_source_info *info, size_t size)
 {
 	struct obs_source_info data = {0};
+	struct module_type_id *type = NULL;
 	struct darray *array = NULL;
 
 	if (info->type == OBS_SOURCE_TYPE_INPUT) {
@@ -627,6 +1357,21 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	if (array)
 		darray_push_back(sizeof(struct obs_source_info), array, &data);
 	da_push_back(obs->source_types, &data);
+
+	/* what listing the type needs, so it can be listed from the manifest
+	 * while its module is deferred */
+	if (data.type == OBS_SOURCE_TYPE_INPUT)
+		type = add_module_type(MODULE_KIND_INPUT, info->id);
+	else if (data.type == OBS_SOURCE_TYPE_FILTER)
+		type = add_module_type(MODULE_KIND_FILTER, info->id);
+	else if (data.type == OBS_SOURCE_TYPE_TRANSITION)
+		type = add_module_type(MODULE_KIND_TRANSITION, info->id);
+
+	if (type) {
+		type->name  = dup_string(data.get_name(data.type_data));
+		type->flags = data.output_flags;
+		type->configurable = data.get_properties != NULL;
+	}
 	return;
 
 error:
@@ -635,6 +1380,9 @@ error:
 
 void obs_register_output_s(const struct obs_output_info *info, size_t size)
 {
+	const struct obs_output_info *registered;
+	struct module_type_id *type;
+
 	if (find_output(info->id)) {
 		output_warn("Output id '%s' already exists!  "
 		                  "Duplicate library?", info->id);
@@ -663,6 +1411,14 @@ void obs_register_output_s(const struct obs_output_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_output_info, obs->output_types, info);
+
+	registered = da_end(obs->output_types);
+	type = add_module_type(MODULE_KIND_OUTPUT, info->id);
+	if (type) {
+		type->name  = dup_string(registered->get_name(
+					registered->type_data));
+		type->flags = registered->flags;
+	}
 	return;
 
 error:
@@ -671,6 +1427,9 @@ error:
 
 void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
 {
+	const struct obs_encoder_info *registered;
+	struct module_type_id *type;
+
 	if (find_encoder(info->id)) {
 		encoder_warn("Encoder id '%s' already exists!  "
 		                  "Duplicate library?", info->id);
@@ -689,6 +1448,15 @@ void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_encoder_info, obs->encoder_types, info);
+
+	registered = da_end(obs->encoder_types);
+	type = add_module_type(MODULE_KIND_ENCODER, info->id);
+	if (type) {
+		type->name  = dup_string(registered->get_name(
+					registered->type_data));
+		type->flags = (uint32_t)registered->type;
+		type->codec = dup_string(registered->codec);
+	}
 	return;
 
 error:
@@ -697,6 +1465,9 @@ error:
 
 void obs_register_service_s(const struct obs_service_info *info, size_t size)
 {
+	const struct obs_service_info *registered;
+	struct module_type_id *type;
+
 	if (find_service(info->id)) {
 		service_warn("Service id '%s' already exists!  "
 		                  "Duplicate library?", info->id);
@@ -711,6 +1482,12 @@ void obs_register_service_s(const struct obs_service_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_service_info, obs->service_types, info);
+
+	registered = da_end(obs->service_types);
+	type = add_module_type(MODULE_KIND_SERVICE, info->id);
+	if (type)
+		type->name = dup_string(registered->get_name(
+					registered->type_data));
 	return;
 
 error:
@@ -727,6 +1504,7 @@ void obs_regsiter_modal_ui_s(const struct obs_modal_ui *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_modal_ui, obs->modal_ui_callbacks, info);
+	add_module_type(MODULE_KIND_UI, info->id);
 	return;
 
 error:
@@ -744,6 +1522,7 @@ void obs_regsiter_modeless_ui_s(const struct obs_modeless_ui *info, size_t size)
 
 	REGISTER_OBS_DEF(size, obs_modeless_ui, obs->modeless_ui_callbacks,
 			info);
+	add_module_type(MODULE_KIND_UI, info->id);
 	return;
 
 error:
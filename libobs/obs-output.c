@@ -50,7 +50,7 @@ static inline bool data_capture_ending(const struct obs_output *output)
 	return os_atomic_load_bool(&output->end_data_capture_thread_active);
 }
 
-const struct obs_output_info *find_output(const char *id)
+static const struct obs_output_info *find_output_info(const char *id)
 {
 	size_t i;
 	for (i = 0; i < obs->output_types.num; i++)
@@ -60,9 +60,29 @@ const struct obs_output_info *find_output(const char *id)
 	return NULL;
 }
 
+const struct obs_output_info *find_output(const char *id)
+{
+	const struct obs_output_info *info = find_output_info(id);
+	if (!info && obs_load_deferred_module(MODULE_KIND_OUTPUT, id))
+		info = find_output_info(id);
+	return info;
+}
+
 const char *obs_output_get_display_name(const char *id)
 {
-	const struct obs_output_info *info = find_output(id);
+	const struct obs_output_info *info = find_output_info(id);
+	const char *name;
+
+	/* listed from the module manifest while the module is deferred */
+	if (!info) {
+		name = obs_get_deferred_type_name(
+				obs_find_deferred_type(MODULE_KIND_OUTPUT, id));
+		if (name)
+			return name;
+
+		info = find_output(id);
+	}
+
 	return (info != NULL) ? info->get_name(info->type_data) : NULL;
 }
 
@@ -94,14 +114,22 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 {
 	const struct obs_output_info *info = find_output(id);
 	struct obs_output *output;
+	pthread_mutexattr_t attr;
 	int ret;
 
 	output = bzalloc(sizeof(struct obs_output));
 	pthread_mutex_init_value(&output->interleaved_mutex);
+	pthread_mutex_init_value(&output->packet_mutex);
 	pthread_mutex_init_value(&output->delay_mutex);
 
+	if (pthread_mutexattr_init(&attr) != 0)
+		goto fail;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		goto fail;
 	if (pthread_mutex_init(&output->interleaved_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&output->packet_mutex, &attr) != 0)
+		goto fail;
 	if (pthread_mutex_init(&output->delay_mutex, NULL) != 0)
 		goto fail;
 	if (os_event_init(&output->stopping_event, OS_EVENT_TYPE_MANUAL) != 0)
@@ -157,8 +185,9 @@ fail:
 static inline void free_packets(struct obs_output *output)
 {
 	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_free_encoder_packet(output->interleaved_packets.array+i);
+		obs_encoder_packet_release(output->interleaved_packets.array+i);
 	da_free(output->interleaved_packets);
+	interleaver_free(&output->interleaver);
 }
 
 void obs_output_destroy(obs_output_t *output)
@@ -197,6 +226,7 @@ void obs_output_destroy(obs_output_t *output)
 
 		os_event_destroy(output->stopping_event);
 		pthread_mutex_destroy(&output->interleaved_mutex);
+		pthread_mutex_destroy(&output->packet_mutex);
 		pthread_mutex_destroy(&output->delay_mutex);
 		os_event_destroy(output->reconnect_stop_event);
 		obs_context_data_free(&output->context);
@@ -302,6 +332,21 @@ static void log_frame_info(struct obs_output *output)
 				"to encoding lag: %"PRIu32" (%0.1f%%)",
 				output->context.name,
 				skipped, percentage_skipped);
+	if (output->video_encoder) {
+		obs_encoder_t *encoder = output->video_encoder;
+		uint32_t enc_total   = obs_encoder_get_total_frames(encoder);
+		uint32_t enc_skipped = obs_encoder_get_skipped_frames(encoder);
+
+		if (enc_total && enc_skipped)
+			blog(LOG_INFO, "Output '%s': Number of frames skipped "
+					"by encoder '%s' due to its own "
+					"encoding lag: %"PRIu32" (%0.1f%%)",
+					output->context.name,
+					obs_encoder_get_name(encoder),
+					enc_skipped,
+					(double)enc_skipped /
+					(double)enc_total * 100.0);
+	}
 	if (drawn && lagged)
 		blog(LOG_INFO, "Output '%s': Number of lagged frames due "
 				"to rendering lag/stalls: %"PRIu32" (%0.1f%%)",
@@ -673,6 +718,19 @@ int obs_output_get_frames_dropped(const obs_output_t *output)
 	return output->info.get_dropped_frames(output->context.data);
 }
 
+bool obs_output_get_transport_stats(const obs_output_t *output,
+		struct obs_transport_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (!obs_output_valid(output, "obs_output_get_transport_stats"))
+		return false;
+	if (!output->info.get_transport_stats)
+		return false;
+
+	return output->info.get_transport_stats(output->context.data, stats);
+}
+
 int obs_output_get_total_frames(const obs_output_t *output)
 {
 	return obs_output_valid(output, "obs_output_get_total_frames") ?
@@ -944,20 +1002,21 @@ static inline bool has_higher_opposing_ts(struct obs_output *output,
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet *next = interleaver_peek(&output->interleaver);
+	struct encoder_packet out;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timstamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	if (!next || !has_higher_opposing_ts(output, next))
 		return;
 
-	if (out.type == OBS_ENCODER_VIDEO)
+	if (next->type == OBS_ENCODER_VIDEO)
 		output->total_frames++;
 
-	da_erase(output->interleaved_packets, 0);
+	interleaver_pop(&output->interleaver, &out);
 	output->info.encoded_packet(output->context.data, &out);
-	obs_free_encoder_packet(&out);
+	obs_encoder_packet_release(&out);
 }
 
 static inline void set_higher_ts(struct obs_output *output,
@@ -1056,7 +1115,7 @@ static void discard_to_idx(struct obs_output *output, size_t idx)
 	for (size_t i = 0; i < idx; i++) {
 		struct encoder_packet *packet =
 			&output->interleaved_packets.array[i];
-		obs_free_encoder_packet(packet);
+		obs_encoder_packet_release(packet);
 	}
 
 	da_erase_range(output->interleaved_packets, 0, idx);
@@ -1265,6 +1324,18 @@ static void resort_interleaved_packets(struct obs_output *output)
 	da_free(old_array);
 }
 
+/* once the start has been lined up, the sorted packets are moved over to
+ * the per-track interleaver in order, which keeps the order of packets with
+ * equal timestamps */
+static void start_merging_packets(struct obs_output *output)
+{
+	for (size_t i = 0; i < output->interleaved_packets.num; i++)
+		interleaver_push(&output->interleaver,
+				&output->interleaved_packets.array[i]);
+
+	da_free(output->interleaved_packets);
+}
+
 static void discard_unused_audio_packets(struct obs_output *output,
 		int64_t dts_usec)
 {
@@ -1304,7 +1375,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 		pthread_mutex_unlock(&output->interleaved_mutex);
 
 		if (output->active_delay_ns)
-			obs_free_encoder_packet(packet);
+			obs_encoder_packet_release(packet);
 		return;
 	}
 
@@ -1313,14 +1384,16 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_duplicate_encoder_packet(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
-	if (was_started)
+	if (was_started) {
 		apply_interleaved_packet_offset(output, &out);
-	else
+		interleaver_push(&output->interleaver, &out);
+	} else {
 		check_received(output, packet);
+		insert_interleaved_packet(output, &out);
+	}
 
-	insert_interleaved_packet(output, &out);
 	set_higher_ts(output, &out);
 
 	/* when both video and audio have been received, we're ready
@@ -1330,6 +1403,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 			if (prune_interleaved_packets(output)) {
 				if (initialize_interleaved_packets(output)) {
 					resort_interleaved_packets(output);
+					start_merging_packets(output);
 					send_interleaved(output);
 				}
 			}
@@ -1345,6 +1419,8 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 {
 	struct obs_output *output = param;
 
+	pthread_mutex_lock(&output->packet_mutex);
+
 	if (data_active(output)) {
 		if (packet->type == OBS_ENCODER_AUDIO)
 			packet->track_idx = get_track_index(output, packet);
@@ -1355,8 +1431,39 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 			output->total_frames++;
 	}
 
+	pthread_mutex_unlock(&output->packet_mutex);
+
 	if (output->active_delay_ns)
-		obs_free_encoder_packet(packet);
+		obs_encoder_packet_release(packet);
+}
+
+static void receive_slice(void *param, struct encoder_slice *slice)
+{
+	struct obs_output    *output = param;
+	struct encoder_slice out     = *slice;
+	bool                 started = true;
+
+	/* slices cannot be held back with the rest of the delayed data */
+	if (!data_active(output) || delay_active(output))
+		return;
+
+	/* slices only follow frames that have gone out, and need the same
+	 * offset as the interleaved packets */
+	if (output->info.flags & OBS_OUTPUT_AUDIO) {
+		int64_t offset;
+
+		pthread_mutex_lock(&output->interleaved_mutex);
+		started = output->received_audio && output->received_video;
+		offset = output->video_offset;
+		pthread_mutex_unlock(&output->interleaved_mutex);
+
+		out.dts -= offset;
+		out.pts -= offset;
+		out.dts_usec = slice_dts_usec(&out);
+	}
+
+	if (started)
+		output->info.encoded_slice(output->context.data, &out);
 }
 
 static void default_raw_video_callback(void *param, struct video_data *frame)
@@ -1437,6 +1544,10 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 			               preserve_active(output) ? "on" : "off");
 		}
 
+		if (has_video && output->info.encoded_slice)
+			obs_encoder_add_slice_callback(output->video_encoder,
+					receive_slice, output);
+
 		if (has_audio)
 			start_audio_encoders(output, encoded_callback);
 		if (has_video)
@@ -1690,6 +1801,10 @@ static void *end_data_capture_thread(void *data)
 			encoded_callback = (has_video && has_audio) ?
 				interleave_packets : default_encoded_callback;
 
+		if (has_video && output->info.encoded_slice)
+			obs_encoder_remove_slice_callback(output->video_encoder,
+					receive_slice, output);
+
 		if (has_video)
 			obs_encoder_stop(output->video_encoder,
 					encoded_callback, output);
@@ -30,6 +30,37 @@ extern "C" {
 
 struct encoder_packet;
 
+/**
+ * Statistics of outputs that send over a network.  The window_ values cover
+ * the last few reports of the transport, window_ms long in total.
+ */
+struct obs_transport_stats {
+	/** os_gettime_ns() of the last report, 0 if there was none yet */
+	uint64_t timestamp;
+
+	/* totals since the output connected */
+	uint64_t packets_sent;
+	uint64_t nack_requests;
+
+	/* last report */
+	int      avg_xmit_delay_ms;
+	int      min_xmit_delay_ms;
+	int      max_xmit_delay_ms;
+	float    queued_fps;
+	float    queued_kbps;
+	float    sent_fps;
+	float    sent_kbps;
+	int      queue_fullness;
+	int      max_frame_size;
+
+	/* rolling window */
+	uint32_t window_ms;
+	float    window_loss_pct;
+	float    window_xmit_delay_ms;
+	int      window_max_xmit_delay_ms;
+	float    window_sent_kbps;
+};
+
 struct obs_output_info {
 	/* required */
 	const char *id;
@@ -64,6 +95,12 @@ struct obs_output_info {
 
 	void *type_data;
 	void (*free_type_data)(void *type_data);
+
+	bool (*get_transport_stats)(void *data,
+			struct obs_transport_stats *stats);
+
+	/* optional, receives video slices ahead of their encoded frame */
+	void (*encoded_slice)(void *data, struct encoder_slice *slice);
 };
 
 EXPORT void obs_register_output_s(const struct obs_output_info *info,
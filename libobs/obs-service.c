@@ -17,7 +17,7 @@
 
 #include "obs-internal.h"
 
-const struct obs_service_info *find_service(const char *id)
+static const struct obs_service_info *find_service_info(const char *id)
 {
 	size_t i;
 	for (i = 0; i < obs->service_types.num; i++)
@@ -27,9 +27,29 @@ const struct obs_service_info *find_service(const char *id)
 	return NULL;
 }
 
+const struct obs_service_info *find_service(const char *id)
+{
+	const struct obs_service_info *info = find_service_info(id);
+	if (!info && obs_load_deferred_module(MODULE_KIND_SERVICE, id))
+		info = find_service_info(id);
+	return info;
+}
+
 const char *obs_service_get_display_name(const char *id)
 {
-	const struct obs_service_info *info = find_service(id);
+	const struct obs_service_info *info = find_service_info(id);
+	const char *name;
+
+	/* listed from the module manifest while the module is deferred */
+	if (!info) {
+		name = obs_get_deferred_type_name(
+				obs_find_deferred_type(MODULE_KIND_SERVICE, id));
+		if (name)
+			return name;
+
+		info = find_service(id);
+	}
+
 	return (info != NULL) ? info->get_name(info->type_data) : NULL;
 }
 
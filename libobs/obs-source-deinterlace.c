@@ -31,6 +31,7 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 		while (source->async_frames.num > 2) {
 			da_erase(source->async_frames, 0);
 			remove_async_frame(source, next_frame);
+			source->async_frames_late++;
 			next_frame = source->async_frames.array[0];
 		}
 
@@ -62,6 +63,7 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 		if (prev_frame) {
 			da_erase(source->async_frames, 0);
 			remove_async_frame(source, prev_frame);
+			source->async_frames_late++;
 		}
 
 		if (source->async_frames.num <= 2) {
@@ -238,6 +240,10 @@ void deinterlace_update_async_video(obs_source_t *source)
 	if (source->deinterlace_rendered)
 		return;
 
+	/* deinterlacing may have just been enabled with a progressive
+	 * upload still in flight */
+	finish_async_upload(source, true);
+
 	frame = get_prev_frame(source, &updated);
 
 	source->deinterlace_rendered = true;
@@ -39,7 +39,7 @@ static inline bool deinterlacing_enabled(const struct obs_source *source)
 	return source->deinterlace_mode != OBS_DEINTERLACE_MODE_DISABLE;
 }
 
-const struct obs_source_info *get_source_info(const char *id)
+static const struct obs_source_info *find_source_info(const char *id)
 {
 	for (size_t i = 0; i < obs->source_types.num; i++) {
 		struct obs_source_info *info = &obs->source_types.array[i];
@@ -50,6 +50,14 @@ const struct obs_source_info *get_source_info(const char *id)
 	return NULL;
 }
 
+const struct obs_source_info *get_source_info(const char *id)
+{
+	const struct obs_source_info *info = find_source_info(id);
+	if (!info && obs_load_deferred_module(MODULE_KIND_SOURCE, id))
+		info = find_source_info(id);
+	return info;
+}
+
 static const char *source_signals[] = {
 	"void destroy(ptr source)",
 	"void remove(ptr source)",
@@ -92,9 +100,25 @@ bool obs_source_init_context(struct obs_source *source,
 			source_signals);
 }
 
+/* types of deferred modules are listed from the module manifest, so the
+ * queries used while listing them don't load the module either */
+static inline const struct module_type_id *find_deferred_source(
+		const char *id)
+{
+	return find_source_info(id) ? NULL :
+		obs_find_deferred_type(MODULE_KIND_SOURCE, id);
+}
+
 const char *obs_source_get_display_name(const char *id)
 {
-	const struct obs_source_info *info = get_source_info(id);
+	const struct module_type_id *type = find_deferred_source(id);
+	const struct obs_source_info *info;
+	const char *name = obs_get_deferred_type_name(type);
+
+	if (name)
+		return name;
+
+	info = get_source_info(id);
 	return (info != NULL) ? info->get_name(info->type_data) : NULL;
 }
 
@@ -456,10 +480,22 @@ void obs_source_frame_init(struct obs_source_frame *frame,
 	}
 }
 
+/* frames output with obs_source_output_video_nocopy reference data owned by
+ * the source, which gets it back through the release callback */
+static inline void async_frame_destroy(struct obs_source_frame *frame)
+{
+	if (frame->release) {
+		frame->release(frame->release_param, frame, frame->rendered);
+		bfree(frame);
+	} else {
+		obs_source_frame_destroy(frame);
+	}
+}
+
 static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 {
 	if (os_atomic_dec_long(&frame->refs) == 0)
-		obs_source_frame_destroy(frame);
+		async_frame_destroy(frame);
 }
 
 static bool obs_source_filter_remove_refless(obs_source_t *source,
@@ -511,6 +547,8 @@ void obs_source_destroy(struct obs_source *source)
 		obs_source_frame_decref(source->async_cache.array[i].frame);
 
 	gs_enter_context(obs->video.graphics);
+	finish_async_upload(source, true);
+	free_async_upload_buffers(source);
 	if (source->async_texrender)
 		gs_texrender_destroy(source->async_texrender);
 	if (source->async_prev_texrender)
@@ -544,6 +582,7 @@ void obs_source_destroy(struct obs_source *source)
 	pthread_mutex_destroy(&source->audio_cb_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
+	os_event_destroy(source->async_upload.done);
 	obs_context_data_free(&source->context);
 
 	if (source->owns_info_id)
@@ -684,7 +723,13 @@ obs_properties_t *obs_get_source_properties(const char *id)
 
 bool obs_is_source_configurable(const char *id)
 {
-	const struct obs_source_info *info = get_source_info(id);
+	const struct module_type_id *type = find_deferred_source(id);
+	const struct obs_source_info *info;
+
+	if (type)
+		return type->configurable;
+
+	info = get_source_info(id);
 	return info && info->get_properties;
 }
 
@@ -717,7 +762,13 @@ uint32_t obs_source_get_output_flags(const obs_source_t *source)
 
 uint32_t obs_get_source_output_flags(const char *id)
 {
-	const struct obs_source_info *info = get_source_info(id);
+	const struct module_type_id *type = find_deferred_source(id);
+	const struct obs_source_info *info;
+
+	if (type)
+		return type->flags;
+
+	info = get_source_info(id);
 	return info ? info->output_flags : 0;
 }
 
@@ -1345,6 +1396,8 @@ bool set_async_texture_size(struct obs_source *source,
 
 	gs_enter_context(obs->video.graphics);
 
+	finish_async_upload(source, true);
+
 	gs_texture_destroy(source->async_texture);
 	gs_texture_destroy(source->async_prev_texture);
 	gs_texrender_destroy(source->async_texrender);
@@ -1447,14 +1500,12 @@ static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
 	gs_effect_set_float(param, val);
 }
 
-static bool update_async_texrender(struct obs_source *source,
-		const struct obs_source_frame *frame,
+static bool convert_async_texture(struct obs_source *source,
+		enum video_format format,
 		gs_texture_t *tex, gs_texrender_t *texrender)
 {
 	gs_texrender_reset(texrender);
 
-	upload_raw_frame(tex, frame);
-
 	uint32_t cx = source->async_width;
 	uint32_t cy = source->async_height;
 
@@ -1463,7 +1514,7 @@ static bool update_async_texrender(struct obs_source *source,
 
 	gs_effect_t *conv = obs->video.conversion_effect;
 	gs_technique_t *tech = gs_effect_get_technique(conv,
-			select_conversion_technique(frame->format));
+			select_conversion_technique(format));
 
 	if (!gs_texrender_begin(texrender, cx, cy))
 		return false;
@@ -1503,14 +1554,17 @@ static bool update_async_texrender(struct obs_source *source,
 	return true;
 }
 
-bool update_async_texture(struct obs_source *source,
+static bool update_async_texrender(struct obs_source *source,
 		const struct obs_source_frame *frame,
 		gs_texture_t *tex, gs_texrender_t *texrender)
 {
-	enum convert_type type      = get_convert_type(frame->format);
-	uint8_t           *ptr;
-	uint32_t          linesize;
+	upload_raw_frame(tex, frame);
+	return convert_async_texture(source, frame->format, tex, texrender);
+}
 
+static inline void set_async_frame_info(struct obs_source *source,
+		const struct obs_source_frame *frame)
+{
 	source->async_flip       = frame->flip;
 	source->async_full_range = frame->full_range;
 	memcpy(source->async_color_matrix, frame->color_matrix,
@@ -1519,6 +1573,49 @@ bool update_async_texture(struct obs_source *source,
 			sizeof frame->color_range_min);
 	memcpy(source->async_color_range_max, frame->color_range_max,
 			sizeof frame->color_range_max);
+}
+
+static void decompress_frame(const struct obs_source_frame *frame,
+		uint8_t *ptr, uint32_t linesize)
+{
+	switch (get_convert_type(frame->format)) {
+	case CONVERT_420:
+		decompress_420((const uint8_t* const*)frame->data,
+				frame->linesize,
+				0, frame->height, ptr, linesize);
+		break;
+
+	case CONVERT_NV12:
+		decompress_nv12((const uint8_t* const*)frame->data,
+				frame->linesize,
+				0, frame->height, ptr, linesize);
+		break;
+
+	case CONVERT_422_Y:
+		decompress_422(frame->data[0], frame->linesize[0],
+				0, frame->height, ptr, linesize, true);
+		break;
+
+	case CONVERT_422_U:
+		decompress_422(frame->data[0], frame->linesize[0],
+				0, frame->height, ptr, linesize, false);
+		break;
+
+	case CONVERT_NONE:
+		assert(false && "No conversion requested");
+		break;
+	}
+}
+
+bool update_async_texture(struct obs_source *source,
+		const struct obs_source_frame *frame,
+		gs_texture_t *tex, gs_texrender_t *texrender)
+{
+	enum convert_type type      = get_convert_type(frame->format);
+	uint8_t           *ptr;
+	uint32_t          linesize;
+
+	set_async_frame_info(source, frame);
 
 	if (source->async_gpu_conversion && texrender)
 		return update_async_texrender(source, frame, tex, texrender);
@@ -1532,25 +1629,216 @@ bool update_async_texture(struct obs_source *source,
 	if (!gs_texture_map(tex, &ptr, &linesize))
 		return false;
 
-	if (type == CONVERT_420)
-		decompress_420((const uint8_t* const*)frame->data,
-				frame->linesize,
-				0, frame->height, ptr, linesize);
+	decompress_frame(frame, ptr, linesize);
 
-	else if (type == CONVERT_NV12)
-		decompress_nv12((const uint8_t* const*)frame->data,
-				frame->linesize,
-				0, frame->height, ptr, linesize);
+	gs_texture_unmap(tex);
+	return true;
+}
 
-	else if (type == CONVERT_422_Y)
-		decompress_422(frame->data[0], frame->linesize[0],
-				0, frame->height, ptr, linesize, true);
+/* ------------------------------------------------------------------------- */
+/* asynchronous texture upload */
 
-	else if (type == CONVERT_422_U)
-		decompress_422(frame->data[0], frame->linesize[0],
-				0, frame->height, ptr, linesize, false);
+/* copies rows of a packed plane into a mapped texture, clamping to the
+ * smaller of the two pitches */
+static void copy_rows(uint8_t *dst, uint32_t dst_linesize,
+		const uint8_t *src, uint32_t src_linesize, uint32_t rows)
+{
+	uint32_t row_size = src_linesize < dst_linesize ?
+		src_linesize : dst_linesize;
 
-	gs_texture_unmap(tex);
+	if (src_linesize == dst_linesize) {
+		memcpy(dst, src, (size_t)src_linesize * rows);
+		return;
+	}
+
+	for (uint32_t y = 0; y < rows; y++) {
+		memcpy(dst, src, row_size);
+		dst += dst_linesize;
+		src += src_linesize;
+	}
+}
+
+/* called from the upload thread: does the same work as upload_raw_frame or
+ * the decompression in update_async_texture, but into memory that was mapped
+ * on the graphics thread */
+void copy_async_upload(struct async_upload *upload)
+{
+	const struct obs_source_frame *frame = upload->frame;
+	uint64_t start = os_gettime_ns();
+
+	if (!upload->raw) {
+		decompress_frame(frame, upload->ptr, upload->linesize);
+
+	} else {
+		enum convert_type type = get_convert_type(frame->format);
+		uint32_t src_linesize = frame->linesize[0];
+
+		/* planar formats are uploaded to a single tall R8 texture,
+		 * the same as upload_raw_frame */
+		if (type == CONVERT_420 || type == CONVERT_NV12)
+			src_linesize = frame->width;
+
+		copy_rows(upload->ptr, upload->linesize, frame->data[0],
+				src_linesize, upload->rows);
+	}
+
+	upload->copy_time = os_gettime_ns() - start;
+	os_event_signal(upload->done);
+}
+
+/* the upload finishes on the next render, which delays the source by a
+ * frame, so sources have to ask for it, and unbuffered ones never get it */
+static inline bool async_upload_enabled(struct obs_source *source,
+		const struct obs_source_frame *frame)
+{
+	uint32_t flags = source->flags;
+
+	return obs->video.upload_thread_active &&
+		(flags & OBS_SOURCE_FLAG_UPLOAD_THREAD) != 0 &&
+		(flags & OBS_SOURCE_FLAG_UNBUFFERED) == 0 &&
+		!deinterlacing_enabled(source) &&
+		source->async_texture &&
+		source->async_width  == frame->width &&
+		source->async_height == frame->height &&
+		source->async_format == frame->format;
+}
+
+void free_async_upload_buffers(struct obs_source *source)
+{
+	for (size_t i = 0; i < ASYNC_UPLOAD_BUFFERS; i++) {
+		struct async_upload_buffer *buf =
+			&source->async_upload_buffers[i];
+
+		gs_sync_destroy(buf->sync);
+		gs_texture_destroy(buf->texture);
+		buf->sync    = NULL;
+		buf->texture = NULL;
+	}
+}
+
+/* waits for the GPU to finish copying out of the buffer the last time it was
+ * used, and (re)creates its texture to match the async texture */
+static bool prepare_upload_buffer(struct obs_source *source,
+		struct async_upload_buffer *buf)
+{
+	gs_texture_t         *tex    = source->async_texture;
+	uint32_t             cx      = gs_texture_get_width(tex);
+	uint32_t             cy      = gs_texture_get_height(tex);
+	enum gs_color_format format = gs_texture_get_color_format(tex);
+
+	if (buf->sync) {
+		if (!gs_sync_wait(buf->sync))
+			return false;
+
+		gs_sync_destroy(buf->sync);
+		buf->sync = NULL;
+	}
+
+	if (buf->texture &&
+	    gs_texture_get_width(buf->texture)        == cx &&
+	    gs_texture_get_height(buf->texture)       == cy &&
+	    gs_texture_get_color_format(buf->texture) == format)
+		return true;
+
+	gs_texture_destroy(buf->texture);
+	buf->texture = gs_texture_create(cx, cy, format, 1, NULL, GS_DYNAMIC);
+	return buf->texture != NULL;
+}
+
+static bool start_async_upload(struct obs_source *source,
+		struct obs_source_frame *frame)
+{
+	struct obs_core_video *video = &obs->video;
+	struct async_upload *upload = &source->async_upload;
+	struct async_upload_buffer *buf =
+		&source->async_upload_buffers[source->async_upload_next];
+	uint64_t start = os_gettime_ns();
+
+	if (!upload->done && os_event_init(&upload->done,
+				OS_EVENT_TYPE_AUTO) != 0)
+		return false;
+
+	if (!prepare_upload_buffer(source, buf))
+		return false;
+	if (!gs_texture_map(buf->texture, &upload->ptr, &upload->linesize))
+		return false;
+
+	upload->frame     = frame;
+	upload->texture   = buf->texture;
+	upload->rows      = source->async_gpu_conversion ?
+		source->async_convert_height : frame->height;
+	upload->raw       = source->async_gpu_conversion ||
+		get_convert_type(frame->format) == CONVERT_NONE;
+	upload->copy_time = 0;
+
+	pthread_mutex_lock(&video->upload_mutex);
+	if (video->upload_thread_stop) {
+		pthread_mutex_unlock(&video->upload_mutex);
+		gs_texture_unmap(upload->texture);
+		upload->frame = NULL;
+		upload->texture = NULL;
+		return false;
+	}
+
+	da_push_back(video->upload_queue, &upload);
+	upload->pending = true;
+	pthread_mutex_unlock(&video->upload_mutex);
+
+	os_sem_post(video->upload_sem);
+
+	source->async_upload_wait_time += os_gettime_ns() - start;
+	return true;
+}
+
+/* completes an upload started on an earlier frame.  returns false if the
+ * upload thread hasn't finished copying yet and wait is false, in which case
+ * the previous texture contents are still what's drawn.  the async texture is
+ * always replaced after finishing the upload, so the buffer still matches */
+bool finish_async_upload(struct obs_source *source, bool wait)
+{
+	struct async_upload *upload = &source->async_upload;
+	struct obs_source_frame *frame = upload->frame;
+	struct async_upload_buffer *buf =
+		&source->async_upload_buffers[source->async_upload_next];
+	uint64_t start = os_gettime_ns();
+	bool converted = true;
+
+	if (!upload->pending)
+		return true;
+
+	if (wait)
+		os_event_wait(upload->done);
+	else if (os_event_try(upload->done) == EAGAIN)
+		return false;
+
+	gs_texture_unmap(upload->texture);
+	gs_copy_texture(source->async_texture, upload->texture);
+
+	buf->sync = gs_sync_create();
+	if (++source->async_upload_next == ASYNC_UPLOAD_BUFFERS)
+		source->async_upload_next = 0;
+
+	set_async_frame_info(source, frame);
+
+	if (source->async_gpu_conversion && source->async_texrender)
+		converted = convert_async_texture(source, frame->format,
+				source->async_texture,
+				source->async_texrender);
+
+	pthread_mutex_lock(&source->async_mutex);
+	if (converted)
+		source->async_frames_uploaded++;
+	source->async_upload_bytes     += (uint64_t)upload->linesize *
+		upload->rows;
+	source->async_upload_copy_time += upload->copy_time;
+	source->async_upload_wait_time += os_gettime_ns() - start;
+	pthread_mutex_unlock(&source->async_mutex);
+
+	upload->pending = false;
+	upload->frame   = NULL;
+	upload->texture = NULL;
+
+	obs_source_release_frame(source, frame);
 	return true;
 }
 
@@ -1617,8 +1905,15 @@ static void obs_source_draw_async_texture(struct obs_source *source)
 static void obs_source_update_async_video(obs_source_t *source)
 {
 	if (!source->async_rendered) {
-		struct obs_source_frame *frame = obs_source_get_frame(source);
+		struct obs_source_frame *unfiltered;
+		struct obs_source_frame *frame;
+
+		/* keep drawing the last texture until the pending upload is
+		 * complete, the next frame stays queued until then */
+		if (!finish_async_upload(source, false))
+			return;
 
+		frame = unfiltered = obs_source_get_frame(source);
 		if (frame)
 			frame = filter_async_video(source, frame);
 
@@ -1629,10 +1924,18 @@ static void obs_source_update_async_video(obs_source_t *source)
 			source->timing_set = true;
 
 			if (source->async_update_texture) {
+				source->async_update_texture = false;
+
+				/* the frame is released once the upload
+				 * thread has finished copying it */
+				if (frame == unfiltered &&
+				    async_upload_enabled(source, frame) &&
+				    start_async_upload(source, frame))
+					return;
+
 				update_async_texture(source, frame,
 						source->async_texture,
 						source->async_texrender);
-				source->async_update_texture = false;
 			}
 
 			obs_source_release_frame(source, frame);
@@ -2174,7 +2477,7 @@ static void clean_cache(obs_source_t *source)
 		struct async_frame *af = &source->async_cache.array[i - 1];
 		if (!af->used) {
 			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
+				async_frame_destroy(af->frame);
 				da_erase(source->async_cache, i - 1);
 			}
 		}
@@ -2183,6 +2486,87 @@ static void clean_cache(obs_source_t *source)
 
 #define MAX_ASYNC_FRAMES 30
 
+static inline void drop_async_frame(struct obs_source *source, size_t idx)
+{
+	struct obs_source_frame *frame = source->async_frames.array[idx];
+
+	da_erase(source->async_frames, idx);
+	remove_async_frame(source, frame);
+	source->async_frames_dropped++;
+}
+
+/* finds the queued frame closest in time to its predecessor, which is the
+ * one whose absence is least noticeable */
+static size_t nearest_async_frame(const struct obs_source *source)
+{
+	struct obs_source_frame **frames = source->async_frames.array;
+	uint64_t min_diff = UINT64_MAX;
+	size_t idx = 0;
+
+	for (size_t i = 1; i < source->async_frames.num; i++) {
+		uint64_t diff = uint64_diff(frames[i]->timestamp,
+				frames[i - 1]->timestamp);
+		if (diff < min_diff) {
+			min_diff = diff;
+			idx = i;
+		}
+	}
+
+	return idx;
+}
+
+/*
+ * Makes room for a new async frame.  Rather than flushing the whole queue
+ * (which stutters, reallocates every frame and forces timing to be
+ * resynchronized), individual frames are dropped according to the drop
+ * policy.  If a target latency is set and the new frame is further ahead
+ * of playback than that, playback is moved forward and frames that would
+ * never be displayed are released.
+ *
+ * Without a target latency, a source whose clock runs faster than the
+ * system clock keeps the queue full, and dropping single frames would keep
+ * it a full queue behind forever.  So if the queue stays full for as many
+ * frames as it holds, the queued frames are dropped and playback is
+ * resynchronized to the new frame.
+ */
+static void trim_async_frames(struct obs_source *source, uint64_t new_ts)
+{
+	bool full = source->async_frames.num >= MAX_ASYNC_FRAMES;
+
+	while (source->async_frames.num >= MAX_ASYNC_FRAMES) {
+		size_t idx = 0;
+		if (source->async_drop_policy == OBS_ASYNC_DROP_NEAREST)
+			idx = nearest_async_frame(source);
+		drop_async_frame(source, idx);
+	}
+
+	if (!full || source->async_target_latency) {
+		source->async_full_count = 0;
+
+	} else if (++source->async_full_count == MAX_ASYNC_FRAMES) {
+		while (source->async_frames.num)
+			drop_async_frame(source, 0);
+
+		source->async_full_count = 0;
+		source->last_frame_ts = 0;
+		return;
+	}
+
+	if (!source->async_target_latency || !source->last_frame_ts)
+		return;
+	if (frame_out_of_bounds(source, new_ts))
+		return;
+	if (new_ts <= source->last_frame_ts + source->async_target_latency)
+		return;
+
+	source->last_frame_ts = new_ts - source->async_target_latency;
+
+	while (source->async_frames.num > 1 &&
+	       source->async_frames.array[1]->timestamp <=
+			source->last_frame_ts)
+		drop_async_frame(source, 0);
+}
+
 static inline struct obs_source_frame *cache_video(struct obs_source *source,
 		const struct obs_source_frame *frame)
 {
@@ -2190,12 +2574,8 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source,
 
 	pthread_mutex_lock(&source->async_mutex);
 
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
-		free_async_cache(source);
-		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
-	}
+	source->async_frames_received++;
+	trim_async_frames(source, frame->timestamp);
 
 	if (async_texture_changed(source, frame)) {
 		free_async_cache(source);
@@ -2208,6 +2588,7 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source,
 		struct async_frame *af = &source->async_cache.array[i];
 		if (!af->used) {
 			new_frame = af->frame;
+			new_frame->rendered = false;
 			af->used = true;
 			af->unused_count = 0;
 			break;
@@ -2267,6 +2648,52 @@ void obs_source_output_video(obs_source_t *source,
 	}
 }
 
+void obs_source_output_video_nocopy(obs_source_t *source,
+		const struct obs_source_frame *frame,
+		obs_source_frame_release_t release, void *param)
+{
+	struct obs_source_frame *new_frame;
+	struct async_frame new_af;
+
+	if (!obs_source_valid(source, "obs_source_output_video_nocopy"))
+		return;
+	if (!obs_ptr_valid(frame, "obs_source_output_video_nocopy"))
+		return;
+	if (!obs_ptr_valid(release, "obs_source_output_video_nocopy"))
+		return;
+
+	new_frame = bmalloc(sizeof(*new_frame));
+	*new_frame = *frame;
+	new_frame->refs          = 1;
+	new_frame->prev_frame    = false;
+	new_frame->rendered      = false;
+	new_frame->release       = release;
+	new_frame->release_param = param;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	source->async_frames_received++;
+	trim_async_frames(source, frame->timestamp);
+
+	if (async_texture_changed(source, frame)) {
+		free_async_cache(source);
+		source->async_cache_width  = frame->width;
+		source->async_cache_height = frame->height;
+		source->async_cache_format = frame->format;
+	}
+
+	/* the cache entry holds the only reference, and is removed again as
+	 * soon as the frame is no longer used */
+	new_af.frame        = new_frame;
+	new_af.used         = true;
+	new_af.unused_count = 0;
+	da_push_back(source->async_cache, &new_af);
+	da_push_back(source->async_frames, &new_frame);
+
+	pthread_mutex_unlock(&source->async_mutex);
+	source->async_active = true;
+}
+
 static inline struct obs_audio_data *filter_async_audio(obs_source_t *source,
 		struct obs_audio_data *in)
 {
@@ -2448,6 +2875,13 @@ void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 
 		if (f->frame == frame) {
 			f->used = false;
+
+			/* borrowed frames go back to their owner right away
+			 * instead of waiting to be reused */
+			if (frame->release) {
+				da_erase(source->async_cache, i);
+				obs_source_frame_decref(frame);
+			}
 			break;
 		}
 	}
@@ -2467,6 +2901,7 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 		while (source->async_frames.num > 1) {
 			da_erase(source->async_frames, 0);
 			remove_async_frame(source, next_frame);
+			source->async_frames_late++;
 			next_frame = source->async_frames.array[0];
 		}
 
@@ -2503,8 +2938,10 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 		if ((source->last_frame_ts - next_frame->timestamp) < 2000000)
 			break;
 
-		if (frame)
+		if (frame) {
 			da_erase(source->async_frames, 0);
+			source->async_frames_late++;
+		}
 
 #if DEBUG_ASYNC_FRAMES
 		blog(LOG_DEBUG, "new frame, "
@@ -2582,6 +3019,7 @@ struct obs_source_frame *obs_source_get_frame(obs_source_t *source)
 
 	if (frame) {
 		os_atomic_inc_long(&frame->refs);
+		frame->rendered = true;
 	}
 
 	pthread_mutex_unlock(&source->async_mutex);
@@ -2596,12 +3034,12 @@ void obs_source_release_frame(obs_source_t *source,
 		return;
 
 	if (!source) {
-		obs_source_frame_destroy(frame);
+		async_frame_destroy(frame);
 	} else {
 		pthread_mutex_lock(&source->async_mutex);
 
 		if (os_atomic_dec_long(&frame->refs) == 0)
-			obs_source_frame_destroy(frame);
+			async_frame_destroy(frame);
 		else
 			remove_async_frame(source, frame);
 
@@ -2609,6 +3047,51 @@ void obs_source_release_frame(obs_source_t *source,
 	}
 }
 
+void obs_source_set_async_buffer(obs_source_t *source,
+		uint32_t target_latency_ms, enum obs_async_drop_policy policy)
+{
+	if (!obs_source_valid(source, "obs_source_set_async_buffer"))
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+	source->async_target_latency = (uint64_t)target_latency_ms * 1000000ULL;
+	source->async_drop_policy = policy;
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
+uint32_t obs_source_get_async_target_latency(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_async_target_latency") ?
+		(uint32_t)(source->async_target_latency / 1000000ULL) : 0;
+}
+
+enum obs_async_drop_policy obs_source_get_async_drop_policy(
+		const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_async_drop_policy") ?
+		source->async_drop_policy : OBS_ASYNC_DROP_OLDEST;
+}
+
+void obs_source_get_async_stats(const obs_source_t *source,
+		struct obs_source_async_stats *stats)
+{
+	if (!obs_source_valid(source, "obs_source_get_async_stats"))
+		return;
+	if (!obs_ptr_valid(stats, "obs_source_get_async_stats"))
+		return;
+
+	pthread_mutex_lock((pthread_mutex_t*)&source->async_mutex);
+	stats->queue_depth     = (uint32_t)source->async_frames.num;
+	stats->frames_received = source->async_frames_received;
+	stats->frames_dropped  = source->async_frames_dropped;
+	stats->frames_late     = source->async_frames_late;
+	stats->frames_uploaded = source->async_frames_uploaded;
+	stats->upload_bytes    = source->async_upload_bytes;
+	stats->upload_copy_ns  = source->async_upload_copy_time;
+	stats->upload_wait_ns  = source->async_upload_wait_time;
+	pthread_mutex_unlock((pthread_mutex_t*)&source->async_mutex);
+}
+
 const char *obs_source_get_name(const obs_source_t *source)
 {
 	return obs_source_valid(source, "obs_source_get_name") ?
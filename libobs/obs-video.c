@@ -35,6 +35,7 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	delta_time = cur_time - last_time;
 	seconds = (float)((double)delta_time / 1000000000.0);
 
+	pthread_mutex_lock(&obs->video.tick_mutex);
 	pthread_mutex_lock(&data->sources_mutex);
 
 	/* call the tick function of each source */
@@ -45,12 +46,15 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	}
 
 	pthread_mutex_unlock(&data->sources_mutex);
+	pthread_mutex_unlock(&obs->video.tick_mutex);
 
 	return cur_time;
 }
 
 /* in obs-display.c */
 extern void render_display(struct obs_display *display);
+extern void render_display_texture(struct obs_display *display);
+extern void present_display_texture(struct obs_display *display);
 
 static inline void render_displays(void)
 {
@@ -66,6 +70,7 @@ static inline void render_displays(void)
 
 	display = obs->data.first_display;
 	while (display) {
+		display->last_render_time = 0;
 		render_display(display);
 		display = display->next;
 	}
@@ -75,6 +80,78 @@ static inline void render_displays(void)
 	gs_leave_context();
 }
 
+/* display thread: runs the draw callbacks into each display's texture and
+ * reads it back.  only the draw callbacks need the main graphics context,
+ * the swap chains are presented on the display device afterwards */
+static inline void render_display_textures(void)
+{
+	struct obs_display *display;
+
+	if (!obs->data.valid)
+		return;
+
+	pthread_mutex_lock(&obs->video.tick_mutex);
+	gs_enter_context(obs->video.graphics);
+	pthread_mutex_lock(&obs->data.displays_mutex);
+
+	display = obs->data.first_display;
+	while (display) {
+		render_display_texture(display);
+		display = display->next;
+	}
+
+	pthread_mutex_unlock(&obs->data.displays_mutex);
+	gs_leave_context();
+	pthread_mutex_unlock(&obs->video.tick_mutex);
+}
+
+static inline void present_display_textures(void)
+{
+	struct obs_display *display;
+
+	if (!obs->data.valid)
+		return;
+
+	gs_enter_context(obs->video.display_graphics);
+	pthread_mutex_lock(&obs->data.displays_mutex);
+
+	display = obs->data.first_display;
+	while (display) {
+		present_display_texture(display);
+		display = display->next;
+	}
+
+	pthread_mutex_unlock(&obs->data.displays_mutex);
+	gs_leave_context();
+}
+
+/* blames a lagged output frame on whichever display took the longest to
+ * render during that frame.  threaded displays only count the time their
+ * draw callbacks held the graphics context, which is all they can take away
+ * from the video thread, and are reset after every frame */
+static void attribute_display_lag(bool lagged, bool threaded)
+{
+	struct obs_display *display;
+	struct obs_display *slowest = NULL;
+
+	pthread_mutex_lock(&obs->data.displays_mutex);
+
+	display = obs->data.first_display;
+	while (display) {
+		if (display->last_render_time && (!slowest ||
+		    display->last_render_time > slowest->last_render_time))
+			slowest = display;
+		if (threaded)
+			display->last_render_time = 0;
+		display = display->next;
+	}
+
+	if (lagged && slowest)
+		os_atomic_inc_long(&slowest->lagged_frames);
+
+	pthread_mutex_unlock(&obs->data.displays_mutex);
+}
+
 static inline void set_render_size(uint32_t width, uint32_t height)
 {
 	gs_enable_depth_test(false);
@@ -108,6 +185,7 @@ static inline void render_main_texture(struct obs_core_video *video,
 	obs_view_render(&obs->data.main_view);
 
 	video->textures_rendered[cur_texture] = true;
+	video->last_main_texture = cur_texture;
 
 	profile_end(render_main_texture_name);
 }
@@ -575,6 +653,9 @@ void *obs_video_thread(void *param)
 	uint64_t interval = video_output_get_frame_time(obs->video.video);
 	uint64_t fps_total_ns = 0;
 	uint32_t fps_total_frames = 0;
+	uint32_t lagged_frames;
+	bool displays_rendered;
+	bool lagged;
 
 	obs->video.video_time = os_gettime_ns();
 
@@ -592,9 +673,12 @@ void *obs_video_thread(void *param)
 		last_time = tick_sources(obs->video.video_time, last_time);
 		profile_end(tick_sources_name);
 
-		profile_start(render_displays_name);
-		render_displays();
-		profile_end(render_displays_name);
+		displays_rendered = !obs->video.display_thread_active;
+		if (displays_rendered) {
+			profile_start(render_displays_name);
+			render_displays();
+			profile_end(render_displays_name);
+		}
 
 		profile_start(output_frame_name);
 		output_frame();
@@ -604,8 +688,13 @@ void *obs_video_thread(void *param)
 
 		profile_reenable_thread();
 
+		lagged_frames = obs->video.lagged_frames;
 		video_sleep(&obs->video, &obs->video.video_time, interval);
 
+		lagged = lagged_frames != obs->video.lagged_frames;
+		if (lagged || !displays_rendered)
+			attribute_display_lag(lagged, !displays_rendered);
+
 		fps_total_ns += (obs->video.video_time - last_time);
 		fps_total_frames++;
 
@@ -620,3 +709,284 @@ void *obs_video_thread(void *param)
 	UNUSED_PARAMETER(param);
 	return NULL;
 }
+
+static const char *display_thread_render_name = "render_displays";
+static const char *display_thread_present_name = "present_displays";
+static void *obs_display_thread(void *param)
+{
+	struct obs_core_video *video = &obs->video;
+	uint64_t interval = video_output_get_frame_time(video->video);
+	uint64_t next_time = os_gettime_ns();
+
+	os_set_thread_name("libobs: display thread");
+
+	const char *display_thread_name =
+		profile_store_name(obs_get_profiler_name_store(),
+			"obs_display_thread(%g"NBSP"ms)", interval / 1000000.);
+	profile_register_root(display_thread_name, interval);
+
+	while (os_event_try(video->display_thread_stop) == EAGAIN) {
+		profile_start(display_thread_name);
+
+		profile_start(display_thread_render_name);
+		render_display_textures();
+		profile_end(display_thread_render_name);
+
+		profile_start(display_thread_present_name);
+		present_display_textures();
+		profile_end(display_thread_present_name);
+
+		profile_end(display_thread_name);
+
+		profile_reenable_thread();
+
+		next_time += interval;
+		if (!os_sleepto_ns(next_time))
+			next_time = os_gettime_ns();
+	}
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+extern char *find_libobs_data_file(const char *file);
+
+static bool create_display_graphics(void)
+{
+	struct obs_core_video *video = &obs->video;
+	char *filename;
+	int errorcode;
+
+	if (!video->graphics_module)
+		return false;
+
+	errorcode = gs_create(&video->display_graphics,
+			video->graphics_module, video->adapter);
+	if (errorcode != GS_SUCCESS) {
+		video->display_graphics = NULL;
+		return false;
+	}
+
+	gs_enter_context(video->display_graphics);
+
+	filename = find_libobs_data_file("default.effect");
+	video->display_effect = gs_effect_create_from_file(filename, NULL);
+	bfree(filename);
+
+	gs_leave_context();
+
+	if (!video->display_effect) {
+		gs_destroy(video->display_graphics);
+		video->display_graphics = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static void destroy_display_graphics(void)
+{
+	struct obs_core_video *video = &obs->video;
+
+	if (!video->display_graphics)
+		return;
+
+	gs_enter_context(video->display_graphics);
+	gs_effect_destroy(video->display_effect);
+	gs_leave_context();
+
+	gs_destroy(video->display_graphics);
+	video->display_graphics = NULL;
+	video->display_effect = NULL;
+}
+
+/* moves every display's swap chain from one device to the other.  when
+ * moving back to the main device, also frees what the display thread used.
+ * each device's context is entered before the displays mutex, the same
+ * order the video and display threads use */
+static void move_display_swaps(graphics_t *from, graphics_t *to)
+{
+	bool to_main = to == obs->video.graphics;
+	struct obs_display *display;
+
+	gs_enter_context(from);
+	pthread_mutex_lock(&obs->data.displays_mutex);
+
+	for (display = obs->data.first_display; display;
+			display = display->next) {
+		if (display->swap_graphics == from)
+			obs_display_destroy_swap(display);
+		if (to_main)
+			obs_display_free_present(display);
+	}
+
+	pthread_mutex_unlock(&obs->data.displays_mutex);
+	gs_leave_context();
+
+	gs_enter_context(to);
+	pthread_mutex_lock(&obs->data.displays_mutex);
+
+	for (display = obs->data.first_display; display;
+			display = display->next) {
+		obs_display_create_swap(display, to);
+		if (to_main)
+			obs_display_free_readback(display);
+	}
+
+	pthread_mutex_unlock(&obs->data.displays_mutex);
+	gs_leave_context();
+}
+
+bool obs_start_display_thread(void)
+{
+	struct obs_core_video *video = &obs->video;
+
+	if (video->display_thread_active)
+		return true;
+
+	if (!create_display_graphics()) {
+		blog(LOG_WARNING, "Failed to create the display graphics "
+		                  "device, displays will be presented from the "
+		                  "video thread");
+		return false;
+	}
+
+	if (os_event_init(&video->display_thread_stop,
+				OS_EVENT_TYPE_MANUAL) != 0) {
+		destroy_display_graphics();
+		return false;
+	}
+
+	/* set first so new displays get their swap chain on the display
+	 * device, the video thread skips displays once they have moved */
+	video->display_thread_active = true;
+	move_display_swaps(video->graphics, video->display_graphics);
+
+	if (pthread_create(&video->display_thread, NULL, obs_display_thread,
+				NULL) != 0) {
+		blog(LOG_WARNING, "Failed to create display thread, displays "
+		                  "will be presented from the video thread");
+		video->display_thread_active = false;
+		move_display_swaps(video->display_graphics, video->graphics);
+		destroy_display_graphics();
+		os_event_destroy(video->display_thread_stop);
+		video->display_thread_stop = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void obs_stop_display_thread(void)
+{
+	struct obs_core_video *video = &obs->video;
+
+	if (!video->display_thread_active)
+		return;
+
+	os_event_signal(video->display_thread_stop);
+	pthread_join(video->display_thread, NULL);
+	os_event_destroy(video->display_thread_stop);
+
+	video->display_thread_stop = NULL;
+	video->display_thread_active = false;
+
+	move_display_swaps(video->display_graphics, video->graphics);
+	destroy_display_graphics();
+}
+
+static void *obs_upload_thread(void *param)
+{
+	struct obs_core_video *video = &obs->video;
+
+	os_set_thread_name("libobs: async texture upload thread");
+
+	for (;;) {
+		struct async_upload *upload = NULL;
+
+		os_sem_wait(video->upload_sem);
+
+		pthread_mutex_lock(&video->upload_mutex);
+		if (video->upload_queue.num) {
+			upload = video->upload_queue.array[0];
+			da_erase(video->upload_queue, 0);
+		}
+		pthread_mutex_unlock(&video->upload_mutex);
+
+		/* the stop request is posted after every queued upload */
+		if (!upload)
+			break;
+
+		copy_async_upload(upload);
+	}
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+bool obs_start_upload_thread(void)
+{
+	struct obs_core_video *video = &obs->video;
+	gs_sync_t *sync;
+
+	if (video->upload_thread_active)
+		return true;
+
+	/* only used with the OpenGL renderer, and upload buffers are only
+	 * reused once a fence says the GPU is done with them */
+	if (gs_get_device_type() != GS_DEVICE_OPENGL)
+		return false;
+
+	sync = gs_sync_create();
+	if (!sync)
+		return false;
+	gs_sync_destroy(sync);
+
+	if (os_sem_init(&video->upload_sem, 0) != 0)
+		return false;
+
+	pthread_mutex_init_value(&video->upload_mutex);
+	if (pthread_mutex_init(&video->upload_mutex, NULL) != 0)
+		goto fail;
+
+	video->upload_thread_stop = false;
+
+	if (pthread_create(&video->upload_thread, NULL, obs_upload_thread,
+				NULL) != 0) {
+		pthread_mutex_destroy(&video->upload_mutex);
+		goto fail;
+	}
+
+	video->upload_thread_active = true;
+	return true;
+
+fail:
+	blog(LOG_WARNING, "Failed to create async texture upload thread, "
+	                  "async frames will be uploaded from the graphics "
+	                  "thread");
+	os_sem_destroy(video->upload_sem);
+	video->upload_sem = NULL;
+	return false;
+}
+
+void obs_stop_upload_thread(void)
+{
+	struct obs_core_video *video = &obs->video;
+
+	if (!video->upload_thread_active)
+		return;
+
+	pthread_mutex_lock(&video->upload_mutex);
+	video->upload_thread_stop = true;
+	pthread_mutex_unlock(&video->upload_mutex);
+
+	os_sem_post(video->upload_sem);
+	pthread_join(video->upload_thread, NULL);
+
+	da_free(video->upload_queue);
+	pthread_mutex_destroy(&video->upload_mutex);
+	os_sem_destroy(video->upload_sem);
+
+	video->upload_sem = NULL;
+	video->upload_thread_active = false;
+}
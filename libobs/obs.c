@@ -248,8 +248,15 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 		}
 	}
 
+	/* threaded displays create a second device from the same module */
+	video->graphics_module = bstrdup(ovi->graphics_module);
+	video->adapter = ovi->adapter;
+
 	gs_enter_context(video->graphics);
 
+	if (obs->shader_cache_path)
+		gs_set_program_cache_path(obs->shader_cache_path);
+
 	char *filename = find_libobs_data_file("default.effect");
 	video->default_effect = gs_effect_create_from_file(filename,
 			NULL);
@@ -382,14 +389,25 @@ static int obs_init_video(struct obs_video_info *ovi)
 	if (!obs_init_textures(ovi))
 		return OBS_VIDEO_FAIL;
 
+	obs_start_upload_thread();
+
 	gs_leave_context();
 
+	pthread_mutex_init_value(&video->tick_mutex);
+	if (pthread_mutex_init(&video->tick_mutex, NULL) != 0)
+		return OBS_VIDEO_FAIL;
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_video_thread, obs);
-	if (errorcode != 0)
+	if (errorcode != 0) {
+		pthread_mutex_destroy(&video->tick_mutex);
 		return OBS_VIDEO_FAIL;
+	}
 
 	video->thread_initialized = true;
+
+	if (video->threaded_displays)
+		obs_start_display_thread();
 	return OBS_VIDEO_SUCCESS;
 }
 
@@ -398,14 +416,19 @@ static void stop_video(void)
 	struct obs_core_video *video = &obs->video;
 	void *thread_retval;
 
+	obs_stop_display_thread();
+
 	if (video->video) {
 		video_output_stop(video->video);
 		if (video->thread_initialized) {
 			pthread_join(video->video_thread, &thread_retval);
+			pthread_mutex_destroy(&video->tick_mutex);
 			video->thread_initialized = false;
 		}
 	}
 
+	obs_stop_upload_thread();
+
 }
 
 static void obs_free_video(void)
@@ -455,6 +478,24 @@ static void obs_free_video(void)
 	}
 }
 
+static void log_program_cache_stats(void)
+{
+	struct gs_program_cache_stats stats;
+
+	if (!obs->shader_cache_path || !gs_get_program_cache_stats(&stats))
+		return;
+
+	blog(LOG_INFO, "Shader program cache: %llu hits, %llu misses "
+			"(%llu rejected), %llu stored, %.1f ms linking, "
+			"%.1f ms loading",
+			(unsigned long long)stats.hits,
+			(unsigned long long)stats.misses,
+			(unsigned long long)stats.rejected,
+			(unsigned long long)stats.stores,
+			(double)stats.link_ns / 1000000.0,
+			(double)stats.load_ns / 1000000.0);
+}
+
 static void obs_free_graphics(void)
 {
 	struct obs_core_video *video = &obs->video;
@@ -462,6 +503,8 @@ static void obs_free_graphics(void)
 	if (video->graphics) {
 		gs_enter_context(video->graphics);
 
+		log_program_cache_stats();
+
 		gs_texture_destroy(video->transparent_texture);
 
 		gs_samplerstate_destroy(video->point_sampler);
@@ -481,6 +524,21 @@ static void obs_free_graphics(void)
 		gs_destroy(video->graphics);
 		video->graphics = NULL;
 	}
+
+	bfree(video->graphics_module);
+	video->graphics_module = NULL;
+}
+
+static task_pool_t *create_audio_render_pool(size_t threads)
+{
+	if (!threads && os_get_logical_cores() > 2) {
+		threads = (size_t)os_get_logical_cores() / 2;
+		if (threads > MAX_AUDIO_RENDER_THREADS)
+			threads = MAX_AUDIO_RENDER_THREADS;
+	}
+
+	/* without a pool task_pool_run renders every source in place */
+	return threads > 1 ? task_pool_create("audio render", threads) : NULL;
 }
 
 static bool obs_init_audio(struct audio_output_info *ai)
@@ -492,6 +550,9 @@ static bool obs_init_audio(struct audio_output_info *ai)
 
 	audio->user_volume    = 1.0f;
 
+	audio->render_pool = create_audio_render_pool(
+			obs->audio_render_threads);
+
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
 		return true;
@@ -509,9 +570,13 @@ static void obs_free_audio(void)
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
+	task_pool_destroy(audio->render_pool);
+
 	circlebuf_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
+	da_free(audio->leaf_nodes);
+	da_free(audio->composite_nodes);
 
 	memset(audio, 0, sizeof(struct obs_core_audio));
 }
@@ -574,6 +639,12 @@ void obs_main_view_free(struct obs_view *view)
 					unfreed); \
 	} while (false)
 
+static inline void context_index_free(struct obs_context_index *index)
+{
+	bfree(index->buckets);
+	memset(index, 0, sizeof(*index));
+}
+
 static void obs_free_data(void)
 {
 	struct obs_core_data *data = &obs->data;
@@ -590,6 +661,11 @@ static void obs_free_data(void)
 	FREE_OBS_LINKED_LIST(display);
 	FREE_OBS_LINKED_LIST(service);
 
+	context_index_free(&data->source_index);
+	context_index_free(&data->output_index);
+	context_index_free(&data->encoder_index);
+	context_index_free(&data->service_index);
+
 	pthread_mutex_destroy(&data->sources_mutex);
 	pthread_mutex_destroy(&data->audio_sources_mutex);
 	pthread_mutex_destroy(&data->displays_mutex);
@@ -716,6 +792,27 @@ static inline void obs_free_hotkeys(void)
 	pthread_mutex_destroy(&hotkeys->mutex);
 }
 
+static bool obs_init_modules_mutex(void)
+{
+	pthread_mutexattr_t attr;
+	bool success = false;
+
+	pthread_mutex_init_value(&obs->modules_mutex);
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		goto fail;
+	if (pthread_mutex_init(&obs->modules_mutex, &attr) != 0)
+		goto fail;
+
+	success = true;
+
+fail:
+	pthread_mutexattr_destroy(&attr);
+	return success;
+}
+
 extern const struct obs_source_info scene_info;
 
 extern void log_system_info(void);
@@ -734,6 +831,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 
 	log_system_info();
 
+	if (!obs_init_modules_mutex())
+		return false;
 	if (!obs_init_data())
 		return false;
 	if (!obs_init_handlers())
@@ -788,6 +887,8 @@ void obs_shutdown(void)
 	if (!obs)
 		return;
 
+	obs_free_module_manifest();
+
 #define FREE_REGISTERED_TYPES(structure, list) \
 	do { \
 		for (size_t i = 0; i < list.num; i++) { \
@@ -830,6 +931,7 @@ void obs_shutdown(void)
 		module = next;
 	}
 	obs->first_module = NULL;
+	pthread_mutex_destroy(&obs->modules_mutex);
 
 	for (size_t i = 0; i < obs->module_paths.num; i++)
 		free_module_path(obs->module_paths.array+i);
@@ -839,6 +941,7 @@ void obs_shutdown(void)
 		profiler_name_store_free(obs->name_store);
 
 	bfree(obs->module_config_path);
+	bfree(obs->shader_cache_path);
 	bfree(obs->locale);
 	bfree(obs);
 	obs = NULL;
@@ -882,6 +985,15 @@ const char *obs_get_locale(void)
 	return obs ? obs->locale : NULL;
 }
 
+void obs_set_shader_cache_path(const char *path)
+{
+	if (!obs)
+		return;
+
+	bfree(obs->shader_cache_path);
+	obs->shader_cache_path = path && *path ? bstrdup(path) : NULL;
+}
+
 #define OBS_SIZE_MIN 2
 #define OBS_SIZE_MAX (32 * 1024)
 
@@ -1038,7 +1150,8 @@ bool obs_enum_source_types(size_t idx, const char **id)
 	if (!obs) return false;
 
 	if (idx >= obs->source_types.num)
-		return false;
+		return obs_enum_deferred_types(MODULE_KIND_SOURCE,
+				idx - obs->source_types.num, id);
 	*id = obs->source_types.array[idx].id;
 	return true;
 }
@@ -1048,7 +1161,8 @@ bool obs_enum_input_types(size_t idx, const char **id)
 	if (!obs) return false;
 
 	if (idx >= obs->input_types.num)
-		return false;
+		return obs_enum_deferred_types(MODULE_KIND_INPUT,
+				idx - obs->input_types.num, id);
 	*id = obs->input_types.array[idx].id;
 	return true;
 }
@@ -1058,7 +1172,8 @@ bool obs_enum_filter_types(size_t idx, const char **id)
 	if (!obs) return false;
 
 	if (idx >= obs->filter_types.num)
-		return false;
+		return obs_enum_deferred_types(MODULE_KIND_FILTER,
+				idx - obs->filter_types.num, id);
 	*id = obs->filter_types.array[idx].id;
 	return true;
 }
@@ -1068,7 +1183,8 @@ bool obs_enum_transition_types(size_t idx, const char **id)
 	if (!obs) return false;
 
 	if (idx >= obs->transition_types.num)
-		return false;
+		return obs_enum_deferred_types(MODULE_KIND_TRANSITION,
+				idx - obs->transition_types.num, id);
 	*id = obs->transition_types.array[idx].id;
 	return true;
 }
@@ -1078,7 +1194,8 @@ bool obs_enum_output_types(size_t idx, const char **id)
 	if (!obs) return false;
 
 	if (idx >= obs->output_types.num)
-		return false;
+		return obs_enum_deferred_types(MODULE_KIND_OUTPUT,
+				idx - obs->output_types.num, id);
 	*id = obs->output_types.array[idx].id;
 	return true;
 }
@@ -1088,7 +1205,8 @@ bool obs_enum_encoder_types(size_t idx, const char **id)
 	if (!obs) return false;
 
 	if (idx >= obs->encoder_types.num)
-		return false;
+		return obs_enum_deferred_types(MODULE_KIND_ENCODER,
+				idx - obs->encoder_types.num, id);
 	*id = obs->encoder_types.array[idx].id;
 	return true;
 }
@@ -1098,7 +1216,8 @@ bool obs_enum_service_types(size_t idx, const char **id)
 	if (!obs) return false;
 
 	if (idx >= obs->service_types.num)
-		return false;
+		return obs_enum_deferred_types(MODULE_KIND_SERVICE,
+				idx - obs->service_types.num, id);
 	*id = obs->service_types.array[idx].id;
 	return true;
 }
@@ -1296,21 +1415,43 @@ void obs_enum_services(bool (*enum_proc)(void*, obs_service_t*), void *param)
 			enum_proc, param);
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
-		pthread_mutex_t *mutex, void *(*addref)(void*))
+static inline uint32_t hash_context_name(const char *name)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static inline void *get_context_by_name(struct obs_context_index *index,
+		const char *name, pthread_mutex_t *mutex,
+		void *(*addref)(void*))
 {
-	struct obs_context_data **first = vfirst;
-	struct obs_context_data *context;
+	struct obs_context_data *context = NULL;
+	uint32_t hash;
+
+	if (!name)
+		return NULL;
+
+	hash = hash_context_name(name);
 
 	pthread_mutex_lock(mutex);
 
-	context = *first;
+	if (index->num_buckets)
+		context = index->buckets[hash & (index->num_buckets - 1)];
+
 	while (context) {
-		if (!context->private && strcmp(context->name, name) == 0) {
+		if (context->name_hash == hash &&
+		    strcmp(context->name, name) == 0) {
 			context = addref(context);
 			break;
 		}
-		context = context->next;
+		context = context->hash_next;
 	}
 
 	pthread_mutex_unlock(mutex);
@@ -1345,28 +1486,28 @@ static inline void *obs_id_(void *data)
 obs_source_t *obs_get_source_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_source, name,
+	return get_context_by_name(&obs->data.source_index, name,
 			&obs->data.sources_mutex, obs_source_addref_safe_);
 }
 
 obs_output_t *obs_get_output_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_output, name,
+	return get_context_by_name(&obs->data.output_index, name,
 			&obs->data.outputs_mutex, obs_output_addref_safe_);
 }
 
 obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_encoder, name,
+	return get_context_by_name(&obs->data.encoder_index, name,
 			&obs->data.encoders_mutex, obs_encoder_addref_safe_);
 }
 
 obs_service_t *obs_get_service_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_service, name,
+	return get_context_by_name(&obs->data.service_index, name,
 			&obs->data.services_mutex, obs_service_addref_safe_);
 }
 
@@ -1421,6 +1562,78 @@ void obs_render_main_view(void)
 	obs_view_render(&obs->data.main_view);
 }
 
+void obs_render_main_texture(void)
+{
+	struct obs_core_video *video;
+	gs_texture_t *tex;
+	gs_effect_t *effect;
+	gs_eparam_t *param;
+	int last_texture;
+
+	if (!obs) return;
+
+	video = &obs->video;
+	last_texture = video->last_main_texture;
+
+	if (!video->textures_rendered[last_texture])
+		return;
+
+	tex = video->render_textures[last_texture];
+	effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	param = gs_effect_get_param_by_name(effect, "image");
+	gs_effect_set_texture(param, tex);
+
+	gs_blend_state_push();
+	gs_enable_blending(false);
+
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite(tex, 0, 0, 0);
+
+	gs_blend_state_pop();
+}
+
+void obs_set_threaded_displays(bool enable)
+{
+	struct obs_core_video *video;
+
+	if (!obs) return;
+
+	video = &obs->video;
+	if (video->threaded_displays == enable)
+		return;
+
+	video->threaded_displays = enable;
+
+	/* otherwise started along with the video thread */
+	if (!video->thread_initialized)
+		return;
+
+	if (enable)
+		obs_start_display_thread();
+	else
+		obs_stop_display_thread();
+}
+
+bool obs_threaded_displays(void)
+{
+	return obs ? obs->video.threaded_displays : false;
+}
+
+void obs_set_audio_render_threads(size_t threads)
+{
+	if (!obs) return;
+
+	if (threads > MAX_AUDIO_RENDER_THREADS)
+		threads = MAX_AUDIO_RENDER_THREADS;
+
+	obs->audio_render_threads = threads;
+}
+
+size_t obs_get_audio_render_threads(void)
+{
+	return obs ? obs->audio_render_threads : 0;
+}
+
 void obs_set_master_volume(float volume)
 {
 	struct calldata data = {0};
@@ -1781,6 +1994,102 @@ void obs_context_data_free(struct obs_context_data *context)
 	memset(context, 0, sizeof(*context));
 }
 
+#define CONTEXT_INDEX_MIN_BUCKETS 64
+
+static struct obs_context_index *get_context_index(enum obs_obj_type type)
+{
+	switch (type) {
+	case OBS_OBJ_TYPE_SOURCE:  return &obs->data.source_index;
+	case OBS_OBJ_TYPE_OUTPUT:  return &obs->data.output_index;
+	case OBS_OBJ_TYPE_ENCODER: return &obs->data.encoder_index;
+	case OBS_OBJ_TYPE_SERVICE: return &obs->data.service_index;
+	case OBS_OBJ_TYPE_INVALID: break;
+	}
+
+	return NULL;
+}
+
+/* appends to the end of each new chain so that contexts with the same name
+ * are still found newest first, the same order as the context lists */
+static void context_index_resize(struct obs_context_index *index,
+		size_t num_buckets)
+{
+	struct obs_context_data **buckets;
+
+	buckets = bzalloc(sizeof(struct obs_context_data*) * num_buckets);
+
+	for (size_t i = 0; i < index->num_buckets; i++) {
+		struct obs_context_data *context = index->buckets[i];
+
+		while (context) {
+			struct obs_context_data *next = context->hash_next;
+			struct obs_context_data **tail;
+
+			tail = &buckets[context->name_hash & (num_buckets - 1)];
+			while (*tail)
+				tail = &(*tail)->hash_next;
+
+			context->hash_next = NULL;
+			*tail = context;
+			context = next;
+		}
+	}
+
+	bfree(index->buckets);
+	index->buckets     = buckets;
+	index->num_buckets = num_buckets;
+}
+
+/* must be called with the mutex of the context's list locked */
+static void context_index_add(struct obs_context_data *context)
+{
+	struct obs_context_index *index;
+	struct obs_context_data **bucket;
+
+	if (context->private || !context->name)
+		return;
+
+	index = get_context_index(context->type);
+	if (!index)
+		return;
+
+	if (index->count >= index->num_buckets)
+		context_index_resize(index, index->num_buckets ?
+				index->num_buckets * 2 :
+				CONTEXT_INDEX_MIN_BUCKETS);
+
+	context->name_hash = hash_context_name(context->name);
+	bucket = &index->buckets[context->name_hash & (index->num_buckets - 1)];
+
+	context->hash_next = *bucket;
+	context->index     = index;
+	*bucket            = context;
+	index->count++;
+}
+
+/* must be called with the mutex of the context's list locked */
+static void context_index_remove(struct obs_context_data *context)
+{
+	struct obs_context_index *index = context->index;
+	struct obs_context_data **cur;
+
+	if (!index)
+		return;
+
+	cur = &index->buckets[context->name_hash & (index->num_buckets - 1)];
+	while (*cur) {
+		if (*cur == context) {
+			*cur = context->hash_next;
+			index->count--;
+			break;
+		}
+		cur = &(*cur)->hash_next;
+	}
+
+	context->hash_next = NULL;
+	context->index     = NULL;
+}
+
 void obs_context_data_insert(struct obs_context_data *context,
 		pthread_mutex_t *mutex, void *pfirst)
 {
@@ -1798,6 +2107,7 @@ void obs_context_data_insert(struct obs_context_data *context,
 	*first              = context;
 	if (context->next)
 		context->next->prev_next = &context->next;
+	context_index_add(context);
 	pthread_mutex_unlock(mutex);
 }
 
@@ -1809,6 +2119,7 @@ void obs_context_data_remove(struct obs_context_data *context)
 			*context->prev_next = context->next;
 		if (context->next)
 			context->next->prev_next = context->prev_next;
+		context_index_remove(context);
 		pthread_mutex_unlock(context->mutex);
 
 		context->mutex = NULL;
@@ -1818,6 +2129,13 @@ void obs_context_data_remove(struct obs_context_data *context)
 void obs_context_data_setname(struct obs_context_data *context,
 		const char *name)
 {
+	pthread_mutex_t *mutex = context->mutex;
+
+	if (mutex) {
+		pthread_mutex_lock(mutex);
+		context_index_remove(context);
+	}
+
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
 	if (context->name)
@@ -1825,6 +2143,11 @@ void obs_context_data_setname(struct obs_context_data *context,
 	context->name = dup_name(name, context->private);
 
 	pthread_mutex_unlock(&context->rename_cache_mutex);
+
+	if (mutex) {
+		context_index_add(context);
+		pthread_mutex_unlock(mutex);
+	}
 }
 
 profiler_name_store_t *obs_get_profiler_name_store(void)
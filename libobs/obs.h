@@ -211,6 +211,17 @@ struct obs_source_audio {
 	uint64_t            timestamp;
 };
 
+struct obs_source_frame;
+
+/**
+ * Called when libobs no longer references a frame passed to
+ * obs_source_output_video_nocopy.  rendered is false if the frame was
+ * discarded without ever being displayed.  May be called from any thread,
+ * including the graphics thread, so it should return quickly.
+ */
+typedef void (*obs_source_frame_release_t)(void *param,
+		struct obs_source_frame *frame, bool rendered);
+
 /**
  * Source asynchronous video output structure.  Used with
  * obs_source_output_video to output asynchronous video.  Video is buffered as
@@ -237,6 +248,9 @@ struct obs_source_frame {
 	/* used internally by libobs */
 	volatile long       refs;
 	bool                prev_frame;
+	bool                rendered;
+	obs_source_frame_release_t release;
+	void                *release_param;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -273,6 +287,12 @@ EXPORT void obs_set_locale(const char *locale);
 /** @return the current locale */
 EXPORT const char *obs_get_locale(void);
 
+/**
+ * Sets the directory the graphics subsystem caches linked shader programs in,
+ * or NULL to disable the cache.  Takes effect the next time video is reset.
+ */
+EXPORT void obs_set_shader_cache_path(const char *path);
+
 /**
  * Returns the profiler name store (see util/profiler.h) used by OBS, which is
  * either a name store passed to obs_startup, an internal name store, or NULL
@@ -376,6 +396,17 @@ EXPORT void obs_add_module_path(const char *bin, const char *data);
 /** Automatically loads all modules from module paths (convenience function) */
 EXPORT void obs_load_all_modules(void);
 
+/**
+ * Sets the file obs_load_all_modules records which types each module
+ * registers in.  When the file is valid for a module binary, loading of that
+ * module is deferred until one of its types is first used.  Listing types and
+ * getting their display names, flags and codecs is answered from the file and
+ * does not count as a use.  Modules that register no types or register UI
+ * callbacks are always loaded.  Must be
+ * called before obs_load_all_modules; NULL disables deferred loading.
+ */
+EXPORT void obs_set_module_manifest_path(const char *path);
+
 struct obs_module_info {
 	const char *bin_path;
 	const char *data_path;
@@ -547,6 +578,21 @@ EXPORT proc_handler_t *obs_get_proc_handler(void);
 /** Renders the main view */
 EXPORT void obs_render_main_view(void);
 
+/**
+ * Draws the last completed main view texture at base resolution instead of
+ * rendering the main view again.  Only valid from a display draw callback.
+ */
+EXPORT void obs_render_main_texture(void);
+
+/**
+ * Sets the number of threads the audio of sources is rendered on, up to 8.
+ * 0 (the default) uses half of the logical cores, or none at all with two
+ * cores or less, and 1 renders every source on the audio thread.  Takes
+ * effect on the next call to obs_reset_audio.
+ */
+EXPORT void obs_set_audio_render_threads(size_t threads);
+EXPORT size_t obs_get_audio_render_threads(void);
+
 /** Sets the master user volume */
 EXPORT void obs_set_master_volume(float volume);
 
@@ -658,6 +704,38 @@ EXPORT bool obs_display_enabled(obs_display_t *display);
 EXPORT void obs_display_set_background_color(obs_display_t *display,
 		uint32_t color);
 
+/**
+ * Limits how often a display is presented.  Pass 0 to present every rendered
+ * frame (the default).
+ */
+EXPORT void obs_display_set_fps_limit(obs_display_t *display, uint32_t fps);
+EXPORT uint32_t obs_display_get_fps_limit(obs_display_t *display);
+
+/** Skips presenting a display while its window can't be seen */
+EXPORT void obs_display_set_occluded(obs_display_t *display, bool occluded);
+
+/**
+ * Gets the number of output frames that lagged while this display was the
+ * slowest one to render
+ */
+EXPORT uint32_t obs_display_get_lagged_frames(obs_display_t *display);
+
+/**
+ * Presents displays from a separate thread on a second graphics device, so
+ * a slow or vsynced swap chain never holds up the video thread.  Draw
+ * callbacks still run in the main graphics context, but never while sources
+ * are being ticked.  Each display is drawn into a texture which is read back
+ * and presented on the display device, so displays are shown one frame
+ * later than when they are presented from the video thread.
+ *
+ * Output frames that lag are still counted against the display whose draw
+ * callbacks held the graphics context the longest.
+ *
+ * Must not be called from within the graphics context.
+ */
+EXPORT void obs_set_threaded_displays(bool enable);
+EXPORT bool obs_threaded_displays(void);
+
 
 /* ------------------------------------------------------------------------- */
 /* Sources */
@@ -820,6 +898,14 @@ EXPORT bool obs_source_showing(const obs_source_t *source);
 #define OBS_SOURCE_FLAG_UNBUFFERED             (1<<0)
 /** Specifies to force audio to mono */
 #define OBS_SOURCE_FLAG_FORCE_MONO             (1<<1)
+/**
+ * Specifies that async video frames should be copied to the GPU on a separate
+ * thread, so that large frames don't stall rendering.  The copy started on
+ * one render is only finished on the next, so this adds one frame of latency
+ * to the source.  Only has an effect with the OpenGL renderer, and not for
+ * unbuffered or deinterlaced sources.
+ */
+#define OBS_SOURCE_FLAG_UPLOAD_THREAD          (1<<2)
 
 /**
  * Sets source flags.  Note that these are different from the main output
@@ -916,6 +1002,43 @@ EXPORT void obs_source_set_deinterlace_field_order(obs_source_t *source,
 EXPORT enum obs_deinterlace_field_order obs_source_get_deinterlace_field_order(
 		const obs_source_t *source);
 
+/** Determines which queued frame is discarded when an async source gets
+ * ahead of rendering */
+enum obs_async_drop_policy {
+	OBS_ASYNC_DROP_OLDEST,
+	OBS_ASYNC_DROP_NEAREST
+};
+
+struct obs_source_async_stats {
+	uint32_t queue_depth;     /**< frames currently waiting to render */
+	uint64_t frames_received; /**< total frames output by the source */
+	uint64_t frames_dropped;  /**< frames discarded before rendering */
+	uint64_t frames_late;     /**< frames skipped because they were late */
+
+	uint64_t frames_uploaded;  /**< frames copied on the upload thread */
+	uint64_t upload_bytes;     /**< bytes copied on the upload thread */
+	uint64_t upload_copy_ns;   /**< time spent copying, upload thread */
+	uint64_t upload_wait_ns;   /**< time spent by the graphics thread
+	                                 mapping, unmapping and converting */
+};
+
+/**
+ * Sets the buffering behavior of an asynchronous video source.
+ *
+ * @param  target_latency_ms  Maximum amount of video (by timestamp) to keep
+ *                            queued, or 0 to only limit the frame count
+ * @param  policy             Which frame to discard when over the limit
+ */
+EXPORT void obs_source_set_async_buffer(obs_source_t *source,
+		uint32_t target_latency_ms, enum obs_async_drop_policy policy);
+EXPORT uint32_t obs_source_get_async_target_latency(const obs_source_t *source);
+EXPORT enum obs_async_drop_policy obs_source_get_async_drop_policy(
+		const obs_source_t *source);
+
+/** Gets the async video queue statistics of a source */
+EXPORT void obs_source_get_async_stats(const obs_source_t *source,
+		struct obs_source_async_stats *stats);
+
 /* ------------------------------------------------------------------------- */
 /* Functions used by sources */
 
@@ -956,6 +1079,18 @@ EXPORT void obs_source_draw(gs_texture_t *image, int x, int y,
 EXPORT void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame);
 
+/**
+ * Outputs asynchronous video data without copying it.
+ *
+ *   The frame data is referenced directly and must stay valid until release
+ * is called.  The frame structure itself is copied and does not need to
+ * persist.  If the frame can't be queued, release is called before this
+ * function returns.
+ */
+EXPORT void obs_source_output_video_nocopy(obs_source_t *source,
+		const struct obs_source_frame *frame,
+		obs_source_frame_release_t release, void *param);
+
 /** Outputs audio data (always asynchronous) */
 EXPORT void obs_source_output_audio(obs_source_t *source,
 		const struct obs_source_audio *audio);
@@ -1443,6 +1578,13 @@ EXPORT uint64_t obs_output_get_total_bytes(const obs_output_t *output);
 EXPORT int obs_output_get_frames_dropped(const obs_output_t *output);
 EXPORT int obs_output_get_total_frames(const obs_output_t *output);
 
+/**
+ * Gets the network statistics of the output.  Returns false if the output
+ * does not provide any.  Cheap enough to call from a UI timer.
+ */
+EXPORT bool obs_output_get_transport_stats(const obs_output_t *output,
+		struct obs_transport_stats *stats);
+
 /**
  * Sets the preferred scaled resolution for this output.  Set width and height
  * to 0 to disable scaling.
@@ -1587,6 +1729,18 @@ EXPORT uint32_t obs_encoder_get_height(const obs_encoder_t *encoder);
 /** For audio encoders, returns the sample rate of the audio */
 EXPORT uint32_t obs_encoder_get_sample_rate(const obs_encoder_t *encoder);
 
+/**
+ * For video encoders, returns the number of raw frames the encoder has been
+ * given since it was started
+ */
+EXPORT uint32_t obs_encoder_get_total_frames(const obs_encoder_t *encoder);
+
+/**
+ * For video encoders, returns the number of raw frames skipped because the
+ * encoder was still busy encoding earlier frames
+ */
+EXPORT uint32_t obs_encoder_get_skipped_frames(const obs_encoder_t *encoder);
+
 /**
  * Sets the preferred video format for a video encoder.  If the encoder can use
  * the format specified, it will force a conversion to that format if the
@@ -1618,6 +1772,19 @@ EXPORT obs_properties_t *obs_encoder_properties(const obs_encoder_t *encoder);
  */
 EXPORT void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings);
 
+/**
+ * Queues a settings update to be applied on the encoding thread before the
+ * next frame.  Use this instead of obs_encoder_update from threads that
+ * must not wait for an encode call to finish, such as an output's send
+ * thread.  Applied immediately if the encoder is not active.
+ */
+EXPORT void obs_encoder_queue_update(obs_encoder_t *encoder,
+		obs_data_t *settings);
+
+/** Returns the number of started outputs receiving packets from the encoder */
+EXPORT size_t obs_encoder_get_active_output_count(
+		const obs_encoder_t *encoder);
+
 /** Gets extra data (headers) associated with this context */
 EXPORT bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
 		uint8_t **extra_data, size_t *size);
@@ -1656,8 +1823,37 @@ EXPORT uint32_t obs_get_encoder_caps(const char *encoder_id);
 EXPORT void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src);
 
+/**
+ * Frees a packet made with obs_duplicate_encoder_packet or one whose data was
+ * allocated by the caller.  Packets passed to an output's encoded_packet
+ * callback are reference counted and owned by libobs, so they must not be
+ * freed with this.
+ */
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 
+/**
+ * Copies an encoder packet into reference counted data.  Packets handed to
+ * encoder callbacks and outputs are reference counted, so they can be kept
+ * with obs_encoder_packet_ref instead of being duplicated.
+ */
+EXPORT void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src);
+
+/** Adds a reference to a reference counted encoder packet */
+EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src);
+
+/** Releases a reference taken with obs_encoder_packet_ref */
+EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
+
+/**
+ * Sends a finished slice of the frame currently being encoded to the outputs
+ * that take slices.  Slices of a frame must be sent in order, and may be sent
+ * from any thread while encode() is running.
+ */
+EXPORT void obs_encoder_send_slice(obs_encoder_t *encoder,
+		struct encoder_slice *slice);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
@@ -312,3 +312,9 @@ void os_inhibit_sleep_destroy(os_inhibit_t *info)
 		bfree(info);
 	}
 }
+
+int os_get_logical_cores(void)
+{
+	NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+	return cores > 0 ? (int)cores : 1;
+}
@@ -615,3 +615,9 @@ void os_breakpoint()
 {
 	raise(SIGTRAP);
 }
+
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
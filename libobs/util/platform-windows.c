@@ -848,3 +848,11 @@ void os_breakpoint(void)
 {
 	__debugbreak();
 }
+
+int os_get_logical_cores(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ?
+		(int)info.dwNumberOfProcessors : 1;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2016 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "bmem.h"
+#include "dstr.h"
+#include "threading.h"
+#include "task-pool.h"
+
+struct task_pool {
+	pthread_t                      *threads;
+	size_t                         num_threads;
+	char                           *name;
+
+	pthread_mutex_t                mutex;
+	os_sem_t                       *work_sem;
+	os_event_t                     *done_event;
+	bool                           exiting;
+
+	task_pool_cb                   callback;
+	void                           *param;
+	size_t                         count;
+	size_t                         next;
+	size_t                         pending;
+};
+
+/* processes indices of the current job until there are none left.  whoever
+ * finishes the last index signals the done event, which happens exactly
+ * once per job. */
+static void process_tasks(struct task_pool *pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->next < pool->count) {
+		task_pool_cb callback = pool->callback;
+		void *param = pool->param;
+		size_t idx = pool->next++;
+
+		pthread_mutex_unlock(&pool->mutex);
+		callback(param, idx);
+		pthread_mutex_lock(&pool->mutex);
+
+		if (--pool->pending == 0)
+			os_event_signal(pool->done_event);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static void *task_pool_thread(void *data)
+{
+	struct task_pool *pool = data;
+
+	os_set_thread_name(pool->name);
+
+	for (;;) {
+		if (os_sem_wait(pool->work_sem) != 0)
+			break;
+		if (pool->exiting)
+			break;
+
+		process_tasks(pool);
+	}
+
+	return NULL;
+}
+
+task_pool_t *task_pool_create(const char *name, size_t num_threads)
+{
+	struct task_pool *pool = bzalloc(sizeof(struct task_pool));
+
+	pthread_mutex_init_value(&pool->mutex);
+	pool->name = bstrdup(name ? name : "task pool");
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&pool->work_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&pool->done_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	if (num_threads)
+		pool->threads = bzalloc(sizeof(pthread_t) * num_threads);
+
+	for (size_t i = 0; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, task_pool_thread,
+					pool) != 0)
+			break;
+		pool->num_threads++;
+	}
+
+	return pool;
+
+fail:
+	task_pool_destroy(pool);
+	return NULL;
+}
+
+void task_pool_destroy(task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	pool->exiting = true;
+	for (size_t i = 0; i < pool->num_threads; i++)
+		os_sem_post(pool->work_sem);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	os_event_destroy(pool->done_event);
+	os_sem_destroy(pool->work_sem);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool->threads);
+	bfree(pool->name);
+	bfree(pool);
+}
+
+size_t task_pool_num_threads(const task_pool_t *pool)
+{
+	return pool ? pool->num_threads : 0;
+}
+
+void task_pool_run(task_pool_t *pool, size_t count,
+		task_pool_cb callback, void *param)
+{
+	size_t wake;
+
+	if (!count || !callback)
+		return;
+
+	if (!pool || !pool->num_threads || count == 1) {
+		for (size_t i = 0; i < count; i++)
+			callback(param, i);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->callback = callback;
+	pool->param    = param;
+	pool->count    = count;
+	pool->next     = 0;
+	pool->pending  = count;
+	pthread_mutex_unlock(&pool->mutex);
+
+	/* the calling thread takes part, so only wake as many workers as
+	 * there are indices beyond the first */
+	wake = count - 1;
+	if (wake > pool->num_threads)
+		wake = pool->num_threads;
+
+	for (size_t i = 0; i < wake; i++)
+		os_sem_post(pool->work_sem);
+
+	process_tasks(pool);
+	os_event_wait(pool->done_event);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->callback = NULL;
+	pool->param    = NULL;
+	pool->count    = 0;
+	pool->next     = 0;
+	pthread_mutex_unlock(&pool->mutex);
+}
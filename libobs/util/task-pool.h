@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2016 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Fixed-size pool of worker threads for fork/join style work.
+ *
+ *   task_pool_run distributes indices [0, count) over the worker threads and
+ * the calling thread, and only returns once every index has been processed,
+ * so callers get a deterministic join point.  Which thread processes which
+ * index is not defined; callbacks must only touch data owned by their index.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct task_pool;
+typedef struct task_pool task_pool_t;
+
+typedef void (*task_pool_cb)(void *param, size_t idx);
+
+EXPORT task_pool_t *task_pool_create(const char *name, size_t num_threads);
+EXPORT void task_pool_destroy(task_pool_t *pool);
+
+EXPORT size_t task_pool_num_threads(const task_pool_t *pool);
+
+EXPORT void task_pool_run(task_pool_t *pool, size_t count,
+		task_pool_cb callback, void *param);
+
+#ifdef __cplusplus
+}
+#endif
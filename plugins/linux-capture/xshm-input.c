@@ -21,9 +21,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <xcb/shm.h>
 #include <xcb/xfixes.h>
 #include <xcb/xinerama.h>
+#ifdef HAVE_XCB_DAMAGE
+#include <xcb/damage.h>
+#endif
 
 #include <obs-module.h>
 #include <util/dstr.h>
+#include <util/darray.h>
+#include <util/threading.h>
+#include <util/platform.h>
 #include "xcursor-xcb.h"
 #include "xhelpers.h"
 
@@ -31,6 +37,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "xshm-input: " msg, ##__VA_ARGS__)
 
+/* damaged regions are merged down to at most this many rectangles */
+#define XSHM_MAX_DAMAGE_RECTS 16
+
+/* when more than this fraction of the screen is damaged the whole screen is
+ * grabbed and uploaded in one go instead */
+#define XSHM_FULL_DAMAGE_RATIO 0.5
+
 struct xshm_data {
 	obs_source_t     *source;
 
@@ -51,6 +64,28 @@ struct xshm_data {
 	bool             show_cursor;
 	bool             use_xinerama;
 	bool             advanced;
+	bool             use_damage;
+
+	/* incremental capture: the capture thread grabs damaged regions into
+	 * a copy of the screen, the video tick uploads just those regions */
+	bool             damage_active;
+#ifdef HAVE_XCB_DAMAGE
+	xcb_damage_damage_t damage;
+	uint8_t          damage_event;
+#endif
+	pthread_t        capture_thread;
+	os_event_t       *capture_stop;
+	pthread_mutex_t  frame_mutex;
+	uint8_t          *frame;
+	DARRAY(struct gs_rect) pending_rects;
+	DARRAY(struct gs_rect) dirty_rects;
+	bool             pending_full;
+	bool             dirty_full;
+
+	/* statistics, cumulative over restarts of the capture */
+	uint64_t         frames_uploaded;
+	uint64_t         full_uploads;
+	uint64_t         bytes_uploaded;
 };
 
 /**
@@ -138,11 +173,370 @@ static const char* xshm_getname(void *unused)
 	return obs_module_text("X11SharedMemoryScreenInput");
 }
 
+static inline bool rects_touch(const struct gs_rect *a,
+		const struct gs_rect *b)
+{
+	return a->x <= b->x + b->cx && b->x <= a->x + a->cx &&
+	       a->y <= b->y + b->cy && b->y <= a->y + a->cy;
+}
+
+static inline void rect_union(struct gs_rect *dst, const struct gs_rect *src)
+{
+	int x2 = dst->x + dst->cx;
+	int y2 = dst->y + dst->cy;
+
+	if (src->x + src->cx > x2) x2 = src->x + src->cx;
+	if (src->y + src->cy > y2) y2 = src->y + src->cy;
+	if (src->x < dst->x) dst->x = src->x;
+	if (src->y < dst->y) dst->y = src->y;
+
+	dst->cx = x2 - dst->x;
+	dst->cy = y2 - dst->y;
+}
+
+/**
+ * Add a damaged area (in root window coordinates) to the pending regions
+ *
+ * Overlapping or adjacent regions are merged, and once there are too many
+ * regions they are collapsed into their bounding box.
+ *
+ * @note only called from the capture thread
+ */
+static void xshm_add_damage(struct xshm_data *data,
+		const xcb_rectangle_t *area)
+{
+	struct gs_rect rect;
+	int x2, y2;
+
+	if (data->pending_full)
+		return;
+
+	rect.x = area->x - (int)data->x_org;
+	rect.y = area->y - (int)data->y_org;
+	x2 = rect.x + area->width;
+	y2 = rect.y + area->height;
+
+	if (rect.x < 0) rect.x = 0;
+	if (rect.y < 0) rect.y = 0;
+	if (x2 > data->width)  x2 = (int)data->width;
+	if (y2 > data->height) y2 = (int)data->height;
+	if (x2 <= rect.x || y2 <= rect.y)
+		return;
+
+	rect.cx = x2 - rect.x;
+	rect.cy = y2 - rect.y;
+
+	/* merging can make the rectangle touch ones it was previously
+	 * separate from, so keep going until nothing else can be merged */
+	for (size_t i = data->pending_rects.num; i > 0; i--) {
+		struct gs_rect *cur = data->pending_rects.array + (i - 1);
+
+		if (rects_touch(cur, &rect)) {
+			rect_union(&rect, cur);
+			da_erase(data->pending_rects, i - 1);
+			i = data->pending_rects.num + 1;
+		}
+	}
+
+	if (data->pending_rects.num == XSHM_MAX_DAMAGE_RECTS) {
+		for (size_t i = 0; i < data->pending_rects.num; i++)
+			rect_union(&rect, data->pending_rects.array + i);
+		da_resize(data->pending_rects, 0);
+	}
+
+	da_push_back(data->pending_rects, &rect);
+}
+
+/* the image is packed at the given offset of the segment */
+static inline void xshm_copy_rect(struct xshm_data *data,
+		const struct gs_rect *rect, uint32_t offset)
+{
+	uint32_t frame_linesize = (uint32_t)data->width * 4;
+	uint32_t rect_linesize  = (uint32_t)rect->cx * 4;
+	uint8_t *dst = data->frame + rect->y * frame_linesize + rect->x * 4;
+	uint8_t *src = data->xshm->data + offset;
+
+	if (rect_linesize == frame_linesize) {
+		memcpy(dst, src, (size_t)rect_linesize * rect->cy);
+		return;
+	}
+
+	for (int y = 0; y < rect->cy; y++) {
+		memcpy(dst, src, rect_linesize);
+		dst += frame_linesize;
+		src += rect_linesize;
+	}
+}
+
+/**
+ * Grab the pending regions into the frame copy and queue them for upload
+ *
+ * All regions are requested at once and packed one after the other into the
+ * shared memory segment, which has room for the whole screen.  Only copying
+ * them into the frame copy is done with the frame mutex held, so the video
+ * tick never waits on the X server.
+ *
+ * @note only called from the capture thread
+ */
+static void xshm_grab_damage(struct xshm_data *data)
+{
+	xcb_shm_get_image_cookie_t cookies[XSHM_MAX_DAMAGE_RECTS];
+	uint32_t offsets[XSHM_MAX_DAMAGE_RECTS];
+	bool grabbed[XSHM_MAX_DAMAGE_RECTS];
+	struct gs_rect full = {0, 0, (int)data->width, (int)data->height};
+	const struct gs_rect *rects;
+	size_t num_rects;
+	uint64_t damaged = 0;
+	uint32_t offset = 0;
+
+	if (!data->pending_full && !data->pending_rects.num)
+		return;
+
+	for (size_t i = 0; i < data->pending_rects.num; i++) {
+		struct gs_rect *rect = data->pending_rects.array + i;
+		damaged += (uint64_t)rect->cx * (uint64_t)rect->cy;
+	}
+
+	/* also keeps the packed regions within the segment */
+	if ((double)damaged > (double)(data->width * data->height) *
+			XSHM_FULL_DAMAGE_RATIO)
+		data->pending_full = true;
+
+	rects     = data->pending_full ? &full : data->pending_rects.array;
+	num_rects = data->pending_full ? 1 : data->pending_rects.num;
+
+	for (size_t i = 0; i < num_rects; i++) {
+		const struct gs_rect *rect = rects + i;
+
+		offsets[i] = offset;
+		cookies[i] = xcb_shm_get_image_unchecked(data->xcb,
+				data->xcb_screen->root,
+				data->x_org + rect->x, data->y_org + rect->y,
+				rect->cx, rect->cy, ~0,
+				XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm->seg,
+				offset);
+		offset += (uint32_t)rect->cx * rect->cy * 4;
+	}
+
+	for (size_t i = 0; i < num_rects; i++) {
+		xcb_shm_get_image_reply_t *img_r;
+
+		img_r = xcb_shm_get_image_reply(data->xcb, cookies[i], NULL);
+		grabbed[i] = img_r != NULL;
+		free(img_r);
+	}
+
+	pthread_mutex_lock(&data->frame_mutex);
+
+	for (size_t i = 0; i < num_rects; i++) {
+		if (!grabbed[i])
+			continue;
+
+		xshm_copy_rect(data, rects + i, offsets[i]);
+
+		if (data->pending_full) {
+			da_resize(data->dirty_rects, 0);
+			data->dirty_full = true;
+		} else {
+			da_push_back(data->dirty_rects, rects + i);
+		}
+	}
+
+	/* regions pile up if the video tick isn't consuming them */
+	if (data->dirty_rects.num > XSHM_MAX_DAMAGE_RECTS) {
+		da_resize(data->dirty_rects, 0);
+		data->dirty_full = true;
+	}
+
+	pthread_mutex_unlock(&data->frame_mutex);
+
+	da_resize(data->pending_rects, 0);
+	data->pending_full = false;
+}
+
+/**
+ * Add the area of a damage event to the pending regions
+ *
+ * @return false if the event isn't a damage event
+ */
+static inline bool xshm_handle_damage_event(struct xshm_data *data,
+		xcb_generic_event_t *event)
+{
+#ifdef HAVE_XCB_DAMAGE
+	uint8_t type = event->response_type & ~0x80;
+
+	if (type == data->damage_event + XCB_DAMAGE_NOTIFY) {
+		xcb_damage_notify_event_t *notify =
+			(xcb_damage_notify_event_t*)event;
+		xshm_add_damage(data, &notify->area);
+		return true;
+	}
+#else
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(event);
+#endif
+	return false;
+}
+
+static void *xshm_capture_thread(void *vptr)
+{
+	XSHM_DATA(vptr);
+
+	uint64_t interval = video_output_get_frame_time(obs_get_video());
+	uint64_t next_time = os_gettime_ns();
+
+	os_set_thread_name("xshm-input: capture thread");
+
+	if (!interval)
+		interval = 1000000000ULL / 30;
+
+	while (os_event_try(data->capture_stop) == EAGAIN) {
+		xcb_generic_event_t *event;
+
+		while ((event = xcb_poll_for_event(data->xcb))) {
+			xshm_handle_damage_event(data, event);
+			free(event);
+		}
+
+		if (xcb_connection_has_error(data->xcb)) {
+			blog(LOG_ERROR, "X connection lost, capture stopped");
+			break;
+		}
+
+		if (obs_source_showing(data->source))
+			xshm_grab_damage(data);
+
+		next_time += interval;
+		if (!os_sleepto_ns(next_time))
+			next_time = os_gettime_ns();
+	}
+
+	return NULL;
+}
+
+/**
+ * Subscribe to damage events on the root window
+ *
+ * @return false if the DAMAGE extension isn't available
+ */
+static bool xshm_damage_subscribe(struct xshm_data *data)
+{
+#ifdef HAVE_XCB_DAMAGE
+	const xcb_query_extension_reply_t *ext;
+	xcb_damage_query_version_reply_t *ver;
+
+	ext = xcb_get_extension_data(data->xcb, &xcb_damage_id);
+	if (!ext || !ext->present) {
+		blog(LOG_INFO, "Missing DAMAGE extension, capturing the "
+		               "whole screen every frame");
+		return false;
+	}
+
+	ver = xcb_damage_query_version_reply(data->xcb,
+			xcb_damage_query_version(data->xcb,
+				XCB_DAMAGE_MAJOR_VERSION,
+				XCB_DAMAGE_MINOR_VERSION), NULL);
+	if (!ver)
+		return false;
+	free(ver);
+
+	data->damage_event = ext->first_event;
+	data->damage = xcb_generate_id(data->xcb);
+	xcb_damage_create(data->xcb, data->damage, data->xcb_screen->root,
+			XCB_DAMAGE_REPORT_LEVEL_RAW_RECTANGLES);
+	xcb_flush(data->xcb);
+	return true;
+#else
+	UNUSED_PARAMETER(data);
+	blog(LOG_INFO, "Built without DAMAGE support, capturing the "
+	               "whole screen every frame");
+	return false;
+#endif
+}
+
+static void xshm_damage_unsubscribe(struct xshm_data *data)
+{
+#ifdef HAVE_XCB_DAMAGE
+	xcb_damage_destroy(data->xcb, data->damage);
+#else
+	UNUSED_PARAMETER(data);
+#endif
+}
+
+/**
+ * Subscribe to damage events on the root window and start the capture thread
+ *
+ * @return false if incremental capture isn't available, in which case the
+ *         whole screen is grabbed from the video tick
+ */
+static bool xshm_damage_start(struct xshm_data *data)
+{
+	if (!xshm_damage_subscribe(data))
+		return false;
+
+	data->frame = bzalloc((size_t)data->width * data->height * 4);
+
+	/* the first grab always covers the whole screen */
+	data->pending_full = true;
+
+	pthread_mutex_init_value(&data->frame_mutex);
+	if (pthread_mutex_init(&data->frame_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&data->capture_stop, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail_event;
+	if (pthread_create(&data->capture_thread, NULL, xshm_capture_thread,
+				data) != 0)
+		goto fail_thread;
+
+	data->damage_active = true;
+	return true;
+
+fail_thread:
+	os_event_destroy(data->capture_stop);
+	data->capture_stop = NULL;
+fail_event:
+	pthread_mutex_destroy(&data->frame_mutex);
+fail:
+	xshm_damage_unsubscribe(data);
+	bfree(data->frame);
+	data->frame = NULL;
+	blog(LOG_ERROR, "failed to start capture thread !");
+	return false;
+}
+
+/**
+ * Stop the capture thread and unsubscribe from damage events
+ */
+static void xshm_damage_stop(struct xshm_data *data)
+{
+	if (!data->damage_active)
+		return;
+
+	os_event_signal(data->capture_stop);
+	pthread_join(data->capture_thread, NULL);
+	os_event_destroy(data->capture_stop);
+	pthread_mutex_destroy(&data->frame_mutex);
+
+	xshm_damage_unsubscribe(data);
+
+	da_free(data->pending_rects);
+	da_free(data->dirty_rects);
+	bfree(data->frame);
+
+	data->capture_stop = NULL;
+	data->frame = NULL;
+	data->pending_full = false;
+	data->dirty_full = false;
+	data->damage_active = false;
+}
+
 /**
  * Stop the capture
  */
 static void xshm_capture_stop(struct xshm_data *data)
 {
+	xshm_damage_stop(data);
+
 	obs_enter_graphics();
 
 	if (data->texture) {
@@ -211,6 +605,9 @@ static void xshm_capture_start(struct xshm_data *data)
 
 	obs_leave_graphics();
 
+	if (data->use_damage)
+		xshm_damage_start(data);
+
 	return;
 fail:
 	xshm_capture_stop(data);
@@ -228,6 +625,7 @@ static void xshm_update(void *vptr, obs_data_t *settings)
 	data->screen_id   = obs_data_get_int(settings, "screen");
 	data->show_cursor = obs_data_get_bool(settings, "show_cursor");
 	data->advanced    = obs_data_get_bool(settings, "advanced");
+	data->use_damage  = obs_data_get_bool(settings, "use_damage");
 	data->server      = bstrdup(obs_data_get_string(settings, "server"));
 
 	xshm_capture_start(data);
@@ -241,6 +639,7 @@ static void xshm_defaults(obs_data_t *defaults)
 	obs_data_set_default_int(defaults, "screen", 0);
 	obs_data_set_default_bool(defaults, "show_cursor", true);
 	obs_data_set_default_bool(defaults, "advanced", false);
+	obs_data_set_default_bool(defaults, "use_damage", false);
 }
 
 /**
@@ -339,6 +738,8 @@ static obs_properties_t *xshm_properties(void *vptr)
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 	obs_properties_add_bool(props, "show_cursor",
 			obs_module_text("CaptureCursor"));
+	obs_properties_add_bool(props, "use_damage",
+			obs_module_text("CaptureDamaged"));
 	obs_property_t *advanced = obs_properties_add_bool(props, "advanced",
 			obs_module_text("AdvancedSettings"));
 	obs_property_t *server = obs_properties_add_text(props, "server",
@@ -370,6 +771,18 @@ static void xshm_destroy(void *vptr)
 	bfree(data);
 }
 
+/**
+ * Capture statistics, cumulative over restarts of the capture
+ */
+static void xshm_get_capture_stats(void *vptr, calldata_t *cd)
+{
+	XSHM_DATA(vptr);
+
+	calldata_set_int(cd, "frames", (long long)data->frames_uploaded);
+	calldata_set_int(cd, "full_frames", (long long)data->full_uploads);
+	calldata_set_int(cd, "bytes", (long long)data->bytes_uploaded);
+}
+
 /**
  * Create the capture
  */
@@ -378,11 +791,62 @@ static void *xshm_create(obs_data_t *settings, obs_source_t *source)
 	struct xshm_data *data = bzalloc(sizeof(struct xshm_data));
 	data->source = source;
 
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_capture_stats(out int frames, "
+			"out int full_frames, out int bytes)",
+			xshm_get_capture_stats, data);
+
 	xshm_update(data, settings);
 
 	return data;
 }
 
+/**
+ * Upload the regions grabbed by the capture thread since the last tick
+ *
+ * @note requires to be called within the obs graphics context
+ */
+static void xshm_upload_damage(struct xshm_data *data)
+{
+	uint32_t linesize = (uint32_t)data->width * 4;
+	bool full;
+
+	pthread_mutex_lock(&data->frame_mutex);
+
+	full = data->dirty_full;
+
+	for (size_t i = 0; !full && i < data->dirty_rects.num; i++) {
+		struct gs_rect *rect = data->dirty_rects.array + i;
+		const uint8_t *ptr = data->frame + rect->y * linesize +
+			rect->x * 4;
+
+		/* fall back to a full upload if the renderer can't do
+		 * partial updates */
+		if (!gs_texture_set_image_region(data->texture, rect, ptr,
+					linesize)) {
+			full = true;
+			break;
+		}
+
+		data->bytes_uploaded += (uint64_t)rect->cx * rect->cy * 4;
+	}
+
+	if (full) {
+		gs_texture_set_image(data->texture, data->frame, linesize,
+				false);
+		data->bytes_uploaded += (uint64_t)linesize * data->height;
+		data->full_uploads++;
+	}
+
+	if (full || data->dirty_rects.num)
+		data->frames_uploaded++;
+
+	da_resize(data->dirty_rects, 0);
+	data->dirty_full = false;
+
+	pthread_mutex_unlock(&data->frame_mutex);
+}
+
 /**
  * Prepare the capture data
  */
@@ -396,6 +860,22 @@ static void xshm_video_tick(void *vptr, float seconds)
 	if (!obs_source_showing(data->source))
 		return;
 
+	if (data->damage_active) {
+		xcb_xfixes_get_cursor_image_reply_t *cur_r;
+
+		cur_r = xcb_xfixes_get_cursor_image_reply(data->xcb,
+			xcb_xfixes_get_cursor_image_unchecked(data->xcb),
+			NULL);
+
+		obs_enter_graphics();
+		xshm_upload_damage(data);
+		xcb_xcursor_update(data->cursor, cur_r);
+		obs_leave_graphics();
+
+		free(cur_r);
+		return;
+	}
+
 	xcb_shm_get_image_cookie_t           img_c;
 	xcb_shm_get_image_reply_t            *img_r;
 	xcb_xfixes_get_cursor_image_cookie_t cur_c;
@@ -418,6 +898,10 @@ static void xshm_video_tick(void *vptr, float seconds)
 		data->width * 4, false);
 	xcb_xcursor_update(data->cursor, cur_r);
 
+	data->bytes_uploaded += (uint64_t)data->width * data->height * 4;
+	data->frames_uploaded++;
+	data->full_uploads++;
+
 	obs_leave_graphics();
 
 exit:
@@ -0,0 +1,536 @@
+/*
+Copyright (C) 2016 by Leonhard Oelke <leonhard@in-verted.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <pthread.h>
+
+#include <libavcodec/avcodec.h>
+
+#include <util/threading.h>
+#include <util/circlebuf.h>
+#include <util/platform.h>
+#include <util/bmem.h>
+#include <obs-avc.h>
+#include <obs-ffmpeg-compat.h>
+
+#include "v4l2-decoder.h"
+
+#define blog(level, msg, ...) blog(level, "v4l2-decoder: " msg, ##__VA_ARGS__)
+
+#define MAX_DECODE_WORKERS 4
+
+/**
+ * A dequeued buffer waiting to be decoded
+ */
+struct v4l2_decode_job {
+	/** index of the device buffer */
+	uint32_t index;
+	/** number of bytes used in the buffer */
+	uint32_t bytesused;
+	/** timestamp of the captured frame */
+	uint64_t timestamp;
+	/** position of the frame in the output order */
+	uint64_t seq;
+};
+
+struct v4l2_decode_worker {
+	struct v4l2_decoder *decoder;
+	pthread_t thread;
+	bool thread_active;
+
+	AVCodecContext *context;
+	AVFrame *frame;
+
+	/** used if there is no room to pad the data in the device buffer */
+	uint8_t *packet_buffer;
+	size_t packet_size;
+
+	/** packed output for planar 4:2:2, which obs can't take directly */
+	uint8_t *packed;
+	size_t packed_size;
+
+	struct obs_source_frame out;
+};
+
+struct v4l2_decoder {
+	obs_source_t *source;
+	int_fast32_t dev;
+	struct v4l2_buffer_data *buffers;
+	enum AVCodecID codec_id;
+	AVCodec *codec;
+
+	pthread_mutex_t queue_mutex;
+	struct circlebuf queue;
+	os_sem_t *queue_sem;
+	uint64_t next_seq;
+
+	pthread_mutex_t output_mutex;
+	pthread_cond_t output_cond;
+	uint64_t next_output_seq;
+
+	volatile bool exiting;
+
+	struct v4l2_decode_worker *workers;
+	size_t num_workers;
+
+	uint64_t decoded;
+	uint64_t dropped;
+	uint64_t skipped;
+};
+
+static inline enum AVCodecID v4l2_to_av_codec_id(uint_fast32_t pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_MJPEG:  return AV_CODEC_ID_MJPEG;
+	case V4L2_PIX_FMT_JPEG:   return AV_CODEC_ID_MJPEG;
+#ifdef V4L2_PIX_FMT_H264
+	case V4L2_PIX_FMT_H264:   return AV_CODEC_ID_H264;
+#endif
+	default:                  return AV_CODEC_ID_NONE;
+	}
+}
+
+bool v4l2_decoder_format_supported(uint_fast32_t pixelformat)
+{
+	enum AVCodecID id = v4l2_to_av_codec_id(pixelformat);
+
+	if (id == AV_CODEC_ID_NONE)
+		return false;
+
+	avcodec_register_all();
+	return avcodec_find_decoder(id) != NULL;
+}
+
+/**
+ * Give a buffer back to the driver
+ */
+static void v4l2_decoder_requeue(struct v4l2_decoder *d, uint32_t index)
+{
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index  = index;
+
+	if (v4l2_ioctl(d->dev, VIDIOC_QBUF, &buf) < 0)
+		blog(LOG_DEBUG, "failed to enqueue buffer");
+}
+
+/**
+ * Get a pointer to the compressed data with the padding libavcodec expects
+ *
+ * Usually the device buffers are much larger than the compressed data, in
+ * that case the padding is cleared in place and no copy is made.
+ */
+static uint8_t *get_packet_data(struct v4l2_decode_worker *w,
+		const struct v4l2_decode_job *job)
+{
+	struct v4l2_mmap_info *info = &w->decoder->buffers->info[job->index];
+	size_t size = job->bytesused;
+	size_t padded = size + FF_INPUT_BUFFER_PADDING_SIZE;
+
+	if (padded <= info->length) {
+		memset((uint8_t*)info->start + size, 0,
+				FF_INPUT_BUFFER_PADDING_SIZE);
+		return info->start;
+	}
+
+	if (w->packet_size < padded) {
+		w->packet_buffer = brealloc(w->packet_buffer, padded);
+		w->packet_size = padded;
+	}
+
+	memcpy(w->packet_buffer, info->start, size);
+	memset(w->packet_buffer + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+	return w->packet_buffer;
+}
+
+/**
+ * Pack planar 4:2:2 into YUY2
+ */
+static void pack_yuv422p(struct v4l2_decode_worker *w, AVFrame *frame)
+{
+	uint32_t linesize = (uint32_t)frame->width * 2;
+	size_t size = (size_t)linesize * frame->height;
+
+	if (w->packed_size < size) {
+		bfree(w->packed);
+		w->packed = bmalloc(size);
+		w->packed_size = size;
+	}
+
+	for (int y = 0; y < frame->height; y++) {
+		const uint8_t *lum = frame->data[0] + y * frame->linesize[0];
+		const uint8_t *u   = frame->data[1] + y * frame->linesize[1];
+		const uint8_t *v   = frame->data[2] + y * frame->linesize[2];
+		uint8_t *out       = w->packed + y * linesize;
+
+		for (int x = 0; x < frame->width / 2; x++) {
+			*(out++) = *(lum++);
+			*(out++) = *(u++);
+			*(out++) = *(lum++);
+			*(out++) = *(v++);
+		}
+	}
+
+	memset(w->out.data, 0, sizeof(w->out.data));
+	memset(w->out.linesize, 0, sizeof(w->out.linesize));
+	w->out.data[0]     = w->packed;
+	w->out.linesize[0] = linesize;
+}
+
+static bool v4l2_decoder_prep_frame(struct v4l2_decode_worker *w,
+		AVFrame *frame)
+{
+	enum video_format format = VIDEO_FORMAT_NONE;
+	bool full_range;
+	bool packed = false;
+
+	switch (frame->format) {
+	case AV_PIX_FMT_YUVJ420P:
+	case AV_PIX_FMT_YUV420P:  format = VIDEO_FORMAT_I420; break;
+	case AV_PIX_FMT_YUVJ422P:
+	case AV_PIX_FMT_YUV422P:  format = VIDEO_FORMAT_YUY2; packed = true;
+				  break;
+	case AV_PIX_FMT_YUVJ444P:
+	case AV_PIX_FMT_YUV444P:  format = VIDEO_FORMAT_I444; break;
+	case AV_PIX_FMT_NV12:     format = VIDEO_FORMAT_NV12; break;
+	case AV_PIX_FMT_YUYV422:  format = VIDEO_FORMAT_YUY2; break;
+	case AV_PIX_FMT_UYVY422:  format = VIDEO_FORMAT_UYVY; break;
+	case AV_PIX_FMT_GRAY8:    format = VIDEO_FORMAT_Y800; break;
+	default:;
+	}
+
+	full_range = frame->format == AV_PIX_FMT_YUVJ420P ||
+	             frame->format == AV_PIX_FMT_YUVJ422P ||
+	             frame->format == AV_PIX_FMT_YUVJ444P ||
+	             frame->color_range == AVCOL_RANGE_JPEG;
+
+	if (format == VIDEO_FORMAT_NONE)
+		return false;
+
+	if (format != w->out.format || full_range != w->out.full_range) {
+		enum video_range_type range = full_range ?
+			VIDEO_RANGE_FULL : VIDEO_RANGE_PARTIAL;
+
+		if (!video_format_get_parameters(VIDEO_CS_601, range,
+					w->out.color_matrix,
+					w->out.color_range_min,
+					w->out.color_range_max))
+			return false;
+
+		w->out.format     = format;
+		w->out.full_range = full_range;
+	}
+
+	if (packed) {
+		pack_yuv422p(w, frame);
+	} else {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			w->out.data[i]     = frame->data[i];
+			w->out.linesize[i] = frame->linesize[i];
+		}
+	}
+
+	w->out.width  = frame->width;
+	w->out.height = frame->height;
+	return true;
+}
+
+static bool v4l2_decode_job(struct v4l2_decode_worker *w,
+		const struct v4l2_decode_job *job)
+{
+	struct v4l2_decoder *d = w->decoder;
+	AVPacket packet = {0};
+	int got_frame = false;
+	int ret;
+
+	av_init_packet(&packet);
+	packet.data = get_packet_data(w, job);
+	packet.size = (int)job->bytesused;
+	packet.pts  = (int64_t)job->timestamp;
+
+	if (d->codec_id == AV_CODEC_ID_MJPEG ||
+	    obs_avc_keyframe(packet.data, job->bytesused))
+		packet.flags |= AV_PKT_FLAG_KEY;
+
+	ret = avcodec_decode_video2(w->context, w->frame, &got_frame, &packet);
+
+	/* the decoder does not keep references to the packet data */
+	v4l2_decoder_requeue(d, job->index);
+
+	if (ret < 0 || !got_frame)
+		return false;
+
+	if (!v4l2_decoder_prep_frame(w, w->frame)) {
+		blog(LOG_DEBUG, "unsupported decoded pixel format %d",
+				w->frame->format);
+		return false;
+	}
+
+	w->out.timestamp = d->codec_id == AV_CODEC_ID_H264 ?
+		(uint64_t)w->frame->pkt_pts : job->timestamp;
+	return true;
+}
+
+/**
+ * Pass the decoded frame to obs once all frames captured before it have been
+ * handled, so frames that finish decoding early don't go back in time.
+ */
+static void v4l2_decoder_output(struct v4l2_decode_worker *w,
+		const struct v4l2_decode_job *job, bool success)
+{
+	struct v4l2_decoder *d = w->decoder;
+
+	pthread_mutex_lock(&d->output_mutex);
+
+	while (d->next_output_seq != job->seq && !d->exiting)
+		pthread_cond_wait(&d->output_cond, &d->output_mutex);
+
+	if (success && !d->exiting) {
+		obs_source_output_video(d->source, &w->out);
+		d->decoded++;
+	} else {
+		d->dropped++;
+	}
+
+	d->next_output_seq++;
+	pthread_cond_broadcast(&d->output_cond);
+
+	pthread_mutex_unlock(&d->output_mutex);
+}
+
+static void *v4l2_decode_thread(void *vptr)
+{
+	struct v4l2_decode_worker *w = vptr;
+	struct v4l2_decoder *d = w->decoder;
+	struct v4l2_decode_job job;
+	bool success;
+
+	os_set_thread_name("v4l2: decoder");
+
+	while (os_sem_wait(d->queue_sem) == 0) {
+		if (d->exiting)
+			break;
+
+		pthread_mutex_lock(&d->queue_mutex);
+		if (!d->queue.size) {
+			pthread_mutex_unlock(&d->queue_mutex);
+			continue;
+		}
+
+		circlebuf_pop_front(&d->queue, &job, sizeof(job));
+		job.seq = d->next_seq++;
+		pthread_mutex_unlock(&d->queue_mutex);
+
+		success = v4l2_decode_job(w, &job);
+		v4l2_decoder_output(w, &job, success);
+	}
+
+	return NULL;
+}
+
+static bool v4l2_decode_worker_init(struct v4l2_decoder *d,
+		struct v4l2_decode_worker *w)
+{
+	w->decoder = d;
+	w->context = avcodec_alloc_context3(d->codec);
+	w->frame   = av_frame_alloc();
+	if (!w->context || !w->frame)
+		return false;
+
+	if (d->codec_id == AV_CODEC_ID_H264) {
+		/* frame threading would add a frame of latency per thread */
+		w->context->thread_count = os_get_logical_cores();
+		w->context->thread_type  = FF_THREAD_SLICE;
+		w->context->flags       |= CODEC_FLAG_LOW_DELAY;
+	} else {
+		w->context->thread_count = 1;
+	}
+
+	if (avcodec_open2(w->context, d->codec, NULL) < 0) {
+		blog(LOG_ERROR, "failed to open %s decoder", d->codec->name);
+		return false;
+	}
+
+	if (pthread_create(&w->thread, NULL, v4l2_decode_thread, w) != 0)
+		return false;
+
+	w->thread_active = true;
+	return true;
+}
+
+static void v4l2_decode_worker_free(struct v4l2_decode_worker *w)
+{
+	if (w->context) {
+		avcodec_close(w->context);
+		av_free(w->context);
+	}
+	if (w->frame)
+		av_frame_free(&w->frame);
+
+	bfree(w->packet_buffer);
+	bfree(w->packed);
+}
+
+struct v4l2_decoder *v4l2_decoder_create(obs_source_t *source,
+		int_fast32_t dev, struct v4l2_buffer_data *buf,
+		uint_fast32_t pixelformat)
+{
+	struct v4l2_decoder *d = bzalloc(sizeof(struct v4l2_decoder));
+
+	d->source   = source;
+	d->dev      = dev;
+	d->buffers  = buf;
+	d->codec_id = v4l2_to_av_codec_id(pixelformat);
+
+	pthread_mutex_init_value(&d->queue_mutex);
+	pthread_mutex_init_value(&d->output_mutex);
+
+	if (pthread_mutex_init(&d->queue_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&d->output_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_cond_init(&d->output_cond, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&d->queue_sem, 0) != 0)
+		goto fail;
+
+	avcodec_register_all();
+	d->codec = avcodec_find_decoder(d->codec_id);
+	if (!d->codec) {
+		blog(LOG_ERROR, "no decoder available for %s",
+				avcodec_get_name(d->codec_id));
+		goto fail;
+	}
+
+	/* every MJPEG frame is a keyframe, so they can be decoded by
+	 * independent decoders, which is where most of the cost is */
+	if (d->codec_id == AV_CODEC_ID_MJPEG) {
+		d->num_workers = (size_t)os_get_logical_cores() / 2;
+		if (d->num_workers > MAX_DECODE_WORKERS)
+			d->num_workers = MAX_DECODE_WORKERS;
+		if (d->num_workers >= buf->count)
+			d->num_workers = buf->count - 1;
+		if (!d->num_workers)
+			d->num_workers = 1;
+	} else {
+		d->num_workers = 1;
+	}
+
+	d->workers = bzalloc(sizeof(struct v4l2_decode_worker) *
+			d->num_workers);
+
+	for (size_t i = 0; i < d->num_workers; i++) {
+		if (!v4l2_decode_worker_init(d, &d->workers[i]))
+			goto fail;
+	}
+
+	blog(LOG_INFO, "Decoding %s with %d worker(s)", d->codec->name,
+			(int)d->num_workers);
+	return d;
+
+fail:
+	v4l2_decoder_destroy(d);
+	return NULL;
+}
+
+void v4l2_decoder_destroy(struct v4l2_decoder *d)
+{
+	if (!d)
+		return;
+
+	pthread_mutex_lock(&d->output_mutex);
+	d->exiting = true;
+	pthread_cond_broadcast(&d->output_cond);
+	pthread_mutex_unlock(&d->output_mutex);
+
+	for (size_t i = 0; i < d->num_workers; i++)
+		os_sem_post(d->queue_sem);
+
+	for (size_t i = 0; i < d->num_workers; i++) {
+		struct v4l2_decode_worker *w = &d->workers[i];
+		if (w->thread_active)
+			pthread_join(w->thread, NULL);
+		v4l2_decode_worker_free(w);
+	}
+
+	if (d->codec)
+		blog(LOG_INFO, "Decoded %"PRIu64" frames, %"PRIu64" failed to "
+				"decode, %"PRIu64" skipped to keep up",
+				d->decoded, d->dropped, d->skipped);
+
+	os_sem_destroy(d->queue_sem);
+	pthread_cond_destroy(&d->output_cond);
+	pthread_mutex_destroy(&d->output_mutex);
+	pthread_mutex_destroy(&d->queue_mutex);
+	circlebuf_free(&d->queue);
+	bfree(d->workers);
+	bfree(d);
+}
+
+static inline bool v4l2_decoder_keyframe(struct v4l2_decoder *d,
+		const struct v4l2_decode_job *job)
+{
+	struct v4l2_mmap_info *info = &d->buffers->info[job->index];
+	return obs_avc_keyframe(info->start, job->bytesused);
+}
+
+/**
+ * Give the oldest waiting buffers back to the driver without decoding them
+ */
+static void v4l2_decoder_skip(struct v4l2_decoder *d, size_t count)
+{
+	struct v4l2_decode_job old;
+
+	while (count-- && d->queue.size) {
+		circlebuf_pop_front(&d->queue, &old, sizeof(old));
+		v4l2_decoder_requeue(d, old.index);
+		d->skipped++;
+	}
+}
+
+void v4l2_decoder_push(struct v4l2_decoder *d, struct v4l2_buffer *buf,
+		uint64_t timestamp)
+{
+	struct v4l2_decode_job job = {
+		.index     = buf->index,
+		.bytesused = buf->bytesused,
+		.timestamp = timestamp
+	};
+
+	pthread_mutex_lock(&d->queue_mutex);
+
+	/* if every worker is busy and frames are still waiting, decoding is
+	 * falling behind, so drop waiting frames instead of adding latency.
+	 * MJPEG frames are independent, so the oldest one is dropped.  H.264
+	 * frames depend on the ones before them, so they are only dropped
+	 * when a keyframe arrives, which nothing after it refers back past */
+	if (d->codec_id == AV_CODEC_ID_MJPEG) {
+		if (d->queue.size >= d->num_workers * sizeof(job))
+			v4l2_decoder_skip(d, 1);
+
+	} else if (d->queue.size && v4l2_decoder_keyframe(d, &job)) {
+		v4l2_decoder_skip(d, d->queue.size / sizeof(job));
+	}
+
+	circlebuf_push_back(&d->queue, &job, sizeof(job));
+
+	pthread_mutex_unlock(&d->queue_mutex);
+
+	os_sem_post(d->queue_sem);
+}
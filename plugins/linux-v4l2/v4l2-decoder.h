@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2016 by Leonhard Oelke <leonhard@in-verted.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <obs-module.h>
+
+#include "v4l2-helpers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Decoder for compressed capture formats (MJPEG, H.264)
+ *
+ * Dequeued buffers are handed to the decoder as they are, the compressed
+ * data is read straight from the mapped buffer and the buffer is given back
+ * to the driver as soon as it has been decoded.
+ * MJPEG frames are independent of each other, so they are decoded on several
+ * worker threads at once, H.264 uses a single worker with slice threading.
+ * Decoded frames are always passed to obs in capture order.
+ * If decoding falls behind, waiting MJPEG frames are dropped oldest first,
+ * while waiting H.264 frames are only dropped once a keyframe arrives.
+ */
+struct v4l2_decoder;
+
+#if HAVE_V4L2_DECODER
+
+/**
+ * Check if a pixelformat can be decoded
+ *
+ * @param pixelformat v4l2 format id
+ *
+ * @return true if the decoder handles the format
+ */
+bool v4l2_decoder_format_supported(uint_fast32_t pixelformat);
+
+/**
+ * Create a decoder and start its worker threads
+ *
+ * @param source the source decoded frames are passed to
+ * @param dev handle for the v4l2 device
+ * @param buf buffer data of the mapped device buffers
+ * @param pixelformat v4l2 format id of the compressed data
+ *
+ * @return the decoder or NULL on failure
+ */
+struct v4l2_decoder *v4l2_decoder_create(obs_source_t *source,
+		int_fast32_t dev, struct v4l2_buffer_data *buf,
+		uint_fast32_t pixelformat);
+
+/**
+ * Stop the worker threads and free the decoder
+ *
+ * This has to be called before the capture is stopped, buffers that are
+ * still queued for decoding are left to the driver.
+ *
+ * @param decoder the decoder
+ */
+void v4l2_decoder_destroy(struct v4l2_decoder *decoder);
+
+/**
+ * Queue a dequeued buffer for decoding
+ *
+ * The decoder takes ownership of the buffer and enqueues it again once the
+ * data has been decoded or dropped.
+ *
+ * @param decoder the decoder
+ * @param buf the dequeued buffer
+ * @param timestamp timestamp for the decoded frame
+ */
+void v4l2_decoder_push(struct v4l2_decoder *decoder, struct v4l2_buffer *buf,
+		uint64_t timestamp);
+
+#else
+
+static inline bool v4l2_decoder_format_supported(uint_fast32_t pixelformat)
+{
+	UNUSED_PARAMETER(pixelformat);
+	return false;
+}
+
+static inline struct v4l2_decoder *v4l2_decoder_create(obs_source_t *source,
+		int_fast32_t dev, struct v4l2_buffer_data *buf,
+		uint_fast32_t pixelformat)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(dev);
+	UNUSED_PARAMETER(buf);
+	UNUSED_PARAMETER(pixelformat);
+	return NULL;
+}
+
+static inline void v4l2_decoder_destroy(struct v4l2_decoder *decoder)
+{
+	UNUSED_PARAMETER(decoder);
+}
+
+static inline void v4l2_decoder_push(struct v4l2_decoder *decoder,
+		struct v4l2_buffer *buf, uint64_t timestamp)
+{
+	UNUSED_PARAMETER(decoder);
+	UNUSED_PARAMETER(buf);
+	UNUSED_PARAMETER(timestamp);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
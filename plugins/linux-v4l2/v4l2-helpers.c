@@ -30,9 +30,15 @@ int_fast32_t v4l2_start_capture(int_fast32_t dev, struct v4l2_buffer_data *buf)
 
 	memset(&enq, 0, sizeof(enq));
 	enq.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	enq.memory = V4L2_MEMORY_MMAP;
+	enq.memory = buf->memory;
 
 	for (enq.index = 0; enq.index < buf->count; ++enq.index) {
+		if (enq.memory == V4L2_MEMORY_USERPTR) {
+			enq.m.userptr = (unsigned long)
+				buf->info[enq.index].start;
+			enq.length    = buf->info[enq.index].length;
+		}
+
 		if (v4l2_ioctl(dev, VIDIOC_QBUF, &enq) < 0) {
 			blog(LOG_ERROR, "unable to queue buffer");
 			return -1;
@@ -61,13 +67,14 @@ int_fast32_t v4l2_stop_capture(int_fast32_t dev)
 	return 0;
 }
 
-int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
+int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf,
+		uint32_t count)
 {
 	struct v4l2_requestbuffers req;
 	struct v4l2_buffer map;
 
 	memset(&req, 0, sizeof(req));
-	req.count  = 4;
+	req.count  = count;
 	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
 
@@ -81,8 +88,9 @@ int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
 		return -1;
 	}
 
-	buf->count = req.count;
-	buf->info  = bzalloc(req.count * sizeof(struct v4l2_mmap_info));
+	buf->count  = req.count;
+	buf->memory = V4L2_MEMORY_MMAP;
+	buf->info   = bzalloc(req.count * sizeof(struct v4l2_mmap_info));
 
 	memset(&map, 0, sizeof(map));
 	map.type   = req.type;
@@ -111,6 +119,8 @@ int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
 int_fast32_t v4l2_destroy_mmap(struct v4l2_buffer_data *buf)
 {
 	for(uint_fast32_t i = 0; i < buf->count; ++i) {
+		if (buf->memory != V4L2_MEMORY_MMAP)
+			break;
 		if (buf->info[i].start != MAP_FAILED && buf->info[i].start != 0)
 			v4l2_munmap(buf->info[i].start, buf->info[i].length);
 	}
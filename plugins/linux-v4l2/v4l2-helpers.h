@@ -43,6 +43,8 @@ struct v4l2_mmap_info {
 struct v4l2_buffer_data {
 	/** number of mapped buffers */
 	uint_fast32_t count;
+	/** memory type of the buffers, V4L2_MEMORY_MMAP or _USERPTR */
+	uint32_t memory;
 	/** memory info for mapped buffers */
 	struct v4l2_mmap_info *info;
 };
@@ -73,6 +75,29 @@ static inline enum video_format v4l2_to_obs_video_format(uint_fast32_t format)
 	}
 }
 
+/**
+ * Check if a v4l2 pixel format carries compressed data
+ *
+ * Compressed formats have to be decoded before they can be passed to obs.
+ *
+ * @param format v4l2 format id
+ *
+ * @return true if the format is compressed
+ */
+static inline bool v4l2_is_compressed_format(uint_fast32_t format)
+{
+	switch (format) {
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+#ifdef V4L2_PIX_FMT_H264
+	case V4L2_PIX_FMT_H264:
+#endif
+		return true;
+	default:
+		return false;
+	}
+}
+
 /**
  * Fixed framesizes for devices that don't support enumerating discrete values.
  *
@@ -172,8 +197,8 @@ static void v4l2_unpack_tuple(int *a, int *b, int packed)
 /**
  * Start the video capture on the device.
  *
- * This enqueues the memory mapped buffers and instructs the device to start
- * the video stream.
+ * This enqueues the memory mapped (or user pointer) buffers and instructs the
+ * device to start the video stream.
  *
  * @param dev handle for the v4l2 device
  * @param buf buffer data
@@ -194,18 +219,24 @@ int_fast32_t v4l2_stop_capture(int_fast32_t dev);
 /**
  * Create memory mapping for buffers
  *
- * This tries to map at least 2, preferably 4, buffers to application memory.
+ * This tries to map the requested number of buffers to application memory,
+ * the device may return less but at least 2 are required.
  *
  * @param dev handle for the v4l2 device
  * @param buf buffer data
+ * @param count number of buffers to request
  *
  * @return negative on failure
  */
-int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf);
+int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf,
+		uint32_t count);
 
 /**
  * Destroy the memory mapping for buffers
  *
+ * User pointer buffers are not owned by the buffer data, so for those only
+ * the buffer info is freed.
+ *
  * @param buf buffer data
  *
  * @return negative on failure
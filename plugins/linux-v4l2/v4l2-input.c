@@ -36,6 +36,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <obs-module.h>
 
 #include "v4l2-helpers.h"
+#include "v4l2-decoder.h"
+#include "v4l2-userptr.h"
 
 #if HAVE_UDEV
 #include "v4l2-udev.h"
@@ -75,6 +77,8 @@ struct v4l2_data {
 	int dv_timing;
 	int resolution;
 	int framerate;
+	int buffer_count;
+	bool zero_copy;
 
 	/* internal data */
 	obs_source_t *source;
@@ -86,12 +90,31 @@ struct v4l2_data {
 	int height;
 	int linesize;
 	struct v4l2_buffer_data buffers;
+
+	/* the pool is read by the capture stats proc handler, which may be
+	 * called from any thread, so it is only replaced with pool_mutex
+	 * held */
+	pthread_mutex_t pool_mutex;
+	struct v4l2_userptr_pool *pool;
+
+	/* statistics, written by the capture thread */
+	volatile long frames_delivered;
+	volatile long frames_dropped_driver;
+	volatile long frames_dropped_obs;
+	volatile long frames_copied;
 };
 
 /* forward declarations */
 static void v4l2_init(struct v4l2_data *data);
 static void v4l2_terminate(struct v4l2_data *data);
 
+/* each counter only has a single writer, so this doesn't need to be one
+ * atomic operation, only readers on other threads have to see whole values */
+static inline void add_stat(volatile long *stat, long val)
+{
+	os_atomic_set_long(stat, os_atomic_load_long(stat) + val);
+}
+
 /**
  * Prepare the output frame structure for obs and compute plane offsets
  *
@@ -153,16 +176,26 @@ static void *v4l2_thread(void *vptr)
 	uint8_t *start;
 	uint64_t frames;
 	uint64_t first_ts;
+	uint32_t last_sequence;
 	struct timeval tv;
 	struct v4l2_buffer buf;
 	struct obs_source_frame out;
 	size_t plane_offsets[MAX_AV_PLANES];
+	struct v4l2_decoder *decoder = NULL;
 
 	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
 		goto exit;
 
+	if (v4l2_is_compressed_format(data->pixfmt)) {
+		decoder = v4l2_decoder_create(data->source, data->dev,
+				&data->buffers, data->pixfmt);
+		if (!decoder)
+			goto exit;
+	}
+
 	frames   = 0;
 	first_ts = 0;
+	last_sequence = 0;
 	v4l2_prep_obs_frame(data, &out, plane_offsets);
 
 	while (os_event_try(data->event) == EAGAIN) {
@@ -182,8 +215,9 @@ static void *v4l2_thread(void *vptr)
 			continue;
 		}
 
+		memset(&buf, 0, sizeof(buf));
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_MMAP;
+		buf.memory = data->buffers.memory;
 
 		if (v4l2_ioctl(data->dev, VIDIOC_DQBUF, &buf) < 0) {
 			if (errno == EAGAIN)
@@ -192,15 +226,44 @@ static void *v4l2_thread(void *vptr)
 			break;
 		}
 
+		/* gaps in the sequence are frames the driver had no free
+		 * buffer for */
+		if (frames && buf.sequence > last_sequence + 1)
+			add_stat(&data->frames_dropped_driver,
+				(long)(buf.sequence - last_sequence - 1));
+		last_sequence = buf.sequence;
+
 		out.timestamp = timeval2ns(buf.timestamp);
 		if (!frames)
 			first_ts = out.timestamp;
 		out.timestamp -= first_ts;
 
+		/* the decoder gives the buffer back to the driver once the
+		 * data has been decoded */
+		if (decoder) {
+			v4l2_decoder_push(decoder, &buf, out.timestamp);
+			os_atomic_inc_long(&data->frames_delivered);
+			frames++;
+			continue;
+		}
+
 		start = (uint8_t *) data->buffers.info[buf.index].start;
 		for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 			out.data[i] = start + plane_offsets[i];
+
+		/* user pointer buffers are enqueued again by the pool once
+		 * obs is done with them */
+		if (data->pool) {
+			if (!v4l2_userptr_pool_output(data->pool, data->source,
+						&buf, &out))
+				os_atomic_inc_long(&data->frames_copied);
+			os_atomic_inc_long(&data->frames_delivered);
+			frames++;
+			continue;
+		}
+
 		obs_source_output_video(data->source, &out);
+		os_atomic_inc_long(&data->frames_delivered);
 
 		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
 			blog(LOG_DEBUG, "failed to enqueue buffer");
@@ -210,9 +273,13 @@ static void *v4l2_thread(void *vptr)
 		frames++;
 	}
 
-	blog(LOG_INFO, "Stopped capture after %"PRIu64" frames", frames);
+	blog(LOG_INFO, "Stopped capture after %"PRIu64" frames, "
+			"%ld dropped by the driver so far", frames,
+			os_atomic_load_long(&data->frames_dropped_driver));
 
 exit:
+	v4l2_decoder_destroy(decoder);
+	v4l2_userptr_pool_stop(data->pool);
 	v4l2_stop_capture(data->dev);
 	return NULL;
 }
@@ -232,6 +299,8 @@ static void v4l2_defaults(obs_data_t *settings)
 	obs_data_set_default_int(settings, "resolution", -1);
 	obs_data_set_default_int(settings, "framerate", -1);
 	obs_data_set_default_bool(settings, "buffering", true);
+	obs_data_set_default_int(settings, "buffer_count", 4);
+	obs_data_set_default_bool(settings, "zero_copy", false);
 }
 
 /**
@@ -389,7 +458,8 @@ static void v4l2_format_list(int dev, obs_property_t *prop)
 			dstr_cat(&buffer, " (Emulated)");
 
 		if (v4l2_to_obs_video_format(fmt.pixelformat)
-				!= VIDEO_FORMAT_NONE) {
+				!= VIDEO_FORMAT_NONE ||
+		    v4l2_decoder_format_supported(fmt.pixelformat)) {
 			obs_property_list_add_int(prop, buffer.array,
 					fmt.pixelformat);
 			blog(LOG_INFO, "Pixelformat: %s (available)",
@@ -762,6 +832,13 @@ static obs_properties_t *v4l2_properties(void *vptr)
 	obs_properties_add_bool(props,
 			"buffering", obs_module_text("UseBuffering"));
 
+	obs_properties_add_int(props,
+			"buffer_count", obs_module_text("BufferCount"),
+			2, 32, 1);
+
+	obs_properties_add_bool(props,
+			"zero_copy", obs_module_text("ZeroCopy"));
+
 	obs_data_t *settings = obs_source_get_settings(data->source);
 	v4l2_device_list(device_list, settings);
 	obs_data_release(settings);
@@ -784,6 +861,15 @@ static void v4l2_terminate(struct v4l2_data *data)
 		data->thread = 0;
 	}
 
+	pthread_mutex_lock(&data->pool_mutex);
+	if (data->pool) {
+		add_stat(&data->frames_dropped_obs,
+				(long)v4l2_userptr_pool_dropped(data->pool));
+		v4l2_userptr_pool_release(data->pool);
+		data->pool = NULL;
+	}
+	pthread_mutex_unlock(&data->pool_mutex);
+
 	v4l2_destroy_mmap(&data->buffers);
 
 	if (data->dev != -1) {
@@ -813,6 +899,7 @@ static void v4l2_destroy(void *vptr)
 	v4l2_unref_udev();
 #endif
 
+	pthread_mutex_destroy(&data->pool_mutex);
 	bfree(data);
 }
 
@@ -874,7 +961,8 @@ static void v4l2_init(struct v4l2_data *data)
 		blog(LOG_ERROR, "Unable to set format");
 		goto fail;
 	}
-	if (v4l2_to_obs_video_format(data->pixfmt) == VIDEO_FORMAT_NONE) {
+	if (v4l2_to_obs_video_format(data->pixfmt) == VIDEO_FORMAT_NONE &&
+	    !v4l2_decoder_format_supported(data->pixfmt)) {
 		blog(LOG_ERROR, "Selected video format not supported");
 		goto fail;
 	}
@@ -891,11 +979,28 @@ static void v4l2_init(struct v4l2_data *data)
 	v4l2_unpack_tuple(&fps_num, &fps_denom, data->framerate);
 	blog(LOG_INFO, "Framerate: %.2f fps", (float) fps_denom / fps_num);
 
+	/* compressed data is decoded into separate frames anyway, so user
+	 * pointers only help for raw formats */
+	if (data->zero_copy && !v4l2_is_compressed_format(data->pixfmt)) {
+		struct v4l2_userptr_pool *pool = v4l2_userptr_pool_create(
+				data->dev, &data->buffers, data->buffer_count);
+
+		pthread_mutex_lock(&data->pool_mutex);
+		data->pool = pool;
+		pthread_mutex_unlock(&data->pool_mutex);
+
+		if (!pool)
+			blog(LOG_WARNING, "Falling back to mapped buffers");
+	}
+
 	/* map buffers */
-	if (v4l2_create_mmap(data->dev, &data->buffers) < 0) {
+	if (!data->pool && v4l2_create_mmap(data->dev, &data->buffers,
+				data->buffer_count) < 0) {
 		blog(LOG_ERROR, "Failed to map buffers");
 		goto fail;
 	}
+	blog(LOG_INFO, "Buffers: %d (%s)", (int)data->buffers.count,
+			data->pool ? "user pointer" : "mapped");
 
 	/* start the capture thread */
 	if (os_event_init(&data->event, OS_EVENT_TYPE_MANUAL) != 0)
@@ -943,18 +1048,49 @@ static void v4l2_update(void *vptr, obs_data_t *settings)
 	data->dv_timing  = obs_data_get_int(settings, "dv_timing");
 	data->resolution = obs_data_get_int(settings, "resolution");
 	data->framerate  = obs_data_get_int(settings, "framerate");
+	data->buffer_count = obs_data_get_int(settings, "buffer_count");
+	data->zero_copy  = obs_data_get_bool(settings, "zero_copy");
 
 	v4l2_update_source_flags(data, settings);
 
 	v4l2_init(data);
 }
 
+/*
+ * Capture statistics, cumulative over restarts of the capture
+ */
+static void v4l2_get_capture_stats(void *vptr, calldata_t *cd)
+{
+	V4L2_DATA(vptr);
+	uint64_t dropped_obs;
+
+	/* the pool is released and replaced when the capture restarts */
+	pthread_mutex_lock(&data->pool_mutex);
+	dropped_obs = (uint64_t)os_atomic_load_long(&data->frames_dropped_obs) +
+		v4l2_userptr_pool_dropped(data->pool);
+	pthread_mutex_unlock(&data->pool_mutex);
+
+	calldata_set_int(cd, "delivered",
+			os_atomic_load_long(&data->frames_delivered));
+	calldata_set_int(cd, "dropped_driver",
+			os_atomic_load_long(&data->frames_dropped_driver));
+	calldata_set_int(cd, "dropped_obs", (long long)dropped_obs);
+	calldata_set_int(cd, "copied",
+			os_atomic_load_long(&data->frames_copied));
+}
+
 static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 {
 	struct v4l2_data *data = bzalloc(sizeof(struct v4l2_data));
 	data->dev = -1;
 	data->source = source;
 
+	pthread_mutex_init_value(&data->pool_mutex);
+	if (pthread_mutex_init(&data->pool_mutex, NULL) != 0) {
+		bfree(data);
+		return NULL;
+	}
+
 	/* Bitch about build problems ... */
 #ifndef V4L2_CAP_DEVICE_CAPS
 	blog(LOG_WARNING, "Plugin built without device caps support!");
@@ -963,6 +1099,11 @@ static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 	blog(LOG_WARNING, "Plugin built without dv-timing support!");
 #endif
 
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_capture_stats(out int delivered, "
+			"out int dropped_driver, out int dropped_obs, "
+			"out int copied)", v4l2_get_capture_stats, data);
+
 	v4l2_update(data, settings);
 
 #if HAVE_UDEV
@@ -0,0 +1,226 @@
+/*
+Copyright (C) 2016 by Leonhard Oelke <leonhard@in-verted.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <util/threading.h>
+#include <util/bmem.h>
+
+#include "v4l2-userptr.h"
+
+#define blog(level, msg, ...) blog(level, "v4l2-userptr: " msg, ##__VA_ARGS__)
+
+/** buffers that always have to stay with the driver */
+#define MIN_QUEUED_BUFFERS 1
+
+struct v4l2_userptr_buffer {
+	struct v4l2_userptr_pool *pool;
+	uint32_t index;
+	void *start;
+	size_t length;
+};
+
+struct v4l2_userptr_pool {
+	volatile long refs;
+
+	pthread_mutex_t mutex;
+	int_fast32_t dev;
+	bool streaming;
+
+	/** number of buffers currently owned by the driver */
+	volatile long queued;
+	/** frames obs discarded without displaying */
+	volatile long dropped;
+
+	uint32_t count;
+	struct v4l2_userptr_buffer *buffers;
+};
+
+static void v4l2_userptr_pool_free(struct v4l2_userptr_pool *pool)
+{
+	for (uint32_t i = 0; i < pool->count; i++)
+		free(pool->buffers[i].start);
+
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool->buffers);
+	bfree(pool);
+}
+
+static inline void v4l2_userptr_pool_decref(struct v4l2_userptr_pool *pool)
+{
+	if (os_atomic_dec_long(&pool->refs) == 0)
+		v4l2_userptr_pool_free(pool);
+}
+
+static int_fast32_t v4l2_userptr_requeue(struct v4l2_userptr_buffer *b)
+{
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type      = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory    = V4L2_MEMORY_USERPTR;
+	buf.index     = b->index;
+	buf.m.userptr = (unsigned long)b->start;
+	buf.length    = b->length;
+
+	if (v4l2_ioctl(b->pool->dev, VIDIOC_QBUF, &buf) < 0) {
+		blog(LOG_DEBUG, "failed to enqueue buffer");
+		return -1;
+	}
+
+	os_atomic_inc_long(&b->pool->queued);
+	return 0;
+}
+
+struct v4l2_userptr_pool *v4l2_userptr_pool_create(int_fast32_t dev,
+		struct v4l2_buffer_data *buf, uint32_t count)
+{
+	struct v4l2_userptr_pool *pool;
+	struct v4l2_requestbuffers req;
+	struct v4l2_format fmt;
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	size_t size;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (v4l2_ioctl(dev, VIDIOC_G_FMT, &fmt) < 0)
+		return NULL;
+
+	memset(&req, 0, sizeof(req));
+	req.count  = count;
+	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_USERPTR;
+
+	if (v4l2_ioctl(dev, VIDIOC_REQBUFS, &req) < 0) {
+		blog(LOG_INFO, "Device does not support user pointers");
+		return NULL;
+	}
+
+	if (req.count < 2) {
+		blog(LOG_ERROR, "Device returned less than 2 buffers");
+		return NULL;
+	}
+
+	size = (fmt.fmt.pix.sizeimage + page_size - 1) & ~(page_size - 1);
+
+	pool = bzalloc(sizeof(struct v4l2_userptr_pool));
+	pool->refs      = 1;
+	pool->dev       = dev;
+	pool->streaming = true;
+	pool->queued    = req.count;
+	pool->buffers   = bzalloc(req.count *
+			sizeof(struct v4l2_userptr_buffer));
+	pthread_mutex_init_value(&pool->mutex);
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		goto fail;
+
+	for (; pool->count < req.count; pool->count++) {
+		struct v4l2_userptr_buffer *b = &pool->buffers[pool->count];
+
+		if (posix_memalign(&b->start, page_size, size) != 0)
+			goto fail;
+
+		b->pool   = pool;
+		b->index  = pool->count;
+		b->length = fmt.fmt.pix.sizeimage;
+	}
+
+	buf->count  = pool->count;
+	buf->memory = V4L2_MEMORY_USERPTR;
+	buf->info   = bzalloc(pool->count * sizeof(struct v4l2_mmap_info));
+
+	for (uint32_t i = 0; i < pool->count; i++) {
+		buf->info[i].start  = pool->buffers[i].start;
+		buf->info[i].length = pool->buffers[i].length;
+	}
+
+	blog(LOG_INFO, "Allocated %"PRIu32" user pointer buffers of %"PRIu32
+			" bytes", pool->count, fmt.fmt.pix.sizeimage);
+	return pool;
+
+fail:
+	blog(LOG_ERROR, "Failed to allocate user pointer buffers");
+	v4l2_userptr_pool_free(pool);
+	return NULL;
+}
+
+void v4l2_userptr_pool_stop(struct v4l2_userptr_pool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->streaming = false;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void v4l2_userptr_pool_release(struct v4l2_userptr_pool *pool)
+{
+	if (!pool)
+		return;
+
+	v4l2_userptr_pool_stop(pool);
+	v4l2_userptr_pool_decref(pool);
+}
+
+/* called by libobs once it no longer references the frame */
+static void v4l2_userptr_frame_released(void *param,
+		struct obs_source_frame *frame, bool rendered)
+{
+	struct v4l2_userptr_buffer *b = param;
+	struct v4l2_userptr_pool *pool = b->pool;
+
+	if (!rendered)
+		os_atomic_inc_long(&pool->dropped);
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->streaming)
+		v4l2_userptr_requeue(b);
+	pthread_mutex_unlock(&pool->mutex);
+
+	v4l2_userptr_pool_decref(pool);
+
+	UNUSED_PARAMETER(frame);
+}
+
+bool v4l2_userptr_pool_output(struct v4l2_userptr_pool *pool,
+		obs_source_t *source, struct v4l2_buffer *buf,
+		struct obs_source_frame *frame)
+{
+	struct v4l2_userptr_buffer *b = &pool->buffers[buf->index];
+
+	if (os_atomic_dec_long(&pool->queued) < MIN_QUEUED_BUFFERS) {
+		obs_source_output_video(source, frame);
+
+		pthread_mutex_lock(&pool->mutex);
+		v4l2_userptr_requeue(b);
+		pthread_mutex_unlock(&pool->mutex);
+		return false;
+	}
+
+	os_atomic_inc_long(&pool->refs);
+	obs_source_output_video_nocopy(source, frame,
+			v4l2_userptr_frame_released, b);
+	return true;
+}
+
+uint64_t v4l2_userptr_pool_dropped(struct v4l2_userptr_pool *pool)
+{
+	return pool ? (uint64_t)os_atomic_load_long(&pool->dropped) : 0;
+}
@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2016 by Leonhard Oelke <leonhard@in-verted.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <obs-module.h>
+
+#include "v4l2-helpers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pool of user pointer buffers
+ *
+ * The device writes directly into page aligned buffers allocated by the
+ * pool, and the frames are handed to obs without copying them.  A buffer is
+ * only given back to the driver once obs has released the frame, so the pool
+ * is reference counted and outlives the capture if obs still holds frames.
+ */
+struct v4l2_userptr_pool;
+
+/**
+ * Request user pointer buffers from the device and allocate them
+ *
+ * On success the buffer data describes the allocated buffers and can be
+ * used with v4l2_start_capture.
+ *
+ * @param dev handle for the v4l2 device
+ * @param buf buffer data
+ * @param count number of buffers to request
+ *
+ * @return the pool or NULL if the device does not support user pointers
+ */
+struct v4l2_userptr_pool *v4l2_userptr_pool_create(int_fast32_t dev,
+		struct v4l2_buffer_data *buf, uint32_t count);
+
+/**
+ * Stop giving buffers back to the driver
+ *
+ * This has to be called before the capture is stopped.
+ *
+ * @param pool the buffer pool
+ */
+void v4l2_userptr_pool_stop(struct v4l2_userptr_pool *pool);
+
+/**
+ * Release the capture's reference to the pool
+ *
+ * @param pool the buffer pool
+ */
+void v4l2_userptr_pool_release(struct v4l2_userptr_pool *pool);
+
+/**
+ * Pass a dequeued buffer to obs
+ *
+ * Normally the frame is handed over without a copy, and the buffer is
+ * enqueued again once obs releases it.  If obs holds on to so many frames
+ * that the driver would run out of buffers, the frame is copied instead and
+ * the buffer enqueued right away.
+ *
+ * @param pool the buffer pool
+ * @param source the source to output the frame to
+ * @param buf the dequeued buffer
+ * @param frame frame description pointing to the buffer memory
+ *
+ * @return true if the frame was handed over without a copy
+ */
+bool v4l2_userptr_pool_output(struct v4l2_userptr_pool *pool,
+		obs_source_t *source, struct v4l2_buffer *buf,
+		struct obs_source_frame *frame);
+
+/**
+ * Get the number of frames obs discarded without displaying them
+ *
+ * @param pool the buffer pool
+ *
+ * @return number of dropped frames
+ */
+uint64_t v4l2_userptr_pool_dropped(struct v4l2_userptr_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
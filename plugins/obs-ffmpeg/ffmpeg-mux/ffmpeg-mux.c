@@ -14,6 +14,10 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
@@ -25,8 +29,18 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ffmpeg-mux.h"
 
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
+
 #include <libavformat/avformat.h>
 
 /* ------------------------------------------------------------------------- */
@@ -75,6 +89,9 @@ struct main_params {
 	int fps_den;
 	char *acodec;
 	char *muxer_settings;
+	int fragment_ms;
+	int sync_ms;
+	int prealloc_mb;
 };
 
 struct audio_params {
@@ -89,6 +106,202 @@ struct header {
 	int size;
 };
 
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Writes the output file for crash-safe recordings.  Disk space is reserved
+ * ahead of the write position in large extents so the file is not spread
+ * over many small ones, and a separate thread syncs the data written so far
+ * to disk at a fixed interval, so a crash of the process or the system loses
+ * at most that much of the recording without ever making the muxer wait on
+ * the disk.
+ */
+
+#define FILE_WRITER_BUFFER_SIZE (1024 * 1024)
+
+#ifndef _WIN32
+struct file_writer {
+	int             fd;
+	int64_t         allocated;
+	int64_t         prealloc_size;
+	int             sync_ms;
+
+	pthread_t       sync_thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+	bool            stop;
+	bool            sync_thread_active;
+};
+
+static inline void sync_file(int fd)
+{
+#ifdef __linux__
+	fdatasync(fd);
+#else
+	fsync(fd);
+#endif
+}
+
+static void preallocate(struct file_writer *fw, int64_t end)
+{
+	if (!fw->prealloc_size || end <= fw->allocated)
+		return;
+
+#ifdef __linux__
+	/* reserve the space without changing the file size, so that a file
+	 * left behind by a crash does not end in zeroes */
+	while (fw->allocated < end) {
+		if (fallocate(fw->fd, FALLOC_FL_KEEP_SIZE, fw->allocated,
+					fw->prealloc_size) != 0) {
+			fw->prealloc_size = 0;
+			return;
+		}
+
+		fw->allocated += fw->prealloc_size;
+	}
+#endif
+}
+
+static int file_writer_write(void *opaque, uint8_t *buf, int buf_size)
+{
+	struct file_writer *fw = opaque;
+	int64_t pos = lseek(fw->fd, 0, SEEK_CUR);
+	int size = buf_size;
+
+	preallocate(fw, pos + buf_size);
+
+	while (size > 0) {
+		ssize_t ret = write(fw->fd, buf, (size_t)size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return AVERROR(errno);
+		}
+
+		buf  += ret;
+		size -= (int)ret;
+	}
+
+	return buf_size;
+}
+
+static int64_t file_writer_seek(void *opaque, int64_t offset, int whence)
+{
+	struct file_writer *fw = opaque;
+	int64_t ret;
+
+	if (whence & AVSEEK_SIZE) {
+		struct stat st;
+		return fstat(fw->fd, &st) == 0 ? (int64_t)st.st_size :
+			AVERROR(errno);
+	}
+
+	ret = lseek(fw->fd, offset, whence & ~AVSEEK_FORCE);
+	return ret < 0 ? AVERROR(errno) : ret;
+}
+
+static void *sync_thread(void *data)
+{
+	struct file_writer *fw = data;
+
+	pthread_mutex_lock(&fw->mutex);
+
+	while (!fw->stop) {
+		struct timeval now;
+		struct timespec ts;
+		int64_t ns;
+
+		gettimeofday(&now, NULL);
+		ns = (int64_t)now.tv_usec * 1000 +
+			(int64_t)fw->sync_ms * 1000000;
+		ts.tv_sec  = now.tv_sec + (time_t)(ns / 1000000000);
+		ts.tv_nsec = (long)(ns % 1000000000);
+
+		pthread_cond_timedwait(&fw->cond, &fw->mutex, &ts);
+		if (fw->stop)
+			break;
+
+		pthread_mutex_unlock(&fw->mutex);
+		sync_file(fw->fd);
+		pthread_mutex_lock(&fw->mutex);
+	}
+
+	pthread_mutex_unlock(&fw->mutex);
+	return NULL;
+}
+
+static struct file_writer *file_writer_open(const char *path, int sync_ms,
+		int prealloc_mb)
+{
+	struct file_writer *fw = calloc(1, sizeof(*fw));
+
+	fw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fw->fd < 0) {
+		free(fw);
+		return NULL;
+	}
+
+	fw->prealloc_size = (int64_t)prealloc_mb * 1024 * 1024;
+	fw->sync_ms = sync_ms;
+
+	pthread_mutex_init(&fw->mutex, NULL);
+	pthread_cond_init(&fw->cond, NULL);
+
+	if (sync_ms > 0)
+		fw->sync_thread_active = pthread_create(&fw->sync_thread, NULL,
+				sync_thread, fw) == 0;
+
+	return fw;
+}
+
+static void file_writer_close(struct file_writer *fw)
+{
+	if (fw->sync_thread_active) {
+		pthread_mutex_lock(&fw->mutex);
+		fw->stop = true;
+		pthread_cond_signal(&fw->cond);
+		pthread_mutex_unlock(&fw->mutex);
+
+		pthread_join(fw->sync_thread, NULL);
+	}
+
+	sync_file(fw->fd);
+
+	/* release the space reserved past the end of the file, the file
+	 * itself was never extended into it */
+	if (fw->allocated) {
+		struct stat st;
+		if (fstat(fw->fd, &st) != 0 ||
+		    ftruncate(fw->fd, st.st_size) != 0)
+			printf("Failed to release preallocated space: %s\n",
+					strerror(errno));
+	}
+
+	close(fw->fd);
+
+	pthread_cond_destroy(&fw->cond);
+	pthread_mutex_destroy(&fw->mutex);
+	free(fw);
+}
+
+static AVIOContext *file_writer_create_avio(struct file_writer *fw)
+{
+	uint8_t *buf = av_malloc(FILE_WRITER_BUFFER_SIZE);
+	AVIOContext *pb;
+
+	if (!buf)
+		return NULL;
+
+	pb = avio_alloc_context(buf, FILE_WRITER_BUFFER_SIZE, 1, fw, NULL,
+			file_writer_write, file_writer_seek);
+	if (!pb)
+		av_free(buf);
+	return pb;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
 struct ffmpeg_mux {
 	AVFormatContext        *output;
 	AVStream               *video_stream;
@@ -99,6 +312,9 @@ struct ffmpeg_mux {
 	struct header          *audio_header;
 	int                    num_audio_streams;
 	bool                   initialized;
+#ifndef _WIN32
+	struct file_writer     *writer;
+#endif
 	char error[4096];
 };
 
@@ -110,6 +326,19 @@ static void header_free(struct header *header)
 static void free_avformat(struct ffmpeg_mux *ffm)
 {
 	if (ffm->output) {
+#ifndef _WIN32
+		if (ffm->writer) {
+			if (ffm->output->pb) {
+				avio_flush(ffm->output->pb);
+				av_freep(&ffm->output->pb->buffer);
+				av_freep(&ffm->output->pb);
+			}
+
+			file_writer_close(ffm->writer);
+			ffm->writer = NULL;
+
+		} else
+#endif
 		if ((ffm->output->oformat->flags & AVFMT_NOFILE) == 0)
 			avio_close(ffm->output->pb);
 
@@ -252,6 +481,19 @@ static bool init_params(int *argc, char ***argv, struct main_params *params,
 
 	get_opt_str(argc, argv, &params->muxer_settings, "muxer settings");
 
+	/* crash-safe recording parameters, only given when it is enabled */
+	if (*argc) {
+		if (!get_opt_int(argc, argv, &params->fragment_ms,
+					"fragment duration"))
+			return false;
+		if (!get_opt_int(argc, argv, &params->sync_ms,
+					"sync interval"))
+			return false;
+		if (!get_opt_int(argc, argv, &params->prealloc_mb,
+					"preallocation size"))
+			return false;
+	}
+
 	return true;
 }
 
@@ -447,19 +689,79 @@ static inline bool ffmpeg_mux_get_extra_data(struct ffmpeg_mux *ffm)
 #pragma warning(disable : 4996)
 #endif
 
+static inline bool use_file_writer(struct ffmpeg_mux *ffm)
+{
+#ifdef _WIN32
+	(void)ffm;
+	return false;
+#else
+	return ffm->params.sync_ms > 0 || ffm->params.prealloc_mb > 0;
+#endif
+}
+
+static int open_file(struct ffmpeg_mux *ffm)
+{
+	int ret;
+
+#ifndef _WIN32
+	if (use_file_writer(ffm)) {
+		ffm->writer = file_writer_open(ffm->params.file,
+				ffm->params.sync_ms, ffm->params.prealloc_mb);
+		if (!ffm->writer) {
+			printf("Couldn't open '%s', %s", ffm->params.file,
+					strerror(errno));
+			return FFM_ERROR;
+		}
+
+		ffm->output->pb = file_writer_create_avio(ffm->writer);
+		return ffm->output->pb ? FFM_SUCCESS : FFM_ERROR;
+	}
+#endif
+
+	ret = avio_open(&ffm->output->pb, ffm->params.file, AVIO_FLAG_WRITE);
+	if (ret < 0) {
+		printf("Couldn't open '%s', %s",
+				ffm->params.file, av_err2str(ret));
+		return FFM_ERROR;
+	}
+
+	return FFM_SUCCESS;
+}
+
+static inline bool is_mp4_or_mov(AVOutputFormat *format)
+{
+	return strcmp(format->name, "mp4") == 0 ||
+	       strcmp(format->name, "mov") == 0;
+}
+
+/* each fragment is complete once written, so everything up to the last
+ * fragment can be played back even if the muxer never gets to finish.
+ * fragments only end on keyframes (frag_duration would also end them in the
+ * middle of a GOP), so the fragment duration is a minimum, and a fragment
+ * lasts until the first keyframe after it */
+static void set_fragmented(struct ffmpeg_mux *ffm, AVDictionary **dict)
+{
+	AVDictionaryEntry *flags = av_dict_get(*dict, "movflags", NULL, 0);
+	char str[256];
+
+	snprintf(str, sizeof(str), "%s%sfrag_keyframe+empty_moov"
+			"+default_base_moof",
+			flags ? flags->value : "", flags ? "+" : "");
+
+	av_dict_set(dict, "movflags", str, 0);
+	av_dict_set_int(dict, "min_frag_duration",
+			(int64_t)ffm->params.fragment_ms * 1000, 0);
+}
+
 static inline int open_output_file(struct ffmpeg_mux *ffm)
 {
 	AVOutputFormat *format = ffm->output->oformat;
 	int ret;
 
 	if ((format->flags & AVFMT_NOFILE) == 0) {
-		ret = avio_open(&ffm->output->pb, ffm->params.file,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
-			printf("Couldn't open '%s', %s",
-					ffm->params.file, av_err2str(ret));
-			return FFM_ERROR;
-		}
+		ret = open_file(ffm);
+		if (ret != FFM_SUCCESS)
+			return ret;
 	}
 
 	strncpy(ffm->output->filename, ffm->params.file,
@@ -475,6 +777,9 @@ static inline int open_output_file(struct ffmpeg_mux *ffm)
 		av_dict_free(&dict);
 	}
 
+	if (ffm->params.fragment_ms > 0 && is_mp4_or_mov(format))
+		set_fragmented(ffm, &dict);
+
 	if (av_dict_count(dict) > 0) {
 		printf("Using muxer settings:");
 
@@ -625,7 +930,16 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 	if (info->keyframe)
 		packet.flags = AV_PKT_FLAG_KEY;
 
-	return av_interleaved_write_frame(ffm->output, &packet) >= 0;
+	if (av_interleaved_write_frame(ffm->output, &packet) < 0)
+		return false;
+
+	/* fragments only end on keyframes, so hand the finished ones to the
+	 * file instead of leaving them in the write buffer */
+	if (ffm->params.fragment_ms > 0 && info->keyframe &&
+	    info->type == FFM_PACKET_VIDEO && ffm->output->pb)
+		avio_flush(ffm->output->pb);
+
+	return true;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -20,6 +20,7 @@
 #include <util/dstr.h>
 #include <util/pipe.h>
 #include <util/threading.h>
+#include <time.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
 
 #include <libavformat/avformat.h>
@@ -31,6 +32,12 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+struct replay_gop {
+	size_t            num_packets;
+	size_t            size;
+	int64_t           dts_usec;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
@@ -40,6 +47,22 @@ struct ffmpeg_muxer {
 	volatile bool     active;
 	volatile bool     stopping;
 	volatile bool     capturing;
+
+	/* replay buffer */
+	DARRAY(struct encoder_packet) packets;
+	size_t            first_packet;
+	DARRAY(struct replay_gop) gops;
+	size_t            first_gop;
+	size_t            total_size;
+	int64_t           max_time_usec;
+	size_t            max_size;
+	volatile bool     save_requested;
+
+	DARRAY(struct encoder_packet) mux_packets;
+	struct dstr       replay_path;
+	pthread_t         mux_thread;
+	bool              mux_thread_joinable;
+	volatile bool     muxing;
 };
 
 static const char *ffmpeg_mux_getname(void *unused)
@@ -177,6 +200,29 @@ static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
 	dstr_free(&mux);
 }
 
+/* fragmented mp4/mov output, with the file synced to disk periodically */
+static void add_crash_safe_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+
+	if (obs_data_get_bool(settings, "crash_safe")) {
+		int fragment_ms = (int)obs_data_get_int(settings,
+				"fragment_duration_ms");
+		int sync_ms = (int)obs_data_get_int(settings,
+				"sync_interval_ms");
+		int prealloc_mb = (int)obs_data_get_int(settings,
+				"preallocate_mb");
+
+		info("Crash-safe recording: fragments of at least %d ms, "
+				"synced every %d ms, %d MB preallocated",
+				fragment_ms, sync_ms, prealloc_mb);
+
+		dstr_catf(cmd, "%d %d %d", fragment_ms, sync_ms, prealloc_mb);
+	}
+
+	obs_data_release(settings);
+}
+
 static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
@@ -211,6 +257,7 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd)
 	}
 
 	add_muxer_params(cmd, stream);
+	add_crash_safe_params(cmd, stream);
 }
 
 static bool ffmpeg_mux_start(void *data)
@@ -314,14 +361,12 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 			sizeof(info));
 	if (ret != sizeof(info)) {
 		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
 		return false;
 	}
 
 	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
 	if (ret != packet->size) {
 		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
 		return false;
 	}
 
@@ -383,8 +428,10 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 		return;
 
 	if (!stream->sent_headers) {
-		if (!send_headers(stream))
+		if (!send_headers(stream)) {
+			signal_failure(stream);
 			return;
+		}
 
 		stream->sent_headers = true;
 	}
@@ -396,7 +443,16 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	write_packet(stream, packet);
+	if (!write_packet(stream, packet))
+		signal_failure(stream);
+}
+
+static void ffmpeg_mux_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_bool(settings, "crash_safe", false);
+	obs_data_set_default_int(settings, "fragment_duration_ms", 2000);
+	obs_data_set_default_int(settings, "sync_interval_ms", 1000);
+	obs_data_set_default_int(settings, "preallocate_mb", 64);
 }
 
 static obs_properties_t *ffmpeg_mux_properties(void *unused)
@@ -408,6 +464,17 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 	obs_properties_add_text(props, "path",
 			obs_module_text("FilePath"),
 			OBS_TEXT_DEFAULT);
+	obs_properties_add_bool(props, "crash_safe",
+			obs_module_text("CrashSafe"));
+	obs_properties_add_int(props, "fragment_duration_ms",
+			obs_module_text("CrashSafe.FragmentDuration"),
+			100, 60000, 100);
+	obs_properties_add_int(props, "sync_interval_ms",
+			obs_module_text("CrashSafe.SyncInterval"),
+			0, 60000, 100);
+	obs_properties_add_int(props, "preallocate_mb",
+			obs_module_text("CrashSafe.Preallocate"),
+			0, 4096, 1);
 	return props;
 }
 
@@ -422,5 +489,395 @@ struct obs_output_info ffmpeg_muxer = {
 	.start          = ffmpeg_mux_start,
 	.stop           = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
+	.get_defaults   = ffmpeg_mux_defaults,
 	.get_properties = ffmpeg_mux_properties
 };
+
+/* ------------------------------------------------------------------------- */
+/* replay buffer */
+
+/*
+ * Keeps the most recent encoded packets in memory instead of writing them out,
+ * and writes them to a new file through ffmpeg-mux whenever "save" is called.
+ * The packets are references to the encoders' shared packet data, grouped by
+ * the video keyframe that starts each GOP, so that whole GOPs can be dropped
+ * from the front once the buffer is over its time or memory limit and a saved
+ * file always starts on a keyframe.  The file is written on its own thread
+ * from a second set of references, so the buffer keeps filling while a replay
+ * is being saved.
+ */
+
+static const char *replay_buffer_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("ReplayBuffer");
+}
+
+static inline struct encoder_packet *replay_packet(struct ffmpeg_muxer *stream,
+		size_t idx)
+{
+	return stream->packets.array + stream->first_packet + idx;
+}
+
+static inline size_t replay_num_packets(struct ffmpeg_muxer *stream)
+{
+	return stream->packets.num - stream->first_packet;
+}
+
+static inline size_t replay_num_gops(struct ffmpeg_muxer *stream)
+{
+	return stream->gops.num - stream->first_gop;
+}
+
+static void free_replay_packets(struct ffmpeg_muxer *stream)
+{
+	for (size_t i = 0; i < replay_num_packets(stream); i++)
+		obs_encoder_packet_release(replay_packet(stream, i));
+
+	da_free(stream->packets);
+	da_free(stream->gops);
+	stream->first_packet = 0;
+	stream->first_gop    = 0;
+	stream->total_size   = 0;
+}
+
+static void replay_buffer_destroy(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	if (stream->mux_thread_joinable)
+		pthread_join(stream->mux_thread, NULL);
+
+	free_replay_packets(stream);
+	da_free(stream->mux_packets);
+	dstr_free(&stream->replay_path);
+	ffmpeg_mux_destroy(stream);
+}
+
+static void replay_buffer_save(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	if (active(stream))
+		os_atomic_set_bool(&stream->save_requested, true);
+
+	UNUSED_PARAMETER(cd);
+}
+
+static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct ffmpeg_muxer *stream = ffmpeg_mux_create(settings, output);
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	signal_handler_t *sh = obs_output_get_signal_handler(output);
+
+	proc_handler_add(ph, "void save()", replay_buffer_save, stream);
+	signal_handler_add(sh, "void saved(ptr output, string path)");
+
+	return stream;
+}
+
+static bool replay_buffer_start(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	obs_data_t *settings;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(stream->output);
+	stream->max_time_usec =
+		obs_data_get_int(settings, "max_time_sec") * 1000000LL;
+	stream->max_size =
+		(size_t)obs_data_get_int(settings, "max_size_mb") * 1024 * 1024;
+	obs_data_release(settings);
+
+	os_atomic_set_bool(&stream->save_requested, false);
+	os_atomic_set_bool(&stream->active, true);
+	os_atomic_set_bool(&stream->capturing, true);
+	obs_output_begin_data_capture(stream->output, 0);
+
+	info("Replay buffer started, keeping up to %d seconds or %d MB",
+			(int)(stream->max_time_usec / 1000000),
+			(int)(stream->max_size / (1024 * 1024)));
+	return true;
+}
+
+static void replay_buffer_deactivate(struct ffmpeg_muxer *stream)
+{
+	free_replay_packets(stream);
+	os_atomic_set_bool(&stream->active, false);
+
+	info("Replay buffer stopped");
+
+	if (stopping(stream))
+		obs_output_end_data_capture(stream->output);
+
+	os_atomic_set_bool(&stream->stopping, false);
+}
+
+/* saved files start at zero, from the keyframe the buffer starts with */
+static inline int64_t usec_to_timebase(const struct encoder_packet *packet,
+		int64_t usec)
+{
+	return usec * packet->timebase_den /
+		((int64_t)packet->timebase_num * 1000000LL);
+}
+
+static bool write_replay_packets(struct ffmpeg_muxer *stream)
+{
+	struct encoder_packet *first = stream->mux_packets.array;
+	int64_t video_offset = first->dts;
+	int64_t start_usec = first->dts_usec;
+
+	for (size_t i = 0; i < stream->mux_packets.num; i++) {
+		struct encoder_packet packet = stream->mux_packets.array[i];
+		int64_t offset = packet.type == OBS_ENCODER_VIDEO ?
+			video_offset : usec_to_timebase(&packet, start_usec);
+
+		packet.dts -= offset;
+		packet.pts -= offset;
+
+		if (!write_packet(stream, &packet))
+			return false;
+	}
+
+	return true;
+}
+
+static void signal_saved(struct ffmpeg_muxer *stream)
+{
+	signal_handler_t *sh = obs_output_get_signal_handler(stream->output);
+	struct calldata params = {0};
+
+	calldata_set_ptr(&params, "output", stream->output);
+	calldata_set_string(&params, "path", stream->replay_path.array);
+	signal_handler_signal(sh, "saved", &params);
+	calldata_free(&params);
+}
+
+static void *replay_buffer_mux_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	bool success = false;
+	struct dstr cmd;
+
+	os_set_thread_name("replay buffer: mux thread");
+
+	build_command_line(stream, &cmd);
+	stream->pipe = os_process_pipe_create(cmd.array, "w");
+	dstr_free(&cmd);
+
+	if (!stream->pipe) {
+		warn("Failed to create process pipe");
+		goto finish;
+	}
+
+	success = send_headers(stream) && write_replay_packets(stream);
+
+	if (os_process_pipe_destroy(stream->pipe) != 0)
+		success = false;
+	stream->pipe = NULL;
+
+finish:
+	for (size_t i = 0; i < stream->mux_packets.num; i++)
+		obs_encoder_packet_release(stream->mux_packets.array + i);
+	da_resize(stream->mux_packets, 0);
+
+	if (success) {
+		info("Wrote replay buffer to '%s'", stream->replay_path.array);
+		signal_saved(stream);
+	} else {
+		warn("Failed to write replay buffer to '%s'",
+				stream->replay_path.array);
+	}
+
+	os_atomic_set_bool(&stream->muxing, false);
+	return NULL;
+}
+
+static void generate_replay_path(struct ffmpeg_muxer *stream)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	const char *dir = obs_data_get_string(settings, "directory");
+	const char *format = obs_data_get_string(settings, "format");
+	const char *ext = obs_data_get_string(settings, "extension");
+	time_t now = time(NULL);
+	char name[256];
+
+	if (!strftime(name, sizeof(name), format, localtime(&now)))
+		strcpy(name, "Replay");
+
+	dstr_copy(&stream->replay_path, dir);
+	dstr_replace(&stream->replay_path, "\\", "/");
+	if (stream->replay_path.len && dstr_end(&stream->replay_path) != '/')
+		dstr_cat_ch(&stream->replay_path, '/');
+	dstr_catf(&stream->replay_path, "%s.%s", name, ext);
+
+	dstr_copy_dstr(&stream->path, &stream->replay_path);
+	dstr_replace(&stream->path, "\"", "\"\"");
+
+	obs_data_release(settings);
+}
+
+static void save_replay(struct ffmpeg_muxer *stream)
+{
+	size_t num = replay_num_packets(stream);
+
+	if (os_atomic_load_bool(&stream->muxing)) {
+		warn("Still writing the last replay, ignoring save request");
+		return;
+	}
+	if (!num)
+		return;
+
+	if (stream->mux_thread_joinable) {
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+
+	da_resize(stream->mux_packets, num);
+	for (size_t i = 0; i < num; i++)
+		obs_encoder_packet_ref(stream->mux_packets.array + i,
+				replay_packet(stream, i));
+
+	generate_replay_path(stream);
+
+	os_atomic_set_bool(&stream->muxing, true);
+	if (pthread_create(&stream->mux_thread, NULL, replay_buffer_mux_thread,
+				stream) != 0) {
+		warn("Failed to create replay buffer mux thread");
+
+		for (size_t i = 0; i < num; i++)
+			obs_encoder_packet_release(
+					stream->mux_packets.array + i);
+		da_resize(stream->mux_packets, 0);
+		os_atomic_set_bool(&stream->muxing, false);
+		return;
+	}
+
+	stream->mux_thread_joinable = true;
+}
+
+static void drop_front_gop(struct ffmpeg_muxer *stream)
+{
+	struct replay_gop *gop = stream->gops.array + stream->first_gop;
+
+	for (size_t i = 0; i < gop->num_packets; i++)
+		obs_encoder_packet_release(replay_packet(stream, i));
+
+	stream->first_packet += gop->num_packets;
+	stream->total_size   -= gop->size;
+	stream->first_gop++;
+
+	/* move the rest down once most of the array is dropped packets, so
+	 * the cost of the move is spread over many packets */
+	if (stream->first_packet >= 64 &&
+	    stream->first_packet * 2 >= stream->packets.num) {
+		da_erase_range(stream->packets, 0, stream->first_packet);
+		stream->first_packet = 0;
+	}
+	if (stream->first_gop >= 16 &&
+	    stream->first_gop * 2 >= stream->gops.num) {
+		da_erase_range(stream->gops, 0, stream->first_gop);
+		stream->first_gop = 0;
+	}
+}
+
+static inline bool replay_over_limit(struct ffmpeg_muxer *stream,
+		int64_t dts_usec)
+{
+	struct replay_gop *gop = stream->gops.array + stream->first_gop;
+
+	return dts_usec - gop->dts_usec > stream->max_time_usec ||
+	       stream->total_size > stream->max_size;
+}
+
+static void replay_buffer_data(void *data, struct encoder_packet *packet)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct replay_gop *gop;
+
+	if (!active(stream))
+		return;
+
+	if (stopping(stream)) {
+		if (packet->sys_dts_usec >= stream->stop_ts) {
+			replay_buffer_deactivate(stream);
+			return;
+		}
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe) {
+		gop = da_push_back_new(stream->gops);
+		gop->dts_usec = packet->dts_usec;
+	}
+
+	/* nothing is kept until the first keyframe */
+	if (!replay_num_gops(stream))
+		return;
+
+	gop = stream->gops.array + stream->gops.num - 1;
+	gop->num_packets++;
+	gop->size += packet->size;
+	stream->total_size += packet->size;
+
+	obs_encoder_packet_ref(da_push_back_new(stream->packets), packet);
+
+	/* always keep the GOP that is currently being filled */
+	while (replay_num_gops(stream) > 1 &&
+	       replay_over_limit(stream, packet->dts_usec))
+		drop_front_gop(stream);
+
+	if (os_atomic_set_bool(&stream->save_requested, false))
+		save_replay(stream);
+}
+
+static void replay_buffer_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "max_time_sec", 20);
+	obs_data_set_default_int(settings, "max_size_mb", 512);
+	obs_data_set_default_string(settings, "format",
+			"Replay %Y-%m-%d %H-%M-%S");
+	obs_data_set_default_string(settings, "extension", "mp4");
+}
+
+static obs_properties_t *replay_buffer_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_path(props, "directory",
+			obs_module_text("ReplayBuffer.Directory"),
+			OBS_PATH_DIRECTORY, NULL, NULL);
+	obs_properties_add_text(props, "format",
+			obs_module_text("ReplayBuffer.Format"),
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_text(props, "extension",
+			obs_module_text("ReplayBuffer.Extension"),
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, "max_time_sec",
+			obs_module_text("ReplayBuffer.MaxTime"),
+			1, 21600, 1);
+	obs_properties_add_int(props, "max_size_mb",
+			obs_module_text("ReplayBuffer.MaxSize"),
+			1, 32768, 1);
+	return props;
+}
+
+struct obs_output_info replay_buffer = {
+	.id             = "replay_buffer",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED |
+	                  OBS_OUTPUT_MULTI_TRACK,
+	.get_name       = replay_buffer_getname,
+	.create         = replay_buffer_create,
+	.destroy        = replay_buffer_destroy,
+	.start          = replay_buffer_start,
+	.stop           = ffmpeg_mux_stop,
+	.encoded_packet = replay_buffer_data,
+	.get_defaults   = replay_buffer_defaults,
+	.get_properties = replay_buffer_properties
+};
@@ -2,6 +2,14 @@
 #include <media-io/audio-math.h>
 #include <math.h>
 
+/* OBS_FILTERS_NO_SIMD builds the scalar code on x86 as well, the filter
+ * benchmark uses it to check both paths produce the same output */
+#if !defined(OBS_FILTERS_NO_SIMD) && (defined(__SSE__) || \
+		defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define GAIN_SSE
+#include <xmmintrin.h>
+#endif
+
 #define do_log(level, format, ...) \
 	blog(level, "[gain filter: '%s'] " format, \
 			obs_source_get_name(gf->context), ##__VA_ARGS__)
@@ -16,6 +24,7 @@
 
 struct gain_data {
 	obs_source_t *context;
+	size_t channels;
 	float multiple;
 };
 
@@ -37,6 +46,9 @@ static void gain_update(void *data, obs_data_t *s)
 	double val = obs_data_get_double(s, S_GAIN_DB);
 
 	gf->multiple = db_to_mul((float)val);
+	gf->channels = audio_output_get_channels(obs_get_audio());
+	if (gf->channels > MAX_AV_PLANES)
+		gf->channels = MAX_AV_PLANES;
 }
 
 static void *gain_create(obs_data_t *settings, obs_source_t *filter)
@@ -52,15 +64,34 @@ static struct obs_audio_data *gain_filter_audio(void *data,
 {
 	struct gain_data *gf = data;
 
-	float *adata[2] = {(float*)audio->data[0], (float*)audio->data[1]};
+	const size_t channels = gf->channels;
+	const size_t frames = audio->frames;
 	const float multiple = gf->multiple;
-
-	for (size_t c = 0; c < 2; c++) {
-		if (audio->data[c]) {
-			for (size_t i = 0; i < audio->frames; i++) {
-				adata[c][i] *= multiple;
-			}
+#ifdef GAIN_SSE
+	const size_t aligned = frames & ~(size_t)3;
+	const __m128 multiple4 = _mm_set1_ps(multiple);
+#else
+	const size_t aligned = 0;
+#endif
+
+	if (multiple == 1.0f)
+		return audio;
+
+	for (size_t c = 0; c < channels; c++) {
+		float *adata = (float*)audio->data[c];
+		size_t i;
+
+		if (!adata)
+			continue;
+
+#ifdef GAIN_SSE
+		for (i = 0; i < aligned; i += 4) {
+			__m128 v = _mm_loadu_ps(adata + i);
+			_mm_storeu_ps(adata + i, _mm_mul_ps(v, multiple4));
 		}
+#endif
+		for (i = aligned; i < frames; i++)
+			adata[i] *= multiple;
 	}
 
 	return audio;
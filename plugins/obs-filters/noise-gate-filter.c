@@ -1,7 +1,16 @@
 #include <media-io/audio-math.h>
 #include <obs-module.h>
+#include <string.h>
 #include <math.h>
 
+/* OBS_FILTERS_NO_SIMD builds the scalar code on x86 as well, the filter
+ * benchmark uses it to check both paths produce the same output */
+#if !defined(OBS_FILTERS_NO_SIMD) && (defined(__SSE2__) || \
+		defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NOISE_GATE_SSE
+#include <emmintrin.h>
+#endif
+
 #define do_log(level, format, ...) \
 	blog(level, "[noise gate: '%s'] " format, \
 			obs_source_get_name(ng->context), ##__VA_ARGS__)
@@ -80,6 +89,8 @@ static void noise_gate_update(void *data, obs_data_t *s)
 
 	ng->sample_rate_i = 1.0f / sample_rate;
 	ng->channels = audio_output_get_channels(obs_get_audio());
+	if (ng->channels > MAX_AV_PLANES)
+		ng->channels = MAX_AV_PLANES;
 	ng->open_threshold = db_to_mul(open_threshold_db);
 	ng->close_threshold = db_to_mul(close_threshold_db);
 	ng->attack_rate = 1.0f / (ms_to_secf(attack_time_ms) * sample_rate);
@@ -104,12 +115,109 @@ static void *noise_gate_create(obs_data_t *settings, obs_source_t *filter)
 	return ng;
 }
 
+/* the gate is evaluated once per block rather than once per sample; at
+ * 48khz a block is two thirds of a millisecond, well below the shortest
+ * attack/release times that are audible */
+#define GATE_BLOCK_SIZE 32
+
+#ifdef NOISE_GATE_SSE
+
+static inline float get_block_peak(float **adata, size_t channels,
+		size_t offset, size_t frames)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 peak4 = _mm_setzero_ps();
+	float peak = 0.0f;
+	size_t aligned = frames & ~(size_t)3;
+
+	for (size_t c = 0; c < channels; c++) {
+		const float *data = adata[c] + offset;
+		size_t i;
+
+		for (i = 0; i < aligned; i += 4) {
+			__m128 v = _mm_and_ps(_mm_loadu_ps(data + i), abs_mask);
+			peak4 = _mm_max_ps(peak4, v);
+		}
+		for (; i < frames; i++)
+			peak = fmaxf(peak, fabsf(data[i]));
+	}
+
+	peak4 = _mm_max_ps(peak4, _mm_movehl_ps(peak4, peak4));
+	peak4 = _mm_max_ss(peak4, _mm_shuffle_ps(peak4, peak4, 1));
+	return fmaxf(peak, _mm_cvtss_f32(peak4));
+}
+
+/* multiplies each sample by start + rate * (i + 1) clamped to [0, 1], which
+ * matches what incrementing the attenuation every sample would produce */
+static inline void apply_gain_ramp(float **adata, size_t channels,
+		size_t offset, size_t frames, float start, float rate)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 four = _mm_set1_ps(4.0f);
+	const __m128 start4 = _mm_set1_ps(start);
+	const __m128 rate4 = _mm_set1_ps(rate);
+	size_t aligned = frames & ~(size_t)3;
+
+	for (size_t c = 0; c < channels; c++) {
+		float *data = adata[c] + offset;
+		__m128 pos = _mm_set_ps(4.0f, 3.0f, 2.0f, 1.0f);
+		size_t i;
+
+		/* the gain is computed from the position rather than
+		 * accumulated so it is the same as the scalar code's */
+		for (i = 0; i < aligned; i += 4) {
+			__m128 g = _mm_add_ps(start4, _mm_mul_ps(rate4, pos));
+			g = _mm_min_ps(one, _mm_max_ps(zero, g));
+			_mm_storeu_ps(data + i,
+					_mm_mul_ps(_mm_loadu_ps(data + i), g));
+			pos = _mm_add_ps(pos, four);
+		}
+		for (; i < frames; i++) {
+			float g = start + rate * (float)(i + 1);
+			data[i] *= fminf(1.0f, fmaxf(0.0f, g));
+		}
+	}
+}
+
+#else
+
+static inline float get_block_peak(float **adata, size_t channels,
+		size_t offset, size_t frames)
+{
+	float peak = 0.0f;
+
+	for (size_t c = 0; c < channels; c++) {
+		const float *data = adata[c] + offset;
+
+		for (size_t i = 0; i < frames; i++)
+			peak = fmaxf(peak, fabsf(data[i]));
+	}
+
+	return peak;
+}
+
+static inline void apply_gain_ramp(float **adata, size_t channels,
+		size_t offset, size_t frames, float start, float rate)
+{
+	for (size_t c = 0; c < channels; c++) {
+		float *data = adata[c] + offset;
+
+		for (size_t i = 0; i < frames; i++) {
+			float g = start + rate * (float)(i + 1);
+			data[i] *= fminf(1.0f, fmaxf(0.0f, g));
+		}
+	}
+}
+
+#endif
+
 static struct obs_audio_data *noise_gate_filter_audio(void *data,
 		struct obs_audio_data *audio)
 {
 	struct noise_gate_data *ng = data;
 
-	float *adata[2] = {(float*)audio->data[0], (float*)audio->data[1]};
+	float *adata[MAX_AV_PLANES];
 	const float close_threshold = ng->close_threshold;
 	const float open_threshold = ng->open_threshold;
 	const float sample_rate_i = ng->sample_rate_i;
@@ -119,10 +227,18 @@ static struct obs_audio_data *noise_gate_filter_audio(void *data,
 	const float hold_time = ng->hold_time;
 	const size_t channels = ng->channels;
 
-	for (size_t i = 0; i < audio->frames; i++) {
-		float cur_level = (channels == 2)
-			? fmaxf(fabsf(adata[0][i]), fabsf(adata[1][i]))
-			: fabsf(adata[0][i]);
+	for (size_t c = 0; c < channels; c++)
+		adata[c] = (float*)audio->data[c];
+
+	for (size_t i = 0; i < audio->frames; i += GATE_BLOCK_SIZE) {
+		size_t frames = audio->frames - i;
+		float cur_level;
+		float rate = 0.0f;
+
+		if (frames > GATE_BLOCK_SIZE)
+			frames = GATE_BLOCK_SIZE;
+
+		cur_level = get_block_peak(adata, channels, i, frames);
 
 		if (cur_level > open_threshold && !ng->is_open) {
 			ng->is_open = true;
@@ -132,21 +248,30 @@ static struct obs_audio_data *noise_gate_filter_audio(void *data,
 			ng->is_open = false;
 		}
 
-		ng->level = fmaxf(ng->level, cur_level) - decay_rate;
+		ng->level = fmaxf(ng->level, cur_level) -
+			decay_rate * (float)frames;
 
 		if (ng->is_open) {
-			ng->attenuation = fminf(1.0f,
-					ng->attenuation + attack_rate);
+			rate = attack_rate;
 		} else {
-			ng->held_time += sample_rate_i;
-			if (ng->held_time > hold_time) {
-				ng->attenuation = fmaxf(0.0f,
-						ng->attenuation - release_rate);
-			}
+			ng->held_time += sample_rate_i * (float)frames;
+			if (ng->held_time > hold_time)
+				rate = -release_rate;
+		}
+
+		/* fully open or closed gates skip the ramp entirely */
+		if (ng->attenuation >= 1.0f && rate >= 0.0f)
+			continue;
+		if (ng->attenuation <= 0.0f && rate <= 0.0f) {
+			for (size_t c = 0; c < channels; c++)
+				memset(adata[c] + i, 0, frames * sizeof(float));
+			continue;
 		}
 
-		for (size_t c = 0; c < channels; c++)
-			adata[c][i] *= ng->attenuation;
+		apply_gain_ramp(adata, channels, i, frames,
+				ng->attenuation, rate);
+		ng->attenuation = fminf(1.0f, fmaxf(0.0f,
+				ng->attenuation + rate * (float)frames));
 	}
 
 	return audio;
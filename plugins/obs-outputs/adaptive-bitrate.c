@@ -0,0 +1,272 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/dstr.h>
+#include "adaptive-bitrate.h"
+
+#define ABR_MIN_KBPS              300
+#define ABR_DEFAULT_QUEUE_HIGH    250000LL
+#define ABR_LOSS_HIGH_PCT         5.0f
+#define ABR_LOSS_LOW_PCT          1.0f
+
+#define ABR_RATE_INTERVAL_NS      500000000ULL
+#define ABR_LINK_VALID_NS         5000000000ULL
+#define ABR_DECREASE_INTERVAL_NS  2000000000ULL
+#define ABR_INCREASE_HOLD_NS      5000000000ULL
+#define ABR_MAX_INCREASE_HOLD_NS  80000000000ULL
+#define ABR_HOLD_RESET_NS         60000000000ULL
+
+bool abr_init(struct adaptive_bitrate *abr)
+{
+	pthread_mutex_init_value(&abr->mutex);
+	return pthread_mutex_init(&abr->mutex, NULL) == 0;
+}
+
+void abr_free(struct adaptive_bitrate *abr)
+{
+	pthread_mutex_destroy(&abr->mutex);
+}
+
+static void reset_state(struct adaptive_bitrate *abr)
+{
+	abr->rate_ts          = 0;
+	abr->rate_bytes       = 0;
+	abr->rate_backlogged  = false;
+	abr->link_kbps        = 0;
+	abr->link_ts          = 0;
+	abr->loss_pct         = 0.0f;
+	abr->xmit_delay_ms    = 0;
+	abr->last_decrease_ts = 0;
+	abr->last_increase_ts = 0;
+	abr->clear_since_ts   = 0;
+
+	abr->cur_kbps         = abr->max_kbps;
+	abr->increase_hold_ns = ABR_INCREASE_HOLD_NS;
+}
+
+void abr_reset(struct adaptive_bitrate *abr, int max_kbps,
+		int64_t drop_threshold_usec)
+{
+	pthread_mutex_lock(&abr->mutex);
+
+	abr->max_kbps = max_kbps;
+	abr->shared   = false;
+	reset_state(abr);
+
+	abr->min_kbps = max_kbps / 4;
+	if (abr->min_kbps < ABR_MIN_KBPS)
+		abr->min_kbps = ABR_MIN_KBPS;
+	if (abr->min_kbps > max_kbps)
+		abr->min_kbps = max_kbps;
+
+	/* react well before frames start being dropped */
+	abr->queue_high_usec = drop_threshold_usec > 0 ?
+		drop_threshold_usec / 2 : ABR_DEFAULT_QUEUE_HIGH;
+	abr->queue_low_usec = abr->queue_high_usec / 5;
+
+	pthread_mutex_unlock(&abr->mutex);
+}
+
+bool abr_set_shared(struct adaptive_bitrate *abr, bool shared)
+{
+	bool changed;
+
+	pthread_mutex_lock(&abr->mutex);
+
+	changed = abr->shared != shared;
+	if (changed) {
+		abr->shared = shared;
+		reset_state(abr);
+	}
+
+	pthread_mutex_unlock(&abr->mutex);
+	return changed;
+}
+
+void abr_add_packet_stats(struct adaptive_bitrate *abr, int sent,
+		int nack_reqs, int avg_xmit_delay_ms)
+{
+	pthread_mutex_lock(&abr->mutex);
+	abr->loss_pct = sent > 0 ? (float)nack_reqs * 100.0f / (float)sent :
+		0.0f;
+	abr->xmit_delay_ms = avg_xmit_delay_ms;
+	pthread_mutex_unlock(&abr->mutex);
+}
+
+/* the rate at which bytes leave is only the link's capacity if there was
+ * something waiting to be sent for the whole interval */
+static void update_link_rate(struct adaptive_bitrate *abr, bool backlogged,
+		uint64_t total_bytes_sent, uint64_t ts)
+{
+	uint64_t elapsed;
+	int kbps;
+
+	if (!abr->rate_ts || total_bytes_sent < abr->rate_bytes) {
+		abr->rate_ts = ts;
+		abr->rate_bytes = total_bytes_sent;
+		abr->rate_backlogged = backlogged;
+		return;
+	}
+
+	abr->rate_backlogged &= backlogged;
+
+	elapsed = ts - abr->rate_ts;
+	if (elapsed < ABR_RATE_INTERVAL_NS)
+		return;
+
+	if (abr->rate_backlogged) {
+		kbps = (int)((total_bytes_sent - abr->rate_bytes) * 8000000ULL /
+				elapsed);
+		abr->link_kbps = abr->link_kbps ?
+			(abr->link_kbps + kbps) / 2 : kbps;
+		abr->link_ts = ts;
+
+	} else if (ts - abr->link_ts > ABR_LINK_VALID_NS) {
+		abr->link_kbps = 0;
+	}
+
+	abr->rate_ts = ts;
+	abr->rate_bytes = total_bytes_sent;
+	abr->rate_backlogged = backlogged;
+}
+
+static int decrease_bitrate(struct adaptive_bitrate *abr, uint64_t ts)
+{
+	int target = abr->cur_kbps * 3 / 4;
+
+	if (abr->last_decrease_ts &&
+	    ts - abr->last_decrease_ts < ABR_DECREASE_INTERVAL_NS)
+		return 0;
+
+	/* leave some room for audio and the queue to drain */
+	if (abr->link_kbps && abr->link_kbps * 85 / 100 < target)
+		target = abr->link_kbps * 85 / 100;
+	if (target < abr->min_kbps)
+		target = abr->min_kbps;
+	if (target >= abr->cur_kbps)
+		return 0;
+
+	/* the last increase did not hold, wait longer before the next one */
+	if (abr->last_increase_ts > abr->last_decrease_ts &&
+	    ts - abr->last_increase_ts < abr->increase_hold_ns * 2) {
+		abr->increase_hold_ns *= 2;
+		if (abr->increase_hold_ns > ABR_MAX_INCREASE_HOLD_NS)
+			abr->increase_hold_ns = ABR_MAX_INCREASE_HOLD_NS;
+	}
+
+	abr->last_decrease_ts = ts;
+	abr->cur_kbps = target;
+	return target;
+}
+
+static int increase_bitrate(struct adaptive_bitrate *abr, uint64_t ts)
+{
+	int step = abr->max_kbps / 10;
+	int target;
+
+	if (abr->cur_kbps >= abr->max_kbps)
+		return 0;
+	if (ts - abr->clear_since_ts < abr->increase_hold_ns)
+		return 0;
+
+	target = abr->cur_kbps + (step > 0 ? step : 1);
+	if (target > abr->max_kbps)
+		target = abr->max_kbps;
+
+	/* each step has to be earned with another quiet period */
+	abr->clear_since_ts = ts;
+	abr->last_increase_ts = ts;
+	abr->cur_kbps = target;
+	return target;
+}
+
+int abr_update(struct adaptive_bitrate *abr, int64_t queue_usec,
+		uint64_t total_bytes_sent, uint64_t ts)
+{
+	int64_t xmit_delay_usec;
+	bool congested, clear;
+	int kbps = 0;
+
+	pthread_mutex_lock(&abr->mutex);
+
+	update_link_rate(abr, queue_usec > abr->queue_low_usec,
+			total_bytes_sent, ts);
+
+	xmit_delay_usec = (int64_t)abr->xmit_delay_ms * 1000;
+
+	congested = queue_usec      > abr->queue_high_usec ||
+	            xmit_delay_usec > abr->queue_high_usec ||
+	            abr->loss_pct   > ABR_LOSS_HIGH_PCT;
+	clear     = queue_usec      < abr->queue_low_usec &&
+	            xmit_delay_usec < abr->queue_high_usec / 2 &&
+	            abr->loss_pct   < ABR_LOSS_LOW_PCT;
+
+	if (congested) {
+		abr->clear_since_ts = 0;
+		kbps = decrease_bitrate(abr, ts);
+
+	} else if (clear) {
+		if (!abr->clear_since_ts)
+			abr->clear_since_ts = ts;
+
+		kbps = increase_bitrate(abr, ts);
+
+		if (ts - abr->last_decrease_ts > ABR_HOLD_RESET_NS)
+			abr->increase_hold_ns = ABR_INCREASE_HOLD_NS;
+
+	} else {
+		/* in between the marks, hold the current bitrate */
+		abr->clear_since_ts = 0;
+	}
+
+	pthread_mutex_unlock(&abr->mutex);
+	return kbps;
+}
+
+int abr_get_bitrate(struct adaptive_bitrate *abr)
+{
+	int kbps;
+
+	pthread_mutex_lock(&abr->mutex);
+	kbps = abr->cur_kbps;
+	pthread_mutex_unlock(&abr->mutex);
+
+	return kbps;
+}
+
+int abr_get_encoder_bitrate(obs_encoder_t *encoder)
+{
+	obs_data_t *settings = obs_encoder_get_settings(encoder);
+	const char *rc = obs_data_get_string(settings, "rate_control");
+	int kbps = (int)obs_data_get_int(settings, "bitrate");
+
+	/* quality based rate control does not use the bitrate at all */
+	if (astrcmpi(rc, "CRF") == 0 || astrcmpi(rc, "CQP") == 0)
+		kbps = 0;
+
+	obs_data_release(settings);
+	return kbps;
+}
+
+void abr_apply_bitrate(obs_encoder_t *encoder, int kbps)
+{
+	obs_data_t *settings = obs_data_create();
+
+	obs_data_set_int(settings, "bitrate", kbps);
+	obs_encoder_queue_update(encoder, settings);
+	obs_data_release(settings);
+}
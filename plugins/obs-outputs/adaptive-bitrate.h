@@ -0,0 +1,90 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/threading.h>
+#include <obs.h>
+
+/*
+ * Adjusts the video encoder's bitrate to what the connection can currently
+ * carry.  The output reports how much media is waiting in its send queue
+ * along with the number of bytes it has sent, and FTL also reports NACK and
+ * transmit delay statistics.  When the queue (or loss) stays above the high
+ * mark the bitrate is cut, straight to just under the measured throughput
+ * if that is known.  It is only raised again in small steps after the queue
+ * has stayed below the low mark for a while, and that wait doubles every
+ * time an increase is quickly followed by another cut.
+ */
+
+struct adaptive_bitrate {
+	pthread_mutex_t mutex;
+
+	int             max_kbps;
+	int             min_kbps;
+	int             cur_kbps;
+
+	int64_t         queue_high_usec;
+	int64_t         queue_low_usec;
+
+	/* throughput measured while the send queue was backed up */
+	uint64_t        rate_ts;
+	uint64_t        rate_bytes;
+	bool            rate_backlogged;
+	int             link_kbps;
+	uint64_t        link_ts;
+
+	/* packet stats, FTL only */
+	float           loss_pct;
+	int             xmit_delay_ms;
+
+	uint64_t        last_decrease_ts;
+	uint64_t        last_increase_ts;
+	uint64_t        clear_since_ts;
+	uint64_t        increase_hold_ns;
+
+	/* the encoder also feeds other outputs, so its bitrate is left alone */
+	bool            shared;
+};
+
+extern bool abr_init(struct adaptive_bitrate *abr);
+extern void abr_free(struct adaptive_bitrate *abr);
+
+/* starts over from max_kbps, called when the output connects */
+extern void abr_reset(struct adaptive_bitrate *abr, int max_kbps,
+		int64_t drop_threshold_usec);
+
+/* pauses or resumes the controller when other outputs start or stop using
+ * the same encoder, starting over from max_kbps.  returns true if that
+ * changed anything */
+extern bool abr_set_shared(struct adaptive_bitrate *abr, bool shared);
+
+/* called from the status thread with each packet stats report */
+extern void abr_add_packet_stats(struct adaptive_bitrate *abr, int sent,
+		int nack_reqs, int avg_xmit_delay_ms);
+
+/* returns the new bitrate in kbps, or 0 if it should stay the same */
+extern int abr_update(struct adaptive_bitrate *abr, int64_t queue_usec,
+		uint64_t total_bytes_sent, uint64_t ts);
+
+extern int abr_get_bitrate(struct adaptive_bitrate *abr);
+
+/* returns 0 if the encoder is not using bitrate based rate control */
+extern int abr_get_encoder_bitrate(obs_encoder_t *encoder);
+
+/* queued, the encoder applies it on its own thread before the next frame */
+extern void abr_apply_bitrate(obs_encoder_t *encoder, int kbps);
@@ -100,7 +100,6 @@ static int write_packet(struct flv_output *stream,
 	flv_packet_mux(packet, &data, &size, is_header);
 	fwrite(data, 1, size, stream->file);
 	bfree(data);
-	obs_free_encoder_packet(packet);
 
 	return ret;
 }
@@ -129,6 +128,7 @@ static void write_audio_header(struct flv_output *stream)
 	obs_encoder_get_extra_data(aencoder, &header, &packet.size);
 	packet.data = bmemdup(header, packet.size);
 	write_packet(stream, &packet, true);
+	obs_free_encoder_packet(&packet);
 }
 
 static void write_video_header(struct flv_output *stream)
@@ -147,6 +147,7 @@ static void write_video_header(struct flv_output *stream)
 	obs_encoder_get_extra_data(vencoder, &header, &size);
 	packet.size = obs_parse_avc_header(&packet.data, header, size);
 	write_packet(stream, &packet, true);
+	obs_free_encoder_packet(&packet);
 }
 
 static void write_headers(struct flv_output *stream)
@@ -0,0 +1,123 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-avc.h>
+#include "ftl-nalu.h"
+
+/* filler data, SEI and access unit delimiters that nothing refers to are
+ * not worth sending */
+static inline bool skip_nalu(const uint8_t *data)
+{
+	int type = data[0] & 0x1F;
+	int nri  = (data[0] >> 5) & 0x3;
+
+	return !nri && (type == OBS_NAL_FILLER || type == OBS_NAL_SEI ||
+			type == OBS_NAL_AUD);
+}
+
+static inline void add_nalu(struct ftl_nalu_list *list, const uint8_t *data,
+		size_t size)
+{
+	struct ftl_nalu *nalu;
+
+	if (!size || skip_nalu(data))
+		return;
+
+	nalu = da_push_back_new(list->nalus);
+	nalu->data = data;
+	nalu->size = size;
+}
+
+static inline void set_marker(struct ftl_nalu_list *list, bool end_of_frame)
+{
+	if (end_of_frame && list->nalus.num)
+		list->nalus.array[list->nalus.num - 1].marker = true;
+}
+
+static inline size_t read_be(const uint8_t *data, size_t bytes)
+{
+	size_t val = 0;
+
+	for (size_t i = 0; i < bytes; i++)
+		val = (val << 8) | data[i];
+	return val;
+}
+
+bool ftl_nalu_parse_avcc(struct ftl_nalu_list *list,
+		const uint8_t *data, size_t size, bool end_of_frame)
+{
+	const uint8_t *end = data + size;
+	bool success = true;
+
+	da_resize(list->nalus, 0);
+
+	while (data < end) {
+		size_t len;
+
+		if (end - data < 4) {
+			success = false;
+			break;
+		}
+
+		len = read_be(data, 4);
+		data += 4;
+
+		if (len > (size_t)(end - data)) {
+			success = false;
+			break;
+		}
+
+		add_nalu(list, data, len);
+		data += len;
+	}
+
+	set_marker(list, end_of_frame);
+	return success;
+}
+
+/* avcC: six bytes of version, profile and lengths, the 16 bit length
+ * prefixed SPS, the number of PPS and the 16 bit length prefixed PPS */
+bool ftl_nalu_parse_header(struct ftl_nalu_list *list,
+		const uint8_t *data, size_t size)
+{
+	const uint8_t *end = data + size;
+	size_t len;
+
+	da_resize(list->nalus, 0);
+
+	if (size < 6)
+		return false;
+	data += 6;
+
+	for (int i = 0; i < 2; i++) {
+		if (i)
+			data++;
+		if (end - data < 2)
+			return false;
+
+		len = read_be(data, 2);
+		data += 2;
+
+		if (len > (size_t)(end - data))
+			return false;
+
+		add_nalu(list, data, len);
+		data += len;
+	}
+
+	return true;
+}
@@ -0,0 +1,52 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/darray.h>
+
+/*
+ * Splits encoded H.264 video into the NAL units FTL sends one at a time.
+ * Frames and slices come as 4 byte length prefixed NAL units (after
+ * obs_parse_avc_packet), the sequence header as an avcC record.  The NAL units
+ * point into the parsed data, so it has to stay valid until they have been
+ * sent.  There is no limit on the number of NAL
+ * units in a frame, the list grows to the largest frame seen and is reused.
+ */
+
+struct ftl_nalu {
+	const uint8_t *data;
+	size_t        size;
+	bool          marker;
+};
+
+struct ftl_nalu_list {
+	DARRAY(struct ftl_nalu) nalus;
+};
+
+/* each parse function replaces the contents of the list.  if end_of_frame is
+ * set, the last NAL unit gets the marker bit.  returns false if the data is
+ * malformed, in which case the NAL units before the error are kept */
+extern bool ftl_nalu_parse_avcc(struct ftl_nalu_list *list,
+		const uint8_t *data, size_t size, bool end_of_frame);
+extern bool ftl_nalu_parse_header(struct ftl_nalu_list *list,
+		const uint8_t *data, size_t size);
+
+static inline void ftl_nalu_list_free(struct ftl_nalu_list *list)
+{
+	da_free(list->nalus);
+}
@@ -27,6 +27,10 @@
 #include "ftl.h"
 #include "flv-mux.h"
 #include "net-if.h"
+#include "adaptive-bitrate.h"
+#include "transport-stats.h"
+#include "ingest-probe.h"
+#include "ftl-nalu.h"
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -46,21 +50,21 @@
 #define OPT_DROP_THRESHOLD "drop_threshold_ms"
 #define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
 #define OPT_BIND_IP "bind_ip"
+#define OPT_ADAPTIVE_BITRATE "adaptive_bitrate"
+#define OPT_PEAK_BITRATE "peak_bitrate_kbps"
 
-//#define TEST_FRAMEDROPS
+#define RESOLVE_TIMEOUT_MS 5000
+#define PROBE_TIMEOUT_MS   1000
 
-typedef struct _nalu_t {
-	int len;
-	int dts_usec;
-	int send_marker_bit;
-	uint8_t *data;
-}nalu_t;
+//#define TEST_FRAMEDROPS
 
-typedef struct _frame_of_nalus_t {
-	nalu_t nalus[100];
-	int total;
-	int complete_frame;
-}frame_of_nalus_t;
+/* video is queued either as whole frames or slice by slice as the encoder
+ * finishes each slice, a whole frame is both its first and last slice */
+struct ftl_packet {
+	struct encoder_packet packet;
+	bool                  first_slice;
+	bool                  last_slice;
+};
 
 struct ftl_stream {
 	obs_output_t     *output;
@@ -85,6 +89,7 @@ struct ftl_stream {
 	uint64_t         stop_ts;
 
 	struct dstr      path;
+	struct dstr      ingest_ip;
 	uint32_t         channel_id;
 	struct dstr      username, password;
 	struct dstr      encoder_name;
@@ -100,10 +105,30 @@ struct ftl_stream {
 	uint64_t         total_bytes_sent;
 	int              dropped_frames;
 
+	bool             adaptive_bitrate;
+	struct adaptive_bitrate abr;
+
+	struct transport_stats transport_stats;
+
 	ftl_handle_t	    ftl_handle;
 	ftl_ingest_params_t params;
 	uint32_t         scale_width, scale_height, width, height;
-	frame_of_nalus_t coded_pic_buffer;
+
+	/* once slices start arriving, video is queued from the encoder as
+	 * each slice is finished rather than when the frame is done.  the
+	 * send thread is the only one that sends */
+	pthread_mutex_t  send_mutex;
+	struct ftl_nalu_list nalus;
+	volatile bool    sending_slices;
+	int64_t          slices_start_dts_usec;
+
+	/* frames are only dropped as a whole: the rest of a frame whose
+	 * first slice went out is kept, and the rest of a dropped frame is
+	 * dropped as it arrives */
+	bool             partial_frame_sent;
+	int64_t          partial_frame_dts_usec;
+	bool             dropping_slices;
+	int64_t          dropping_slices_dts_usec;
 };
 
 void log_libftl_messages(ftl_log_severity_t log_level, const char * message);
@@ -138,10 +163,13 @@ static inline void free_packets(struct ftl_stream *stream)
 		info("Freeing %d remaining packets", (int)num_packets);
 
 	while (stream->packets.size) {
-		struct encoder_packet packet;
+		struct ftl_packet packet;
 		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-		obs_free_encoder_packet(&packet);
+		obs_free_encoder_packet(&packet.packet);
 	}
+
+	stream->partial_frame_sent = false;
+	stream->dropping_slices = false;
 	pthread_mutex_unlock(&stream->packets_mutex);
 }
 
@@ -201,6 +229,7 @@ static void ftl_stream_destroy(void *data)
 	if (stream) {
 		free_packets(stream);
 		dstr_free(&stream->path);
+		dstr_free(&stream->ingest_ip);
 		dstr_free(&stream->username);
 		dstr_free(&stream->password);
 		dstr_free(&stream->encoder_name);
@@ -208,29 +237,63 @@ static void ftl_stream_destroy(void *data)
 		os_event_destroy(stream->stop_event);
 		os_sem_destroy(stream->send_sem);
 		pthread_mutex_destroy(&stream->packets_mutex);
+		pthread_mutex_destroy(&stream->send_mutex);
 		circlebuf_free(&stream->packets);
+		ftl_nalu_list_free(&stream->nalus);
+		abr_free(&stream->abr);
 		bfree(stream);
 	}
 }
 
+static void ftl_stream_get_transport_stats_proc(void *data, calldata_t *cd)
+{
+	struct ftl_stream *stream = data;
+	struct obs_transport_stats stats;
+
+	transport_stats_get(&stream->transport_stats, &stats);
+
+	calldata_set_int(cd, "packets_sent", (long long)stats.packets_sent);
+	calldata_set_int(cd, "nack_requests", (long long)stats.nack_requests);
+	calldata_set_float(cd, "loss_pct", stats.window_loss_pct);
+	calldata_set_float(cd, "xmit_delay_ms", stats.window_xmit_delay_ms);
+	calldata_set_int(cd, "max_xmit_delay_ms",
+			stats.window_max_xmit_delay_ms);
+	calldata_set_float(cd, "sent_kbps", stats.window_sent_kbps);
+	calldata_set_int(cd, "queue_fullness", stats.queue_fullness);
+}
+
 static void *ftl_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	ftl_status_t status_code;	
 	struct ftl_stream *stream = bzalloc(sizeof(struct ftl_stream));
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	pthread_mutexattr_t attr;
 	info("ftl_stream_create\n");
 	
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+	pthread_mutex_init_value(&stream->send_mutex);
 	
 	ftl_init();
 
 	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutexattr_init(&attr) != 0)
+		goto fail;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		goto fail;
+	if (pthread_mutex_init(&stream->send_mutex, &attr) != 0)
+		goto fail;
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
+	if (!abr_init(&stream->abr))
+		goto fail;
 
-	stream->coded_pic_buffer.total = 0;
-	stream->coded_pic_buffer.complete_frame = 0;
+	proc_handler_add(ph, "void get_transport_stats(out int packets_sent, "
+			"out int nack_requests, out float loss_pct, "
+			"out float xmit_delay_ms, out int max_xmit_delay_ms, "
+			"out float sent_kbps, out int queue_fullness)",
+			ftl_stream_get_transport_stats_proc, stream);
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -262,108 +325,67 @@ static void ftl_stream_stop(void *data, uint64_t ts)
 }
 
 static inline bool get_next_packet(struct ftl_stream *stream,
-		struct encoder_packet *packet)
+		struct ftl_packet *packet)
 {
 	bool new_packet = false;
 
 	pthread_mutex_lock(&stream->packets_mutex);
 	if (stream->packets.size) {
 		circlebuf_pop_front(&stream->packets, packet,
-				sizeof(struct encoder_packet));
+				sizeof(struct ftl_packet));
 		new_packet = true;
+
+		if (packet->packet.type == OBS_ENCODER_VIDEO) {
+			stream->partial_frame_sent = !packet->last_slice;
+			stream->partial_frame_dts_usec =
+				packet->packet.dts_usec;
+		}
 	}
 	pthread_mutex_unlock(&stream->packets_mutex);
 
 	return new_packet;
 }
 
-static int avc_get_video_frame(struct ftl_stream *stream, struct encoder_packet *packet, bool is_header, size_t idx) {
-
-	int consumed = 0;
-	int len = packet->size;
-	nalu_t *nalu;
-
-	unsigned char *video_stream = packet->data;
-
-	while (consumed < packet->size) {
-
-		if (stream->coded_pic_buffer.total >= sizeof(stream->coded_pic_buffer.nalus) / sizeof(stream->coded_pic_buffer.nalus[0])) {
-			warn("ERROR: cannot continue, nalu buffers are full\n");
-			return -1;
-		}
-
-		nalu = &stream->coded_pic_buffer.nalus[stream->coded_pic_buffer.total];
-
-		if (is_header) {
-			if (consumed == 0) {
-				video_stream += 6; //first 6 bytes are some obs header with part of the sps
-				consumed += 6;
-			}
-			else {
-				video_stream += 1; //another spacer byte of 0x1
-				consumed += 1;
-			}
-
-			len = video_stream[0] << 8 | video_stream[1];
-			video_stream += 2;
-			consumed += 2;
-		}
-		else {
-			len = video_stream[0] << 24 | video_stream[1] << 16 | video_stream[2] << 8 | video_stream[3];
-
-			if (len > (packet->size - consumed)) {
-				warn("ERROR: got len of %d but packet only has %d left\n", len, (packet->size - consumed));
-			}
-
-			consumed += 4;
-			video_stream += 4;
-		}
-
-		consumed += len;
-
-		uint8_t nalu_type = video_stream[0] & 0x1F;
-		uint8_t nri = (video_stream[0] >> 5) & 0x3;
-
-		int send_marker_bit = (consumed >= packet->size) && !is_header;
+/* called with send_mutex held */
+static int send_nalus(struct ftl_stream *stream, int64_t dts_usec)
+{
+	int bytes_sent = 0;
 
-		if ((nalu_type != 12 && nalu_type != 6 && nalu_type != 9) || nri) {
-			nalu->data = video_stream;
-			nalu->len = len;
-			nalu->send_marker_bit = 0;
-			stream->coded_pic_buffer.total++;
-		}
+	for (size_t i = 0; i < stream->nalus.nalus.num; i++) {
+		struct ftl_nalu *nalu = stream->nalus.nalus.array + i;
 
-		video_stream += len;
-	}
+		bytes_sent += ftl_ingest_send_media_dts(&stream->ftl_handle,
+				FTL_VIDEO_DATA, dts_usec, (uint8_t*)nalu->data,
+				(int32_t)nalu->size, nalu->marker);
 
-	if (!is_header) {
-		stream->coded_pic_buffer.nalus[stream->coded_pic_buffer.total - 1].send_marker_bit = 1;
+		if (nalu->marker)
+			stream->frames_sent++;
 	}
 
-	return 0;
+	return bytes_sent;
 }
 
 static int send_packet(struct ftl_stream *stream,
-		struct encoder_packet *packet, bool is_header, size_t idx)
+		struct encoder_packet *packet, bool is_header,
+		bool end_of_frame)
 {
-	enum obs_encoder_type type;
-	int     recv_size = 0;
 	int     ret = 0;
 	int bytes_sent = 0;
 
-	if (packet->type == OBS_ENCODER_VIDEO) {
-
-		stream->coded_pic_buffer.total = 0;
-		avc_get_video_frame(stream, packet, is_header, idx);
+	pthread_mutex_lock(&stream->send_mutex);
 
-		int i;
-		for (i = 0; i < stream->coded_pic_buffer.total; i++) {
-			nalu_t *nalu = &stream->coded_pic_buffer.nalus[i];
-			bytes_sent += ftl_ingest_send_media_dts(&stream->ftl_handle, FTL_VIDEO_DATA, packet->dts_usec, nalu->data, nalu->len, nalu->send_marker_bit);
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (is_header) {
+			if (!ftl_nalu_parse_header(&stream->nalus,
+						packet->data, packet->size))
+				warn("Malformed video header");
+			bytes_sent += send_nalus(stream, packet->dts_usec);
 
-			if (nalu->send_marker_bit) {
-				stream->frames_sent++;
-			}
+		} else {
+			if (!ftl_nalu_parse_avcc(&stream->nalus, packet->data,
+						packet->size, end_of_frame))
+				warn("Malformed video packet");
+			bytes_sent += send_nalus(stream, packet->dts_usec);
 		}
 	}
 	else if (packet->type == OBS_ENCODER_AUDIO) {
@@ -375,32 +397,22 @@ static int send_packet(struct ftl_stream *stream,
 
 	stream->total_bytes_sent += bytes_sent;
 
+	pthread_mutex_unlock(&stream->send_mutex);
+
 	obs_free_encoder_packet(packet);
 	return ret;
 }
 
-static void set_peak_bitrate(struct ftl_stream *stream) {
-	int speedtest_kbps = 10000;
-	int speedtest_duration = 1000;
-
-	warn("Running speed test: sending %d kbps for %d ms", speedtest_kbps, speedtest_duration);
-	float packetloss_rate = 0;
-	packetloss_rate = ftl_ingest_speed_test(&stream->ftl_handle, speedtest_kbps, speedtest_duration);
-
-	if(packetloss_rate <= 1){
-		stream->params.peak_kbps = speedtest_kbps;
-	}
-	else{
-		stream->params.peak_kbps = (float)speedtest_kbps * (100.f - packetloss_rate) / 110;
-	}
+static inline bool send_headers(struct ftl_stream *stream, int64_t dts_usec);
 
-	warn("Running speed test complete: packet loss rate was %3.2f, setting peak bitrate to %d\n", packetloss_rate, stream->params.peak_kbps);
+static void restore_bitrate(struct ftl_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
 
-	ftl_ingest_update_params(&stream->ftl_handle, &stream->params);
+	if (abr_get_bitrate(&stream->abr) != stream->abr.max_kbps)
+		abr_apply_bitrate(vencoder, stream->abr.max_kbps);
 }
 
-static inline bool send_headers(struct ftl_stream *stream, int64_t dts_usec);
-
 static void *send_thread(void *data)
 {
 	struct ftl_stream *stream = data;
@@ -409,7 +421,7 @@ static void *send_thread(void *data)
 	os_set_thread_name("ftl-stream: send_thread");
 
 	while (os_sem_wait(stream->send_sem) == 0) {
-		struct encoder_packet packet;
+		struct ftl_packet packet;
 
 		if (stopping(stream) && stream->stop_ts == 0) {
 			break;
@@ -419,21 +431,24 @@ static void *send_thread(void *data)
 			continue;
 
 		if (stopping(stream)) {
-			if (packet.sys_dts_usec >= (int64_t)stream->stop_ts) {
-				obs_free_encoder_packet(&packet);
+			if (packet.packet.sys_dts_usec >=
+					(int64_t)stream->stop_ts) {
+				obs_free_encoder_packet(&packet.packet);
 				break;
 			}
 		}
 
 		/*sends sps/pps on every key frame as this is typically required for webrtc*/
-		if (packet.keyframe) {
-			if (!send_headers(stream, packet.dts_usec)) {
+		if (packet.packet.keyframe && packet.first_slice) {
+			if (!send_headers(stream, packet.packet.dts_usec)) {
+				obs_free_encoder_packet(&packet.packet);
 				os_atomic_set_bool(&stream->disconnected, true);
 				break;
 			}
 		}
 
-		if (send_packet(stream, &packet, false, packet.track_idx) < 0) {
+		if (send_packet(stream, &packet.packet, false,
+					packet.last_slice) < 0) {
 			os_atomic_set_bool(&stream->disconnected, true);
 			break;
 		}
@@ -445,6 +460,9 @@ static void *send_thread(void *data)
 		info("User stopped the stream");
 	}
 
+	if (stream->adaptive_bitrate)
+		restore_bitrate(stream);
+
 	if (!stopping(stream)) {
 		pthread_detach(stream->send_thread);
 		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
@@ -453,13 +471,18 @@ static void *send_thread(void *data)
 	}
 
 	info("ingest disconnect");
+	pthread_mutex_lock(&stream->send_mutex);
 	if ((status_code = ftl_ingest_disconnect(&stream->ftl_handle)) != FTL_SUCCESS) {
 		printf("Failed to disconnect from ingest %d\n", status_code);
 	}
+	pthread_mutex_unlock(&stream->send_mutex);
 	
 	free_packets(stream);
-	os_event_reset(stream->stop_event);
+
+	/* no longer active before no longer stopping, so that slices are
+	 * not sent in between */
 	os_atomic_set_bool(&stream->active, false);
+	os_event_reset(stream->stop_event);
 	stream->sent_headers = false;
 	return NULL;
 }
@@ -521,7 +544,7 @@ static bool send_video_header(struct ftl_stream *stream, int64_t dts_usec)
 
 	obs_encoder_get_extra_data(vencoder, &header, &size);
 	packet.size = obs_parse_avc_header(&packet.data, header, size);
-	return send_packet(stream, &packet, true, 0) >= 0;
+	return send_packet(stream, &packet, true, true) >= 0;
 }
 
 static inline bool send_headers(struct ftl_stream *stream, int64_t dts_usec)
@@ -622,34 +645,6 @@ static void win32_log_interface_type(struct ftl_stream *stream)
 */
 #endif
 
-static int lookup_ingest_ip(const char *ingest_location, char *ingest_ip) {
-	struct hostent *remoteHost;
-	struct in_addr addr;
-	int retval = -1;
-	ingest_ip[0] = '\0';
-
-	remoteHost = gethostbyname(ingest_location);
-
-	if (remoteHost) {
-		int i = 0;
-		if (remoteHost->h_addrtype == AF_INET)
-		{
-			while (remoteHost->h_addr_list[i] != 0) {
-				addr.s_addr = *(u_long *)remoteHost->h_addr_list[i++];
-				blog(LOG_INFO, "IP Address #%d of ingest is: %s\n", i, inet_ntoa(addr));
-
-				/*only use the first ip found*/
-				if (strlen(ingest_ip) == 0) {
-					strcpy(ingest_ip, inet_ntoa(addr));
-					retval = 0;
-				}
-			}
-		}
-	}
-
-	return retval;
-}
-
 static int try_connect(struct ftl_stream *stream)
 {
 	ftl_status_t status_code;
@@ -671,8 +666,6 @@ static int try_connect(struct ftl_stream *stream)
 
 	info("Connection to %s successful", stream->path.array);
 
-	set_peak_bitrate(stream);
-
 	pthread_create(&stream->status_thread, NULL, status_thread, stream);
 
 	return init_send(stream);
@@ -697,17 +690,75 @@ static bool ftl_stream_start(void *data)
 }
 
 static inline bool add_packet(struct ftl_stream *stream,
-		struct encoder_packet *packet)
+		struct ftl_packet *packet)
 {
 	circlebuf_push_back(&stream->packets, packet,
-			sizeof(struct encoder_packet));
-	stream->last_dts_usec = packet->dts_usec;
+			sizeof(struct ftl_packet));
+	stream->last_dts_usec = packet->packet.dts_usec;
 	return true;
 }
 
 static inline size_t num_buffered_packets(struct ftl_stream *stream)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	return stream->packets.size / sizeof(struct ftl_packet);
+}
+
+static int64_t get_buffer_duration_usec(struct ftl_stream *stream)
+{
+	struct ftl_packet first;
+
+	if (!stream->packets.size)
+		return 0;
+
+	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+	return stream->last_dts_usec - first.packet.dts_usec;
+}
+
+/* changing the bitrate of an encoder that other outputs also use (such as a
+ * recording using the stream encoder) would change it for them as well */
+static bool check_shared_encoder(struct ftl_stream *stream,
+		obs_encoder_t *vencoder)
+{
+	bool shared = obs_encoder_get_active_output_count(vencoder) > 1;
+
+	if (abr_set_shared(&stream->abr, shared)) {
+		if (shared) {
+			warn("Video encoder is used by another output, "
+			     "pausing adaptive bitrate");
+			abr_apply_bitrate(vencoder, stream->abr.max_kbps);
+		} else {
+			info("Video encoder no longer used by another output, "
+			     "resuming adaptive bitrate");
+		}
+	}
+
+	return shared;
+}
+
+static void update_bitrate(struct ftl_stream *stream, int64_t buffer_usec)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	int kbps;
+
+	if (check_shared_encoder(stream, vencoder))
+		return;
+
+	kbps = abr_update(&stream->abr, buffer_usec, stream->total_bytes_sent,
+			os_gettime_ns());
+	if (!kbps)
+		return;
+
+	info("Send buffer at %d ms, changing video bitrate to %d kbps",
+			(int)(buffer_usec / 1000), kbps);
+	abr_apply_bitrate(vencoder, kbps);
+}
+
+/* the remaining slices of the frame the send thread is partway through */
+static inline bool is_partial_frame(struct ftl_stream *stream,
+		struct ftl_packet *packet)
+{
+	return stream->partial_frame_sent && !packet->first_slice &&
+		packet->packet.dts_usec == stream->partial_frame_dts_usec;
 }
 
 static void drop_frames(struct ftl_stream *stream)
@@ -722,22 +773,32 @@ static void drop_frames(struct ftl_stream *stream)
 	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
 
 	while (stream->packets.size) {
-		struct encoder_packet packet;
+		struct ftl_packet packet;
 		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
 
-		last_drop_dts_usec = packet.dts_usec;
+		last_drop_dts_usec = packet.packet.dts_usec;
 
 		// do not drop audio data or video keyframes 
-		if (packet.type          == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority == OBS_NAL_PRIORITY_HIGHEST) {
+		if (packet.packet.type          == OBS_ENCODER_AUDIO ||
+		    packet.packet.drop_priority == OBS_NAL_PRIORITY_HIGHEST ||
+		    is_partial_frame(stream, &packet)) {
 			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
 
 		} else {
-			if (drop_priority < packet.drop_priority)
-				drop_priority = packet.drop_priority;
+			if (drop_priority < packet.packet.drop_priority)
+				drop_priority = packet.packet.drop_priority;
+
+			if (packet.first_slice)
+				num_frames_dropped++;
 
-			num_frames_dropped++;
-			obs_free_encoder_packet(&packet);
+			/* the rest of this frame has yet to arrive */
+			if (!packet.last_slice) {
+				stream->dropping_slices = true;
+				stream->dropping_slices_dts_usec =
+					packet.packet.dts_usec;
+			}
+
+			obs_free_encoder_packet(&packet.packet);
 		}
 	}
 
@@ -752,7 +813,7 @@ static void drop_frames(struct ftl_stream *stream)
 
 static void check_to_drop_frames(struct ftl_stream *stream)
 {
-	struct encoder_packet first;
+	struct ftl_packet first;
 	int64_t buffer_duration_usec;
 
 	if (num_buffered_packets(stream) < 5)
@@ -761,12 +822,12 @@ static void check_to_drop_frames(struct ftl_stream *stream)
 	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
 
 	//do not drop frames if frames were just dropped within this time
-	if (first.dts_usec < stream->min_drop_dts_usec)
+	if (first.packet.dts_usec < stream->min_drop_dts_usec)
 		return;
 
 	// if the amount of time stored in the buffered packets waiting to be
 	// sent is higher than threshold, drop frames 
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
+	buffer_duration_usec = stream->last_dts_usec - first.packet.dts_usec;
 
 	if (buffer_duration_usec > stream->drop_threshold_usec) {
 		drop_frames(stream);
@@ -776,14 +837,31 @@ static void check_to_drop_frames(struct ftl_stream *stream)
 }
 
 static bool add_video_packet(struct ftl_stream *stream,
-		struct encoder_packet *packet)
+		struct ftl_packet *packet)
 {
+	/* the rest of a frame follows its first slice */
+	if (!packet->first_slice) {
+		if (stream->dropping_slices &&
+		    stream->dropping_slices_dts_usec == packet->packet.dts_usec)
+			return false;
+
+		return add_packet(stream, packet);
+	}
+
+	stream->dropping_slices = false;
+
 	check_to_drop_frames(stream);
 
 	// if currently dropping frames, drop packets until it reaches the
 	// desired priority 
-	if (packet->priority < stream->min_priority) {
+	if (packet->packet.priority < stream->min_priority) {
 		stream->dropped_frames++;
+
+		if (!packet->last_slice) {
+			stream->dropping_slices = true;
+			stream->dropping_slices_dts_usec =
+				packet->packet.dts_usec;
+		}
 		return false;
 	} else {
 		stream->min_priority = 0;
@@ -792,6 +870,32 @@ static bool add_video_packet(struct ftl_stream *stream,
 	return add_packet(stream, packet);
 }
 
+/* returns the duration of the buffered data */
+static int64_t queue_packet(struct ftl_stream *stream,
+		struct ftl_packet *packet)
+{
+	bool    added_packet = false;
+	int64_t buffer_usec  = 0;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	if (!disconnected(stream)) {
+		added_packet = (packet->packet.type == OBS_ENCODER_VIDEO) ?
+			add_video_packet(stream, packet) :
+			add_packet(stream, packet);
+		buffer_usec = get_buffer_duration_usec(stream);
+	}
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	if (added_packet)
+		os_sem_post(stream->send_sem);
+	else
+		obs_free_encoder_packet(&packet->packet);
+
+	return buffer_usec;
+}
+
 
 static void ftl_stream_data(void *data, struct encoder_packet *packet)
 {
@@ -799,36 +903,86 @@ static void ftl_stream_data(void *data, struct encoder_packet *packet)
 
 //	info("ftl_stream_data\n");
 
-	struct encoder_packet new_packet;
-	bool                  added_packet = false;
+	struct ftl_packet     new_packet   = {.first_slice = true,
+	                                      .last_slice  = true};
+	int64_t               buffer_usec  = 0;
 
 	if (disconnected(stream) || !active(stream))
 		return;
 
+	/* the frame has already been queued slice by slice.  frames from
+	 * before the switch would now go out after newer ones */
+	if (packet->type == OBS_ENCODER_VIDEO &&
+	    os_atomic_load_bool(&stream->sending_slices)) {
+		pthread_mutex_lock(&stream->packets_mutex);
+		if (packet->dts_usec < stream->slices_start_dts_usec)
+			stream->dropped_frames++;
+		buffer_usec = get_buffer_duration_usec(stream);
+		pthread_mutex_unlock(&stream->packets_mutex);
+
+		if (stream->adaptive_bitrate)
+			update_bitrate(stream, buffer_usec);
+		return;
+	}
+
 	if (packet->type == OBS_ENCODER_VIDEO)
-		obs_parse_avc_packet(&new_packet, packet);
+		obs_parse_avc_packet(&new_packet.packet, packet);
 	else
-		obs_duplicate_encoder_packet(&new_packet, packet);
+		obs_duplicate_encoder_packet(&new_packet.packet, packet);
 
-	pthread_mutex_lock(&stream->packets_mutex);
+	buffer_usec = queue_packet(stream, &new_packet);
 
-	if (!disconnected(stream)) {
-		added_packet = (packet->type == OBS_ENCODER_VIDEO) ?
-			add_video_packet(stream, &new_packet) :
-			add_packet(stream, &new_packet);
-	}
+	if (stream->adaptive_bitrate && packet->type == OBS_ENCODER_VIDEO)
+		update_bitrate(stream, buffer_usec);
+}
 
-	pthread_mutex_unlock(&stream->packets_mutex);
+/* called from the encoder threads, possibly while the encoder holds locks
+ * of its own, so the slice is only queued for the send thread here */
+static void ftl_stream_slice(void *data, struct encoder_slice *slice)
+{
+	struct ftl_stream     *stream = data;
+	struct encoder_packet src     = {0};
+	struct ftl_packet     new_packet;
 
-	if (added_packet)
-		os_sem_post(stream->send_sem);
-	else
-		obs_free_encoder_packet(&new_packet);
+	if (disconnected(stream) || !active(stream) || stopping(stream))
+		return;
+
+	/* switch over at a keyframe so the receiver never misses a frame */
+	if (!os_atomic_load_bool(&stream->sending_slices)) {
+		if (!slice->keyframe || !slice->first_slice)
+			return;
+
+		info("Sending video slices as they are encoded");
+
+		pthread_mutex_lock(&stream->packets_mutex);
+		stream->slices_start_dts_usec = slice->dts_usec;
+		pthread_mutex_unlock(&stream->packets_mutex);
+
+		os_atomic_set_bool(&stream->sending_slices, true);
+	}
+
+	src.data         = slice->data;
+	src.size         = slice->size;
+	src.pts          = slice->pts;
+	src.dts          = slice->dts;
+	src.timebase_num = slice->timebase_num;
+	src.timebase_den = slice->timebase_den;
+	src.type         = OBS_ENCODER_VIDEO;
+	src.keyframe     = slice->keyframe;
+	src.dts_usec     = slice->dts_usec;
+	src.sys_dts_usec = slice->sys_dts_usec;
+	src.encoder      = slice->encoder;
+
+	obs_parse_avc_packet(&new_packet.packet, &src);
+	new_packet.first_slice = slice->first_slice;
+	new_packet.last_slice  = slice->last_slice;
+
+	queue_packet(stream, &new_packet);
 }
 
 static void ftl_stream_defaults(obs_data_t *defaults)
 {
-	UNUSED_PARAMETER(defaults);
+	obs_data_set_default_bool(defaults, OPT_ADAPTIVE_BITRATE, false);
 	/*
 	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 600);
 	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 5);
@@ -849,10 +1003,13 @@ static obs_properties_t *ftl_stream_properties(void *unused)
 	struct netif_saddr_data addrs = {0};
 	obs_property_t *p;
 */
-	obs_properties_add_int(props, "peak_bitrate_kbps",
+	obs_properties_add_int(props, OPT_PEAK_BITRATE,
 			obs_module_text("FTLStream.PeakBitrate"),
 			1000, 10000, 500);
 
+	obs_properties_add_bool(props, OPT_ADAPTIVE_BITRATE,
+			obs_module_text("AdaptiveBitrate"));
+
 /*
 	p = obs_properties_add_list(props, OPT_BIND_IP,
 			obs_module_text("RTMPStream.BindIP"),
@@ -885,6 +1042,15 @@ static int ftl_stream_dropped_frames(void *data)
 	return stream->dropped_frames;
 }
 
+static bool ftl_stream_get_transport_stats(void *data,
+		struct obs_transport_stats *stats)
+{
+	struct ftl_stream *stream = data;
+
+	transport_stats_get(&stream->transport_stats, stats);
+	return true;
+}
+
 
 
 /*********************************************************************/
@@ -932,6 +1098,15 @@ static void *status_thread(void *data)
 			blog(LOG_INFO, "Avg packet send per second %3.1f, nack requests %d, avg transmit delay %d (min: %d, max: %d)\n",
 				(float)p->sent * 1000.f / p->period,
 				p->nack_reqs, p->avg_xmit_delay, p->min_xmit_delay, p->max_xmit_delay);
+
+			transport_stats_add_packets(&stream->transport_stats,
+					(uint32_t)p->period, p->sent,
+					p->nack_reqs, p->avg_xmit_delay,
+					p->min_xmit_delay, p->max_xmit_delay);
+
+			if (stream->adaptive_bitrate)
+				abr_add_packet_stats(&stream->abr, p->sent,
+						p->nack_reqs, p->avg_xmit_delay);
 		}
 		else if (status.type == FTL_STATUS_VIDEO) {
 			ftl_video_frame_stats_msg_t *v = &status.msg.video_stats;
@@ -942,6 +1117,12 @@ static void *status_thread(void *data)
 				(float)v->frames_sent * 1000.f / v->period,
 				(float)v->bytes_sent / v->period * 8,
 				v->queue_fullness, v->max_frame_size);
+
+			transport_stats_add_video(&stream->transport_stats,
+					(uint32_t)v->period, v->frames_queued,
+					(uint64_t)v->bytes_queued,
+					v->frames_sent, (uint64_t)v->bytes_sent,
+					v->queue_fullness, v->max_frame_size);
 		}
 		else {
 			blog(LOG_INFO, "Status:  Got Status message of type %d\n", status.type);
@@ -987,12 +1168,58 @@ void log_libftl_messages(ftl_log_severity_t log_level, const char * message)
   blog(LOG_WARNING, "[libftl] %s", message);
 }
 
+static void init_adaptive_bitrate(struct ftl_stream *stream,
+		obs_encoder_t *vencoder)
+{
+	int kbps = abr_get_encoder_bitrate(vencoder);
+
+	if (kbps <= 0) {
+		info("Adaptive bitrate disabled, the video encoder is not "
+		     "using bitrate based rate control");
+		stream->adaptive_bitrate = false;
+		return;
+	}
+
+	abr_reset(&stream->abr, kbps, stream->drop_threshold_usec);
+}
+
+/* picks the ingest address that answers pings the fastest, if none does
+ * the host name is passed on to libftl as it is */
+static void select_ingest(struct ftl_stream *stream)
+{
+	struct ingest_addrs addrs = {0};
+	uint64_t start = os_gettime_ns();
+	int best;
+
+	dstr_free(&stream->ingest_ip);
+
+	if (!ingest_resolve(stream->path.array, &addrs, RESOLVE_TIMEOUT_MS))
+		return;
+
+	for (size_t i = 0; i < addrs.addrs.num; i++)
+		info("IP Address #%d of ingest is: %s", (int)i + 1,
+				addrs.addrs.array[i].ip);
+
+	best = ingest_probe(&addrs, INGEST_PING_PORT, PROBE_TIMEOUT_MS);
+	if (best >= 0) {
+		dstr_copy(&stream->ingest_ip, addrs.addrs.array[best].ip);
+		info("Selected ingest %s (%d ms round trip) in %d ms",
+				stream->ingest_ip.array,
+				addrs.addrs.array[best].rtt_ms,
+				(int)((os_gettime_ns() - start) / 1000000));
+	} else {
+		info("No ingest address answered pings, connecting to %s",
+				stream->path.array);
+	}
+
+	ingest_addrs_free(&addrs);
+}
+
 static bool init_connect(struct ftl_stream *stream)
 {
 	obs_service_t *service;
 	obs_data_t *settings;
 	const char *bind_ip, *key;
-	char tmp_ip[20];
 	ftl_status_t status_code;
 
 
@@ -1012,11 +1239,14 @@ static bool init_connect(struct ftl_stream *stream)
 	stream->dropped_frames   = 0;
 	stream->min_drop_dts_usec= 0;
 	stream->min_priority     = 0;
+	os_atomic_set_bool(&stream->sending_slices, false);
+	transport_stats_reset(&stream->transport_stats);
 
 	settings = obs_output_get_settings(stream->output);
 	obs_encoder_t *video_encoder = obs_output_get_video_encoder(stream->output);
 	obs_data_t *video_settings = obs_encoder_get_settings(video_encoder);
 	dstr_copy(&stream->path,     obs_service_get_url(service));
+	dstr_depad(&stream->path);
 	key = obs_service_get_key(service);
 
 	struct obs_video_info ovi;
@@ -1039,6 +1269,12 @@ static bool init_connect(struct ftl_stream *stream)
 		peak_bitrate = target_bitrate;
 	}
 
+	if (obs_data_get_int(settings, OPT_PEAK_BITRATE) > 0)
+		peak_bitrate = (int)obs_data_get_int(settings,
+				OPT_PEAK_BITRATE);
+
+	select_ingest(stream);
+
 	struct dstr version;
 	dstr_init(&version);
 	dstr_printf(&version, "%d.%d.%d", LIBOBS_API_MAJOR_VER, LIBOBS_API_MINOR_VER, LIBOBS_API_PATCH_VER);
@@ -1046,12 +1282,13 @@ static bool init_connect(struct ftl_stream *stream)
 	stream->params.stream_key = (char*)key;
 	stream->params.video_codec = FTL_VIDEO_H264;
 	stream->params.audio_codec = FTL_AUDIO_OPUS;
-	stream->params.ingest_hostname = stream->path.array;
+	stream->params.ingest_hostname = dstr_is_empty(&stream->ingest_ip) ?
+		stream->path.array : stream->ingest_ip.array;
 	stream->params.vendor_name = "OBS Studio";
 	stream->params.vendor_version = version.array;
 	stream->params.fps_num = 0; //not required when using ftl_ingest_send_media_dts
 	stream->params.fps_den = 0; // not required when using ftl_ingest_send_media_dts
-	stream->params.peak_kbps = 0;
+	stream->params.peak_kbps = peak_bitrate;
 
 	blog(LOG_ERROR, "H.264 opts %s\n", obs_data_get_string(video_settings, "x264opts")); 
 
@@ -1062,7 +1299,6 @@ static bool init_connect(struct ftl_stream *stream)
 
 	dstr_copy(&stream->username, obs_service_get_username(service));
 	dstr_copy(&stream->password, obs_service_get_password(service));
-	dstr_depad(&stream->path);
 	dstr_free(&version);
 	
 	stream->drop_threshold_usec =
@@ -1073,6 +1309,12 @@ static bool init_connect(struct ftl_stream *stream)
 	bind_ip = obs_data_get_string(settings, OPT_BIND_IP);
 	dstr_copy(&stream->bind_ip, bind_ip);
 
+	stream->adaptive_bitrate =
+		obs_data_get_bool(settings, OPT_ADAPTIVE_BITRATE);
+	if (stream->adaptive_bitrate)
+		init_adaptive_bitrate(stream, video_encoder);
+
+	obs_data_release(video_settings);
 	obs_data_release(settings);
 	return true;
 }
@@ -1131,8 +1373,10 @@ struct obs_output_info ftl_output_info = {
 	.start              = ftl_stream_start,
 	.stop               = ftl_stream_stop,
 	.encoded_packet     = ftl_stream_data,
+	.encoded_slice      = ftl_stream_slice,
 	.get_defaults       = ftl_stream_defaults,
 	.get_properties     = ftl_stream_properties,
 	.get_total_bytes    = ftl_stream_total_bytes_sent,
-	.get_dropped_frames = ftl_stream_dropped_frames
+	.get_dropped_frames = ftl_stream_dropped_frames,
+	.get_transport_stats = ftl_stream_get_transport_stats
 };
@@ -0,0 +1,333 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "ingest-probe.h"
+
+#ifdef _WIN32
+typedef SOCKET probe_socket_t;
+#define INVALID_PROBE_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#else
+#include <fcntl.h>
+#include <sys/select.h>
+typedef int probe_socket_t;
+#define INVALID_PROBE_SOCKET -1
+#define close_socket close
+#endif
+
+/* ---------------------------------------------------------------------- */
+/* resolving */
+
+struct resolve_request {
+	volatile long   refs;
+	char            *host;
+	os_event_t      *done;
+	struct addrinfo *result;
+	int             error;
+};
+
+/* the request is shared with the resolver thread, which keeps running on
+ * its own if the caller gives up waiting */
+static void resolve_request_release(struct resolve_request *req)
+{
+	if (os_atomic_dec_long(&req->refs) != 0)
+		return;
+
+	if (req->result)
+		freeaddrinfo(req->result);
+	os_event_destroy(req->done);
+	bfree(req->host);
+	bfree(req);
+}
+
+static void *resolve_thread(void *data)
+{
+	struct resolve_request *req = data;
+	struct addrinfo hints = {0};
+
+	os_set_thread_name("ingest-probe: resolve_thread");
+
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	req->error = getaddrinfo(req->host, NULL, &hints, &req->result);
+	os_event_signal(req->done);
+	resolve_request_release(req);
+	return NULL;
+}
+
+static void add_addr(struct ingest_addrs *addrs, const struct addrinfo *ai)
+{
+	struct ingest_addr *addr;
+	const void *src;
+
+	if (ai->ai_family == AF_INET)
+		src = &((struct sockaddr_in*)ai->ai_addr)->sin_addr;
+	else if (ai->ai_family == AF_INET6)
+		src = &((struct sockaddr_in6*)ai->ai_addr)->sin6_addr;
+	else
+		return;
+
+	for (size_t i = 0; i < addrs->addrs.num; i++) {
+		addr = addrs->addrs.array + i;
+		if (addr->addr_len == (int)ai->ai_addrlen &&
+		    memcmp(&addr->addr, ai->ai_addr, ai->ai_addrlen) == 0)
+			return;
+	}
+
+	addr = da_push_back_new(addrs->addrs);
+	memcpy(&addr->addr, ai->ai_addr, ai->ai_addrlen);
+	addr->addr_len = (int)ai->ai_addrlen;
+	addr->rtt_ms   = -1;
+	inet_ntop(ai->ai_family, (void*)src, addr->ip, sizeof(addr->ip));
+}
+
+bool ingest_resolve(const char *host, struct ingest_addrs *addrs,
+		uint32_t timeout_ms)
+{
+	struct resolve_request *req;
+	pthread_t thread;
+	bool success = false;
+	int ret;
+
+	if (!host || !*host)
+		return false;
+
+	req = bzalloc(sizeof(*req));
+	req->refs = 2;
+	req->host = bstrdup(host);
+
+	if (os_event_init(&req->done, OS_EVENT_TYPE_MANUAL) != 0) {
+		bfree(req->host);
+		bfree(req);
+		return false;
+	}
+
+	if (pthread_create(&thread, NULL, resolve_thread, req) != 0) {
+		req->refs = 1;
+		resolve_request_release(req);
+		return false;
+	}
+
+	pthread_detach(thread);
+
+	ret = os_event_timedwait(req->done, (unsigned long)timeout_ms);
+	if (ret == ETIMEDOUT) {
+		blog(LOG_WARNING, "Resolving '%s' timed out after %u ms",
+				host, timeout_ms);
+
+	} else if (ret == 0 && req->error == 0) {
+		for (struct addrinfo *ai = req->result; ai; ai = ai->ai_next)
+			add_addr(addrs, ai);
+		success = addrs->addrs.num > 0;
+
+	} else if (ret == 0) {
+		blog(LOG_WARNING, "Failed to resolve '%s': %s", host,
+				gai_strerror(req->error));
+	}
+
+	resolve_request_release(req);
+	return success;
+}
+
+void ingest_addrs_free(struct ingest_addrs *addrs)
+{
+	da_free(addrs->addrs);
+}
+
+/* ---------------------------------------------------------------------- */
+/* probing */
+
+/* RTP version 2 header, the ingest echoes the whole packet back */
+#define PING_HEADER        0x80FA0000U
+#define PING_SLICE_USEC    10000
+
+struct ingest_ping {
+	uint32_t header;
+	uint32_t index;
+	uint64_t send_ts;
+};
+
+static void set_port(struct ingest_addr *addr, uint16_t port)
+{
+	if (addr->addr.ss_family == AF_INET)
+		((struct sockaddr_in*)&addr->addr)->sin_port = htons(port);
+	else
+		((struct sockaddr_in6*)&addr->addr)->sin6_port = htons(port);
+}
+
+static bool set_nonblocking(probe_socket_t sock)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+	int flags = fcntl(sock, F_GETFL, 0);
+	return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+static probe_socket_t open_socket(struct ingest_addr *addr)
+{
+	probe_socket_t sock;
+
+	sock = socket(addr->addr.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == INVALID_PROBE_SOCKET)
+		return INVALID_PROBE_SOCKET;
+
+	/* connecting the socket filters out packets from anywhere else */
+	if (!set_nonblocking(sock) ||
+	    connect(sock, (struct sockaddr*)&addr->addr, addr->addr_len) != 0) {
+		close_socket(sock);
+		return INVALID_PROBE_SOCKET;
+	}
+
+	return sock;
+}
+
+static bool send_ping(probe_socket_t sock, size_t index)
+{
+	struct ingest_ping ping;
+
+	ping.header  = htonl(PING_HEADER);
+	ping.index   = htonl((uint32_t)index);
+	ping.send_ts = os_gettime_ns();
+
+	return send(sock, (const char*)&ping, sizeof(ping), 0) ==
+		(int)sizeof(ping);
+}
+
+/* returns false once no reply can come from this socket anymore */
+static bool receive_ping(probe_socket_t sock, struct ingest_addr *addr,
+		size_t index)
+{
+	struct ingest_ping ping;
+	int ret = (int)recv(sock, (char*)&ping, sizeof(ping), 0);
+
+	if (ret < 0) {
+#ifdef _WIN32
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+	}
+
+	if (ret != (int)sizeof(ping) ||
+	    ntohl(ping.header) != PING_HEADER ||
+	    ntohl(ping.index) != (uint32_t)index)
+		return true;
+
+	addr->rtt_ms = (int)((os_gettime_ns() - ping.send_ts) / 1000000ULL);
+	return false;
+}
+
+int ingest_probe(struct ingest_addrs *addrs, uint16_t port,
+		uint32_t timeout_ms)
+{
+	size_t num = addrs->addrs.num;
+	probe_socket_t *socks;
+	uint64_t start = os_gettime_ns();
+	uint64_t end = start + (uint64_t)timeout_ms * 1000000ULL;
+	bool resent = false;
+	size_t pending = 0;
+	int best = -1;
+
+	if (!num)
+		return -1;
+
+	socks = bmalloc(num * sizeof(*socks));
+
+	for (size_t i = 0; i < num; i++) {
+		struct ingest_addr *addr = addrs->addrs.array + i;
+
+		addr->rtt_ms = -1;
+		set_port(addr, port);
+
+		socks[i] = open_socket(addr);
+		if (socks[i] == INVALID_PROBE_SOCKET)
+			continue;
+
+		if (send_ping(socks[i], i)) {
+			pending++;
+		} else {
+			close_socket(socks[i]);
+			socks[i] = INVALID_PROBE_SOCKET;
+		}
+	}
+
+	/* every address was pinged at the same time, so the first answer is
+	 * also the fastest one */
+	while (pending && best == -1) {
+		uint64_t now = os_gettime_ns();
+		struct timeval tv = {0, PING_SLICE_USEC};
+		probe_socket_t max_sock = 0;
+		fd_set set;
+		int ret;
+
+		if (now >= end)
+			break;
+
+		/* ping again halfway through in case a packet got lost */
+		if (!resent && now >= start + (end - start) / 2) {
+			for (size_t i = 0; i < num; i++) {
+				if (socks[i] != INVALID_PROBE_SOCKET)
+					send_ping(socks[i], i);
+			}
+			resent = true;
+		}
+
+		FD_ZERO(&set);
+		for (size_t i = 0; i < num; i++) {
+			if (socks[i] == INVALID_PROBE_SOCKET)
+				continue;
+			FD_SET(socks[i], &set);
+			if (socks[i] > max_sock)
+				max_sock = socks[i];
+		}
+
+		ret = select((int)max_sock + 1, &set, NULL, NULL, &tv);
+		if (ret <= 0)
+			continue;
+
+		for (size_t i = 0; i < num; i++) {
+			if (socks[i] == INVALID_PROBE_SOCKET ||
+			    !FD_ISSET(socks[i], &set))
+				continue;
+
+			if (receive_ping(socks[i], addrs->addrs.array + i, i))
+				continue;
+
+			close_socket(socks[i]);
+			socks[i] = INVALID_PROBE_SOCKET;
+			pending--;
+
+			if (addrs->addrs.array[i].rtt_ms >= 0 && best == -1)
+				best = (int)i;
+		}
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		if (socks[i] != INVALID_PROBE_SOCKET)
+			close_socket(socks[i]);
+	}
+
+	bfree(socks);
+	return best;
+}
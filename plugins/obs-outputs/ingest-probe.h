@@ -0,0 +1,52 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/darray.h>
+#include "net-if.h"
+
+/*
+ * Picks the ingest server to stream to.  The ingest host name is resolved
+ * on a worker thread so a hung resolver only costs the timeout, and every
+ * A and AAAA record is kept.  All addresses are then pinged at once on the
+ * ingest's UDP ping port, which echoes the packet back, and the one that
+ * answers first wins.
+ */
+
+#define INGEST_PING_PORT 8079
+
+struct ingest_addr {
+	struct sockaddr_storage addr;
+	int                     addr_len;
+	char                    ip[INET6_ADDRSTRLEN];
+	int                     rtt_ms;
+};
+
+struct ingest_addrs {
+	DARRAY(struct ingest_addr) addrs;
+};
+
+extern bool ingest_resolve(const char *host, struct ingest_addrs *addrs,
+		uint32_t timeout_ms);
+
+/* returns the index of the first address to answer, or -1 if none did
+ * within the timeout, and sets its rtt_ms */
+extern int ingest_probe(struct ingest_addrs *addrs, uint16_t port,
+		uint32_t timeout_ms);
+
+extern void ingest_addrs_free(struct ingest_addrs *addrs);
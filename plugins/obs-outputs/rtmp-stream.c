@@ -26,6 +26,7 @@
 #include "librtmp/log.h"
 #include "flv-mux.h"
 #include "net-if.h"
+#include "adaptive-bitrate.h"
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -45,6 +46,7 @@
 #define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
 #define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
 #define OPT_BIND_IP "bind_ip"
+#define OPT_ADAPTIVE_BITRATE "adaptive_bitrate"
 
 //#define TEST_FRAMEDROPS
 
@@ -97,6 +99,9 @@ struct rtmp_stream {
 	uint64_t         total_bytes_sent;
 	int              dropped_frames;
 
+	bool             adaptive_bitrate;
+	struct adaptive_bitrate abr;
+
 #ifdef TEST_FRAMEDROPS
 	struct circlebuf droptest_info;
 	size_t           droptest_size;
@@ -192,6 +197,7 @@ static void rtmp_stream_destroy(void *data)
 		os_sem_destroy(stream->send_sem);
 		pthread_mutex_destroy(&stream->packets_mutex);
 		circlebuf_free(&stream->packets);
+		abr_free(&stream->abr);
 #ifdef TEST_FRAMEDROPS
 		circlebuf_free(&stream->droptest_info);
 #endif
@@ -204,6 +210,7 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+	pthread_mutex_init_value(&stream->abr.mutex);
 
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetCallback(log_rtmp);
@@ -213,6 +220,8 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 		goto fail;
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
+	if (!abr_init(&stream->abr))
+		goto fail;
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -396,6 +405,14 @@ static inline bool can_shutdown_stream(struct rtmp_stream *stream,
 	return timeout || packet->sys_dts_usec >= (int64_t)stream->stop_ts;
 }
 
+static void restore_bitrate(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+
+	if (abr_get_bitrate(&stream->abr) != stream->abr.max_kbps)
+		abr_apply_bitrate(vencoder, stream->abr.max_kbps);
+}
+
 static void *send_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -440,6 +457,9 @@ static void *send_thread(void *data)
 
 	RTMP_Close(&stream->rtmp);
 
+	if (stream->adaptive_bitrate)
+		restore_bitrate(stream);
+
 	if (!stopping(stream)) {
 		pthread_detach(stream->send_thread);
 		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
@@ -712,6 +732,21 @@ static int try_connect(struct rtmp_stream *stream)
 	return init_send(stream);
 }
 
+static void init_adaptive_bitrate(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	int kbps = abr_get_encoder_bitrate(vencoder);
+
+	if (kbps <= 0) {
+		info("Adaptive bitrate disabled, the video encoder is not "
+		     "using bitrate based rate control");
+		stream->adaptive_bitrate = false;
+		return;
+	}
+
+	abr_reset(&stream->abr, kbps, stream->drop_threshold_usec);
+}
+
 static bool init_connect(struct rtmp_stream *stream)
 {
 	obs_service_t *service;
@@ -756,6 +791,11 @@ static bool init_connect(struct rtmp_stream *stream)
 	bind_ip = obs_data_get_string(settings, OPT_BIND_IP);
 	dstr_copy(&stream->bind_ip, bind_ip);
 
+	stream->adaptive_bitrate =
+		obs_data_get_bool(settings, OPT_ADAPTIVE_BITRATE);
+	if (stream->adaptive_bitrate)
+		init_adaptive_bitrate(stream);
+
 	obs_data_release(settings);
 	return true;
 }
@@ -814,6 +854,56 @@ static inline size_t num_buffered_packets(struct rtmp_stream *stream)
 	return stream->packets.size / sizeof(struct encoder_packet);
 }
 
+static int64_t get_buffer_duration_usec(struct rtmp_stream *stream)
+{
+	struct encoder_packet first;
+
+	if (!stream->packets.size)
+		return 0;
+
+	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+	return stream->last_dts_usec - first.dts_usec;
+}
+
+/* changing the bitrate of an encoder that other outputs also use (such as a
+ * recording using the stream encoder) would change it for them as well */
+static bool check_shared_encoder(struct rtmp_stream *stream,
+		obs_encoder_t *vencoder)
+{
+	bool shared = obs_encoder_get_active_output_count(vencoder) > 1;
+
+	if (abr_set_shared(&stream->abr, shared)) {
+		if (shared) {
+			warn("Video encoder is used by another output, "
+			     "pausing adaptive bitrate");
+			abr_apply_bitrate(vencoder, stream->abr.max_kbps);
+		} else {
+			info("Video encoder no longer used by another output, "
+			     "resuming adaptive bitrate");
+		}
+	}
+
+	return shared;
+}
+
+static void update_bitrate(struct rtmp_stream *stream, int64_t buffer_usec)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	int kbps;
+
+	if (check_shared_encoder(stream, vencoder))
+		return;
+
+	kbps = abr_update(&stream->abr, buffer_usec, stream->total_bytes_sent,
+			os_gettime_ns());
+	if (!kbps)
+		return;
+
+	info("Send buffer at %d ms, changing video bitrate to %d kbps",
+			(int)(buffer_usec / 1000), kbps);
+	abr_apply_bitrate(vencoder, kbps);
+}
+
 static void drop_frames(struct rtmp_stream *stream, const char *name,
 		int highest_priority, int64_t *p_min_dts_usec)
 {
@@ -920,6 +1010,7 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 	struct rtmp_stream    *stream = data;
 	struct encoder_packet new_packet;
 	bool                  added_packet = false;
+	int64_t               buffer_usec  = 0;
 
 	if (disconnected(stream) || !active(stream))
 		return;
@@ -935,6 +1026,7 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 		added_packet = (packet->type == OBS_ENCODER_VIDEO) ?
 			add_video_packet(stream, &new_packet) :
 			add_packet(stream, &new_packet);
+		buffer_usec = get_buffer_duration_usec(stream);
 	}
 
 	pthread_mutex_unlock(&stream->packets_mutex);
@@ -943,6 +1035,9 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 		os_sem_post(stream->send_sem);
 	else
 		obs_free_encoder_packet(&new_packet);
+
+	if (stream->adaptive_bitrate && packet->type == OBS_ENCODER_VIDEO)
+		update_bitrate(stream, buffer_usec);
 }
 
 static void rtmp_stream_defaults(obs_data_t *defaults)
@@ -951,6 +1046,7 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 800);
 	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 30);
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
+	obs_data_set_default_bool(defaults, OPT_ADAPTIVE_BITRATE, false);
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -965,6 +1061,9 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 			obs_module_text("RTMPStream.DropThreshold"),
 			200, 10000, 100);
 
+	obs_properties_add_bool(props, OPT_ADAPTIVE_BITRATE,
+			obs_module_text("AdaptiveBitrate"));
+
 	p = obs_properties_add_list(props, OPT_BIND_IP,
 			obs_module_text("RTMPStream.BindIP"),
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
@@ -0,0 +1,153 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/platform.h>
+#include "transport-stats.h"
+
+/* readers see an odd sequence number while the snapshot is being written */
+static void publish(struct transport_stats *ts)
+{
+	os_atomic_inc_long(&ts->seq);
+	ts->snapshot = ts->cur;
+	os_atomic_inc_long(&ts->seq);
+}
+
+void transport_stats_reset(struct transport_stats *ts)
+{
+	memset(&ts->cur, 0, sizeof(ts->cur));
+	ts->num_packets = 0;
+	ts->num_video   = 0;
+	publish(ts);
+}
+
+static inline void push_report(void *window, size_t *num, size_t size,
+		const void *report)
+{
+	uint8_t *data = window;
+
+	if (*num == TRANSPORT_STATS_WINDOW) {
+		memmove(data, data + size, size * (TRANSPORT_STATS_WINDOW - 1));
+		(*num)--;
+	}
+
+	memcpy(data + size * (*num)++, report, size);
+}
+
+static void update_packet_window(struct transport_stats *ts)
+{
+	struct obs_transport_stats *cur = &ts->cur;
+	uint32_t period_ms = 0;
+	int64_t sent = 0;
+	int64_t nacks = 0;
+	int64_t weighted_delay = 0;
+	int max_delay = 0;
+
+	for (size_t i = 0; i < ts->num_packets; i++) {
+		struct transport_packet_report *r = &ts->packets[i];
+
+		period_ms      += r->period_ms;
+		sent           += r->sent;
+		nacks          += r->nack_reqs;
+		weighted_delay += (int64_t)r->avg_xmit_delay_ms * r->sent;
+		if (r->max_xmit_delay_ms > max_delay)
+			max_delay = r->max_xmit_delay_ms;
+	}
+
+	cur->window_ms = period_ms;
+	cur->window_loss_pct = sent ?
+		(float)((double)nacks * 100.0 / (double)sent) : 0.0f;
+	cur->window_xmit_delay_ms = sent ?
+		(float)((double)weighted_delay / (double)sent) : 0.0f;
+	cur->window_max_xmit_delay_ms = max_delay;
+}
+
+void transport_stats_add_packets(struct transport_stats *ts,
+		uint32_t period_ms, int sent, int nack_reqs,
+		int avg_xmit_delay_ms, int min_xmit_delay_ms,
+		int max_xmit_delay_ms)
+{
+	struct obs_transport_stats *cur = &ts->cur;
+	struct transport_packet_report report = {
+		.period_ms         = period_ms,
+		.sent              = sent,
+		.nack_reqs         = nack_reqs,
+		.avg_xmit_delay_ms = avg_xmit_delay_ms,
+		.max_xmit_delay_ms = max_xmit_delay_ms
+	};
+
+	push_report(ts->packets, &ts->num_packets, sizeof(report), &report);
+
+	cur->timestamp         = os_gettime_ns();
+	cur->packets_sent     += (uint64_t)sent;
+	cur->nack_requests    += (uint64_t)nack_reqs;
+	cur->avg_xmit_delay_ms = avg_xmit_delay_ms;
+	cur->min_xmit_delay_ms = min_xmit_delay_ms;
+	cur->max_xmit_delay_ms = max_xmit_delay_ms;
+	update_packet_window(ts);
+
+	publish(ts);
+}
+
+void transport_stats_add_video(struct transport_stats *ts,
+		uint32_t period_ms, int frames_queued, uint64_t bytes_queued,
+		int frames_sent, uint64_t bytes_sent, int queue_fullness,
+		int max_frame_size)
+{
+	struct obs_transport_stats *cur = &ts->cur;
+	struct transport_video_report report = {period_ms, bytes_sent};
+	uint64_t window_bytes = 0;
+	uint32_t window_ms = 0;
+
+	if (!period_ms)
+		return;
+
+	push_report(ts->video, &ts->num_video, sizeof(report), &report);
+
+	for (size_t i = 0; i < ts->num_video; i++) {
+		window_bytes += ts->video[i].bytes_sent;
+		window_ms    += ts->video[i].period_ms;
+	}
+
+	cur->timestamp      = os_gettime_ns();
+	cur->queued_fps     = (float)frames_queued * 1000.0f / period_ms;
+	cur->queued_kbps    = (float)bytes_queued * 8.0f / period_ms;
+	cur->sent_fps       = (float)frames_sent * 1000.0f / period_ms;
+	cur->sent_kbps      = (float)bytes_sent * 8.0f / period_ms;
+	cur->queue_fullness = queue_fullness;
+	cur->max_frame_size = max_frame_size;
+	cur->window_sent_kbps = (float)window_bytes * 8.0f / window_ms;
+
+	publish(ts);
+}
+
+void transport_stats_get(struct transport_stats *ts,
+		struct obs_transport_stats *stats)
+{
+	for (;;) {
+		long seq = os_atomic_load_long(&ts->seq);
+
+		if (seq & 1)
+			continue;
+
+		*stats = ts->snapshot;
+
+		/* compare and swap with the same value is a full barrier that
+		 * fails if a report was published during the copy */
+		if (os_atomic_compare_swap_long(&ts->seq, seq, seq))
+			break;
+	}
+}
@@ -0,0 +1,70 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/threading.h>
+#include <obs.h>
+
+/*
+ * Collects the statistics reports of a network transport into an
+ * obs_transport_stats snapshot.  There is a single writer (the thread that
+ * receives the reports) and any number of readers; readers never block the
+ * writer, they retry if a report was published while they were copying.
+ */
+
+#define TRANSPORT_STATS_WINDOW 6
+
+struct transport_packet_report {
+	uint32_t period_ms;
+	int      sent;
+	int      nack_reqs;
+	int      avg_xmit_delay_ms;
+	int      max_xmit_delay_ms;
+};
+
+struct transport_video_report {
+	uint32_t period_ms;
+	uint64_t bytes_sent;
+};
+
+struct transport_stats {
+	volatile long                  seq;
+	struct obs_transport_stats     snapshot;
+
+	/* only touched by the writer */
+	struct obs_transport_stats     cur;
+	struct transport_packet_report packets[TRANSPORT_STATS_WINDOW];
+	struct transport_video_report  video[TRANSPORT_STATS_WINDOW];
+	size_t                         num_packets;
+	size_t                         num_video;
+};
+
+extern void transport_stats_reset(struct transport_stats *ts);
+
+extern void transport_stats_add_packets(struct transport_stats *ts,
+		uint32_t period_ms, int sent, int nack_reqs,
+		int avg_xmit_delay_ms, int min_xmit_delay_ms,
+		int max_xmit_delay_ms);
+
+extern void transport_stats_add_video(struct transport_stats *ts,
+		uint32_t period_ms, int frames_queued, uint64_t bytes_queued,
+		int frames_sent, uint64_t bytes_sent, int queue_fullness,
+		int max_frame_size);
+
+extern void transport_stats_get(struct transport_stats *ts,
+		struct obs_transport_stats *stats);
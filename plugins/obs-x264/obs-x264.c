@@ -19,6 +19,7 @@
 #include <util/dstr.h>
 #include <util/darray.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <obs-module.h>
 
 #ifndef _STDINT_H_INCLUDED
@@ -37,6 +38,25 @@
 
 /* ------------------------------------------------------------------------- */
 
+struct slice_nal {
+	uint8_t                *data;
+	int                    size;
+	int                    type;
+	int                    first_mb;
+	int                    last_mb;
+	int                    order;
+	bool                   sent;
+};
+
+/* a frame on its way through x264 when sending slices */
+struct slice_frame {
+	struct obs_x264        *obsx264;
+	int64_t                pts;
+	DARRAY(struct slice_nal) nals;
+	bool                   have_slices;
+	int                    next_mb;
+};
+
 struct obs_x264 {
 	obs_encoder_t          *encoder;
 
@@ -52,6 +72,11 @@ struct obs_x264 {
 	size_t                 sei_size;
 
 	os_performance_token_t *performance_token;
+
+	bool                   send_slices;
+	int                    total_mbs;
+	pthread_mutex_t        slice_mutex;
+	DARRAY(struct slice_frame*) slice_frames;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -63,6 +88,15 @@ static const char *obs_x264_getname(void *unused)
 }
 
 static void obs_x264_stop(void *data);
+static void nalu_process(x264_t *h, x264_nal_t *nal, void *opaque);
+
+static void free_slice_frame(struct slice_frame *frame)
+{
+	for (size_t i = 0; i < frame->nals.num; i++)
+		bfree(frame->nals.array[i].data);
+	da_free(frame->nals);
+	bfree(frame);
+}
 
 static void clear_data(struct obs_x264 *obsx264)
 {
@@ -75,6 +109,10 @@ static void clear_data(struct obs_x264 *obsx264)
 		obsx264->sei        = NULL;
 		obsx264->extra_data = NULL;
 	}
+
+	for (size_t i = 0; i < obsx264->slice_frames.num; i++)
+		free_slice_frame(obsx264->slice_frames.array[i]);
+	da_free(obsx264->slice_frames);
 }
 
 static void obs_x264_destroy(void *data)
@@ -85,6 +123,7 @@ static void obs_x264_destroy(void *data)
 		os_end_high_performance(obsx264->performance_token);
 		clear_data(obsx264);
 		da_free(obsx264->packet_data);
+		pthread_mutex_destroy(&obsx264->slice_mutex);
 		bfree(obsx264);
 	}
 }
@@ -103,6 +142,7 @@ static void obs_x264_defaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, "profile",     "");
 	obs_data_set_default_string(settings, "tune",        "");
 	obs_data_set_default_string(settings, "x264opts",    "");
+	obs_data_set_default_bool  (settings, "send_slices", false);
 }
 
 static inline void add_strings(obs_property_t *list, const char *const *strings)
@@ -125,6 +165,7 @@ static inline void add_strings(obs_property_t *list, const char *const *strings)
 #define TEXT_TUNE       obs_module_text("Tune")
 #define TEXT_NONE       obs_module_text("None")
 #define TEXT_X264_OPTS  obs_module_text("EncoderOptions")
+#define TEXT_SEND_SLICES obs_module_text("SendSlices")
 
 static bool use_bufsize_modified(obs_properties_t *ppts, obs_property_t *p,
 		obs_data_t *settings)
@@ -204,6 +245,8 @@ static obs_properties_t *obs_x264_props(void *unused)
 
 	obs_properties_add_bool(props, "vfr", TEXT_VFR);
 
+	obs_properties_add_bool(props, "send_slices", TEXT_SEND_SLICES);
+
 	obs_properties_add_text(props, "x264opts", TEXT_X264_OPTS,
 			OBS_TEXT_DEFAULT);
 
@@ -513,6 +556,27 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	     vfr ? "on" : "off");
 }
 
+/* x264 hands each NAL unit to nalu_process as soon as it is written, and
+ * with sliced threads the slices of a frame are encoded in parallel.  frames
+ * must not be reordered, and the HRD SEI cannot go through the callback.
+ * HRD is also turned off on builds that use filler for CBR, as it can still
+ * be turned on with the custom x264 options */
+static void enable_slices(struct obs_x264 *obsx264)
+{
+	int mb_width  = (obsx264->params.i_width  + 15) / 16;
+	int mb_height = (obsx264->params.i_height + 15) / 16;
+
+	obsx264->params.b_sliced_threads = true;
+	obsx264->params.i_bframe         = 0;
+	obsx264->params.nalu_process     = nalu_process;
+	obsx264->params.i_nal_hrd        = X264_NAL_HRD_NONE;
+
+	obsx264->total_mbs   = mb_width * mb_height;
+	obsx264->send_slices = true;
+
+	info("sending slices as they are encoded");
+}
+
 static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
 {
 	char *preset     = bstrdup(obs_data_get_string(settings, "preset"));
@@ -545,6 +609,10 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
 
 		if (!obsx264->context)
 			apply_x264_profile(obsx264, profile);
+
+		if (!obsx264->context &&
+		    obs_data_get_bool(settings, "send_slices"))
+			enable_slices(obsx264);
 	}
 
 	obsx264->params.b_repeat_headers = false;
@@ -575,6 +643,7 @@ static bool obs_x264_update(void *data, obs_data_t *settings)
 
 static void load_headers(struct obs_x264 *obsx264)
 {
+	x264_t          *context = obsx264->context;
 	x264_nal_t      *nals;
 	int             nal_count;
 	DARRAY(uint8_t) header;
@@ -583,7 +652,20 @@ static void load_headers(struct obs_x264 *obsx264)
 	da_init(header);
 	da_init(sei);
 
-	x264_encoder_headers(obsx264->context, &nals, &nal_count);
+	/* the headers are not tied to a frame, so they cannot go through
+	 * nalu_process.  an encoder without it writes the same ones */
+	if (obsx264->send_slices) {
+		x264_param_t params = obsx264->params;
+		params.nalu_process = NULL;
+
+		context = x264_encoder_open(&params);
+		if (!context) {
+			warn("failed to open encoder for the headers");
+			return;
+		}
+	}
+
+	x264_encoder_headers(context, &nals, &nal_count);
 
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals+i;
@@ -599,6 +681,9 @@ static void load_headers(struct obs_x264 *obsx264)
 	obsx264->extra_data_size = header.num;
 	obsx264->sei             = sei.array;
 	obsx264->sei_size        = sei.num;
+
+	if (context != obsx264->context)
+		x264_encoder_close(context);
 }
 
 static void *obs_x264_create(obs_data_t *settings, obs_encoder_t *encoder)
@@ -606,6 +691,11 @@ static void *obs_x264_create(obs_data_t *settings, obs_encoder_t *encoder)
 	struct obs_x264 *obsx264 = bzalloc(sizeof(struct obs_x264));
 	obsx264->encoder = encoder;
 
+	if (pthread_mutex_init(&obsx264->slice_mutex, NULL) != 0) {
+		bfree(obsx264);
+		return NULL;
+	}
+
 	if (update_settings(obsx264, settings)) {
 		obsx264->context = x264_encoder_open(&obsx264->params);
 
@@ -618,6 +708,7 @@ static void *obs_x264_create(obs_data_t *settings, obs_encoder_t *encoder)
 	}
 
 	if (!obsx264->context) {
+		pthread_mutex_destroy(&obsx264->slice_mutex);
 		bfree(obsx264);
 		return NULL;
 	}
@@ -650,6 +741,121 @@ static void parse_packet(struct obs_x264 *obsx264,
 	packet->keyframe      = pic_out->b_keyframe != 0;
 }
 
+static inline bool is_slice_nal(int type)
+{
+	return type == NAL_SLICE || type == NAL_SLICE_IDR;
+}
+
+/* sends the slices that continue the frame from where the last one ended,
+ * slices finished out of order wait for the ones before them */
+static void send_ready_slices(struct obs_x264 *obsx264,
+		struct slice_frame *frame)
+{
+	for (size_t i = 0; i < frame->nals.num; i++) {
+		struct slice_nal *nal = frame->nals.array + i;
+		struct encoder_slice slice = {0};
+
+		if (!is_slice_nal(nal->type) || nal->sent)
+			continue;
+		if (nal->first_mb != frame->next_mb)
+			break;
+
+		slice.data        = nal->data;
+		slice.size        = nal->size;
+		slice.pts         = frame->pts;
+		slice.dts         = frame->pts;
+		slice.keyframe    = nal->type == NAL_SLICE_IDR;
+		slice.first_slice = nal->first_mb == 0;
+		slice.last_slice  = nal->last_mb >= obsx264->total_mbs - 1;
+
+		obs_encoder_send_slice(obsx264->encoder, &slice);
+
+		nal->sent = true;
+		frame->next_mb = nal->last_mb + 1;
+	}
+}
+
+/* called from x264's slice threads, possibly several at once */
+static void nalu_process(x264_t *h, x264_nal_t *nal, void *opaque)
+{
+	struct slice_frame *frame = opaque;
+	struct obs_x264    *obsx264;
+	struct slice_nal   new_nal = {0};
+	size_t             idx;
+
+	if (!frame)
+		return;
+
+	obsx264 = frame->obsx264;
+
+	new_nal.data = bmalloc(nal->i_payload * 3 / 2 + 5 + 64);
+	x264_nal_encode(h, new_nal.data, nal);
+
+	new_nal.size     = nal->i_payload;
+	new_nal.type     = nal->i_type;
+	new_nal.first_mb = nal->i_first_mb;
+	new_nal.last_mb  = nal->i_last_mb;
+
+	pthread_mutex_lock(&obsx264->slice_mutex);
+
+	/* slices in macroblock order, anything else where x264 wrote it
+	 * relative to them: SEI before, filler after */
+	if (is_slice_nal(new_nal.type)) {
+		new_nal.order = new_nal.first_mb;
+		frame->have_slices = true;
+	} else {
+		new_nal.order = frame->have_slices ? obsx264->total_mbs : -1;
+	}
+
+	idx = frame->nals.num;
+	while (idx > 0 && frame->nals.array[idx - 1].order > new_nal.order)
+		idx--;
+	da_insert(frame->nals, idx, &new_nal);
+
+	send_ready_slices(obsx264, frame);
+
+	pthread_mutex_unlock(&obsx264->slice_mutex);
+}
+
+static struct slice_frame *new_slice_frame(struct obs_x264 *obsx264,
+		int64_t pts)
+{
+	struct slice_frame *frame = bzalloc(sizeof(struct slice_frame));
+	frame->obsx264 = obsx264;
+	frame->pts     = pts;
+
+	da_push_back(obsx264->slice_frames, &frame);
+	return frame;
+}
+
+/* with nalu_process set, x264_encoder_encode does not return the NAL units,
+ * the frame is put together from what went through the callback */
+static void parse_slice_packet(struct obs_x264 *obsx264,
+		struct encoder_packet *packet, x264_picture_t *pic_out)
+{
+	struct slice_frame *frame = pic_out->opaque;
+
+	if (!frame)
+		return;
+
+	da_resize(obsx264->packet_data, 0);
+
+	for (size_t i = 0; i < frame->nals.num; i++) {
+		struct slice_nal *nal = frame->nals.array + i;
+		da_push_back_array(obsx264->packet_data, nal->data, nal->size);
+	}
+
+	packet->data          = obsx264->packet_data.array;
+	packet->size          = obsx264->packet_data.num;
+	packet->type          = OBS_ENCODER_VIDEO;
+	packet->pts           = pic_out->i_pts;
+	packet->dts           = pic_out->i_dts;
+	packet->keyframe      = pic_out->b_keyframe != 0;
+
+	da_erase_item(obsx264->slice_frames, &frame);
+	free_slice_frame(frame);
+}
+
 static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
 		struct encoder_frame *frame)
 {
@@ -683,9 +889,13 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	if (!frame || !packet || !received_packet)
 		return false;
 
-	if (frame)
+	if (frame) {
 		init_pic_data(obsx264, &pic, frame);
 
+		if (obsx264->send_slices)
+			pic.opaque = new_slice_frame(obsx264, frame->pts);
+	}
+
 	ret = x264_encoder_encode(obsx264->context, &nals, &nal_count,
 			(frame ? &pic : NULL), &pic_out);
 	if (ret < 0) {
@@ -693,6 +903,13 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 		return false;
 	}
 
+	if (obsx264->send_slices) {
+		*received_packet = (ret > 0);
+		if (ret > 0)
+			parse_slice_packet(obsx264, packet, &pic_out);
+		return true;
+	}
+
 	*received_packet = (nal_count != 0);
 	parse_packet(obsx264, packet, nals, nal_count, &pic_out);
 
@@ -0,0 +1,382 @@
+/*
+ * Adaptive bitrate simulation.
+ *
+ *   Streams synthetic 30 fps video over a local TCP connection to a stand-in
+ * receiver that only reads as fast as a bandwidth schedule allows: plenty of
+ * bandwidth, then a drop to half the configured bitrate, a partial recovery
+ * to 80% and finally plenty again.  The send side buffers packets and drops
+ * frames past the drop threshold like rtmp-stream does.  It runs once with
+ * the bitrate fixed and once with the adaptive bitrate controller used by
+ * the streaming outputs, printing the link rate, the encoder bitrate and the
+ * send buffer once a second and a summary of both runs at the end.
+ *
+ * usage: abr-sim [seconds] [bitrate kbps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include "adaptive-bitrate.h"
+
+#define FPS                30
+#define FRAME_USEC         (1000000LL / FPS)
+#define KEYFRAME_INTERVAL  (FPS * 2)
+#define DROP_THRESHOLD     500000LL
+#define SOCKET_BUFFER_SIZE 16384
+#define RECV_INTERVAL_NS   5000000ULL
+
+struct sim_frame {
+	int64_t dts_usec;
+	size_t  size;
+	bool    keyframe;
+};
+
+struct sim {
+	int              seconds;
+	int              max_kbps;
+	bool             adaptive;
+
+	pthread_mutex_t  mutex;
+	struct circlebuf frames;
+	int64_t          last_dts_usec;
+	bool             dropping;
+	os_sem_t         *send_sem;
+	volatile bool    stop;
+
+	uint64_t         start_ts;
+	uint64_t         total_bytes_sent;
+	int              dropped_frames;
+	int64_t          max_buffer_usec;
+
+	int              listen_fd;
+	int              send_fd;
+	volatile long    link_kbps;
+};
+
+static inline double seconds_since(uint64_t start)
+{
+	return (double)(os_gettime_ns() - start) / 1000000000.0;
+}
+
+/* the bandwidth the receiver accepts at the given point of the run */
+static int link_kbps_at(struct sim *sim, double t)
+{
+	double pos = t / (double)sim->seconds;
+
+	if (pos < 0.25)
+		return sim->max_kbps * 3 / 2;
+	if (pos < 0.55)
+		return sim->max_kbps / 2;
+	if (pos < 0.75)
+		return sim->max_kbps * 4 / 5;
+	return sim->max_kbps * 3 / 2;
+}
+
+static void *receive_thread(void *data)
+{
+	struct sim *sim = data;
+	static uint8_t buf[65536];
+	uint64_t last_ts;
+	double allowed = 0.0;
+	int fd;
+
+	fd = accept(sim->listen_fd, NULL, NULL);
+	if (fd < 0)
+		return NULL;
+
+	last_ts = os_gettime_ns();
+
+	for (;;) {
+		uint64_t ts = os_gettime_ns();
+		int kbps = link_kbps_at(sim, seconds_since(sim->start_ts));
+		double max_burst = (double)kbps * 1000.0 / 8.0 * 0.02;
+		size_t size;
+		ssize_t ret;
+
+		os_atomic_set_long(&sim->link_kbps, kbps);
+
+		allowed += (double)kbps * 1000.0 / 8.0 *
+			(double)(ts - last_ts) / 1000000000.0;
+		if (allowed > max_burst)
+			allowed = max_burst;
+		last_ts = ts;
+
+		size = allowed < sizeof(buf) ? (size_t)allowed : sizeof(buf);
+		if (size) {
+			ret = recv(fd, buf, size, 0);
+			if (ret <= 0)
+				break;
+			allowed -= (double)ret;
+		}
+
+		os_sleepto_ns(ts + RECV_INTERVAL_NS);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static bool send_all(int fd, size_t size)
+{
+	static uint8_t buf[65536];
+
+	while (size) {
+		size_t bytes = size < sizeof(buf) ? size : sizeof(buf);
+		ssize_t ret = send(fd, buf, bytes, 0);
+		if (ret <= 0)
+			return false;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static void *send_thread(void *data)
+{
+	struct sim *sim = data;
+
+	while (os_sem_wait(sim->send_sem) == 0) {
+		struct sim_frame frame;
+		bool have_frame = false;
+
+		pthread_mutex_lock(&sim->mutex);
+		if (sim->frames.size) {
+			circlebuf_pop_front(&sim->frames, &frame,
+					sizeof(frame));
+			have_frame = true;
+		}
+		pthread_mutex_unlock(&sim->mutex);
+
+		if (!have_frame) {
+			if (os_atomic_load_bool(&sim->stop))
+				break;
+			continue;
+		}
+
+		if (!send_all(sim->send_fd, frame.size))
+			break;
+
+		pthread_mutex_lock(&sim->mutex);
+		sim->total_bytes_sent += frame.size;
+		pthread_mutex_unlock(&sim->mutex);
+	}
+
+	return NULL;
+}
+
+static int64_t buffer_duration_usec(struct sim *sim)
+{
+	struct sim_frame first;
+
+	if (!sim->frames.size)
+		return 0;
+
+	circlebuf_peek_front(&sim->frames, &first, sizeof(first));
+	return sim->last_dts_usec - first.dts_usec;
+}
+
+/* same as rtmp-stream: past the threshold every buffered non-keyframe is
+ * dropped, and new frames are dropped until the next keyframe */
+static void drop_frames(struct sim *sim)
+{
+	struct circlebuf new_buf = {0};
+
+	while (sim->frames.size) {
+		struct sim_frame frame;
+		circlebuf_pop_front(&sim->frames, &frame, sizeof(frame));
+
+		if (frame.keyframe)
+			circlebuf_push_back(&new_buf, &frame, sizeof(frame));
+		else
+			sim->dropped_frames++;
+	}
+
+	circlebuf_free(&sim->frames);
+	sim->frames = new_buf;
+	sim->dropping = true;
+}
+
+static bool add_frame(struct sim *sim, struct sim_frame *frame)
+{
+	if (buffer_duration_usec(sim) > DROP_THRESHOLD)
+		drop_frames(sim);
+
+	if (sim->dropping && !frame->keyframe) {
+		sim->dropped_frames++;
+		return false;
+	}
+
+	sim->dropping = false;
+	circlebuf_push_back(&sim->frames, frame, sizeof(*frame));
+	sim->last_dts_usec = frame->dts_usec;
+	return true;
+}
+
+/* keyframes are three times the size of the average frame */
+static size_t frame_size(int kbps, bool keyframe)
+{
+	size_t avg = (size_t)kbps * 1000 / 8 / FPS;
+
+	if (keyframe)
+		return avg * 3;
+	return (avg * KEYFRAME_INTERVAL - avg * 3) / (KEYFRAME_INTERVAL - 1);
+}
+
+static bool connect_sockets(struct sim *sim)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+	int size = SOCKET_BUFFER_SIZE;
+
+	sim->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	sim->send_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sim->listen_fd < 0 || sim->send_fd < 0)
+		return false;
+
+	/* keep the kernel buffers small so congestion shows up in the send
+	 * buffer rather than in the sockets */
+	setsockopt(sim->listen_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(sim->send_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(sim->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		return false;
+	if (listen(sim->listen_fd, 1) != 0)
+		return false;
+	if (getsockname(sim->listen_fd, (struct sockaddr*)&addr,
+				&addr_len) != 0)
+		return false;
+
+	return connect(sim->send_fd, (struct sockaddr*)&addr,
+			sizeof(addr)) == 0;
+}
+
+static void run(struct sim *sim)
+{
+	struct adaptive_bitrate abr;
+	pthread_t recv_thread, snd_thread;
+	int kbps = sim->max_kbps;
+	int64_t frames = (int64_t)sim->seconds * FPS;
+	uint64_t total_bytes_sent = 0;
+
+	abr_init(&abr);
+	abr_reset(&abr, sim->max_kbps, DROP_THRESHOLD);
+
+	pthread_mutex_init(&sim->mutex, NULL);
+	os_sem_init(&sim->send_sem, 0);
+
+	if (!connect_sockets(sim)) {
+		fprintf(stderr, "failed to set up the local connection\n");
+		exit(1);
+	}
+
+	printf("\n%s bitrate\n", sim->adaptive ? "adaptive" : "fixed");
+	printf("%6s %10s %10s %10s %8s\n", "time", "link kbps", "enc kbps",
+			"buffer ms", "dropped");
+
+	sim->start_ts = os_gettime_ns();
+	pthread_create(&recv_thread, NULL, receive_thread, sim);
+	pthread_create(&snd_thread, NULL, send_thread, sim);
+
+	for (int64_t i = 0; i < frames; i++) {
+		struct sim_frame frame;
+		int64_t buffer_usec;
+		bool added;
+
+		frame.dts_usec = i * FRAME_USEC;
+		frame.keyframe = (i % KEYFRAME_INTERVAL) == 0;
+		frame.size = frame_size(kbps, frame.keyframe);
+
+		pthread_mutex_lock(&sim->mutex);
+		added = add_frame(sim, &frame);
+		buffer_usec = buffer_duration_usec(sim);
+		total_bytes_sent = sim->total_bytes_sent;
+		if (buffer_usec > sim->max_buffer_usec)
+			sim->max_buffer_usec = buffer_usec;
+		pthread_mutex_unlock(&sim->mutex);
+
+		if (added)
+			os_sem_post(sim->send_sem);
+
+		if (sim->adaptive) {
+			int new_kbps = abr_update(&abr, buffer_usec,
+					total_bytes_sent, os_gettime_ns());
+			if (new_kbps)
+				kbps = new_kbps;
+		}
+
+		if (i % FPS == FPS - 1)
+			printf("%5llds %10ld %10d %10d %8d\n",
+					(long long)((i + 1) / FPS),
+					os_atomic_load_long(&sim->link_kbps),
+					kbps, (int)(buffer_usec / 1000),
+					sim->dropped_frames);
+
+		os_sleepto_ns(sim->start_ts +
+				(uint64_t)(i + 1) * FRAME_USEC * 1000);
+	}
+
+	os_atomic_set_bool(&sim->stop, true);
+	os_sem_post(sim->send_sem);
+	pthread_join(snd_thread, NULL);
+
+	shutdown(sim->send_fd, SHUT_RDWR);
+	close(sim->send_fd);
+	pthread_join(recv_thread, NULL);
+	close(sim->listen_fd);
+
+	os_sem_destroy(sim->send_sem);
+	pthread_mutex_destroy(&sim->mutex);
+	circlebuf_free(&sim->frames);
+	abr_free(&abr);
+}
+
+static void print_summary(const struct sim *sim)
+{
+	int frames = sim->seconds * FPS;
+
+	printf("%-8s sent %8.1f kbps  dropped %5d of %5d frames (%5.2f%%)  "
+			"max buffer %5d ms\n",
+			sim->adaptive ? "adaptive" : "fixed",
+			(double)sim->total_bytes_sent * 8.0 / 1000.0 /
+			(double)sim->seconds,
+			sim->dropped_frames, frames,
+			(double)sim->dropped_frames * 100.0 / (double)frames,
+			(int)(sim->max_buffer_usec / 1000));
+}
+
+int main(int argc, char *argv[])
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : 60;
+	int max_kbps = argc > 2 ? atoi(argv[2]) : 2500;
+	struct sim fixed = {0};
+	struct sim adaptive = {0};
+
+	if (seconds <= 0 || max_kbps <= 0) {
+		fprintf(stderr, "usage: %s [seconds] [bitrate kbps]\n",
+				argv[0]);
+		return 1;
+	}
+
+	fixed.seconds = adaptive.seconds = seconds;
+	fixed.max_kbps = adaptive.max_kbps = max_kbps;
+	adaptive.adaptive = true;
+
+	run(&fixed);
+	run(&adaptive);
+
+	printf("\n");
+	print_summary(&fixed);
+	print_summary(&adaptive);
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Async video queue drift test.
+ *
+ *   Outputs frames from an async source whose clock runs faster than the
+ * system clock: frames arrive at a steady rate, but their timestamps are
+ * spaced further apart than that, so every frame is a little further ahead of
+ * playback than the one before and the queue keeps growing.  This is run once
+ * without a target latency, where the queue has to be resynchronized instead
+ * of staying a full queue behind, and once with a target latency, which the
+ * queued video must not exceed.  Needs the OpenGL renderer to tick sources,
+ * which also runs on Mesa's software renderer, e.g.:
+ *
+ *   Xvfb :99 -screen 0 1280x720x24 &
+ *   DISPLAY=:99 LIBGL_ALWAYS_SOFTWARE=1 ./async-drift-test
+ *
+ * usage: async-drift-test [seconds] [drift percent] [target latency ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/platform.h>
+#include <obs.h>
+#include "test-util.h"
+
+#define FPS         30
+#define SIZE        16
+
+/* same as MAX_ASYNC_FRAMES in obs-source.c */
+#define QUEUE_LIMIT 30
+
+/* ------------------------------------------------------------------------- */
+/* async source that only outputs what the test gives it */
+
+static const char *drift_source_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Drift Source";
+}
+
+static void *drift_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void drift_source_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static struct obs_source_info drift_source = {
+	.id           = "drift_source",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO,
+	.get_name     = drift_source_get_name,
+	.create       = drift_source_create,
+	.destroy      = drift_source_destroy
+};
+
+/* ------------------------------------------------------------------------- */
+
+struct drift_result {
+	uint32_t max_depth;
+	int      longest_full;
+	uint64_t dropped;
+	uint64_t late;
+};
+
+static void run_drift(int seconds, int drift, uint32_t target_ms,
+		struct drift_result *result)
+{
+	static uint8_t pixels[SIZE * SIZE * 4];
+	struct obs_source_frame frame = {0};
+	uint64_t interval = 1000000000ULL / FPS;
+	uint64_t ts_interval = interval * (100 + drift) / 100;
+	uint64_t frames = (uint64_t)seconds * FPS;
+	uint64_t start = os_gettime_ns();
+	uint64_t ts = start;
+	int full = 0;
+	obs_source_t *source;
+
+	source = obs_source_create("drift_source", "drift", NULL, NULL);
+	obs_source_set_async_buffer(source, target_ms, OBS_ASYNC_DROP_OLDEST);
+
+	frame.data[0]     = pixels;
+	frame.linesize[0] = SIZE * 4;
+	frame.width       = SIZE;
+	frame.height      = SIZE;
+	frame.format      = VIDEO_FORMAT_BGRA;
+
+	for (uint64_t i = 0; i < frames; i++) {
+		struct obs_source_async_stats stats = {0};
+
+		frame.timestamp = ts;
+		obs_source_output_video(source, &frame);
+		ts += ts_interval;
+
+		/* the queue is at its deepest right after a frame is added */
+		obs_source_get_async_stats(source, &stats);
+
+		if (stats.queue_depth > result->max_depth)
+			result->max_depth = stats.queue_depth;
+
+		full = stats.queue_depth >= QUEUE_LIMIT ? full + 1 : 0;
+		if (full > result->longest_full)
+			result->longest_full = full;
+
+		result->dropped = stats.frames_dropped;
+		result->late    = stats.frames_late;
+
+		os_sleepto_ns(start + (i + 1) * interval);
+	}
+
+	obs_source_release(source);
+}
+
+static bool reset_video(void)
+{
+	struct obs_video_info ovi = {0};
+
+	ovi.graphics_module = "libobs-opengl";
+	ovi.fps_num         = FPS;
+	ovi.fps_den         = 1;
+	ovi.base_width      = SIZE;
+	ovi.base_height     = SIZE;
+	ovi.output_width    = SIZE;
+	ovi.output_height   = SIZE;
+	ovi.output_format   = VIDEO_FORMAT_NV12;
+	ovi.gpu_conversion  = true;
+	ovi.colorspace      = VIDEO_CS_601;
+	ovi.range           = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type      = OBS_SCALE_BICUBIC;
+
+	return obs_reset_video(&ovi) == OBS_VIDEO_SUCCESS;
+}
+
+static void print_result(const char *name, const struct drift_result *result)
+{
+	printf("%-16s max queue %2u, longest full %3d frames, "
+			"%4llu dropped, %4llu late\n", name,
+			result->max_depth, result->longest_full,
+			(unsigned long long)result->dropped,
+			(unsigned long long)result->late);
+}
+
+int main(int argc, char *argv[])
+{
+	int seconds = test_arg_int(argc, argv, 1, 20);
+	int drift = test_arg_int(argc, argv, 2, 25);
+	uint32_t target_ms = (uint32_t)test_arg_int(argc, argv, 3, 200);
+	struct drift_result unbounded = {0};
+	struct drift_result bounded = {0};
+	uint64_t ts_interval;
+	uint32_t target_frames;
+
+	if (seconds <= 0 || drift <= 0 || !target_ms)
+		return test_usage(argv[0], "[seconds] [drift percent] "
+				"[target latency ms]");
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return 1;
+
+	if (!reset_video()) {
+		fprintf(stderr, "failed to initialize video\n");
+		obs_shutdown();
+		return 1;
+	}
+
+	obs_register_source(&drift_source);
+
+	printf("%d s at %d fps, source clock %d%% fast\n", seconds, FPS, drift);
+
+	run_drift(seconds, drift, 0, &unbounded);
+	print_result("no target", &unbounded);
+
+	run_drift(seconds, drift, target_ms, &bounded);
+	print_result("target latency", &bounded);
+
+	obs_shutdown();
+
+	/* the queue may fill up, but has to be resynchronized once it has
+	 * been full for as many frames as it holds (plus a frame of slack
+	 * for the graphics thread) */
+	test_check(unbounded.longest_full <= QUEUE_LIMIT + 1,
+			"the queue stayed full for %d frames",
+			unbounded.longest_full);
+
+	/* with a target latency the queued frames must not span more than
+	 * that, again with a frame of slack */
+	ts_interval = 1000000000ULL / FPS * (100 + drift) / 100;
+	target_frames = (uint32_t)(target_ms * 1000000ULL / ts_interval) + 2;
+
+	test_check(bounded.max_depth <= target_frames,
+			"%u frames queued with a %u ms target latency, "
+			"expected at most %u", bounded.max_depth, target_ms,
+			target_frames);
+
+	test_check(unbounded.dropped && bounded.dropped,
+			"no frames were dropped, the source did not drift");
+
+	return test_result();
+}
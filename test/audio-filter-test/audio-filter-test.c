@@ -0,0 +1,259 @@
+/*
+ * Offline audio filter test.
+ *
+ *   Pushes synthetic audio through the filter_audio callback of audio filters
+ * directly, without a running frontend or audio device.  Each filter is also
+ * built without its SIMD code (see the *-scalar.c files); both builds are run
+ * side by side on the same blocks and have to produce the same output.  Also
+ * reports how long each build took relative to real time.
+ *
+ * usage: audio-filter-test [filter id|all] [channels] [seconds]
+ *                          [block frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <obs-module.h>
+#include "test-util.h"
+
+#ifndef M_PI
+#define M_PI 3.1415926535897932384626433832795
+#endif
+
+#define SAMPLE_RATE  48000
+#define MAX_DIFF     1e-6f
+
+extern struct obs_source_info gain_filter;
+extern struct obs_source_info gain_filter_scalar;
+extern struct obs_source_info noise_gate_filter;
+extern struct obs_source_info noise_gate_filter_scalar;
+
+struct test_filter {
+	struct obs_source_info *info;
+	struct obs_source_info *scalar;
+};
+
+static struct test_filter filters[] = {
+	{&gain_filter,       &gain_filter_scalar},
+	{&noise_gate_filter, &noise_gate_filter_scalar},
+};
+
+#define NUM_FILTERS (sizeof(filters) / sizeof(filters[0]))
+
+/* the filters are compiled directly into this program rather than loaded as
+ * a module, so provide the module functions they expect */
+const char *obs_module_text(const char *val)
+{
+	return val;
+}
+
+obs_module_t *obs_current_module(void)
+{
+	return NULL;
+}
+
+static enum speaker_layout channels_to_speakers(int channels)
+{
+	switch (channels) {
+	case 1: return SPEAKERS_MONO;
+	case 2: return SPEAKERS_STEREO;
+	case 3: return SPEAKERS_2POINT1;
+	case 4: return SPEAKERS_QUAD;
+	case 5: return SPEAKERS_4POINT1;
+	case 6: return SPEAKERS_5POINT1;
+	case 8: return SPEAKERS_7POINT1;
+	}
+
+	return SPEAKERS_UNKNOWN;
+}
+
+/* alternates a loud tone with quiet noise every quarter second so that
+ * dynamics filters change state regularly */
+static float *create_test_signal(size_t frames)
+{
+	float *signal = bmalloc(frames * sizeof(float));
+	size_t period = SAMPLE_RATE / 4;
+
+	for (size_t i = 0; i < frames; i++) {
+		if ((i / period) % 2 == 0) {
+			double t = (double)i / (double)SAMPLE_RATE;
+			signal[i] = (float)(0.5 * sin(2.0 * M_PI * 440.0 * t));
+		} else {
+			signal[i] = test_rand_float() * 0.003f;
+		}
+	}
+
+	return signal;
+}
+
+struct test_instance {
+	struct obs_source_info *info;
+	void                   *data;
+	float                  *planes[MAX_AV_PLANES];
+	uint64_t               elapsed;
+};
+
+static bool instance_init(struct test_instance *inst,
+		struct obs_source_info *info, obs_data_t *settings,
+		size_t channels, size_t block_frames)
+{
+	memset(inst, 0, sizeof(*inst));
+	inst->info = info;
+	inst->data = info->create(settings, NULL);
+	if (!inst->data)
+		return false;
+
+	for (size_t c = 0; c < channels; c++)
+		inst->planes[c] = bmalloc(block_frames * sizeof(float));
+	return true;
+}
+
+static void instance_free(struct test_instance *inst, size_t channels)
+{
+	for (size_t c = 0; c < channels; c++)
+		bfree(inst->planes[c]);
+
+	if (inst->data)
+		inst->info->destroy(inst->data);
+}
+
+static void instance_filter(struct test_instance *inst, size_t channels,
+		const float *signal, size_t pos, size_t frames)
+{
+	struct obs_audio_data audio = {0};
+	uint64_t start;
+
+	for (size_t c = 0; c < channels; c++) {
+		memcpy(inst->planes[c], signal + pos, frames * sizeof(float));
+		audio.data[c] = (uint8_t*)inst->planes[c];
+	}
+
+	audio.frames = (uint32_t)frames;
+	audio.timestamp = pos * 1000000000ULL / SAMPLE_RATE;
+
+	start = os_gettime_ns();
+	inst->info->filter_audio(inst->data, &audio);
+	inst->elapsed += os_gettime_ns() - start;
+}
+
+static void print_timing(const char *name, uint64_t elapsed, size_t frames)
+{
+	double audio_ns = (double)frames * 1000000000.0 / (double)SAMPLE_RATE;
+
+	printf("%-28s %8.2f ns/frame %10.1fx realtime\n", name,
+			(double)elapsed / (double)frames,
+			elapsed ? audio_ns / (double)elapsed : 0.0);
+}
+
+static void run_filter(struct test_filter *filter, size_t channels,
+		const float *signal, size_t frames, size_t block_frames)
+{
+	struct test_instance simd = {0};
+	struct test_instance scalar = {0};
+	obs_data_t *settings = obs_data_create();
+	const char *id = filter->info->id;
+	float max_diff = 0.0f;
+	char name[64];
+
+	if (filter->info->get_defaults)
+		filter->info->get_defaults(settings);
+
+	if (!instance_init(&simd, filter->info, settings, channels,
+				block_frames) ||
+	    !instance_init(&scalar, filter->scalar, settings, channels,
+				block_frames)) {
+		test_fail("%s: failed to create", id);
+		goto fail;
+	}
+
+	for (size_t pos = 0; pos < frames; pos += block_frames) {
+		size_t block = frames - pos;
+
+		if (block > block_frames)
+			block = block_frames;
+
+		instance_filter(&simd, channels, signal, pos, block);
+		instance_filter(&scalar, channels, signal, pos, block);
+
+		for (size_t c = 0; c < channels; c++) {
+			for (size_t i = 0; i < block; i++) {
+				float diff = fabsf(simd.planes[c][i] -
+						scalar.planes[c][i]);
+				if (diff > max_diff)
+					max_diff = diff;
+			}
+		}
+	}
+
+	print_timing(id, simd.elapsed, frames);
+	snprintf(name, sizeof(name), "%s (scalar)", id);
+	print_timing(name, scalar.elapsed, frames);
+
+	test_check(max_diff <= MAX_DIFF,
+			"%s: output differs from scalar by up to %g", id,
+			max_diff);
+
+fail:
+	instance_free(&simd, channels);
+	instance_free(&scalar, channels);
+	obs_data_release(settings);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter_id = argc > 1 ? argv[1] : "all";
+	int channels = test_arg_int(argc, argv, 2, 2);
+	int seconds = test_arg_int(argc, argv, 3, 60);
+	int block_frames = test_arg_int(argc, argv, 4, AUDIO_OUTPUT_FRAMES);
+	struct obs_audio_info oai;
+	bool found = false;
+	float *signal;
+	size_t frames;
+
+	oai.samples_per_sec = SAMPLE_RATE;
+	oai.speakers = channels_to_speakers(channels);
+
+	if (oai.speakers == SPEAKERS_UNKNOWN || seconds <= 0 ||
+	    block_frames <= 0)
+		return test_usage(argv[0], "[filter id|all] [channels] "
+				"[seconds] [block frames]");
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return 1;
+
+	if (!obs_reset_audio(&oai)) {
+		fprintf(stderr, "failed to initialize audio\n");
+		obs_shutdown();
+		return 1;
+	}
+
+	frames = (size_t)seconds * SAMPLE_RATE;
+	signal = create_test_signal(frames);
+
+	printf("%d channel(s), %d second(s) of audio in blocks of %d frames\n",
+			channels, seconds, block_frames);
+
+	for (size_t i = 0; i < NUM_FILTERS; i++) {
+		if (strcmp(filter_id, "all") != 0 &&
+		    strcmp(filter_id, filters[i].info->id) != 0)
+			continue;
+
+		run_filter(&filters[i], (size_t)channels, signal, frames,
+				(size_t)block_frames);
+		found = true;
+	}
+
+	bfree(signal);
+	obs_shutdown();
+
+	if (!found) {
+		fprintf(stderr, "unknown filter '%s'\n", filter_id);
+		return 1;
+	}
+
+	return test_result();
+}
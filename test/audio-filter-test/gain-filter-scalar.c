@@ -0,0 +1,5 @@
+/* the gain filter again without its SIMD code, renamed so that it can be
+ * linked next to the regular build and compared against it */
+#define OBS_FILTERS_NO_SIMD
+#define gain_filter gain_filter_scalar
+#include "gain-filter.c"
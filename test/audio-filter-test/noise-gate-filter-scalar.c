@@ -0,0 +1,5 @@
+/* the noise gate again without its SIMD code, renamed so that it can be
+ * linked next to the regular build and compared against it */
+#define OBS_FILTERS_NO_SIMD
+#define noise_gate_filter noise_gate_filter_scalar
+#include "noise-gate-filter.c"
@@ -0,0 +1,354 @@
+/*
+ * Parallel audio render equivalence test.
+ *
+ *   Starts libobs with audio only and builds random trees of real sources:
+ * test inputs that output a constant level per channel with their own
+ * volume and mixers, nested in scenes that are set as output channels.  Each
+ * tree is rendered once with the audio render pool forced on and once with
+ * every source rendered on the audio thread (obs_set_audio_render_threads),
+ * and the steady level of every mix captured with audio_output_connect has
+ * to be bit-identical between the two.  The levels are multiples of 1/256
+ * so that summing them is exact.
+ *
+ * usage: audio-render-test [iterations] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "test-util.h"
+
+#define SAMPLE_RATE     48000
+#define CHANNELS        2
+#define NUM_LEAVES      8
+#define NUM_SCENES      4
+#define POOL_THREADS    4
+#define FEED_AHEAD_NS   200000000ULL
+#define WARMUP_MS       1000
+#define SETTLE_MS       2000
+
+struct test_input {
+	obs_source_t *source;
+};
+
+struct capture {
+	pthread_mutex_t mutex;
+	float           data[MAX_AUDIO_MIXES][CHANNELS][AUDIO_OUTPUT_FRAMES];
+	uint64_t        ticks;
+};
+
+struct test_tree {
+	obs_source_t    *leaves[NUM_LEAVES];
+	obs_scene_t     *scenes[NUM_SCENES];
+
+	uint64_t        start_ts;
+	uint64_t        frames_sent;
+};
+
+struct levels {
+	float           level[MAX_AUDIO_MIXES][CHANNELS];
+};
+
+/* ------------------------------------------------------------------------- */
+
+static const char *test_input_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Audio render test input";
+}
+
+static void *test_input_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct test_input *input = bzalloc(sizeof(struct test_input));
+	input->source = source;
+
+	UNUSED_PARAMETER(settings);
+	return input;
+}
+
+static void test_input_destroy(void *data)
+{
+	bfree(data);
+}
+
+static struct obs_source_info test_input_info = {
+	.id           = "audio_render_test_input",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.get_name     = test_input_name,
+	.create       = test_input_create,
+	.destroy      = test_input_destroy
+};
+
+/* ------------------------------------------------------------------------- */
+
+static inline float leaf_level(size_t idx, size_t ch)
+{
+	return (float)(idx + 1) / (ch ? -256.0f : 128.0f);
+}
+
+/* outputs every leaf up to a little ahead of the current time, with
+ * timestamps close enough to os_gettime_ns to be used directly */
+static void feed_leaves(struct test_tree *tree)
+{
+	static float planes[NUM_LEAVES][CHANNELS][AUDIO_OUTPUT_FRAMES];
+	static bool initialized = false;
+	uint64_t end_ts = os_gettime_ns() + FEED_AHEAD_NS;
+
+	if (!initialized) {
+		initialized = true;
+		for (size_t i = 0; i < NUM_LEAVES; i++)
+			for (size_t ch = 0; ch < CHANNELS; ch++)
+				for (size_t f = 0; f < AUDIO_OUTPUT_FRAMES; f++)
+					planes[i][ch][f] = leaf_level(i, ch);
+	}
+
+	for (;;) {
+		uint64_t ts = tree->start_ts +
+			tree->frames_sent * 1000000000ULL / SAMPLE_RATE;
+
+		if (ts >= end_ts)
+			break;
+
+		for (size_t i = 0; i < NUM_LEAVES; i++) {
+			struct obs_source_audio audio = {
+				.data            = {
+					(uint8_t*)planes[i][0],
+					(uint8_t*)planes[i][1]
+				},
+				.frames          = AUDIO_OUTPUT_FRAMES,
+				.speakers        = SPEAKERS_STEREO,
+				.format          = AUDIO_FORMAT_FLOAT_PLANAR,
+				.samples_per_sec = SAMPLE_RATE,
+				.timestamp       = ts
+			};
+
+			obs_source_output_audio(tree->leaves[i], &audio);
+		}
+
+		tree->frames_sent += AUDIO_OUTPUT_FRAMES;
+	}
+}
+
+static void capture_mix(void *param, size_t mix_idx, struct audio_data *data)
+{
+	struct capture *capture = param;
+
+	if (data->frames != AUDIO_OUTPUT_FRAMES)
+		return;
+
+	pthread_mutex_lock(&capture->mutex);
+
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		memcpy(capture->data[mix_idx][ch], data->data[ch],
+				AUDIO_OUTPUT_FRAMES * sizeof(float));
+
+	if (mix_idx == MAX_AUDIO_MIXES - 1)
+		capture->ticks++;
+
+	pthread_mutex_unlock(&capture->mutex);
+}
+
+/* every leaf and scene goes to a random set of mixes with a volume that is a
+ * power of two.  the last scene always holds the first four leaves so that
+ * the render pool is used, the others hold random leaves and may nest any
+ * earlier scene.  the leaves are only mixed through the output channels. */
+static void build_tree(struct test_tree *tree, uint32_t seed)
+{
+	char name[32];
+
+	test_srand(seed);
+
+	for (size_t i = 0; i < NUM_LEAVES; i++) {
+		obs_source_t *leaf;
+
+		snprintf(name, sizeof(name), "leaf %d", (int)i);
+		leaf = obs_source_create("audio_render_test_input", name, NULL,
+				NULL);
+		obs_source_set_audio_mixers(leaf, test_rand() % 63 + 1);
+		obs_source_set_volume(leaf,
+				1.0f / (float)(1 << (test_rand() % 3)));
+		tree->leaves[i] = leaf;
+	}
+
+	for (size_t i = 0; i < NUM_SCENES; i++) {
+		bool last = i == NUM_SCENES - 1;
+		obs_scene_t *scene;
+		obs_source_t *source;
+
+		snprintf(name, sizeof(name), "scene %d", (int)i);
+		scene = obs_scene_create(name);
+		source = obs_scene_get_source(scene);
+
+		obs_source_set_audio_mixers(source, test_rand() % 63 + 1);
+
+		for (size_t j = 0; j < i; j++) {
+			if (test_rand() % 3 == 0)
+				obs_scene_add(scene, obs_scene_get_source(
+							tree->scenes[j]));
+		}
+
+		for (size_t j = 0; j < NUM_LEAVES; j++) {
+			if ((last && j < 4) || test_rand() % 2)
+				obs_scene_add(scene, tree->leaves[j]);
+		}
+
+		tree->scenes[i] = scene;
+	}
+
+	obs_set_output_source(0, obs_scene_get_source(tree->scenes[3]));
+	obs_set_output_source(1, obs_scene_get_source(tree->scenes[2]));
+}
+
+static void free_tree(struct test_tree *tree)
+{
+	obs_set_output_source(0, NULL);
+	obs_set_output_source(1, NULL);
+
+	for (size_t i = 0; i < NUM_SCENES; i++)
+		obs_scene_release(tree->scenes[i]);
+	for (size_t i = 0; i < NUM_LEAVES; i++)
+		obs_source_release(tree->leaves[i]);
+}
+
+/* the levels once every leaf is buffered: each channel of each mix is the
+ * same value for a whole tick */
+static bool get_levels(struct capture *capture, struct levels *levels)
+{
+	bool steady;
+
+	pthread_mutex_lock(&capture->mutex);
+	steady = capture->ticks > 0;
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		for (size_t ch = 0; ch < CHANNELS; ch++) {
+			float *data = capture->data[mix][ch];
+
+			for (size_t f = 1; f < AUDIO_OUTPUT_FRAMES; f++) {
+				if (data[f] != data[0])
+					steady = false;
+			}
+
+			levels->level[mix][ch] = data[0];
+		}
+	}
+
+	pthread_mutex_unlock(&capture->mutex);
+	return steady;
+}
+
+static bool reset_audio(size_t threads)
+{
+	struct obs_audio_info oai = {
+		.samples_per_sec = SAMPLE_RATE,
+		.speakers        = SPEAKERS_STEREO
+	};
+
+	obs_set_audio_render_threads(threads);
+	return obs_reset_audio(&oai);
+}
+
+static bool render_tree(uint32_t seed, size_t threads, struct levels *levels)
+{
+	struct test_tree tree = {0};
+	struct capture *capture = bzalloc(sizeof(struct capture));
+	audio_t *audio;
+	bool steady = false;
+
+	pthread_mutex_init_value(&capture->mutex);
+	if (pthread_mutex_init(&capture->mutex, NULL) != 0 ||
+	    !reset_audio(threads)) {
+		bfree(capture);
+		return false;
+	}
+
+	audio = obs_get_audio();
+	build_tree(&tree, seed);
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++)
+		audio_output_connect(audio, mix, NULL, capture_mix, capture);
+
+	tree.start_ts = os_gettime_ns();
+
+	for (int ms = 0; ms < WARMUP_MS; ms += 5) {
+		feed_leaves(&tree);
+		os_sleep_ms(5);
+	}
+
+	for (int ms = 0; !steady && ms < SETTLE_MS; ms += 5) {
+		feed_leaves(&tree);
+		os_sleep_ms(5);
+
+		steady = get_levels(capture, levels);
+	}
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++)
+		audio_output_disconnect(audio, mix, capture_mix, capture);
+
+	free_tree(&tree);
+
+	pthread_mutex_destroy(&capture->mutex);
+	bfree(capture);
+	return steady;
+}
+
+static void compare_levels(int it, const struct levels *pooled,
+		const struct levels *serial)
+{
+	bool silent = true;
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		for (size_t ch = 0; ch < CHANNELS; ch++) {
+			float a = pooled->level[mix][ch];
+			float b = serial->level[mix][ch];
+
+			if (a != 0.0f)
+				silent = false;
+
+			test_check(a == b, "iteration %d: mix %d channel %d is "
+					"%f pooled, %f serial", it, (int)mix,
+					(int)ch, a, b);
+		}
+	}
+
+	test_check(!silent, "iteration %d: every mix is silent", it);
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = test_arg_int(argc, argv, 1, 4);
+	uint32_t seed = test_arg_seed(argc, argv, 2);
+
+	if (iterations <= 0)
+		return test_usage(argv[0], "[iterations] [seed]");
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "Couldn't start libobs\n");
+		return 1;
+	}
+
+	obs_register_source(&test_input_info);
+
+	for (int it = 0; it < iterations; it++) {
+		uint32_t tree_seed = seed + (uint32_t)it;
+		struct levels pooled;
+		struct levels serial;
+
+		if (!render_tree(tree_seed, POOL_THREADS, &pooled) ||
+		    !render_tree(tree_seed, 1, &serial)) {
+			test_fail("iteration %d: the mixes never settled", it);
+			continue;
+		}
+
+		compare_levels(it, &pooled, &serial);
+	}
+
+	obs_shutdown();
+
+	printf("%d iterations, seed %u\n", iterations, seed);
+	return test_result();
+}
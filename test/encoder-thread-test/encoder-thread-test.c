@@ -0,0 +1,206 @@
+/*
+ * Encoder thread isolation test.
+ *
+ *   Feeds frames at a fixed rate into a video output with one fast synthetic
+ * encoder and one or more slow ones connected.  The slow encoders take
+ * longer than a frame interval to encode, the way a recording encoder at a
+ * slower preset than the stream would, and each takes a little longer than
+ * the last so they fall behind at different rates.  Reports how many frames
+ * each encoder and the video output as a whole had to skip.  Only the slow
+ * encoders should skip frames; the run fails if the video output skipped
+ * frames for every encoder, which happens if the slow ones hold all of the
+ * cached frames between them.  Each encoder also derives its pts from the
+ * frame timestamps the way obs-encoder does.  The run fails if a pts goes
+ * backwards or drifts off the video clock, so skipped frames have to show
+ * up as gaps rather than shortening the timeline.
+ *
+ * usage: encoder-thread-test [fast delay ms] [slow delay ms] [seconds]
+ *                            [slow encoders]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/platform.h>
+#include <media-io/video-io.h>
+#include <media-io/video-frame.h>
+#include "test-util.h"
+
+#define WIDTH    320
+#define HEIGHT   180
+#define FPS      30
+#define MAX_SLOW 8
+
+struct synthetic_encoder {
+	const char *name;
+	video_t    *video;
+	uint64_t   delay_ns;
+	uint32_t   encoded;
+	uint64_t   last_ts;
+	uint32_t   out_of_order;
+
+	uint64_t   start_ts;
+	int64_t    last_pts;
+	uint32_t   pts_gaps;
+	uint32_t   pts_errors;
+	uint32_t   skipped;
+};
+
+/* same as receive_video in obs-encoder.c, with a time base of 1/FPS */
+static void check_pts(struct synthetic_encoder *enc, uint64_t timestamp)
+{
+	uint64_t interval = video_output_get_frame_time(enc->video);
+	int64_t pts;
+
+	if (!enc->encoded) {
+		enc->start_ts = timestamp;
+		enc->last_pts = -1;
+	}
+
+	pts = video_output_get_frame_index(enc->video, enc->start_ts,
+			timestamp);
+
+	if (pts <= enc->last_pts ||
+	    enc->start_ts + (uint64_t)pts * interval != timestamp)
+		enc->pts_errors++;
+	else if (pts > enc->last_pts + 1)
+		enc->pts_gaps += (uint32_t)(pts - enc->last_pts - 1);
+
+	enc->last_pts = pts;
+}
+
+static void encode(void *param, struct video_data *frame)
+{
+	struct synthetic_encoder *enc = param;
+
+	if (enc->encoded && frame->timestamp <= enc->last_ts)
+		enc->out_of_order++;
+	enc->last_ts = frame->timestamp;
+
+	check_pts(enc, frame->timestamp);
+
+	/* touch the frame so it can't be handed out while still in use */
+	volatile uint8_t sum = 0;
+	for (size_t y = 0; y < HEIGHT; y += 16)
+		sum += frame->data[0][y * frame->linesize[0]];
+
+	os_sleepto_ns(os_gettime_ns() + enc->delay_ns);
+	enc->encoded++;
+}
+
+static void print_encoder(video_t *video, struct synthetic_encoder *enc)
+{
+	uint32_t total = 0;
+	uint32_t skipped = 0;
+
+	video_output_get_input_frames(video, encode, enc, &total, &skipped);
+	enc->skipped = skipped;
+
+	printf("%-5s %4d ms/frame: %5u frames, %5u encoded, %5u skipped "
+			"(%5.1f%%), %u out of order\n",
+			enc->name, (int)(enc->delay_ns / 1000000),
+			total, enc->encoded, skipped,
+			total ? (double)skipped / (double)total * 100.0 : 0.0,
+			enc->out_of_order);
+	printf("%-5s pts: %u frame gaps, %u off the video clock\n",
+			enc->name, enc->pts_gaps, enc->pts_errors);
+}
+
+/* every skip has to be a gap in pts, except for frames skipped after the
+ * last one encoded.  only valid once the encoder has been disconnected */
+static void check_encoder(const struct synthetic_encoder *enc)
+{
+	test_check(enc->pts_errors == 0 && enc->out_of_order == 0 &&
+			enc->pts_gaps <= enc->skipped &&
+			(uint32_t)enc->last_pts + 1 ==
+			enc->encoded + enc->pts_gaps,
+			"%s: pts not continuous", enc->name);
+}
+
+int main(int argc, char *argv[])
+{
+	int fast_ms = test_arg_int(argc, argv, 1, 5);
+	int slow_ms = test_arg_int(argc, argv, 2, 50);
+	int seconds = test_arg_int(argc, argv, 3, 10);
+	int num_slow = test_arg_int(argc, argv, 4, 3);
+	struct synthetic_encoder fast = {"fast"};
+	struct synthetic_encoder slow[MAX_SLOW] = {{0}};
+	char slow_names[MAX_SLOW][8];
+	struct video_output_info info = {0};
+	uint64_t interval = 1000000000ULL / FPS;
+	uint64_t timestamp;
+	uint32_t skipped;
+	video_t *video;
+
+	if (fast_ms < 0 || slow_ms < 0 || seconds <= 0 || num_slow <= 0 ||
+	    num_slow > MAX_SLOW)
+		return test_usage(argv[0], "[fast delay ms] [slow delay ms] "
+				"[seconds] [slow encoders (1-8)]");
+
+	info.name       = "encoder-thread-test";
+	info.format     = VIDEO_FORMAT_NV12;
+	info.fps_num    = FPS;
+	info.fps_den    = 1;
+	info.width      = WIDTH;
+	info.height     = HEIGHT;
+	info.cache_size = 6;
+	info.colorspace = VIDEO_CS_601;
+	info.range      = VIDEO_RANGE_PARTIAL;
+
+	if (video_output_open(&video, &info) != VIDEO_OUTPUT_SUCCESS) {
+		fprintf(stderr, "failed to open video output\n");
+		return 1;
+	}
+
+	fast.delay_ns = (uint64_t)fast_ms * 1000000ULL;
+	fast.video = video;
+	video_output_connect(video, NULL, encode, &fast);
+
+	for (int i = 0; i < num_slow; i++) {
+		snprintf(slow_names[i], sizeof(slow_names[i]), "slow%d", i);
+		slow[i].name = slow_names[i];
+		/* different speeds, so they hold on to different frames */
+		slow[i].delay_ns = (uint64_t)(slow_ms + slow_ms * i / 2) *
+			1000000ULL;
+		slow[i].video = video;
+		video_output_connect(video, NULL, encode, &slow[i]);
+	}
+
+	timestamp = os_gettime_ns();
+
+	for (int i = 0; i < seconds * FPS; i++) {
+		struct video_frame frame;
+
+		if (video_output_lock_frame(video, &frame, 1, timestamp)) {
+			memset(frame.data[0], i & 0xFF, frame.linesize[0]);
+			video_output_unlock_frame(video);
+		}
+
+		timestamp += interval;
+		os_sleepto_ns(timestamp);
+	}
+
+	print_encoder(video, &fast);
+	for (int i = 0; i < num_slow; i++)
+		print_encoder(video, &slow[i]);
+
+	skipped = video_output_get_skipped_frames(video);
+	printf("video output: %u frames, %u skipped for all encoders\n",
+			video_output_get_total_frames(video), skipped);
+
+	video_output_disconnect(video, encode, &fast);
+	for (int i = 0; i < num_slow; i++)
+		video_output_disconnect(video, encode, &slow[i]);
+	video_output_close(video);
+
+	check_encoder(&fast);
+	for (int i = 0; i < num_slow; i++)
+		check_encoder(&slow[i]);
+
+	/* allow for the odd frame lost to scheduling */
+	test_check(skipped <= (uint32_t)(seconds * FPS) / 100,
+			"slow encoders made every encoder skip frames");
+
+	return test_result();
+}
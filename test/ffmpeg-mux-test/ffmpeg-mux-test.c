@@ -0,0 +1,317 @@
+/*
+ * ffmpeg-mux crash-safe recording test.
+ *
+ *   Feeds synthetic 60 fps H.264 video and AAC audio to the ffmpeg-mux
+ * executable and records an mp4 twice, once as a regular mp4 and once with
+ * the crash-safe mode (fragmented mp4, preallocation and periodic syncs).
+ * First each file is written as fast as the muxer accepts data to compare
+ * throughput, then each is written in real time and the muxer is killed
+ * partway through, after which the file is opened with libavformat to see
+ * how much of the recording can still be read.  Losing power cannot be
+ * simulated here; the sync interval only bounds what the page cache holds.
+ *
+ * usage: ffmpeg-mux-test <ffmpeg-mux path> <output directory> [seconds]
+ *                        [video mbps]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include "ffmpeg-mux.h"
+#include "test-util.h"
+
+#include <libavformat/avformat.h>
+
+#define FPS              60
+#define WIDTH            1920
+#define HEIGHT           1080
+#define KEYINT           (FPS * 2)
+#define SAMPLE_RATE      48000
+#define AAC_FRAME        1024
+#define AUDIO_KBPS       160
+#define FRAGMENT_MS      2000
+#define SYNC_MS          1000
+#define PREALLOC_MB      64
+
+/* 1920x1080 high profile avcC, the muxer does not look past the header */
+static const uint8_t avcc[] = {
+	0x01, 0x64, 0x00, 0x28, 0xff, 0xe1, 0x00, 0x0f,
+	0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78,
+	0x02, 0x27, 0xe5, 0x84, 0x00, 0x00, 0x03, 0x00,
+	0x04, 0x01, 0x00, 0x06, 0x68, 0xeb, 0xe3, 0xcb,
+	0x22, 0xc0
+};
+
+/* AAC LC, 48000 hz, stereo */
+static const uint8_t aac_config[] = {0x11, 0x90};
+
+struct mux_process {
+	pid_t pid;
+	FILE  *pipe;
+};
+
+static bool mux_start(struct mux_process *mux, const char *exe,
+		const char *path, int mbps, bool crash_safe)
+{
+	char vbitrate[16], abitrate[16], width[16], height[16], fps[16];
+	char sample_rate[16], fragment[16], sync[16], prealloc[16];
+	int fds[2];
+
+	snprintf(vbitrate, sizeof(vbitrate), "%d", mbps * 1000);
+	snprintf(abitrate, sizeof(abitrate), "%d", AUDIO_KBPS);
+	snprintf(width, sizeof(width), "%d", WIDTH);
+	snprintf(height, sizeof(height), "%d", HEIGHT);
+	snprintf(fps, sizeof(fps), "%d", FPS);
+	snprintf(sample_rate, sizeof(sample_rate), "%d", SAMPLE_RATE);
+	snprintf(fragment, sizeof(fragment), "%d", FRAGMENT_MS);
+	snprintf(sync, sizeof(sync), "%d", SYNC_MS);
+	snprintf(prealloc, sizeof(prealloc), "%d", PREALLOC_MB);
+
+	if (pipe(fds) != 0)
+		return false;
+
+	mux->pid = fork();
+	if (mux->pid < 0)
+		return false;
+
+	if (mux->pid == 0) {
+		/* the crash-safe arguments are left off for regular files */
+		char *args[] = {
+			(char*)exe, (char*)path, "1", "1",
+			"h264", vbitrate, width, height, fps, "1",
+			"aac", "Track1", abitrate, sample_rate, "2",
+			"",
+			crash_safe ? fragment : NULL, sync, prealloc,
+			NULL
+		};
+
+		dup2(fds[0], STDIN_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execv(exe, args);
+		_exit(127);
+	}
+
+	close(fds[0]);
+	mux->pipe = fdopen(fds[1], "w");
+	return mux->pipe != NULL;
+}
+
+static int mux_wait(struct mux_process *mux, bool kill_process)
+{
+	int status = 0;
+
+	if (kill_process)
+		kill(mux->pid, SIGKILL);
+
+	fclose(mux->pipe);
+	waitpid(mux->pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static bool write_packet(struct mux_process *mux, enum ffm_packet_type type,
+		int64_t ts, bool keyframe, const uint8_t *data, size_t size)
+{
+	struct ffm_packet_info info = {0};
+
+	info.pts      = ts;
+	info.dts      = ts;
+	info.size     = (uint32_t)size;
+	info.type     = type;
+	info.keyframe = keyframe;
+
+	return fwrite(&info, sizeof(info), 1, mux->pipe) == 1 &&
+		fwrite(data, 1, size, mux->pipe) == size;
+}
+
+static uint8_t *make_payload(size_t size)
+{
+	uint8_t *data = malloc(size);
+
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8_t)test_rand();
+	return data;
+}
+
+/* a single length prefixed slice, IDR for keyframes */
+static void set_nal(uint8_t *data, size_t size, bool keyframe)
+{
+	uint32_t nal_size = (uint32_t)size - 4;
+
+	data[0] = (uint8_t)(nal_size >> 24);
+	data[1] = (uint8_t)(nal_size >> 16);
+	data[2] = (uint8_t)(nal_size >> 8);
+	data[3] = (uint8_t)nal_size;
+	data[4] = keyframe ? 0x65 : 0x41;
+}
+
+/* writes the headers and then the given duration of packets, paced to real
+ * time if requested */
+static bool write_recording(struct mux_process *mux, int seconds, int mbps,
+		bool realtime)
+{
+	size_t frame_size = (size_t)mbps * 1000000 / 8 / FPS;
+	size_t audio_size = AUDIO_KBPS * 1000 / 8 * AAC_FRAME / SAMPLE_RATE;
+	uint8_t *video = make_payload(frame_size * 3);
+	uint8_t *audio = make_payload(audio_size);
+	int64_t frames = (int64_t)seconds * FPS;
+	int64_t samples = 0;
+	uint64_t start = os_gettime_ns();
+	bool success;
+
+	success = write_packet(mux, FFM_PACKET_VIDEO, 0, false, avcc,
+				sizeof(avcc)) &&
+		write_packet(mux, FFM_PACKET_AUDIO, 0, false, aac_config,
+				sizeof(aac_config));
+
+	for (int64_t i = 0; success && i < frames; i++) {
+		bool keyframe = (i % KEYINT) == 0;
+		size_t size = keyframe ? frame_size * 3 : frame_size;
+
+		set_nal(video, size, keyframe);
+		success = write_packet(mux, FFM_PACKET_VIDEO, i, keyframe,
+				video, size);
+
+		while (success && samples * FPS <= i * SAMPLE_RATE) {
+			success = write_packet(mux, FFM_PACKET_AUDIO, samples,
+					true, audio, audio_size);
+			samples += AAC_FRAME;
+		}
+
+		if (realtime) {
+			fflush(mux->pipe);
+			os_sleepto_ns(start + (uint64_t)(i + 1) *
+					1000000000ULL / FPS);
+		}
+	}
+
+	free(video);
+	free(audio);
+	return success;
+}
+
+/* the seconds of video that can still be read from the file */
+static double readable_seconds(const char *path)
+{
+	AVFormatContext *ctx = NULL;
+	AVPacket pkt;
+	int64_t last_pts = -1;
+	int video_idx = -1;
+
+	if (avformat_open_input(&ctx, path, NULL, NULL) < 0)
+		return 0.0;
+
+	for (unsigned i = 0; i < ctx->nb_streams; i++) {
+		if (ctx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+			video_idx = (int)i;
+	}
+
+	while (av_read_frame(ctx, &pkt) >= 0) {
+		if (pkt.stream_index == video_idx && pkt.pts > last_pts)
+			last_pts = pkt.pts;
+		av_free_packet(&pkt);
+	}
+
+	if (video_idx >= 0 && last_pts >= 0) {
+		AVRational tb = ctx->streams[video_idx]->time_base;
+		avformat_close_input(&ctx);
+		return (double)(last_pts + 1) * av_q2d(tb);
+	}
+
+	avformat_close_input(&ctx);
+	return 0.0;
+}
+
+static bool throughput(const char *exe, const char *path, int seconds,
+		int mbps, bool crash_safe)
+{
+	struct mux_process mux;
+	uint64_t start = os_gettime_ns();
+	double elapsed;
+	int64_t size;
+	bool success;
+
+	if (!mux_start(&mux, exe, path, mbps, crash_safe))
+		return false;
+
+	success = write_recording(&mux, seconds, mbps, false);
+	success = mux_wait(&mux, false) == 0 && success;
+
+	elapsed = (double)(os_gettime_ns() - start) / 1000000000.0;
+	size = os_get_file_size(path);
+
+	printf("%-12s %8.2f s %10.1f MB/s %8.1fx realtime%s\n",
+			crash_safe ? "crash-safe" : "regular", elapsed,
+			(double)size / (1024.0 * 1024.0) / elapsed,
+			(double)seconds / elapsed,
+			success ? "" : " (failed)");
+
+	os_unlink(path);
+	return success;
+}
+
+static bool recovery(const char *exe, const char *path, int seconds,
+		int mbps, bool crash_safe)
+{
+	struct mux_process mux;
+	double recovered;
+
+	if (!mux_start(&mux, exe, path, mbps, crash_safe))
+		return false;
+
+	write_recording(&mux, seconds, mbps, true);
+	mux_wait(&mux, true);
+
+	recovered = readable_seconds(path);
+	printf("%-12s killed after %d s, %6.2f s readable\n",
+			crash_safe ? "crash-safe" : "regular", seconds,
+			recovered);
+
+	os_unlink(path);
+
+	/* everything but the fragment being written has to survive */
+	return !crash_safe ||
+		recovered >= (double)seconds - FRAGMENT_MS / 1000.0 * 2.0;
+}
+
+int main(int argc, char *argv[])
+{
+	int seconds = test_arg_int(argc, argv, 3, 60);
+	int mbps = test_arg_int(argc, argv, 4, 100);
+	struct dstr path = {0};
+
+	if (argc < 3 || seconds <= 0 || mbps <= 0)
+		return test_usage(argv[0], "<ffmpeg-mux path> "
+				"<output directory> [seconds] [video mbps]");
+
+	/* the muxer is killed with packets possibly still in the pipe */
+	signal(SIGPIPE, SIG_IGN);
+
+	av_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	dstr_printf(&path, "%s/ffmpeg-mux-test.mp4", argv[2]);
+
+	printf("throughput, %d s of %d mbps video\n", seconds, mbps);
+	test_check(throughput(argv[1], path.array, seconds, mbps, false),
+			"mp4 not written");
+	test_check(throughput(argv[1], path.array, seconds, mbps, true),
+			"crash-safe mp4 not written");
+
+	printf("\nrecovery, muxer killed while recording\n");
+	test_check(recovery(argv[1], path.array, 10, mbps, false),
+			"mp4 muxer did not start");
+	test_check(recovery(argv[1], path.array, 10, mbps, true),
+			"crash-safe mp4 lost more than the last fragment");
+
+	dstr_free(&path);
+
+	printf("\n");
+	return test_result();
+}
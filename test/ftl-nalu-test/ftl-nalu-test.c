@@ -0,0 +1,285 @@
+/*
+ * FTL NAL unit splitting test.
+ *
+ *   Builds a synthetic access unit of 256 slices in Annex B form (with an
+ * access unit delimiter, SEI and filler data around them, and a mix of three
+ * and four byte start codes), then checks that the FTL output gets every
+ * slice back out of it the way ftl_stream_data and ftl_stream_slice do, by
+ * converting it with obs_parse_avc_packet and splitting the length prefixed
+ * result: as a whole frame, and one slice at a time the way an encoder
+ * sending slices as they are encoded delivers them.  Only the last slice of
+ * the frame may carry the marker bit.  Also checks the sequence header and
+ * that truncated data is rejected, and times splitting the frame.
+ *
+ * usage: ftl-nalu-test [slices]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/platform.h>
+#include <obs.h>
+#include <obs-avc.h>
+#include "ftl-nalu.h"
+#include "test-util.h"
+
+#define DEFAULT_SLICES 256
+#define ITERATIONS     10000
+#define FILLER_SIZE    64
+
+struct test_slice {
+	size_t offset;
+	size_t size;
+};
+
+struct test_frame {
+	DARRAY(uint8_t)          data;
+	DARRAY(struct test_slice) slices;
+};
+
+static void add_nal(struct test_frame *frame, uint8_t header, size_t size,
+		bool long_startcode, bool is_slice)
+{
+	static const uint8_t start[] = {0, 0, 0, 1};
+	struct test_slice slice;
+
+	if (long_startcode)
+		da_push_back_array(frame->data, start, 4);
+	else
+		da_push_back_array(frame->data, start + 1, 3);
+
+	slice.offset = frame->data.num;
+	slice.size   = size;
+
+	da_push_back(frame->data, &header);
+
+	/* zero bytes only as part of emulation prevention, and a non-zero
+	 * stop bit at the end, like real slice data */
+	for (size_t i = 1; i < size; i++) {
+		uint8_t val = (uint8_t)(test_rand() & 0xFF);
+		if (!val)
+			val = 1;
+		if (i % 50 < 2 && i + 2 < size)
+			val = 0;
+		else if (i % 50 == 2 && i + 1 < size)
+			val = 3;
+		if (i == size - 1)
+			val |= 0x80;
+		da_push_back(frame->data, &val);
+	}
+
+	if (is_slice)
+		da_push_back(frame->slices, &slice);
+}
+
+static void build_frame(struct test_frame *frame, int num_slices)
+{
+	memset(frame, 0, sizeof(*frame));
+
+	add_nal(frame, OBS_NAL_AUD, 2, true, false);
+	add_nal(frame, OBS_NAL_SEI, 24, false, false);
+
+	for (int i = 0; i < num_slices; i++) {
+		uint8_t header = i == 0 ?
+			(3 << 5) | OBS_NAL_SLICE_IDR :
+			(2 << 5) | OBS_NAL_SLICE;
+
+		/* mostly small slices, with the odd one over 64k */
+		size_t size = (i % 97 == 50) ? 70000 :
+			20 + (test_rand() % 1400);
+
+		add_nal(frame, header, size, (i % 2) == 0, true);
+	}
+
+	add_nal(frame, OBS_NAL_FILLER, FILLER_SIZE, true, false);
+}
+
+static void free_frame(struct test_frame *frame)
+{
+	da_free(frame->data);
+	da_free(frame->slices);
+}
+
+static void check_nalus(const char *name, struct ftl_nalu_list *list,
+		struct test_frame *frame, size_t first, bool end_of_frame)
+{
+	size_t num = list->nalus.num;
+
+	for (size_t i = 0; i < num && first + i < frame->slices.num; i++) {
+		struct ftl_nalu *nalu = list->nalus.array + i;
+		struct test_slice *slice = frame->slices.array + first + i;
+		const uint8_t *expected = frame->data.array + slice->offset;
+		bool marker = end_of_frame && i == num - 1;
+
+		test_check(nalu->size == slice->size,
+				"%s: slice %d is %d bytes instead of %d", name,
+				(int)(first + i), (int)nalu->size,
+				(int)slice->size);
+		test_check(nalu->size != slice->size ||
+				memcmp(nalu->data, expected, nalu->size) == 0,
+				"%s: slice %d data differs", name,
+				(int)(first + i));
+		test_check(nalu->marker == marker,
+				"%s: slice %d marker bit is %s", name,
+				(int)(first + i),
+				nalu->marker ? "set" : "clear");
+	}
+}
+
+static void test_avcc(struct test_frame *frame)
+{
+	struct encoder_packet src = {0};
+	struct encoder_packet avcc;
+	struct ftl_nalu_list list = {0};
+	bool success;
+
+	src.data     = frame->data.array;
+	src.size     = frame->data.num;
+	src.type     = OBS_ENCODER_VIDEO;
+	src.keyframe = true;
+
+	obs_parse_avc_packet(&avcc, &src);
+
+	success = ftl_nalu_parse_avcc(&list, avcc.data, avcc.size, true);
+	test_check(success, "avcc: frame not parsed");
+	test_check(list.nalus.num == frame->slices.num,
+			"avcc: %d NAL units instead of %d",
+			(int)list.nalus.num, (int)frame->slices.num);
+	check_nalus("avcc", &list, frame, 0, true);
+
+	/* a frame cut off in the middle of the last slice, before the
+	 * filler data */
+	success = ftl_nalu_parse_avcc(&list, avcc.data,
+			avcc.size - (4 + FILLER_SIZE) - 10, true);
+	test_check(!success, "avcc: truncated frame accepted");
+	test_check(list.nalus.num == frame->slices.num - 1,
+			"avcc: %d NAL units before the truncated one",
+			(int)list.nalus.num);
+
+	printf("avcc:    %d slices in %d bytes\n", (int)frame->slices.num,
+			(int)avcc.size);
+
+	obs_free_encoder_packet(&avcc);
+	ftl_nalu_list_free(&list);
+}
+
+/* the slices the way an encoder sends them, each with its start code */
+static void test_slices(struct test_frame *frame)
+{
+	struct ftl_nalu_list list = {0};
+	size_t num = frame->slices.num;
+	int markers = 0;
+
+	for (size_t i = 0; i < num; i++) {
+		struct test_slice *slice = frame->slices.array + i;
+		size_t start = slice->offset - ((i % 2) == 0 ? 4 : 3);
+		bool last = i == num - 1;
+		struct encoder_packet src = {0};
+		struct encoder_packet avcc;
+
+		src.data = frame->data.array + start;
+		src.size = slice->offset + slice->size - start;
+		src.type = OBS_ENCODER_VIDEO;
+		obs_parse_avc_packet(&avcc, &src);
+
+		test_check(ftl_nalu_parse_avcc(&list, avcc.data, avcc.size,
+					last),
+				"slices: slice %d not parsed", (int)i);
+
+		test_check(list.nalus.num == 1,
+				"slices: slice %d gave %d NAL units",
+				(int)i, (int)list.nalus.num);
+		check_nalus("slices", &list, frame, i, last);
+
+		if (list.nalus.num && list.nalus.array[0].marker)
+			markers++;
+
+		obs_free_encoder_packet(&avcc);
+	}
+
+	test_check(markers == 1, "slices: %d marker bits in the frame",
+			markers);
+	printf("slices:  %d sent one at a time\n", (int)num);
+
+	ftl_nalu_list_free(&list);
+}
+
+static void test_header(void)
+{
+	static const uint8_t sps_pps[] = {
+		0, 0, 0, 1, 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50,
+		0, 0, 0, 1, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0
+	};
+	struct ftl_nalu_list list = {0};
+	uint8_t *header;
+	size_t size;
+
+	size = obs_parse_avc_header(&header, sps_pps, sizeof(sps_pps));
+
+	test_check(ftl_nalu_parse_header(&list, header, size),
+			"header: not parsed");
+	test_check(list.nalus.num == 2, "header: %d NAL units instead of 2",
+			(int)list.nalus.num);
+	if (list.nalus.num == 2) {
+		test_check(list.nalus.array[0].size == 8 &&
+				(list.nalus.array[0].data[0] & 0x1F) ==
+				OBS_NAL_SPS, "header: bad SPS");
+		test_check(list.nalus.array[1].size == 6 &&
+				(list.nalus.array[1].data[0] & 0x1F) ==
+				OBS_NAL_PPS, "header: bad PPS");
+		test_check(!list.nalus.array[1].marker,
+				"header: marker bit set");
+	}
+
+	test_check(!ftl_nalu_parse_header(&list, header, size - 3),
+			"header: truncated header accepted");
+
+	printf("header:  SPS and PPS\n");
+
+	bfree(header);
+	ftl_nalu_list_free(&list);
+}
+
+static void time_parse(struct test_frame *frame)
+{
+	struct encoder_packet src = {0};
+	struct encoder_packet avcc;
+	struct ftl_nalu_list list = {0};
+	uint64_t start, avcc_ns;
+
+	src.data = frame->data.array;
+	src.size = frame->data.num;
+	src.type = OBS_ENCODER_VIDEO;
+	obs_parse_avc_packet(&avcc, &src);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < ITERATIONS; i++)
+		ftl_nalu_parse_avcc(&list, avcc.data, avcc.size, true);
+	avcc_ns = os_gettime_ns() - start;
+
+	printf("\nsplitting the frame takes %.2f us\n",
+			(double)avcc_ns / ITERATIONS / 1000.0);
+
+	obs_free_encoder_packet(&avcc);
+	ftl_nalu_list_free(&list);
+}
+
+int main(int argc, char *argv[])
+{
+	int num_slices = test_arg_int(argc, argv, 1, DEFAULT_SLICES);
+	struct test_frame frame;
+
+	if (num_slices <= 0)
+		return test_usage(argv[0], "[slices]");
+
+	build_frame(&frame, num_slices);
+
+	test_avcc(&frame);
+	test_slices(&frame);
+	test_header();
+	time_parse(&frame);
+
+	free_frame(&frame);
+
+	return test_result();
+}
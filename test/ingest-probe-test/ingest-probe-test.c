@@ -0,0 +1,167 @@
+/*
+ * FTL ingest selection test.
+ *
+ *   Starts stand-in ingests on several loopback addresses that echo pings
+ * on the same UDP port after different delays, one of them never answering,
+ * and checks that probing picks the fastest one within the timeout.  Also
+ * resolves a host name (localhost by default) and lists every address found,
+ * the way the FTL output does before connecting.
+ *
+ * usage: ingest-probe-test [host name]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "ingest-probe.h"
+#include "test-util.h"
+
+#define PROBE_TIMEOUT_MS 1000
+
+struct responder {
+	const char *ip;
+	int        delay_ms;
+	int        sock;
+	pthread_t  thread;
+};
+
+static struct responder responders[] = {
+	{"127.0.0.2",  80},
+	{"127.0.0.3",  15},
+	{"127.0.0.4",  -1},
+	{"127.0.0.5",  40},
+	{"127.0.0.6", 200}
+};
+
+#define NUM_RESPONDERS (sizeof(responders) / sizeof(responders[0]))
+#define EXPECTED_IP    "127.0.0.3"
+
+static volatile bool stop;
+
+static void *responder_thread(void *data)
+{
+	struct responder *r = data;
+	uint8_t buf[64];
+
+	while (!os_atomic_load_bool(&stop)) {
+		struct sockaddr_storage from;
+		socklen_t from_len = sizeof(from);
+		ssize_t size = recvfrom(r->sock, buf, sizeof(buf), 0,
+				(struct sockaddr*)&from, &from_len);
+
+		if (size <= 0 || r->delay_ms < 0)
+			continue;
+
+		os_sleep_ms((uint32_t)r->delay_ms);
+		sendto(r->sock, buf, (size_t)size, 0, (struct sockaddr*)&from,
+				from_len);
+	}
+
+	return NULL;
+}
+
+static bool start_responder(struct responder *r, uint16_t *port)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+	struct timeval tv = {0, 100000};
+
+	r->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (r->sock < 0)
+		return false;
+
+	setsockopt(r->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(*port);
+	inet_pton(AF_INET, r->ip, &addr.sin_addr);
+
+	if (bind(r->sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		return false;
+
+	/* the first responder picks the port, the rest share it */
+	if (!*port) {
+		getsockname(r->sock, (struct sockaddr*)&addr, &addr_len);
+		*port = ntohs(addr.sin_port);
+	}
+
+	return pthread_create(&r->thread, NULL, responder_thread, r) == 0;
+}
+
+static void add_candidate(struct ingest_addrs *addrs, const char *ip)
+{
+	struct ingest_addr *addr = da_push_back_new(addrs->addrs);
+	struct sockaddr_in *in = (struct sockaddr_in*)&addr->addr;
+
+	in->sin_family = AF_INET;
+	inet_pton(AF_INET, ip, &in->sin_addr);
+	addr->addr_len = sizeof(*in);
+	strcpy(addr->ip, ip);
+}
+
+static void list_resolved(const char *host)
+{
+	struct ingest_addrs addrs = {0};
+	uint64_t start = os_gettime_ns();
+
+	if (!ingest_resolve(host, &addrs, 5000)) {
+		printf("failed to resolve '%s'\n", host);
+		return;
+	}
+
+	printf("resolved '%s' in %.2f ms:\n", host,
+			(double)(os_gettime_ns() - start) / 1000000.0);
+	for (size_t i = 0; i < addrs.addrs.num; i++)
+		printf("  %s\n", addrs.addrs.array[i].ip);
+
+	ingest_addrs_free(&addrs);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ingest_addrs addrs = {0};
+	uint16_t port = 0;
+	uint64_t start;
+	double probe_ms;
+	int best;
+
+	list_resolved(argc > 1 ? argv[1] : "localhost");
+
+	for (size_t i = 0; i < NUM_RESPONDERS; i++) {
+		if (!start_responder(&responders[i], &port)) {
+			fprintf(stderr, "failed to start responder on %s\n",
+					responders[i].ip);
+			return 1;
+		}
+		add_candidate(&addrs, responders[i].ip);
+	}
+
+	start = os_gettime_ns();
+	best = ingest_probe(&addrs, port, PROBE_TIMEOUT_MS);
+	probe_ms = (double)(os_gettime_ns() - start) / 1000000.0;
+
+	printf("\nprobed %d candidates on port %d in %.2f ms:\n",
+			(int)addrs.addrs.num, (int)port, probe_ms);
+	for (size_t i = 0; i < addrs.addrs.num; i++) {
+		struct ingest_addr *addr = addrs.addrs.array + i;
+		printf("  %-12s delay %4d ms  rtt %4d ms%s\n", addr->ip,
+				responders[i].delay_ms, addr->rtt_ms,
+				(int)i == best ? "  <- selected" : "");
+	}
+
+	os_atomic_set_bool(&stop, true);
+	for (size_t i = 0; i < NUM_RESPONDERS; i++) {
+		pthread_join(responders[i].thread, NULL);
+		close(responders[i].sock);
+	}
+
+	test_check(best >= 0 &&
+			strcmp(addrs.addrs.array[best].ip, EXPECTED_IP) == 0,
+			"expected %s to be selected", EXPECTED_IP);
+
+	ingest_addrs_free(&addrs);
+	return test_result();
+}
@@ -0,0 +1,262 @@
+/*
+ * Output packet interleaving test.
+ *
+ *   Generates the packets of one video track and every audio track an output
+ * can have, at the rates a 60 fps recording with AAC audio produces them,
+ * with the video packets arriving later than the audio like they do with
+ * encoder lookahead.  The packets are interleaved both with the per-track
+ * merge the outputs use and with the single sorted array they used before,
+ * using the same sending rule, and the two resulting packet orders have to be
+ * identical.  Also reports how long each took.
+ *
+ * usage: interleave-test [minutes] [video latency ms] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <obs-interleave.h>
+#include "test-util.h"
+
+#define VIDEO_FRAME_USEC (1000000LL / 60)
+#define AUDIO_FRAME_USEC (1024LL * 1000000LL / 48000)
+#define NUM_AUDIO_TRACKS MAX_AUDIO_MIXES
+
+struct arrival {
+	int64_t               time;
+	struct encoder_packet packet;
+};
+
+static int cmp_arrival(const void *a, const void *b)
+{
+	const struct arrival *aa = a;
+	const struct arrival *ab = b;
+
+	if (aa->time != ab->time)
+		return aa->time < ab->time ? -1 : 1;
+	return 0;
+}
+
+static void make_packet(struct encoder_packet *packet,
+		enum obs_encoder_type type, size_t track_idx, int64_t dts_usec)
+{
+	memset(packet, 0, sizeof(*packet));
+	packet->type      = type;
+	packet->track_idx = track_idx;
+	packet->dts_usec  = dts_usec;
+	packet->dts       = dts_usec;
+	packet->pts       = dts_usec;
+}
+
+/* every audio track gets the same timestamps, so there are plenty of ties */
+static struct arrival *generate(int minutes, int64_t latency_usec,
+		size_t *count)
+{
+	int64_t duration = (int64_t)minutes * 60LL * 1000000LL;
+	size_t num_video = (size_t)(duration / VIDEO_FRAME_USEC);
+	size_t num_audio = (size_t)(duration / AUDIO_FRAME_USEC);
+	size_t total = num_video + num_audio * NUM_AUDIO_TRACKS;
+	struct arrival *arrivals = bmalloc(total * sizeof(*arrivals));
+	size_t n = 0;
+
+	for (size_t i = 0; i < num_video; i++) {
+		int64_t dts = (int64_t)i * VIDEO_FRAME_USEC;
+		arrivals[n].time = dts + latency_usec + test_rand() % 4000;
+		make_packet(&arrivals[n++].packet, OBS_ENCODER_VIDEO, 0, dts);
+	}
+
+	for (size_t i = 0; i < num_audio; i++) {
+		int64_t dts = (int64_t)i * AUDIO_FRAME_USEC;
+
+		for (size_t t = 0; t < NUM_AUDIO_TRACKS; t++) {
+			arrivals[n].time = dts + AUDIO_FRAME_USEC +
+				test_rand() % 2000;
+			make_packet(&arrivals[n++].packet, OBS_ENCODER_AUDIO,
+					t, dts);
+		}
+	}
+
+	/* tracks are each delivered in order, the jitter only changes how
+	 * they are interleaved with each other */
+	for (size_t i = 1; i < n; i++) {
+		struct arrival *prev = &arrivals[i - 1];
+		struct arrival *cur = &arrivals[i];
+		if (cur->packet.type == prev->packet.type &&
+		    cur->packet.track_idx == prev->packet.track_idx &&
+		    cur->time < prev->time)
+			cur->time = prev->time;
+	}
+
+	qsort(arrivals, n, sizeof(*arrivals), cmp_arrival);
+	*count = n;
+	return arrivals;
+}
+
+struct sent_packet {
+	enum obs_encoder_type type;
+	size_t                track_idx;
+	int64_t               dts_usec;
+};
+
+struct send_state {
+	int64_t highest_video_ts;
+	int64_t highest_audio_ts;
+	DARRAY(struct sent_packet) sent;
+};
+
+static inline void set_higher_ts(struct send_state *state,
+		const struct encoder_packet *packet)
+{
+	int64_t *ts = packet->type == OBS_ENCODER_VIDEO ?
+		&state->highest_video_ts : &state->highest_audio_ts;
+	if (*ts < packet->dts_usec)
+		*ts = packet->dts_usec;
+}
+
+static inline bool can_send(struct send_state *state,
+		const struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		return state->highest_audio_ts > packet->dts_usec;
+	else
+		return state->highest_video_ts > packet->dts_usec;
+}
+
+static inline void record(struct send_state *state,
+		const struct encoder_packet *packet)
+{
+	struct sent_packet *sent = da_push_back_new(state->sent);
+	sent->type      = packet->type;
+	sent->track_idx = packet->track_idx;
+	sent->dts_usec  = packet->dts_usec;
+}
+
+/* ------------------------------------------------------------------------- */
+/* the previous single sorted array */
+
+static double run_sorted(const struct arrival *arrivals, size_t count,
+		struct send_state *state)
+{
+	DARRAY(struct encoder_packet) packets;
+	uint64_t start = os_gettime_ns();
+
+	da_init(packets);
+
+	for (size_t i = 0; i < count; i++) {
+		const struct encoder_packet *in = &arrivals[i].packet;
+		size_t idx;
+
+		for (idx = 0; idx < packets.num; idx++) {
+			if (in->dts_usec < packets.array[idx].dts_usec)
+				break;
+		}
+
+		da_insert(packets, idx, in);
+		set_higher_ts(state, in);
+
+		if (packets.num && can_send(state, packets.array)) {
+			record(state, packets.array);
+			da_erase(packets, 0);
+		}
+	}
+
+	da_free(packets);
+	return (double)(os_gettime_ns() - start) / 1000000.0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* per-track queues merged with a heap */
+
+static double run_merged(const struct arrival *arrivals, size_t count,
+		struct send_state *state)
+{
+	struct packet_interleaver il = {0};
+	uint64_t start = os_gettime_ns();
+
+	for (size_t i = 0; i < count; i++) {
+		const struct encoder_packet *in = &arrivals[i].packet;
+		struct encoder_packet *next;
+
+		interleaver_push(&il, in);
+		set_higher_ts(state, in);
+
+		next = interleaver_peek(&il);
+		if (next && can_send(state, next)) {
+			struct encoder_packet out;
+			interleaver_pop(&il, &out);
+			record(state, &out);
+		}
+	}
+
+	interleaver_free(&il);
+	return (double)(os_gettime_ns() - start) / 1000000.0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void check_order(const struct send_state *a,
+		const struct send_state *b)
+{
+	if (a->sent.num != b->sent.num) {
+		test_fail("sent %d packets instead of %d", (int)b->sent.num,
+				(int)a->sent.num);
+		return;
+	}
+
+	for (size_t i = 0; i < a->sent.num; i++) {
+		const struct sent_packet *pa = &a->sent.array[i];
+		const struct sent_packet *pb = &b->sent.array[i];
+
+		if (pa->type != pb->type || pa->track_idx != pb->track_idx ||
+		    pa->dts_usec != pb->dts_usec) {
+			test_fail("packet %d differs: %s %d %lld instead of "
+					"%s %d %lld", (int)i,
+					pb->type == OBS_ENCODER_VIDEO ?
+					"video" : "audio",
+					(int)pb->track_idx,
+					(long long)pb->dts_usec,
+					pa->type == OBS_ENCODER_VIDEO ?
+					"video" : "audio",
+					(int)pa->track_idx,
+					(long long)pa->dts_usec);
+			return;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int minutes = test_arg_int(argc, argv, 1, 30);
+	int latency_ms = test_arg_int(argc, argv, 2, 500);
+	struct send_state sorted = {0};
+	struct send_state merged = {0};
+	struct arrival *arrivals;
+	double sorted_ms, merged_ms;
+	size_t count;
+
+	if (minutes <= 0 || latency_ms < 0)
+		return test_usage(argv[0],
+				"[minutes] [video latency ms] [seed]");
+
+	test_srand(test_arg_seed(argc, argv, 3));
+	arrivals = generate(minutes, (int64_t)latency_ms * 1000LL, &count);
+
+	sorted_ms = run_sorted(arrivals, count, &sorted);
+	merged_ms = run_merged(arrivals, count, &merged);
+	check_order(&sorted, &merged);
+
+	printf("1 video + %d audio tracks, %d minutes, %d packets, "
+			"%d ms video latency\n", NUM_AUDIO_TRACKS, minutes,
+			(int)count, latency_ms);
+	printf("sorted array: %10.2f ms (%6.1f ns/packet)\n", sorted_ms,
+			sorted_ms * 1000000.0 / (double)count);
+	printf("track merge:  %10.2f ms (%6.1f ns/packet)\n", merged_ms,
+			merged_ms * 1000000.0 / (double)count);
+	printf("%d packets sent\n", (int)merged.sent.num);
+
+	da_free(sorted.sent);
+	da_free(merged.sent);
+	bfree(arrivals);
+	return test_result();
+}
@@ -0,0 +1,74 @@
+/*
+ * Helpers shared by the test executables: argument parsing, a deterministic
+ * random number generator and pass/fail reporting.
+ *
+ *   Tests exit with 0 only if every check passed, and each one that can run
+ * without a display or input files is registered with CTest, with arguments
+ * that keep it short (see the add_test calls in the test directories).
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TEST_DEFAULT_SEED 0x0b5a0d10
+
+static int test_failures = 0;
+static uint32_t test_rand_state = TEST_DEFAULT_SEED;
+
+/* counts a failed check and prints the message */
+#define test_check(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			printf("FAILED: " __VA_ARGS__); \
+			printf("\n"); \
+			test_failures++; \
+		} \
+	} while (false)
+
+#define test_fail(...) test_check(false, __VA_ARGS__)
+
+static inline int test_arg_int(int argc, char *argv[], int idx, int def)
+{
+	return argc > idx ? atoi(argv[idx]) : def;
+}
+
+static inline uint32_t test_arg_seed(int argc, char *argv[], int idx)
+{
+	return argc > idx ? (uint32_t)strtoul(argv[idx], NULL, 10) :
+		TEST_DEFAULT_SEED;
+}
+
+static inline int test_usage(const char *name, const char *args)
+{
+	fprintf(stderr, "usage: %s %s\n", name, args);
+	return 1;
+}
+
+static inline void test_srand(uint32_t seed)
+{
+	test_rand_state = seed;
+}
+
+/* 24 bits from a linear congruential generator, the same sequence on every
+ * platform unlike rand() */
+static inline uint32_t test_rand(void)
+{
+	test_rand_state = test_rand_state * 1664525 + 1013904223;
+	return test_rand_state >> 8;
+}
+
+/* in [-1, 1) */
+static inline float test_rand_float(void)
+{
+	return (float)(test_rand() & 0xFFFF) / 32768.0f - 1.0f;
+}
+
+static inline int test_result(void)
+{
+	printf("%s\n", test_failures ? "FAILED" : "passed");
+	return test_failures ? 1 : 0;
+}
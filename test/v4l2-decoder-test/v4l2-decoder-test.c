@@ -0,0 +1,359 @@
+/*
+ * V4L2 capture decoder test with a file-backed stand-in device.
+ *
+ *   Splits an MJPEG or H.264 (Annex B) file into frames and feeds them to the
+ * v4l2 decoder the way the capture thread does, through a stand-in for the
+ * device: a fixed set of buffers that are filled with the next frame at the
+ * capture frame rate, pushed to the decoder, and only filled again once the
+ * decoder has given them back with VIDIOC_QBUF.  Half of the buffers have no
+ * room for the decoder's padding so the copying path is used as well.  Decoded
+ * frames can be delayed to make the decoder fall behind and drop frames.
+ *
+ *   Checks that the decoded frames come out in capture order, that every
+ * buffer is given back, and for H.264 that frames were only dropped right
+ * before a keyframe and the decoder never reported an error, so nothing was
+ * decoded with missing references.
+ *
+ *   The decoder's calls to v4l2_ioctl and obs_source_output_video are renamed
+ * to the stand-ins below at compile time (see CMakeLists.txt).
+ *
+ * usage: v4l2-decoder-test <mjpeg|h264> <file> [output delay ms] [fps]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <libavcodec/avcodec.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/darray.h>
+#include <util/bmem.h>
+#include <obs-avc.h>
+#include "v4l2-decoder.h"
+#include "test-util.h"
+
+#define NUM_BUFFERS  4
+#define FRAME_NS     1000000ULL
+#define DRAIN_MS     5000
+
+struct test_frame {
+	size_t offset;
+	size_t size;
+	bool   keyframe;
+};
+
+struct stand_in_device {
+	pthread_mutex_t          mutex;
+	pthread_cond_t           cond;
+	bool                     queued[NUM_BUFFERS];
+	struct v4l2_mmap_info    info[NUM_BUFFERS];
+	struct v4l2_buffer_data  buffers;
+};
+
+static struct stand_in_device device;
+static DARRAY(struct test_frame) frames;
+
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(uint64_t) output_ts;
+static int output_delay_ms = 0;
+static volatile long decode_errors = 0;
+
+int test_v4l2_ioctl(int fd, unsigned long int request, ...)
+{
+	struct v4l2_buffer *buf;
+	va_list args;
+
+	if (request != VIDIOC_QBUF)
+		return -1;
+
+	va_start(args, request);
+	buf = va_arg(args, struct v4l2_buffer*);
+	va_end(args);
+
+	pthread_mutex_lock(&device.mutex);
+	device.queued[buf->index] = true;
+	pthread_cond_signal(&device.cond);
+	pthread_mutex_unlock(&device.mutex);
+
+	(void)fd;
+	return 0;
+}
+
+void test_source_output_video(obs_source_t *source,
+		const struct obs_source_frame *frame)
+{
+	if (output_delay_ms)
+		os_sleep_ms(output_delay_ms);
+
+	pthread_mutex_lock(&output_mutex);
+	da_push_back(output_ts, &frame->timestamp);
+	pthread_mutex_unlock(&output_mutex);
+
+	(void)source;
+}
+
+static void log_callback(void *ptr, int level, const char *fmt, va_list args)
+{
+	if (level <= AV_LOG_ERROR)
+		os_atomic_inc_long(&decode_errors);
+
+	av_log_default_callback(ptr, level, fmt, args);
+}
+
+static bool read_frames(enum AVCodecID id, const uint8_t *data, size_t size)
+{
+	AVCodecParserContext *parser = av_parser_init(id);
+	AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+	size_t pos = 0;
+	size_t frame_start = 0;
+
+	if (!parser || !ctx)
+		return false;
+
+	/* the parser holds back each frame until the next one starts, a
+	 * final call without data flushes the last one */
+	while (true) {
+		uint8_t *out;
+		int out_size;
+		int len = av_parser_parse2(parser, ctx, &out, &out_size,
+				size > pos ? data + pos : NULL,
+				(int)(size - pos), AV_NOPTS_VALUE,
+				AV_NOPTS_VALUE, 0);
+
+		pos += len;
+
+		if (out_size) {
+			struct test_frame frame;
+			frame.offset   = frame_start;
+			frame.size     = (size_t)out_size;
+			frame.keyframe = id == AV_CODEC_ID_MJPEG ||
+				obs_avc_keyframe(out, (size_t)out_size);
+
+			/* frames are passed through unchanged and back to
+			 * back, so the file data can be used directly */
+			da_push_back(frames, &frame);
+			frame_start += (size_t)out_size;
+		}
+
+		if (pos >= size && !out_size)
+			break;
+	}
+
+	av_parser_close(parser);
+	av_free(ctx);
+	return frames.num > 0;
+}
+
+static bool init_device(size_t max_size)
+{
+	pthread_mutex_init(&device.mutex, NULL);
+	pthread_cond_init(&device.cond, NULL);
+
+	for (size_t i = 0; i < NUM_BUFFERS; i++) {
+		/* odd buffers leave no room for the padding */
+		size_t size = (i & 1) ? max_size :
+			max_size + FF_INPUT_BUFFER_PADDING_SIZE;
+
+		device.info[i].length = size;
+		device.info[i].start  = bzalloc(size);
+		device.queued[i]      = true;
+	}
+
+	device.buffers.count  = NUM_BUFFERS;
+	device.buffers.memory = V4L2_MEMORY_MMAP;
+	device.buffers.info   = device.info;
+	return true;
+}
+
+static void free_device(void)
+{
+	for (size_t i = 0; i < NUM_BUFFERS; i++)
+		bfree(device.info[i].start);
+
+	pthread_cond_destroy(&device.cond);
+	pthread_mutex_destroy(&device.mutex);
+}
+
+/* the next buffer the driver has, blocks until one is given back */
+static uint32_t dequeue_buffer(void)
+{
+	uint32_t index = 0;
+
+	pthread_mutex_lock(&device.mutex);
+	while (true) {
+		for (index = 0; index < NUM_BUFFERS; index++) {
+			if (device.queued[index])
+				break;
+		}
+		if (index < NUM_BUFFERS)
+			break;
+
+		pthread_cond_wait(&device.cond, &device.mutex);
+	}
+
+	device.queued[index] = false;
+	pthread_mutex_unlock(&device.mutex);
+	return index;
+}
+
+static bool wait_for_buffers(void)
+{
+	uint64_t end = os_gettime_ns() + DRAIN_MS * 1000000ULL;
+	bool all_queued = false;
+
+	while (!all_queued && os_gettime_ns() < end) {
+		all_queued = true;
+
+		pthread_mutex_lock(&device.mutex);
+		for (size_t i = 0; i < NUM_BUFFERS; i++)
+			all_queued = all_queued && device.queued[i];
+		pthread_mutex_unlock(&device.mutex);
+
+		if (!all_queued)
+			os_sleep_ms(10);
+	}
+
+	return all_queued;
+}
+
+static void capture(struct v4l2_decoder *decoder, const uint8_t *data,
+		int fps)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (size_t i = 0; i < frames.num; i++) {
+		const struct test_frame *frame = frames.array + i;
+		struct v4l2_buffer buf;
+		uint32_t index = dequeue_buffer();
+
+		memcpy(device.info[index].start, data + frame->offset,
+				frame->size);
+
+		memset(&buf, 0, sizeof(buf));
+		buf.type      = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory    = V4L2_MEMORY_MMAP;
+		buf.index     = index;
+		buf.bytesused = (uint32_t)frame->size;
+
+		v4l2_decoder_push(decoder, &buf, (i + 1) * FRAME_NS);
+
+		if (fps)
+			os_sleepto_ns(start + (i + 1) * 1000000000ULL / fps);
+	}
+}
+
+static void check_output(bool h264)
+{
+	uint64_t last = 0;
+
+	for (size_t i = 0; i < output_ts.num; i++) {
+		uint64_t ts = output_ts.array[i];
+		uint64_t idx = ts / FRAME_NS - 1;
+
+		if (ts % FRAME_NS || idx >= frames.num) {
+			test_fail("unknown timestamp %"PRIu64, ts);
+			continue;
+		}
+
+		test_check(ts > last, "frame %"PRIu64" out of order", idx);
+
+		/* an H.264 frame after a gap has to be a keyframe, anything
+		 * else would have been decoded without its references */
+		test_check(!h264 || ts <= last + FRAME_NS ||
+				frames.array[idx].keyframe,
+				"frame %"PRIu64" follows dropped frames but is "
+				"not a keyframe", idx);
+
+		last = ts;
+	}
+
+	test_check(!h264 || !decode_errors,
+			"the decoder reported %ld errors", decode_errors);
+}
+
+int main(int argc, char *argv[])
+{
+	struct v4l2_decoder *decoder;
+	enum AVCodecID id;
+	uint32_t pixelformat;
+	uint8_t *data;
+	size_t size;
+	size_t max_size = 0;
+	uint64_t start;
+	int fps;
+	FILE *file;
+
+	if (argc < 3)
+		return test_usage(argv[0], "<mjpeg|h264> <file> "
+				"[output delay ms] [fps]");
+
+	if (strcmp(argv[1], "h264") == 0) {
+		id = AV_CODEC_ID_H264;
+		pixelformat = V4L2_PIX_FMT_H264;
+	} else {
+		id = AV_CODEC_ID_MJPEG;
+		pixelformat = V4L2_PIX_FMT_MJPEG;
+	}
+
+	output_delay_ms = test_arg_int(argc, argv, 3, 0);
+	fps = test_arg_int(argc, argv, 4, 30);
+
+	file = os_fopen(argv[2], "rb");
+	if (!file) {
+		fprintf(stderr, "failed to open %s\n", argv[2]);
+		return 1;
+	}
+
+	size = (size_t)os_fgetsize(file);
+	data = bmalloc(size);
+	if (fread(data, 1, size, file) != size) {
+		fprintf(stderr, "failed to read %s\n", argv[2]);
+		return 1;
+	}
+	fclose(file);
+
+	avcodec_register_all();
+	av_log_set_callback(log_callback);
+
+	if (!read_frames(id, data, size)) {
+		fprintf(stderr, "no frames found in %s\n", argv[2]);
+		return 1;
+	}
+
+	for (size_t i = 0; i < frames.num; i++) {
+		if (frames.array[i].size > max_size)
+			max_size = frames.array[i].size;
+	}
+
+	init_device(max_size);
+
+	decoder = v4l2_decoder_create(NULL, 0, &device.buffers, pixelformat);
+	if (!decoder) {
+		fprintf(stderr, "failed to create the decoder\n");
+		return 1;
+	}
+
+	start = os_gettime_ns();
+	capture(decoder, data, fps);
+
+	test_check(wait_for_buffers(),
+			"buffers were not given back to the device");
+
+	v4l2_decoder_destroy(decoder);
+
+	printf("%s: %d frames captured, %d decoded, %d dropped in %.2f s\n",
+			argv[1], (int)frames.num, (int)output_ts.num,
+			(int)(frames.num - output_ts.num),
+			(double)(os_gettime_ns() - start) / 1000000000.0);
+
+	check_output(id == AV_CODEC_ID_H264);
+
+	free_device();
+	da_free(frames);
+	da_free(output_ts);
+	bfree(data);
+
+	return test_result();
+}